@@ -0,0 +1,63 @@
+//Generated by zen2cc 0.1.0 from tests/bounds.zen
+#include <stdint.h>
+
+
+static inline uint64_t zen_bound(uint64_t i, uint64_t n) {
+    if(__builtin_expect(i >= n, 0)) __builtin_trap();
+    return i;
+}
+
+static int bounds__sum(int a[64]);
+static int bounds__mask(int a[64], int k, uint8_t b);
+static int bounds__scan(int n);
+static int bounds__main(void);
+
+static int bounds__grid[8][16];
+static uint8_t bounds__table[256];
+
+static int const bounds__lit0[64] = {0};
+
+static int bounds__sum(int a[64]) {
+    int s = 0;
+    for(int i = 0; (i < 64); (i++)) {
+        (s = (s + a[i]));
+    }
+    for(int i_1 = 63; (i_1 >= 0); (i_1--)) {
+        (s = (s + a[i_1]));
+    }
+    for(int i_2 = 0; (i_2 < 32); (i_2 = (i_2 + 2))) {
+        (s = (s + (a[(i_2 + 1)] + a[(i_2 * 2)])));
+    }
+    for(int i_3 = 0; (i_3 <= 64); (i_3++)) {
+        (s = (s + a[zen_bound(i_3, 64)]));
+    }
+    return s;
+}
+
+static int bounds__mask(int a[64], int k, uint8_t b) {
+    return ((((a[(k & 63)] + a[zen_bound((k % 64), 64)]) + a[zen_bound(k, 64)]) + ((int)bounds__table[b])) + a[zen_bound(70, 64)]);
+}
+
+static int bounds__scan(int n) {
+    int s = 0;
+    for(int y = 0; (y < 8); (y++)) {
+        for(int x = 0; ((x < 16) && (x < n)); (x++)) {
+            (s = (s + bounds__grid[y][x]));
+        }
+    }
+    for(int x_1 = 0; (x_1 < 16); (x_1++)) {
+        (s = (s + bounds__grid[0][zen_bound(x_1, 16)]));
+        (x_1 = (x_1 + 1));
+    }
+    return s;
+}
+
+static int bounds__main(void) {
+    int a[64];
+    __builtin_memcpy(a, bounds__lit0, sizeof a);
+    return ((bounds__sum(a) + bounds__mask(a, 5, ((uint8_t)3))) + bounds__scan(4));
+}
+
+int main(void) {
+    return bounds__main();
+}
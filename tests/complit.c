@@ -0,0 +1,94 @@
+//Generated by zen2cc 0.1.0 from tests/complit.zen
+#include <stdint.h>
+
+struct complit__vec3;
+typedef struct complit__vec3 complit__vec3;
+struct complit__vec3 {
+    double x;
+    double y;
+    double z;
+};
+_Static_assert(sizeof(struct complit__vec3) == 24 && _Alignof(struct complit__vec3) == 8, "layout of complit__vec3");
+
+static double complit__len(complit__vec3 v);
+static int complit__days(int m);
+static int complit__primes(int i);
+static int complit__bump(int i);
+static int complit__first(int t[3]);
+static int complit__copies(void);
+static int complit__lengths(void);
+static int complit__main(void);
+static int complit__second__0(int t[3]);
+
+
+static int const complit__lit0[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+static int const complit__lit1[8] = {2, 3, 5, 7, 11, 13, 17, 19};
+static int const complit__lit2[3] = {1, 2, 3};
+static int const complit__lit3[3] = {4, 5, 6};
+static complit__vec3 const complit__lit4 = {1.0, 2.0, 3.0};
+
+static double complit__len(complit__vec3 v) {
+    return ((v.x + v.y) + v.z);
+}
+
+static int complit__days(int m) {
+    int const *t = complit__lit0;
+    return t[m];
+}
+
+static int complit__primes(int i) {
+    return complit__lit1[i];
+}
+
+static int complit__bump(int i) {
+    int t[12];
+    __builtin_memcpy(t, complit__lit0, sizeof t);
+    (t[i] = (t[i] + 1));
+    return t[i];
+}
+
+static int complit__first(int t_in[3]) {
+    int t[3];
+    __builtin_memcpy(t, t_in, sizeof t);
+    (t[0] = 0);
+    return t[0];
+}
+
+static int complit__copies(void) {
+    int t[3];
+    __builtin_memcpy(t, complit__lit2, sizeof t);
+    int u[3];
+    __builtin_memcpy(u, t, sizeof u);
+    (u[1] = 5);
+    __builtin_memcpy(t, u, sizeof t);
+    (u[0] = 4);
+    return (((complit__first(t) + t[0]) + t[1]) + u[0]);
+}
+
+static int complit__lengths(void) {
+    int a[3];
+    __builtin_memcpy(a, complit__lit2, sizeof a);
+    int b[3];
+    __builtin_memcpy(b, complit__lit3, sizeof b);
+    __builtin_memcpy(a, b, sizeof a);
+    return ((complit__second__0(a) + complit__second__0(b)) + complit__second__0(((int [3]){7, 8, 9})));
+}
+
+static int complit__main(void) {
+    double a = complit__len(complit__lit4);
+    complit__vec3 b = complit__lit4;
+    (b.x = 4.0);
+    complit__vec3 *p = (&((complit__vec3){1.0, 2.0, 3.0}));
+    for(int u[2] = {1, 2}; (u[0] < 3); (u[0]++)) {
+        (a = (a + 1.0));
+    }
+    return (((((((((int)a) + ((int)b.x)) + ((int)p->z)) + complit__days(1)) + complit__primes(3)) + complit__bump(1)) + complit__copies()) + complit__lengths());
+}
+
+static int complit__second__0(int t[3]) {
+    return t[1];
+}
+
+int main(void) {
+    return complit__main();
+}
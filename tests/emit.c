@@ -0,0 +1,138 @@
+//Generated by zen2cc 0.1.0 from tests/emit.zen
+#include <stdint.h>
+
+struct emit__vec;
+typedef struct emit__vec emit__vec;
+struct emit__list;
+typedef struct emit__list emit__list;
+enum {
+    emit__day__MON,
+    emit__day__TUE = 3,
+    emit__day__WED,
+};
+typedef uint8_t emit__day;
+typedef float emit__v4float32 __attribute__((vector_size(4 * sizeof(float)), aligned(16)));
+typedef emit__v4float32 emit__vec4;
+struct emit__slot;
+typedef struct emit__slot emit__slot;
+struct emit__vec {
+    float x;
+    float y;
+};
+_Static_assert(sizeof(struct emit__vec) == 8 && _Alignof(struct emit__vec) == 4, "layout of emit__vec");
+struct __attribute__((aligned(64))) emit__slot {
+    uint64_t hits;
+    uint32_t lock __attribute__((aligned(16)));
+};
+_Static_assert(sizeof(struct emit__slot) == 64 && _Alignof(struct emit__slot) == 64, "layout of emit__slot");
+struct emit__list {
+    emit__list *next;
+    int val;
+};
+_Static_assert(sizeof(struct emit__list) == 16 && _Alignof(struct emit__list) == 8, "layout of emit__list");
+typedef int32_t emit__v8int32 __attribute__((vector_size(8 * sizeof(int32_t)), aligned(32)));
+
+static int emit__sum(int n);
+static int emit__length(emit__list *l);
+static int emit__pick(int a);
+int emit__add(int a, int b);
+static emit__vec4 emit__axpy(emit__vec4 x, emit__vec4 y, float k);
+static float emit__hsum(emit__vec4 x);
+static emit__v8int32 emit__clamp(emit__v8int32 x, int32_t lo);
+static int emit__main(void);
+static float emit__vec__len2(emit__vec vec);
+static emit__vec emit__vec__scale(emit__vec vec, float by);
+static int emit__twice__0(int8_t x);
+static int emit__twice__1(int x);
+
+static int emit__count;
+int emit__total = (4 * 10);
+static uint8_t *emit__names[4];
+static emit__vec emit__origin = {0.0, 0.0};
+static int emit__start;
+static emit__day emit__today = emit__day__TUE;
+static emit__slot emit__slots[4];
+static unsigned emit__lock_at = (16u + sizeof(emit__slot));
+static int64_t emit__big = 1099511627776LL;
+static int64_t emit__wide = 1099511627775LL;
+
+static emit__vec const emit__lit0 = {3.0, 4.0};
+static emit__vec4 const emit__lit1 = {1.0, 2.0, 3.0, 4.0};
+static emit__vec4 const emit__lit2 = {0};
+static emit__v8int32 const emit__lit3 = {0};
+
+__attribute__((constructor)) static void emit__init(void) {
+    emit__start = emit__sum(3);
+}
+
+static int emit__sum(int n) {
+    int s = 0;
+    for(int i = 0; (i < n); (i++)) {
+        (s = (s + i));
+    }
+    return s;
+}
+
+static int emit__length(emit__list *l) {
+    int n = 0;
+    for(; (l != ((emit__list *)0)); (l = l->next)) {
+        (n++);
+    }
+    return n;
+}
+
+static int emit__pick(int a) {
+    if((a > 4)) {
+        return a;
+    } else {
+        return (-a);
+    }
+}
+
+int emit__add(int a, int b) {
+    int x = a;
+    int x_1 = (x + b);
+    return x_1;
+}
+
+static emit__vec4 emit__axpy(emit__vec4 x, emit__vec4 y, float k) {
+    return ((x * k) + y);
+}
+
+static float emit__hsum(emit__vec4 x) {
+    return (((x[0] + x[1]) + x[2]) + x[3]);
+}
+
+static emit__v8int32 emit__clamp(emit__v8int32 x, int32_t lo) {
+    return (((x < lo) & lo) | ((~(x < lo)) & x));
+}
+
+static int emit__main(void) {
+    emit__vec v = emit__lit0;
+    emit__vec *p = (&v);
+    (emit__count = (emit__twice__1(2) + emit__twice__0(((int8_t)1))));
+    emit__vec__len2(*p);
+    emit__vec r = emit__vec__scale(v, ((float)1.5));
+    emit__vec4 w = emit__axpy(emit__lit1, emit__lit2, 2.0);
+    return ((((emit__add(emit__sum(4), ((int)r.x)) + emit__pick(emit__count)) + ((int)emit__hsum(w))) + emit__clamp(emit__lit3, 1)[7]) + ((int)(emit__big >> 40)));
+}
+
+static float emit__vec__len2(emit__vec vec) {
+    return ((vec.x * vec.x) + (vec.y * vec.y));
+}
+
+static emit__vec emit__vec__scale(emit__vec vec, float by) {
+    return ((emit__vec){(vec.x * by), (vec.y * by)});
+}
+
+static int emit__twice__0(int8_t x) {
+    return (x + x);
+}
+
+static int emit__twice__1(int x) {
+    return (x + x);
+}
+
+int main(void) {
+    return emit__main();
+}
@@ -0,0 +1,34 @@
+//Generated by zen2cc 0.1.0 from tests/import.zen
+#include <stdint.h>
+
+
+int arith__add(int x, int y);
+int arith__cube(int x);
+int arith__clamp(int x, int lo, int hi);
+int arith__count(void);
+int arith__sum(int n);
+int arith__quad(int x);
+static int import__main(void);
+
+
+static int import__main(void) {
+    int t;
+    int t_1;
+    int d;
+    int t_2;
+    int t_3;
+    int t_4;
+    int t_5;
+    t = arith__count();
+    t_1 = arith__count();
+    d = t + t_1;
+    t_2 = 250 + d;
+    t_3 = arith__sum(4);
+    t_4 = t_2 + t_3;
+    t_5 = t_4 - 200;
+    return t_5;
+}
+
+int main(void) {
+    return import__main();
+}
@@ -0,0 +1,189 @@
+//Generated by zen2cc 0.1.0 from tests/inline.zen
+#include <stdint.h>
+
+
+static int inline__add(int x, int y);
+static int inline__sq(int x);
+static int inline__norm(int x, int y);
+static int inline__fact(int n);
+static int inline__even(int n);
+static int inline__odd(int n);
+static int inline__big(int n);
+static void inline__bump(void);
+static int inline__abs(int x);
+static int inline__main(void);
+
+static int inline__g;
+
+static int inline__add(int x, int y) {
+    int t;
+    t = x + y;
+    return t;
+}
+
+static int inline__sq(int x) {
+    int t;
+    t = x * x;
+    return t;
+}
+
+static int inline__norm(int x, int y) {
+    int x_1;
+    int y_1;
+    int t;
+    x_1 = x * x;
+    y_1 = y * y;
+    t = x_1 + y_1;
+    return t;
+}
+
+static int inline__fact(int n) {
+    int t;
+    int t_1;
+    int t_2;
+    int r;
+    int r_1;
+    t = n > 1;
+    if(!t) goto b3;
+    t_1 = n - 1;
+    t_2 = inline__fact(t_1);
+    r = n * t_2;
+    r_1 = r;
+    goto b2;
+    b3:;
+    r_1 = 1;
+    b2:;
+    return r_1;
+}
+
+static int inline__even(int n) {
+    int t;
+    int t_1;
+    int r;
+    int r_1;
+    t = n > 0;
+    if(!t) goto b3;
+    t_1 = n - 1;
+    r = inline__odd(t_1);
+    r_1 = r;
+    goto b2;
+    b3:;
+    r_1 = 1;
+    b2:;
+    return r_1;
+}
+
+static int inline__odd(int n) {
+    int t;
+    int t_1;
+    int r;
+    int r_1;
+    t = n > 0;
+    if(!t) goto b3;
+    t_1 = n - 1;
+    r = inline__even(t_1);
+    r_1 = r;
+    goto b2;
+    b3:;
+    r_1 = 0;
+    b2:;
+    return r_1;
+}
+
+static int inline__big(int n) {
+    int i;
+    int s;
+    int t;
+    int t_1;
+    int t_2;
+    int t_3;
+    int t_4;
+    int t_5;
+    int t_6;
+    int t_7;
+    int t_8;
+    int t_9;
+    int t_10;
+    int t_11;
+    int s_1;
+    int i_1;
+    i = 0;
+    s = 0;
+    b1:;
+    t = i < n;
+    if(!t) goto b3;
+    t_1 = i * 3;
+    t_2 = s + t_1;
+    t_3 = s >> 2;
+    t_4 = t_2 + t_3;
+    t_5 = i ^ 5;
+    t_6 = t_4 - t_5;
+    t_7 = s & 7;
+    t_8 = t_6 + t_7;
+    t_9 = i | 1;
+    t_10 = t_8 + t_9;
+    t_11 = inline__g;
+    s_1 = t_10 + t_11;
+    inline__g = s_1;
+    i_1 = i + 1;
+    i = i_1;
+    s = s_1;
+    goto b1;
+    b3:;
+    return s;
+}
+
+static void inline__bump(void) {
+    int t;
+    int t_1;
+    t = inline__g;
+    t_1 = t + 1;
+    inline__g = t_1;
+    return;
+}
+
+static int inline__abs(int x) {
+    int t;
+    int r;
+    int r_1;
+    t = x < 0;
+    if(!t) goto b3;
+    r = -x;
+    r_1 = r;
+    goto b2;
+    b3:;
+    r_1 = x;
+    b2:;
+    return r_1;
+}
+
+static int inline__main(void) {
+    int t;
+    int t_1;
+    int t_2;
+    int r;
+    int t_3;
+    int r_1;
+    int t_4;
+    int t_5;
+    int t_6;
+    int t_7;
+    int t_8;
+    t = inline__g;
+    t_1 = t + 1;
+    inline__g = t_1;
+    t_2 = inline__fact(3);
+    r = 4 * t_2;
+    t_3 = 37 + r;
+    r_1 = inline__odd(5);
+    t_4 = t_3 + r_1;
+    t_5 = inline__big(3);
+    t_6 = t_4 + t_5;
+    t_7 = inline__g;
+    t_8 = t_6 - t_7;
+    return t_8;
+}
+
+int main(void) {
+    return inline__main();
+}
@@ -0,0 +1,164 @@
+//Generated by zen2cc 0.1.0 from tests/ir.zen
+#include <stdint.h>
+
+
+static int ir__fold(int x);
+static int ir__cse(int a, int b);
+static int ir__swap(int n);
+static int ir__logic(int a, int b);
+static int ir__mem(int *p, int n);
+static uint8_t ir__narrow(uint8_t x, uint8_t y);
+static int ir__lines(int *p, int *q);
+static int ir__main(void);
+
+static int ir__g;
+static uint8_t ir__tab[16];
+
+static int ir__fold(int x) {
+    int t;
+    t = x + 40;
+    return t;
+}
+
+static int ir__cse(int a, int b) {
+    int t;
+    int c;
+    int d;
+    int t_1;
+    t = a * b;
+    c = t + 1;
+    d = t + 2;
+    t_1 = c * d;
+    return t_1;
+}
+
+static int ir__swap(int n) {
+    int i;
+    int a;
+    int b;
+    int t;
+    int b_1;
+    int i_1;
+    int t_1;
+    int t_2;
+    i = 0;
+    a = 1;
+    b = 2;
+    b1:;
+    t = i < n;
+    if(!t) goto b3;
+    b_1 = a + b;
+    i_1 = i + 1;
+    {
+        int phi = i_1;
+        int phi_1 = b;
+        int phi_2 = b_1;
+        i = phi;
+        a = phi_1;
+        b = phi_2;
+    }
+    goto b1;
+    b3:;
+    t_1 = a * 3;
+    t_2 = t_1 + b;
+    return t_2;
+}
+
+static int ir__logic(int a, int b) {
+    int t;
+    int t_1;
+    int x;
+    int t_2;
+    int t_3;
+    int y;
+    int t_4;
+    int t_5;
+    t = a > 2;
+    if(!t) goto b5;
+    t_1 = b < 5;
+    x = t_1;
+    goto b2;
+    b5:;
+    x = 0;
+    b2:;
+    t_2 = a == 1;
+    if(t_2) goto b6;
+    t_3 = b == 1;
+    y = t_3;
+    goto b4;
+    b6:;
+    y = 1;
+    b4:;
+    t_4 = x * 2;
+    t_5 = t_4 + y;
+    return t_5;
+}
+
+static int ir__mem(int *p, int n) {
+    int i;
+    int s;
+    int t;
+    int t_1;
+    int t_2;
+    int s_1;
+    int t_3;
+    int t_4;
+    int t_5;
+    uint8_t t_6;
+    int i_1;
+    int t_7;
+    int t_8;
+    i = 0;
+    s = 0;
+    b1:;
+    t = i < n;
+    if(!t) goto b3;
+    t_1 = p[0];
+    t_2 = t_1 + i;
+    p[0] = t_2;
+    s_1 = s + t_2;
+    t_3 = ir__g;
+    t_4 = t_3 + s_1;
+    ir__g = t_4;
+    t_5 = i & 15;
+    t_6 = (uint8_t)i;
+    ir__tab[t_5] = t_6;
+    i_1 = i + 1;
+    i = i_1;
+    s = s_1;
+    goto b1;
+    b3:;
+    t_7 = ir__g;
+    t_8 = s + t_7;
+    return t_8;
+}
+
+static uint8_t ir__narrow(uint8_t x, uint8_t y) {
+    int t;
+    uint8_t z;
+    t = x + y;
+    z = (uint8_t)t;
+    return z;
+}
+
+static int ir__lines(int *p, int *q) {
+    int t;
+    int a;
+    int t_1;
+    t = p[0];
+    a = t + 1;
+    q[0] = 7;
+    t_1 = -a;
+    return t_1;
+}
+
+static int ir__main(void) {
+    int n = 4;
+    int m = 0;
+    int r = (((((ir__fold(1) + ir__cse(2, 3)) + ir__swap(n)) + ir__logic(3, 1)) + ir__mem((&n), 3)) + ((int)ir__narrow(200, 100)));
+    return ((r + ir__lines((&n), (&m))) + m);
+}
+
+int main(void) {
+    return ir__main();
+}
@@ -0,0 +1,65 @@
+//Generated by zen2cc 0.1.0 from tests/line.zen
+#include <stdint.h>
+
+
+static int line__step(int n);
+static int line__pick(int a);
+static int line__loop(int n);
+static int line__main(void);
+
+static int line__counter;
+static int line__start;
+
+__attribute__((constructor)) static void line__init(void) {
+#line 2 "tests/line.zen"
+    line__start = line__step(1);
+}
+
+#line 4 "tests/line.zen"
+static int line__step(int n) {
+#line 5 "tests/line.zen"
+    (line__counter = (line__counter + n));
+#line 6 "tests/line.zen"
+    return line__counter;
+}
+
+#line 9 "tests/line.zen"
+static int line__pick(int a) {
+#line 10 "tests/line.zen"
+    if((a > 2)) {
+#line 11 "tests/line.zen"
+        return line__step(a);
+    } else {
+#line 13 "tests/line.zen"
+        return 0;
+    }
+}
+
+#line 16 "tests/line.zen"
+static int line__loop(int n) {
+#line 17 "tests/line.zen"
+    for(int i = 0; (i < n); (i++)) {
+#line 18 "tests/line.zen"
+        line__step(i);
+    }
+#line 20 "tests/line.zen"
+    if((n > 10)) {
+#line 20 "tests/line.zen"
+        line__step(n);
+    }
+#line 21 "tests/line.zen"
+    return line__counter;
+}
+
+#line 24 "tests/line.zen"
+static int line__main(void) {
+#line 25 "tests/line.zen"
+    line__loop(3);
+#line 26 "tests/line.zen"
+    return line__pick(line__counter);
+}
+
+#line 24 "tests/line.zen"
+int main(void) {
+    return line__main();
+}
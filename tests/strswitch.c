@@ -0,0 +1,126 @@
+//Generated by zen2cc 0.1.0 from tests/strswitch.zen
+#include <stdint.h>
+
+
+static int strswitch__method(uint8_t *s, int n);
+static int strswitch__tag(uint8_t s[4]);
+static int strswitch__main(void);
+
+
+static int strswitch__method(uint8_t *s, int n) {
+    {
+        const uint8_t *sw = s;
+        uint64_t sw_len = n;
+        if(sw_len == 0) {
+            if(__builtin_memcmp(sw, "", 0) == 0) goto sw0_9;
+            goto sw0_default;
+        }
+        if(sw_len == 3) {
+            static const uint8_t *const sw_keys[] = {(const uint8_t *)"PUT", (const uint8_t *)"GET"};
+            static void *const sw_table[] = {&&sw0_1, &&sw0_0};
+            uint32_t sw_hash = 2166136260u;
+            for(uint64_t i = 0; i < 3; i++) sw_hash = (sw_hash ^ sw[i]) * 16777619u;
+            sw_hash = (sw_hash ^ sw_hash >> 16) & 1;
+            if(sw_keys[sw_hash] && __builtin_memcmp(sw, sw_keys[sw_hash], 3) == 0) goto *sw_table[sw_hash];
+            goto sw0_default;
+        }
+        if(sw_len == 4) {
+            static const uint8_t *const sw_keys_1[] = {(const uint8_t *)"HEAD", (const uint8_t *)"POST"};
+            static void *const sw_table_1[] = {&&sw0_3, &&sw0_2};
+            uint32_t sw_hash_1 = 2166136260u;
+            for(uint64_t i_1 = 0; i_1 < 4; i_1++) sw_hash_1 = (sw_hash_1 ^ sw[i_1]) * 16777619u;
+            sw_hash_1 = (sw_hash_1 ^ sw_hash_1 >> 16) & 1;
+            if(sw_keys_1[sw_hash_1] && __builtin_memcmp(sw, sw_keys_1[sw_hash_1], 4) == 0) goto *sw_table_1[sw_hash_1];
+            goto sw0_default;
+        }
+        if(sw_len == 5) {
+            static const uint8_t *const sw_keys_2[] = {(const uint8_t *)"PATCH", (const uint8_t *)"TRACE"};
+            static void *const sw_table_2[] = {&&sw0_4, &&sw0_7};
+            uint32_t sw_hash_2 = 2166136260u;
+            for(uint64_t i_2 = 0; i_2 < 5; i_2++) sw_hash_2 = (sw_hash_2 ^ sw[i_2]) * 16777619u;
+            sw_hash_2 = (sw_hash_2 ^ sw_hash_2 >> 16) & 1;
+            if(sw_keys_2[sw_hash_2] && __builtin_memcmp(sw, sw_keys_2[sw_hash_2], 5) == 0) goto *sw_table_2[sw_hash_2];
+            goto sw0_default;
+        }
+        if(sw_len == 6) {
+            if(__builtin_memcmp(sw, "DELETE", 6) == 0) goto sw0_5;
+            goto sw0_default;
+        }
+        if(sw_len == 7) {
+            static const uint8_t *const sw_keys_3[] = {(const uint8_t *)"CONNECT", (const uint8_t *)"OPTIONS"};
+            static void *const sw_table_3[] = {&&sw0_8, &&sw0_6};
+            uint32_t sw_hash_3 = 2166136261u;
+            for(uint64_t i_3 = 0; i_3 < 7; i_3++) sw_hash_3 = (sw_hash_3 ^ sw[i_3]) * 16777619u;
+            sw_hash_3 = (sw_hash_3 ^ sw_hash_3 >> 16) & 1;
+            if(sw_keys_3[sw_hash_3] && __builtin_memcmp(sw, sw_keys_3[sw_hash_3], 7) == 0) goto *sw_table_3[sw_hash_3];
+            goto sw0_default;
+        }
+        goto sw0_default;
+        sw0_0: {
+            return 1;
+        }
+        sw0_1: {
+            return 2;
+        }
+        sw0_2: {
+            return 3;
+        }
+        sw0_3: {
+            return 4;
+        }
+        sw0_4: {
+            return 5;
+        }
+        sw0_5: {
+            return 6;
+        }
+        sw0_6: {
+            return 7;
+        }
+        sw0_7: {
+        }
+        sw0_8: {
+            return 8;
+        }
+        sw0_9: {
+            return 9;
+        }
+        sw0_default: {
+            return 0;
+        }
+    }
+}
+
+static int strswitch__tag(uint8_t s[4]) {
+    {
+        const uint8_t *sw = s;
+        uint64_t sw_len = 4;
+        if(sw_len == 4) {
+            static const uint8_t *const sw_keys[] = {(const uint8_t *)"ab\000c", (const uint8_t *)"HEAD"};
+            static void *const sw_table[] = {&&sw0_0, &&sw0_1};
+            uint32_t sw_hash = 2166136261u;
+            for(uint64_t i = 0; i < 4; i++) sw_hash = (sw_hash ^ sw[i]) * 16777619u;
+            sw_hash = (sw_hash ^ sw_hash >> 16) & 1;
+            if(sw_keys[sw_hash] && __builtin_memcmp(sw, sw_keys[sw_hash], 4) == 0) goto *sw_table[sw_hash];
+            goto sw0_default;
+        }
+        goto sw0_default;
+        sw0_0: {
+            return 1;
+        }
+        sw0_1: {
+            return 2;
+        }
+        sw0_default: {
+            return 0;
+        }
+    }
+}
+
+static int strswitch__main(void) {
+    return ((strswitch__method((uint8_t *)"POST", 4) + strswitch__method((uint8_t *)"PUTS", 3)) + strswitch__tag((uint8_t *)"HEAD"));
+}
+
+int main(void) {
+    return strswitch__main();
+}
@@ -0,0 +1,193 @@
+//Generated by zen2cc 0.1.0 from tests/switch.zen
+#include <stdint.h>
+
+enum {
+    switch__day__MON,
+    switch__day__TUE,
+    switch__day__WED,
+    switch__day__THU,
+    switch__day__FRI,
+    switch__day__SAT,
+    switch__day__SUN,
+};
+typedef uint8_t switch__day;
+
+static int switch__dense(int x);
+static int switch__sparse(uint32_t x);
+static int switch__workday(switch__day d);
+static int switch__weekend(switch__day d);
+static int switch__sign(int x);
+static int switch__count(uint8_t x);
+static int switch__main(void);
+
+
+static int switch__dense(int x) {
+    {
+        int sw = x;
+        static void *const sw_table[] = {
+            &&sw0_0, &&sw0_1, &&sw0_2, &&sw0_3, &&sw0_4
+        };
+        if((uint64_t)sw - (uint64_t)1 > 4u) goto sw0_default;
+        goto *sw_table[(uint64_t)sw - (uint64_t)1];
+        sw0_0: {
+            return 10;
+        }
+        sw0_1: {
+            return 20;
+        }
+        sw0_2: {
+            int y = 30;
+            return (y + 1);
+        }
+        sw0_3: {
+        }
+        sw0_4: {
+            return 50;
+        }
+        sw0_default: {
+            return 0;
+        }
+    }
+}
+
+static int switch__sparse(uint32_t x) {
+    {
+        uint32_t sw = x;
+        if(sw < 1000) {
+            if(sw == 1) goto sw0_0;
+            if(sw == 100) goto sw0_1;
+            goto sw0_default;
+        } else {
+            if(sw == 1000) goto sw0_2;
+            if(sw == 10000) goto sw0_3;
+            if(sw == 100000) goto sw0_4;
+            goto sw0_default;
+        }
+        sw0_0: {
+            return 1;
+        }
+        sw0_1: {
+            return 2;
+        }
+        sw0_2: {
+            return 3;
+        }
+        sw0_3: {
+            return 4;
+        }
+        sw0_4: {
+            return 5;
+        }
+        sw0_default: {
+            return 6;
+        }
+    }
+}
+
+static int switch__workday(switch__day d) {
+    {
+        switch__day sw = d;
+        static void *const sw_table[] = {
+            &&sw0_0, &&sw0_1, &&sw0_2, &&sw0_3, &&sw0_4, &&sw0_default, &&sw0_default
+        };
+        if((uint64_t)sw - (uint64_t)0 > 6u) goto sw0_default;
+        goto *sw_table[(uint64_t)sw - (uint64_t)0];
+        sw0_0: {
+        }
+        sw0_1: {
+        }
+        sw0_2: {
+        }
+        sw0_3: {
+        }
+        sw0_4: {
+            return 1;
+        }
+        sw0_default: {
+            return 0;
+        }
+    }
+}
+
+static int switch__weekend(switch__day d) {
+    {
+        switch__day sw = d;
+        if(sw == switch__day__SAT) goto sw0_0;
+        if(sw == switch__day__SUN) goto sw0_1;
+        goto sw0_default;
+        sw0_0: {
+            return 1;
+        }
+        sw0_1: {
+            return 2;
+        }
+        sw0_default: {
+            return 0;
+        }
+    }
+}
+
+static int switch__sign(int x) {
+    {
+        if((x < 0)) goto sw0_0;
+        if((x > 0)) goto sw0_1;
+        goto sw0_default;
+        sw0_0: {
+            return (-1);
+        }
+        sw0_1: {
+            return 1;
+        }
+        sw0_default: {
+            return 0;
+        }
+    }
+}
+
+static int switch__count(uint8_t x) {
+    int r = 0;
+    {
+        uint8_t sw = x;
+        if(sw == 0) goto sw0_0;
+        if(sw == 1) goto sw0_1;
+        if(sw == 2) goto sw0_2;
+        goto sw0_end;
+        sw0_0: {
+            (r = (r + 1));
+        }
+        sw0_1: {
+            (r = (r + 1));
+            goto sw0_end;
+        }
+        sw0_2: {
+            goto sw0_end;
+        }
+        sw0_end:;
+    }
+    return (r + ({
+        int sw_value;
+        {
+            uint8_t sw_1 = x;
+            if(sw_1 == 7) goto sw1_0;
+            goto sw1_default;
+            sw1_0: {
+                sw_value = 7;
+                goto sw1_end;
+            }
+            sw1_default: {
+                sw_value = 1;
+            }
+            sw1_end:;
+        }
+        sw_value;
+    }));
+}
+
+static int switch__main(void) {
+    int r = (((((switch__dense(4) + switch__sparse(1000)) + switch__workday(switch__day__SUN)) + switch__workday(((switch__day)200))) + switch__sign((-5))) + switch__count(0));
+    return ((r + (switch__weekend(switch__day__SAT) * 60)) + (switch__weekend(switch__day__MON) * 7));
+}
+
+int main(void) {
+    return switch__main();
+}
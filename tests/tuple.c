@@ -0,0 +1,100 @@
+//Generated by zen2cc 0.1.0 from tests/tuple.zen
+#include <stdint.h>
+
+struct tuple__vec3;
+typedef struct tuple__vec3 tuple__vec3;
+struct tuple__s0;
+struct tuple__s0 {
+    int _0;
+    int _1;
+};
+_Static_assert(sizeof(struct tuple__s0) == 8 && _Alignof(struct tuple__s0) == 4, "layout of tuple__s0");
+struct tuple__vec3 {
+    double x;
+    double y;
+    double z;
+};
+_Static_assert(sizeof(struct tuple__vec3) == 24 && _Alignof(struct tuple__vec3) == 8, "layout of tuple__vec3");
+struct tuple__s1;
+struct tuple__s1 {
+    double _0;
+    double _1;
+    int64_t _2;
+    tuple__vec3 _3;
+};
+_Static_assert(sizeof(struct tuple__s1) == 48 && _Alignof(struct tuple__s1) == 8, "layout of tuple__s1");
+
+static struct tuple__s0 tuple__divmod(int a, int b);
+static void tuple__span(double *a, int n, double *ret_0, double *ret_1, int64_t *ret_2, tuple__vec3 *ret_3);
+static void tuple__pass(double *a, int n, double *ret_0, double *ret_1, int64_t *ret_2, tuple__vec3 *ret_3);
+static int tuple__quotient(int a);
+static int tuple__main(void);
+
+static double tuple__xs[4] = {3.0, 1.0, 4.0, 1.5};
+
+static struct tuple__s0 tuple__divmod(int a, int b) {
+    return ((struct tuple__s0){(a / b), (a % b)});
+}
+
+static void tuple__span(double *a, int n, double *ret_0, double *ret_1, int64_t *ret_2, tuple__vec3 *ret_3) {
+    double lo = a[0];
+    double hi = a[0];
+    for(int i = 1; (i < n); (i++)) {
+        if((a[i] < lo)) {
+            (lo = a[i]);
+        }
+        if((a[i] > hi)) {
+            (hi = a[i]);
+        }
+    }
+    *ret_0 = lo;
+    *ret_1 = hi;
+    *ret_2 = ((int64_t)n);
+    *ret_3 = ((tuple__vec3){lo, hi, 0.5});
+    return;
+}
+
+static void tuple__pass(double *a, int n, double *ret_0, double *ret_1, int64_t *ret_2, tuple__vec3 *ret_3) {
+    tuple__span(a, n, ret_0, ret_1, ret_2, ret_3);
+    return;
+}
+
+static int tuple__quotient(int a) {
+    struct tuple__s0 tuple = tuple__divmod(a, 3);
+    int x = tuple._0;
+    int discard __attribute__((unused)) = x;
+    int y = 4;
+    return (y * x);
+}
+
+static int tuple__main(void) {
+    struct tuple__s0 tuple = tuple__divmod(17, 5);
+    int q = tuple._0;
+    int r = tuple._1;
+    struct tuple__s0 t = tuple__divmod(9, 2);
+    struct tuple__s0 tuple_1 = ((struct tuple__s0){r, q});
+    q = tuple_1._0;
+    r = tuple_1._1;
+    double lo;
+    double hi;
+    int64_t n;
+    tuple__vec3 v;
+    tuple__pass(tuple__xs, 4, &lo, &hi, &n, &v);
+    struct tuple__s1 u = ({
+        struct tuple__s1 ret;
+        tuple__span(tuple__xs, 2, &ret._0, &ret._1, &ret._2, &ret._3);
+        ret;
+    });
+    struct tuple__s0 tuple_2 = tuple__divmod(23, 5);
+    int d = tuple_2._0;
+    struct tuple__s0 tuple_3 = tuple__divmod(29, 5);
+    r = tuple_3._1;
+    struct tuple__s1 ret_1;
+    tuple__span(tuple__xs, 3, &ret_1._0, &ret_1._1, &ret_1._2, &ret_1._3);
+    n = ret_1._2;
+    return ((((((((((q * 100) + (r * 10)) + ((int)hi)) + ((int)n)) + ((int)v.z)) + ((int)lo)) + t._1) - ((int)u._1)) + d) + tuple__quotient(9));
+}
+
+int main(void) {
+    return tuple__main();
+}
@@ -0,0 +1,498 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bn.h"
+
+void bn_init(struct bn *a) {
+    assert(a);
+    *a = (struct bn){0};
+}
+
+void bn_free(struct bn *a) {
+    if(!a) return;
+    free(a->d);
+    bn_init(a);
+}
+
+static void bn_reserve(struct bn *a, int n) {
+    if(a->c >= n) return;
+    a->d = realloc(a->d, n * sizeof *a->d);
+    assert(a->d);
+    a->c = n;
+}
+
+//Drop leading zero limbs, zero is never negative
+static void bn_trim(struct bn *a) {
+    while(a->n && !a->d[a->n-1]) a->n--;
+    if(!a->n) a->neg = false;
+}
+
+//Replace r with the temporary t, so operands may alias r
+static void bn_move(struct bn *r, struct bn *t) {
+    if(r == t) return;
+    free(r->d);
+    *r = *t;
+}
+
+void bn_set(struct bn *r, struct bn *a) {
+    if(r == a) return;
+    bn_reserve(r, a->n);
+    if(a->n) memcpy(r->d, a->d, a->n * sizeof *a->d);
+    r->n = a->n;
+    r->neg = a->neg;
+}
+
+void bn_set_int(struct bn *r, int64_t v) {
+    uint64_t u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+    bn_reserve(r, 2);
+    r->d[0] = (uint32_t)u;
+    r->d[1] = (uint32_t)(u >> 32);
+    r->n = 2;
+    r->neg = v < 0;
+    bn_trim(r);
+}
+
+bool bn_is_zero(struct bn *a) {
+    return a->n == 0;
+}
+
+static int mag_cmp(struct bn *a, struct bn *b) {
+    if(a->n != b->n) return a->n < b->n ? -1 : 1;
+    for(int i = a->n - 1; i >= 0; i--)
+        if(a->d[i] != b->d[i]) return a->d[i] < b->d[i] ? -1 : 1;
+    return 0;
+}
+
+int bn_cmp(struct bn *a, struct bn *b) {
+    if(a->neg != b->neg) return a->neg ? -1 : 1;
+    int c = mag_cmp(a, b);
+    return a->neg ? -c : c;
+}
+
+//Number of bits in the magnitude of a
+int bn_bits(struct bn *a) {
+    if(!a->n) return 0;
+    return (a->n - 1) * 32 + (32 - __builtin_clz(a->d[a->n-1]));
+}
+
+//Returns false if a does not fit in an int64_t
+bool bn_to_int64(struct bn *a, int64_t *v) {
+    if(a->n > 2) return false;
+
+    uint64_t u = 0;
+    for(int i = a->n - 1; i >= 0; i--) u = (u << 32) | a->d[i];
+
+    if(!a->neg) {
+        if(u > INT64_MAX) return false;
+        *v = (int64_t)u;
+    } else {
+        if(u > (uint64_t)INT64_MAX + 1) return false;
+        *v = u ? -(int64_t)(u - 1) - 1 : 0;
+    }
+
+    return true;
+}
+
+//t = |a| + |b|
+static void mag_add(struct bn *t, struct bn *a, struct bn *b) {
+    if(a->n < b->n) { struct bn *s = a; a = b; b = s; }
+
+    bn_reserve(t, a->n + 1);
+    uint64_t carry = 0;
+    for(int i = 0; i < a->n; i++) {
+        carry += (uint64_t)a->d[i] + (i < b->n ? b->d[i] : 0);
+        t->d[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    t->d[a->n] = (uint32_t)carry;
+    t->n = a->n + 1;
+}
+
+//t = |a| - |b|, where |a| >= |b|
+static void mag_sub(struct bn *t, struct bn *a, struct bn *b) {
+    bn_reserve(t, a->n);
+    int64_t borrow = 0;
+    for(int i = 0; i < a->n; i++) {
+        int64_t d = (int64_t)a->d[i] - (i < b->n ? b->d[i] : 0) - borrow;
+        borrow = d < 0;
+        t->d[i] = (uint32_t)(d + (borrow << 32));
+    }
+    t->n = a->n;
+}
+
+//r = a + b, with the sign of b given by bneg
+static void bn_add_signed(struct bn *r, struct bn *a, struct bn *b, bool bneg) {
+    struct bn t;
+    bn_init(&t);
+
+    if(a->neg == bneg) {
+        mag_add(&t, a, b);
+        t.neg = a->neg;
+    } else if(mag_cmp(a, b) >= 0) {
+        mag_sub(&t, a, b);
+        t.neg = a->neg;
+    } else {
+        mag_sub(&t, b, a);
+        t.neg = bneg;
+    }
+
+    bn_trim(&t);
+    bn_move(r, &t);
+}
+
+void bn_neg(struct bn *r, struct bn *a) {
+    bn_set(r, a);
+    r->neg = !r->neg;
+    bn_trim(r);
+}
+
+void bn_add(struct bn *r, struct bn *a, struct bn *b) {
+    bn_add_signed(r, a, b, b->neg);
+}
+
+void bn_sub(struct bn *r, struct bn *a, struct bn *b) {
+    bn_add_signed(r, a, b, !b->neg);
+}
+
+void bn_mul(struct bn *r, struct bn *a, struct bn *b) {
+    struct bn t;
+    bn_init(&t);
+
+    bn_reserve(&t, a->n + b->n + 1);
+    t.n = a->n + b->n;
+    memset(t.d, 0, t.n * sizeof *t.d);
+
+    for(int i = 0; i < a->n; i++) {
+        uint64_t carry = 0;
+        for(int j = 0; j < b->n; j++) {
+            carry += (uint64_t)a->d[i] * b->d[j] + t.d[i+j];
+            t.d[i+j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        t.d[i + b->n] = (uint32_t)carry;
+    }
+
+    t.neg = a->neg != b->neg;
+    bn_trim(&t);
+    bn_move(r, &t);
+}
+
+//r = r * m + a, on the magnitude of r
+void bn_mul_add_small(struct bn *r, uint32_t m, uint32_t a) {
+    uint64_t carry = a;
+    for(int i = 0; i < r->n; i++) {
+        carry += (uint64_t)r->d[i] * m;
+        r->d[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+
+    if(carry) {
+        bn_reserve(r, r->n + 1);
+        r->d[r->n++] = (uint32_t)carry;
+    }
+    bn_trim(r);
+}
+
+//r = base^e, by repeated squaring
+void bn_pow_small(struct bn *r, uint32_t base, uint32_t e) {
+    struct bn b, t;
+    bn_init(&b); bn_init(&t);
+    bn_set_int(&b, base);
+    bn_set_int(&t, 1);
+
+    for(; e; e >>= 1) {
+        if(e & 1) bn_mul(&t, &t, &b);
+        if(e > 1) bn_mul(&b, &b, &b);
+    }
+
+    bn_free(&b);
+    bn_move(r, &t);
+}
+
+//Divide magnitudes, q = |a| / |b| and m = |a| % |b|. Knuth's algorithm D,
+//with b normalized so its top limb has the high bit set.
+static void mag_divmod(struct bn *q, struct bn *m, struct bn *a, struct bn *b) {
+    int an = a->n, bn = b->n;
+    assert(bn > 0);
+
+    bn_reserve(q, an > bn ? an - bn + 1 : 1);
+    bn_reserve(m, bn);
+
+    if(an < bn) {
+        q->n = 0;
+        if(an) memcpy(m->d, a->d, an * sizeof *a->d);
+        m->n = an;
+        return;
+    }
+
+    if(bn == 1) {
+        uint64_t rem = 0;
+        for(int i = an - 1; i >= 0; i--) {
+            rem = (rem << 32) | a->d[i];
+            q->d[i] = (uint32_t)(rem / b->d[0]);
+            rem %= b->d[0];
+        }
+        q->n = an;
+        m->d[0] = (uint32_t)rem;
+        m->n = 1;
+        return;
+    }
+
+    int s = __builtin_clz(b->d[bn-1]);
+    uint32_t *vn = malloc(bn * sizeof *vn);
+    uint32_t *un = malloc((an + 1) * sizeof *un);
+    assert(vn); assert(un);
+
+    for(int i = bn - 1; i > 0; i--)
+        vn[i] = (uint32_t)(((uint64_t)b->d[i] << s) | ((uint64_t)b->d[i-1] >> (32 - s)));
+    vn[0] = b->d[0] << s;
+
+    un[an] = (uint32_t)((uint64_t)a->d[an-1] >> (32 - s));
+    for(int i = an - 1; i > 0; i--)
+        un[i] = (uint32_t)(((uint64_t)a->d[i] << s) | ((uint64_t)a->d[i-1] >> (32 - s)));
+    un[0] = a->d[0] << s;
+
+    const uint64_t base = (uint64_t)1 << 32;
+    for(int j = an - bn; j >= 0; j--) {
+        uint64_t num = ((uint64_t)un[j+bn] << 32) | un[j+bn-1];
+        uint64_t qhat = num / vn[bn-1];
+        uint64_t rhat = num % vn[bn-1];
+
+        while(qhat >= base || qhat * vn[bn-2] > ((rhat << 32) | un[j+bn-2])) {
+            qhat--;
+            rhat += vn[bn-1];
+            if(rhat >= base) break;
+        }
+
+        //Multiply and subtract qhat * vn from un[j..j+bn]
+        int64_t k = 0, t;
+        for(int i = 0; i < bn; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i+j] - k - (int64_t)(p & 0xFFFFFFFF);
+            un[i+j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j+bn] - k;
+        un[j+bn] = (uint32_t)t;
+
+        //qhat was one too large, add back
+        if(t < 0) {
+            qhat--;
+            uint64_t c = 0;
+            for(int i = 0; i < bn; i++) {
+                c += (uint64_t)un[i+j] + vn[i];
+                un[i+j] = (uint32_t)c;
+                c >>= 32;
+            }
+            un[j+bn] += (uint32_t)c;
+        }
+
+        q->d[j] = (uint32_t)qhat;
+    }
+    q->n = an - bn + 1;
+
+    for(int i = 0; i < bn; i++)
+        m->d[i] = (uint32_t)(((uint64_t)un[i] >> s) | ((uint64_t)un[i+1] << (32 - s)));
+    m->n = bn;
+
+    free(vn);
+    free(un);
+}
+
+//Truncating division as in C, q = a / b and m = a % b. Either result may be
+//NULL. Returns false on division by zero.
+bool bn_divmod(struct bn *q, struct bn *m, struct bn *a, struct bn *b) {
+    if(bn_is_zero(b)) return false;
+
+    struct bn tq, tm;
+    bn_init(&tq); bn_init(&tm);
+    mag_divmod(&tq, &tm, a, b);
+
+    tq.neg = a->neg != b->neg;
+    tm.neg = a->neg;
+    bn_trim(&tq);
+    bn_trim(&tm);
+
+    if(q) bn_move(q, &tq);
+    else bn_free(&tq);
+    if(m) bn_move(m, &tm);
+    else bn_free(&tm);
+
+    return true;
+}
+
+//Greatest common divisor of |a| and |b|
+void bn_gcd(struct bn *r, struct bn *a, struct bn *b) {
+    struct bn x, y;
+    bn_init(&x); bn_init(&y);
+    bn_set(&x, a); x.neg = false;
+    bn_set(&y, b); y.neg = false;
+
+    while(!bn_is_zero(&y)) {
+        bn_divmod(NULL, &x, &x, &y);
+        struct bn s = x; x = y; y = s;
+    }
+
+    bn_free(&y);
+    bn_move(r, &x);
+}
+
+void bn_shl(struct bn *r, struct bn *a, int bits) {
+    assert(bits >= 0 && bits <= BN_SHIFT_MAX);
+
+    struct bn t;
+    bn_init(&t);
+
+    int limbs = bits / 32, s = bits % 32;
+    bn_reserve(&t, a->n + limbs + 1);
+    memset(t.d, 0, (a->n + limbs + 1) * sizeof *t.d);
+
+    for(int i = 0; i < a->n; i++) {
+        uint64_t v = (uint64_t)a->d[i] << s;
+        t.d[i+limbs] |= (uint32_t)v;
+        t.d[i+limbs+1] |= (uint32_t)(v >> 32);
+    }
+
+    t.n = a->n + limbs + 1;
+    t.neg = a->neg;
+    bn_trim(&t);
+    bn_move(r, &t);
+}
+
+//Arithmetic shift right, rounding toward negative infinity
+void bn_shr(struct bn *r, struct bn *a, int bits) {
+    assert(bits >= 0);
+
+    struct bn t;
+    bn_init(&t);
+
+    int limbs = bits / 32, s = bits % 32;
+    bool lost = false;
+    for(int i = 0; i < limbs && i < a->n; i++) lost |= a->d[i] != 0;
+
+    if(limbs < a->n) {
+        t.n = a->n - limbs;
+        bn_reserve(&t, t.n);
+        lost |= (a->d[limbs] & ((1ull << s) - 1)) != 0;
+        for(int i = 0; i < t.n; i++) {
+            uint64_t v = a->d[i+limbs] >> s;
+            if(i + limbs + 1 < a->n) v |= (uint64_t)a->d[i+limbs+1] << (32 - s);
+            t.d[i] = (uint32_t)v;
+        }
+    }
+
+    t.neg = a->neg;
+    bn_trim(&t);
+
+    //-(m >> k) rounds toward zero, so step down if any bits were lost
+    if(a->neg && lost) {
+        t.neg = false;
+        bn_mul_add_small(&t, 1, 1);
+        t.neg = true;
+    }
+
+    bn_move(r, &t);
+}
+
+//Two's complement limbs of a, sign extended to n limbs
+static void twos(uint32_t *out, struct bn *a, int n) {
+    uint64_t carry = 1;
+    for(int i = 0; i < n; i++) {
+        uint32_t v = i < a->n ? a->d[i] : 0;
+        if(!a->neg) {
+            out[i] = v;
+            continue;
+        }
+        carry += (uint32_t)~v;
+        out[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+enum bitop {BIT_AND, BIT_OR, BIT_XOR};
+
+//Bit wise operations act on the infinite two's complement representation
+static void bn_bitop(struct bn *r, struct bn *a, struct bn *b, enum bitop op) {
+    int n = (a->n > b->n ? a->n : b->n) + 1;
+    uint32_t *x = malloc(n * sizeof *x), *y = malloc(n * sizeof *y);
+    assert(x); assert(y);
+    twos(x, a, n);
+    twos(y, b, n);
+
+    for(int i = 0; i < n; i++) {
+        switch(op) {
+        case BIT_AND: x[i] &= y[i]; break;
+        case BIT_OR: x[i] |= y[i]; break;
+        case BIT_XOR: x[i] ^= y[i]; break;
+        }
+    }
+
+    struct bn t;
+    bn_init(&t);
+    t.d = x;
+    t.c = t.n = n;
+    t.neg = x[n-1] >> 31;
+    if(t.neg) {
+        //Negate back to sign and magnitude
+        uint64_t carry = 1;
+        for(int i = 0; i < n; i++) {
+            carry += (uint32_t)~x[i];
+            x[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+    }
+
+    free(y);
+    bn_trim(&t);
+    bn_move(r, &t);
+}
+
+void bn_and(struct bn *r, struct bn *a, struct bn *b) { bn_bitop(r, a, b, BIT_AND); }
+void bn_or(struct bn *r, struct bn *a, struct bn *b) { bn_bitop(r, a, b, BIT_OR); }
+void bn_xor(struct bn *r, struct bn *a, struct bn *b) { bn_bitop(r, a, b, BIT_XOR); }
+
+//~a == -a - 1
+void bn_not(struct bn *r, struct bn *a) {
+    struct bn one;
+    bn_init(&one);
+    bn_set_int(&one, 1);
+    bn_neg(r, a);
+    bn_sub(r, r, &one);
+    bn_free(&one);
+}
+
+//Decimal representation of a, which the caller must free
+char *bn_str(struct bn *a) {
+    //Base 10^9 chunks, least significant first
+    int chunks_n = 0;
+    uint32_t *chunks = malloc((a->n * 10 / 9 + 2) * sizeof *chunks);
+    assert(chunks);
+
+    struct bn t;
+    bn_init(&t);
+    bn_set(&t, a);
+    while(t.n) {
+        uint64_t rem = 0;
+        for(int i = t.n - 1; i >= 0; i--) {
+            rem = (rem << 32) | t.d[i];
+            t.d[i] = (uint32_t)(rem / 1000000000);
+            rem %= 1000000000;
+        }
+        chunks[chunks_n++] = (uint32_t)rem;
+        bn_trim(&t);
+    }
+    bn_free(&t);
+
+    char *s = malloc(chunks_n * 9 + 3);
+    assert(s);
+    char *c = s;
+    if(a->neg) *c++ = '-';
+    if(!chunks_n) c += sprintf(c, "0");
+    else c += sprintf(c, "%u", chunks[chunks_n-1]);
+    for(int i = chunks_n - 2; i >= 0; i--) c += sprintf(c, "%09u", chunks[i]);
+
+    free(chunks);
+    return s;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Arbitrary precision signed integers, as sign and magnitude. The magnitude is
+//stored in base 2^32 limbs, least significant first, without leading zero
+//limbs, so zero has n == 0 and is never negative. Results may alias operands.
+
+struct bn {
+    uint32_t *d;
+    int n, c;
+    bool neg;
+};
+
+#define BN_SHIFT_MAX (1 << 16)     //Largest shift allowed, in bits
+
+void bn_init(struct bn *a);
+void bn_free(struct bn *a);
+void bn_set(struct bn *r, struct bn *a);
+void bn_set_int(struct bn *r, int64_t v);
+
+bool bn_is_zero(struct bn *a);
+int bn_cmp(struct bn *a, struct bn *b);
+int bn_bits(struct bn *a);
+bool bn_to_int64(struct bn *a, int64_t *v);
+
+void bn_neg(struct bn *r, struct bn *a);
+void bn_add(struct bn *r, struct bn *a, struct bn *b);
+void bn_sub(struct bn *r, struct bn *a, struct bn *b);
+void bn_mul(struct bn *r, struct bn *a, struct bn *b);
+void bn_mul_add_small(struct bn *r, uint32_t m, uint32_t a);
+void bn_pow_small(struct bn *r, uint32_t base, uint32_t e);
+bool bn_divmod(struct bn *q, struct bn *m, struct bn *a, struct bn *b);
+void bn_gcd(struct bn *r, struct bn *a, struct bn *b);
+
+void bn_shl(struct bn *r, struct bn *a, int bits);
+void bn_shr(struct bn *r, struct bn *a, int bits);
+void bn_and(struct bn *r, struct bn *a, struct bn *b);
+void bn_or(struct bn *r, struct bn *a, struct bn *b);
+void bn_xor(struct bn *r, struct bn *a, struct bn *b);
+void bn_not(struct bn *r, struct bn *a);
+
+char *bn_str(struct bn *a);
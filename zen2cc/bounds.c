@@ -0,0 +1,340 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bounds.h"
+#include "fold.h"
+#include "layout.h"
+#include "mono.h"
+#include "sema.h"
+#include "timing.h"
+
+//Range of an induction variable in the body of its loop
+struct bounds_var {
+    struct expr *local;
+    int64_t lo, hi;
+};
+
+struct bounds {
+    struct parse *p;
+    bool checked;               //Keep checks not elided, rather than only count them
+    bool report;                //Report the checks elided and kept in each function
+    struct bounds_var *vars;    //Induction variables of the loops walked into
+    int vars_n, vars_c;
+    int elided, kept;           //Checks of the definition being walked
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static bool type_range(struct type *t, int64_t *lo, int64_t *hi) {
+    return t && layout_int_range(sema_resolve(t), lo, hi);
+}
+
+//Whether lo..hi is within the range of type t, so what is computed does not
+//wrap in it
+static bool fits(struct type *t, int64_t lo, int64_t hi) {
+    int64_t min, max;
+    return type_range(t, &min, &max) && lo >= min && hi <= max;
+}
+
+static bool is_local(struct expr *e, struct expr *l) {
+    return e->type == EXPR_IDENT && e->local == l;
+}
+
+static bool range(struct bounds *b, struct expr *e, int64_t *lo, int64_t *hi);
+
+//Range of binary operator e from the ranges of its operands, in exact
+//arithmetic. False if unknown or overflowing.
+static bool op_range(struct bounds *b, struct expr *e, int64_t *lo, int64_t *hi) {
+    int64_t llo, lhi, rlo, rhi;
+    bool l = range(b, e->l, &llo, &lhi), r = range(b, e->r, &rlo, &rhi);
+
+    //Masking by a value not negative bounds the result by it, whatever the
+    //other
+    if(e->type == EXPR_BAND) {
+        if(!l || llo < 0) llo = -1, lhi = INT64_MAX;
+        if(!r || rlo < 0) rlo = -1, rhi = INT64_MAX;
+        if(llo < 0 && rlo < 0) return false;
+        *lo = 0;
+        *hi = lhi < rhi ? lhi : rhi;
+        return true;
+    }
+    if(!l || !r) return false;
+
+    switch(e->type) {
+    case EXPR_ADD:
+        return !__builtin_add_overflow(llo, rlo, lo) && !__builtin_add_overflow(lhi, rhi, hi);
+    case EXPR_SUB:
+        return !__builtin_sub_overflow(llo, rhi, lo) && !__builtin_sub_overflow(lhi, rlo, hi);
+    case EXPR_MUL: {
+        int64_t p[4];
+        if(__builtin_mul_overflow(llo, rlo, &p[0]) || __builtin_mul_overflow(llo, rhi, &p[1])
+                || __builtin_mul_overflow(lhi, rlo, &p[2]) || __builtin_mul_overflow(lhi, rhi, &p[3]))
+            return false;
+        *lo = *hi = p[0];
+        for(int i = 1; i < 4; i++) {
+            if(p[i] < *lo) *lo = p[i];
+            if(p[i] > *hi) *hi = p[i];
+        }
+        return true;
+    }
+
+    case EXPR_MOD:
+        if(llo < 0 || rlo <= 0) return false;
+        *lo = 0;
+        *hi = lhi < rhi - 1 ? lhi : rhi - 1;
+        return true;
+    case EXPR_BSR:
+        if(llo < 0 || rlo < 0 || rhi > 63) return false;
+        *lo = llo >> rhi;
+        *hi = lhi >> rlo;
+        return true;
+
+    default: return false;
+    }
+}
+
+//Range lo..hi of the values integer e may take, false if unknown. Operators
+//are only known in exact arithmetic when the result fits their type, as C
+//computes narrow types promoted to int. Values stored in a type, or cast to
+//it, are within its range.
+static bool range(struct bounds *b, struct expr *e, int64_t *lo, int64_t *hi) {
+    int64_t v;
+    if(fold_int(b->p, e, &v)) {
+        *lo = *hi = v;
+        return true;
+    }
+
+    switch(e->type) {
+    case EXPR_IDENT:
+        for(int i = b->vars_n - 1; i >= 0; i--) {
+            if(!e->local || e->local != b->vars[i].local) continue;
+            *lo = b->vars[i].lo;
+            *hi = b->vars[i].hi;
+            return true;
+        }
+        break;
+
+    case EXPR_CAST:
+        if(range(b, e->tacc.m, lo, hi) && fits(e->tacc.t, *lo, *hi)) return true;
+        return type_range(e->tacc.t, lo, hi);
+
+    case EXPR_ADD: case EXPR_SUB: case EXPR_MUL: case EXPR_BAND: case EXPR_MOD: case EXPR_BSR:
+        return op_range(b, e, lo, hi) && fits(e->ty, *lo, *hi);
+
+    case EXPR_FCALL: case EXPR_ARRSUB: case EXPR_SACC: case EXPR_DEFER: case EXPR_ASSIGN:
+    case EXPR_POSTINC: case EXPR_POSTDEC: case EXPR_PREINC: case EXPR_PREDEC:
+        break;
+
+    default: return false;
+    }
+
+    return type_range(e->ty, lo, hi);
+}
+
+//Whether local l may be written to in e, or have its address taken
+static bool writes(struct expr *e, struct expr *l) {
+    if(!e) return false;
+
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: case EXPR_TACC: return false;
+
+    case EXPR_FCALL:
+        for(int i = 0; i < e->args_n; i++) if(writes(&e->args[i], l)) return true;
+        return writes(e->f, l);
+    case EXPR_COMP_LIT: case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) if(writes(&e->vals[i], l)) return true;
+        return false;
+
+    EXPR_CASE_CTL: {
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        for(int i = 0; i < 5; i++) if(writes(c[i], l)) return true;
+        return false;
+    }
+
+    case EXPR_CAST: return writes(e->tacc.m, l);
+    case EXPR_SACC: return writes(e->l, l);
+
+    //Methods may take their receiver by pointer
+    case EXPR_POSTINC: case EXPR_POSTDEC: case EXPR_PREINC: case EXPR_PREDEC:
+    case EXPR_ADDR: case EXPR_MACC:
+        return is_local(e->l, l) || writes(e->l, l);
+
+    case EXPR_ASSIGN:
+        if(is_local(e->l, l)) return true;
+        if(e->l->type == EXPR_TUPLE)
+            for(int i = 0; i < e->l->vals_n; i++) if(is_local(&e->l->vals[i], l)) return true;
+        //fallthrough
+    case EXPR_ARRSUB: EXPR_CASE_BINARY: case EXPR_DEFINE:
+        if(writes(e->r, l)) return true;
+        //fallthrough
+    default: return writes(e->l, l);
+    }
+}
+
+//Narrow lo..hi of induction variable i, counted up if up, by comparison c
+//of the condition of its loop
+static void compare(struct bounds *b, struct expr *c, struct expr *i, bool up, int64_t *lo, int64_t *hi) {
+    if(c->type == EXPR_AND) {
+        compare(b, c->l, i, up, lo, hi);
+        compare(b, c->r, i, up, lo, hi);
+        return;
+    }
+
+    //As i <op> bound
+    enum expr_type op = c->type;
+    struct expr *bound;
+    if(op < EXPR_LT || op > EXPR_GE) return;
+    if(is_local(c->l, i)) bound = c->r;
+    else if(is_local(c->r, i)) {
+        static enum expr_type mirror[] = {
+            [EXPR_LT] = EXPR_GT, [EXPR_LE] = EXPR_GE, [EXPR_GT] = EXPR_LT, [EXPR_GE] = EXPR_LE,
+        };
+        bound = c->l;
+        op = mirror[op];
+    } else return;
+
+    int64_t blo, bhi;
+    if(!range(b, bound, &blo, &bhi) || bhi == INT64_MIN || blo == INT64_MAX) return;
+    if(up && op == EXPR_LT && bhi - 1 < *hi) *hi = bhi - 1;
+    if(up && op == EXPR_LE && bhi < *hi) *hi = bhi;
+    if(!up && op == EXPR_GT && blo + 1 > *lo) *lo = blo + 1;
+    if(!up && op == EXPR_GE && blo > *lo) *lo = blo;
+}
+
+//Induction variable of for loop e and its range in the body: defined by the
+//loop, stepped by a constant, bounded by the condition in the direction
+//counted, and written nowhere else. Its last step must not wrap, as that
+//would leave the range with the loop still running.
+static bool induction(struct bounds *b, struct expr *e, struct bounds_var *v) {
+    struct expr *init = e->ctl.init, *step = e->ctl.step, *i;
+    if(!init || !step || !e->ctl.cond || init->type != EXPR_DEFINE || init->l->type != EXPR_IDENT)
+        return false;
+    i = init->l;
+
+    int64_t c, slo, shi, min, max;
+    if(!type_range(i->ty, &min, &max) || !range(b, init->r, &slo, &shi) || !fits(i->ty, slo, shi))
+        return false;
+
+    if((step->type == EXPR_POSTINC || step->type == EXPR_PREINC) && is_local(step->l, i)) c = 1;
+    else if((step->type == EXPR_POSTDEC || step->type == EXPR_PREDEC) && is_local(step->l, i)) c = -1;
+    else if(step->type == EXPR_ASSIGN && is_local(step->l, i)
+            && (step->r->type == EXPR_ADD || step->r->type == EXPR_SUB)
+            && is_local(step->r->l, i) && fold_int(b->p, step->r->r, &c) && c > 0) {
+        if(step->r->type == EXPR_SUB) c = -c;
+    } else return false;
+
+    if(writes(e->ctl.cond, i) || writes(e->ctl.body, i)) return false;
+
+    int64_t lo = c > 0 ? slo : min, hi = c > 0 ? max : shi, last;
+    compare(b, e->ctl.cond, i, c > 0, &lo, &hi);
+    if(c > 0 ? __builtin_add_overflow(hi, c, &last) || last > max
+             : __builtin_add_overflow(lo, c, &last) || last < min)
+        return false;
+
+    *v = (struct bounds_var){i, lo, hi};
+    return true;
+}
+
+//Decide whether subscript e of an array of known length is checked
+static void check(struct bounds *b, struct expr *e) {
+    e->check = false;
+    struct type *t = e->l->ty ? sema_resolve(e->l->ty) : NULL;
+    if(!t || t->type != TYPE_ARRAY || t->n < 0) return;
+
+    int64_t lo, hi;
+    bool known = range(b, e->r, &lo, &hi);
+    if(known && lo == hi && (lo < 0 || lo >= t->n)) {
+        snprintf(err_buf, ERRBUF_SIZE, "Index %lli is out of bounds of an array of %i",
+                (long long)lo, t->n);
+        b->p->warn(b->p->ts, e->op, err_buf);
+    }
+
+    if(known && lo >= 0 && hi < t->n) {
+        timing_count(TIMING_BOUNDS, 1);
+        b->elided++;
+        return;
+    }
+    b->kept++;
+    e->check = b->checked;
+}
+
+static void walk(struct bounds *b, struct expr *e) {
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: case EXPR_TACC: return;
+
+    case EXPR_FCALL:
+        walk(b, e->f);
+        for(int i = 0; i < e->args_n; i++) walk(b, &e->args[i]);
+        return;
+    case EXPR_COMP_LIT: case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) walk(b, &e->vals[i]);
+        return;
+
+    //The range of an induction variable holds in the body of its loop
+    EXPR_CASE_CTL: {
+        struct bounds_var v;
+        bool ind = e->type == EXPR_FOR && induction(b, e, &v);
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step};
+        for(int i = 0; i < 3; i++) if(c[i]) walk(b, c[i]);
+
+        if(ind) {
+            if(b->vars_n == b->vars_c) {
+                b->vars_c = b->vars_c ? b->vars_c * 2 : 8;
+                b->vars = realloc(b->vars, b->vars_c * sizeof *b->vars);
+                assert(b->vars);
+            }
+            b->vars[b->vars_n++] = v;
+        }
+        if(e->ctl.body) walk(b, e->ctl.body);
+        if(ind) b->vars_n--;
+        if(e->ctl.els) walk(b, e->ctl.els);
+        return;
+    }
+
+    case EXPR_CAST: walk(b, e->tacc.m); return;
+    case EXPR_SACC: case EXPR_MACC: walk(b, e->l); return;
+    case EXPR_ARRSUB: check(b, e); //fallthrough
+    EXPR_CASE_BINARY: case EXPR_ASSIGN: case EXPR_DEFINE:
+        walk(b, e->r);
+        //fallthrough
+    default: walk(b, e->l); return;
+    }
+}
+
+static void walk_func(struct bounds *b, char *name, struct val *v) {
+    b->elided = b->kept = 0;
+    walk(b, &v->func_expr);
+    if(!b->report || b->elided + b->kept == 0) return;
+
+    snprintf(err_buf, ERRBUF_SIZE, "Bounds checks of '%s': %i elided, %i kept",
+            name, b->elided, b->kept);
+    b->p->warn(b->p->ts, expr_tok(&v->func_expr), err_buf);
+}
+
+//Decide which subscripts of arrays of known length are checked, after
+//sema() and monomorphize(). Checks are only kept if checked, and counts of
+//those elided and kept in each function reported through p->warn if report.
+//Constant indices out of bounds are warned of. Returns number of errors.
+int bounds(struct parse *p, bool checked, bool report) {
+    assert(p);
+
+    timing_start(TIMING_BOUNDS);
+
+    struct bounds b = {p, checked, report};
+
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type == VAL_VAR) walk(&b, &v->expr);
+        else if(v->type == VAL_FUNC && !func_is_generic(v)) walk_func(&b, p->globals.key[i], v);
+    }
+    for(int i = 0; i < p->methods.n; i++)
+        if(!func_is_generic(&p->methods.val[i])) walk_func(&b, p->methods.key[i], &p->methods.val[i]);
+    for(int i = 0; i < p->instances.n; i++) walk_func(&b, p->instances.name[i], p->instances.inst[i]);
+
+    free(b.vars);
+    timing_stop(TIMING_BOUNDS);
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "parse.h"
+
+//Bounds checks of subscripts of arrays of known length, in checked mode. A
+//check is elided where the range of the index is proven to be within the
+//array: constants, integers too narrow to leave it, and loop induction
+//variables, counted by one or a constant step from a constant start toward
+//a bound of known range, and not otherwise written, along with sums,
+//differences, products, masks, remainders and shifts of those.
+//
+//Checks kept are marked in e->check of the EXPR_ARRSUB, which the C backend
+//emits as a trap when the index is out of bounds.
+
+int bounds(struct parse *p, bool checked, bool report);
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "build.h"
+#include "timing.h"
+
+#define PATH_SIZE 4096
+
+//Arguments the compiler gets before the flags given, to make an object of C
+//read from stdin
+static char *defaults[] = {"-std=gnu11", "-c", "-x", "c"};
+#define DEFAULTS_N (int)(sizeof defaults / sizeof *defaults)
+
+//Add the identity of compiler cc to k: the file run, with its size and time
+//of modification, so an upgraded compiler misses the cache
+static void key_compiler(struct cache_key *k, char *cc) {
+    char path[PATH_SIZE];
+    struct stat st;
+    bool found = false;
+
+    if(strchr(cc, '/')) {
+        snprintf(path, PATH_SIZE, "%s", cc);
+        found = stat(path, &st) == 0;
+    } else {
+        char *dirs = getenv("PATH");
+        while(dirs && *dirs && !found) {
+            size_t n = strcspn(dirs, ":");
+            int len = snprintf(path, PATH_SIZE, "%.*s/%s", (int)n, n ? dirs : ".", cc);
+            found = len > 0 && len < PATH_SIZE && stat(path, &st) == 0 && S_ISREG(st.st_mode)
+                && access(path, X_OK) == 0;
+            dirs += n + (dirs[n] == ':');
+        }
+    }
+
+    cache_key_add(k, cc, strlen(cc) + 1);
+    if(!found) return;
+    cache_key_add(k, path, strlen(path) + 1);
+    cache_key_add(k, &st.st_size, sizeof st.st_size);
+    cache_key_add(k, &st.st_mtime, sizeof st.st_mtime);
+}
+
+void build_init(struct build *b, char *cc, char **flags, int flags_n, char *cache_dir, int jobs) {
+    assert(b); assert(cc); assert(flags || !flags_n); assert(jobs > 0);
+    *b = (struct build){.cc = cc, .flags = flags, .flags_n = flags_n, .cache_dir = cache_dir,
+        .jobs_max = jobs};
+    b->jobs = malloc(sizeof(struct build_job) * jobs);
+    assert(b->jobs);
+
+    //A compiler exiting early shows in its status, not as a signal to us
+    signal(SIGPIPE, SIG_IGN);
+
+    cache_key_init(&b->key, "obj");
+    key_compiler(&b->key, cc);
+    for(int i = 0; i < flags_n; i++) cache_key_add(&b->key, flags[i], strlen(flags[i]) + 1);
+
+    char cwd[PATH_SIZE];
+    if(getcwd(cwd, PATH_SIZE)) cache_key_add(&b->key, cwd, strlen(cwd) + 1);
+}
+
+static bool write_all(int fd, const char *s, size_t len) {
+    for(size_t done = 0; done < len;) {
+        ssize_t w = write(fd, s + done, len - done);
+        if(w < 0 && errno == EINTR) continue;
+        if(w <= 0) return false;
+        done += w;
+    }
+    return true;
+}
+
+//Write the object of a cache hit out to its file
+static bool write_obj(char *obj, struct cache_blob *blob) {
+    int fd = open(obj, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0) return false;
+    bool ok = write_all(fd, blob->data, blob->len);
+    if(close(fd) != 0) ok = false;
+    if(!ok) unlink(obj);
+    return ok;
+}
+
+//Store the object a compiler made in the cache
+static void store_obj(struct build *b, struct build_job *j) {
+    int fd = open(j->obj, O_RDONLY);
+    if(fd < 0) return;
+
+    struct stat st;
+    char *data = NULL;
+    bool ok = fstat(fd, &st) == 0 && st.st_size > 0;
+    if(ok) {
+        data = malloc(st.st_size);
+        assert(data);
+        for(off_t done = 0; ok && done < st.st_size;) {
+            ssize_t r = read(fd, data + done, st.st_size - done);
+            if(r < 0 && errno == EINTR) continue;
+            ok = r > 0;
+            done += ok ? r : 0;
+        }
+    }
+    close(fd);
+
+    if(ok) cache_put(b->cache_dir, &j->key, data, st.st_size);
+    free(data);
+}
+
+//Wait for a compiler to finish, caching its object if it succeeded
+static void reap(struct build *b) {
+    assert(b->jobs_n > 0);
+
+    int status;
+    pid_t pid = wait(&status);
+    if(pid < 0 && errno == EINTR) return;
+    assert(pid > 0);
+
+    int i = 0;
+    while(i < b->jobs_n && b->jobs[i].pid != pid) i++;
+    if(i == b->jobs_n) return;
+    struct build_job *j = &b->jobs[i];
+
+    if(WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        if(b->cache_dir) store_obj(b, j);
+    } else {
+        fprintf(stderr, "ERR: C compiler failed making \"%s\"\n", j->obj);
+        b->failed++;
+    }
+
+    free(j->obj);
+    *j = b->jobs[--b->jobs_n];
+}
+
+//Compile len bytes of C to object file obj, or take it from the cache. The
+//compiler may still be running on return, c can be freed.
+void build_add(struct build *b, const char *c, size_t len, char *obj) {
+    assert(b); assert(c || !len); assert(obj);
+
+    struct cache_key k = b->key;
+    cache_key_add(&k, c, len);
+
+    if(b->cache_dir) {
+        timing_start(TIMING_CC_HIT);
+        struct cache_blob blob;
+        bool hit = cache_get(b->cache_dir, &k, &blob);
+        if(hit) {
+            if(!write_obj(obj, &blob)) {
+                fprintf(stderr, "ERR: Could not write file \"%s\"\n", obj);
+                b->failed++;
+            }
+            cache_release(&blob);
+        }
+        timing_stop(TIMING_CC_HIT);
+        if(hit) {
+            timing_count(TIMING_CC_HIT, 1);
+            return;
+        }
+    }
+
+    timing_start(TIMING_CC);
+    while(b->jobs_n == b->jobs_max) reap(b);
+
+    char *argv[DEFAULTS_N + b->flags_n + 5];
+    int argc = 0;
+    argv[argc++] = b->cc;
+    for(int i = 0; i < DEFAULTS_N; i++) argv[argc++] = defaults[i];
+    for(int i = 0; i < b->flags_n; i++) argv[argc++] = b->flags[i];
+    argv[argc++] = "-o";
+    argv[argc++] = obj;
+    argv[argc++] = "-";
+    argv[argc] = NULL;
+
+    int fds[2];
+    pid_t pid = -1;
+    if(pipe(fds) == 0) {
+        fflush(stderr);
+        pid = fork();
+        if(pid == 0) {
+            dup2(fds[0], STDIN_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execvp(b->cc, argv);
+            fprintf(stderr, "ERR: Could not run C compiler \"%s\"\n", b->cc);
+            _exit(127);
+        }
+        close(fds[0]);
+        if(pid < 0) close(fds[1]);
+    }
+
+    if(pid < 0) {
+        fprintf(stderr, "ERR: Could not run C compiler \"%s\"\n", b->cc);
+        b->failed++;
+    } else {
+        b->jobs[b->jobs_n++] = (struct build_job){pid, strdup(obj), k};
+        assert(b->jobs[b->jobs_n - 1].obj);
+
+        //A failed write means the compiler exited, which reap() reports
+        write_all(fds[1], c, len);
+        close(fds[1]);
+        timing_count(TIMING_CC, 1);
+    }
+    timing_stop(TIMING_CC);
+}
+
+//Wait for all compilers, returning how many objects could not be made
+int build_finish(struct build *b) {
+    assert(b);
+    timing_start(TIMING_CC);
+    while(b->jobs_n) reap(b);
+    timing_stop(TIMING_CC);
+
+    free(b->jobs);
+    b->jobs = NULL;
+    return b->failed;
+}
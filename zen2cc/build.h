@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "cache.h"
+
+//Compiles emitted C to objects with the system C compiler, like a built in
+//ccache. The C reaches the compiler through a pipe to its stdin, never a
+//temporary file, and up to jobs compilers run at once while the next modules
+//are translated.
+//
+//With a cache directory, each object is stored under a key hashing the C,
+//the compiler, its flags and the working directory debug info records, so a
+//module whose C did not change is copied out of the cache instead.
+
+#define BUILD_CC "cc"           //C compiler when $CC is not set
+
+struct build_job {
+    pid_t pid;
+    char *obj;                  //Object file written
+    struct cache_key key;
+};
+
+struct build {
+    char *cc;
+    char **flags;               //Given to the compiler after its defaults
+    int flags_n;
+    char *cache_dir;            //Or NULL not to cache objects
+    struct cache_key key;       //Of everything but the C
+    struct build_job *jobs;     //Compilers running
+    int jobs_n, jobs_max;
+    int failed;
+};
+
+void build_init(struct build *b, char *cc, char **flags, int flags_n, char *cache_dir, int jobs);
+void build_add(struct build *b, const char *c, size_t len, char *obj);
+int build_finish(struct build *b);
@@ -0,0 +1,126 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "common.h"
+
+//Keys hash everything they are built from in two independent 64 bit lanes,
+//so a stale hit needs a 128 bit collision. Every key includes the compiler
+//version and the domain of what is cached.
+
+#define PATH_SIZE 4096
+
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+void cache_key_init(struct cache_key *k, char *domain) {
+    assert(k); assert(domain);
+    k->h[0] = 0xcbf29ce484222325ull;
+    k->h[1] = 0x9e3779b97f4a7c15ull;
+    cache_key_add(k, ZEN2CC_VERSION, sizeof ZEN2CC_VERSION);
+    cache_key_add(k, domain, strlen(domain) + 1);
+}
+
+void cache_key_add(struct cache_key *k, const void *data, size_t len) {
+    assert(k);
+    const unsigned char *s = data;
+    uint64_t a = k->h[0], b = k->h[1];
+    for(size_t i = 0; i < len; i++) {
+        a = (a ^ s[i]) * 0x100000001b3ull;
+        b = (b + s[i]) * 0xbf58476d1ce4e5b9ull;
+        b ^= b >> 31;
+    }
+    k->h[0] = a;
+    k->h[1] = b;
+}
+
+//Path of key k, with the directory ending at *sep
+static bool cache_path(char *dir, struct cache_key *k, char *path, char **sep) {
+    uint64_t a = mix(k->h[0] ^ mix(k->h[1])), b = mix(k->h[1] + a);
+    int n = snprintf(path, PATH_SIZE, "%s/%02x/%014llx%016llx", dir, (unsigned)(a >> 56),
+            (unsigned long long)(a & 0xffffffffffffffull), (unsigned long long)b);
+    if(n < 0 || n >= PATH_SIZE) return false;
+    *sep = path + strlen(dir) + 3;
+    return true;
+}
+
+//Map the blob stored under k. Returns false if there is none.
+bool cache_get(char *dir, struct cache_key *k, struct cache_blob *b) {
+    assert(dir); assert(k); assert(b);
+
+    char path[PATH_SIZE], *sep;
+    if(!cache_path(dir, k, path, &sep)) return false;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    b->len = st.st_size;
+    b->data = mmap(NULL, b->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    return b->data != MAP_FAILED;
+}
+
+void cache_release(struct cache_blob *b) {
+    if(!b || !b->data) return;
+    munmap(b->data, b->len);
+    b->data = NULL;
+}
+
+//Store data under k. The file is written aside and renamed in to place, so
+//readers never see part of a blob. Returns false if it could not be stored.
+bool cache_put(char *dir, struct cache_key *k, const void *data, size_t len) {
+    assert(dir); assert(k); assert(data || !len);
+
+    char path[PATH_SIZE], tmp[PATH_SIZE], *sep;
+    if(!cache_path(dir, k, path, &sep)) return false;
+
+    *sep = '\0';
+    if(mkdir(dir, 0777) != 0 && errno != EEXIST) return false;
+    if(mkdir(path, 0777) != 0 && errno != EEXIST) return false;
+    *sep = '/';
+
+    int n = snprintf(tmp, PATH_SIZE, "%s.%ld", path, (long)getpid());
+    if(n < 0 || n >= PATH_SIZE) return false;
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0) return false;
+
+    const char *s = data;
+    for(size_t done = 0; done < len;) {
+        ssize_t w = write(fd, s + done, len - done);
+        if(w < 0 && errno == EINTR) continue;
+        if(w <= 0) {
+            close(fd);
+            unlink(tmp);
+            return false;
+        }
+        done += w;
+    }
+
+    if(close(fd) != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Persistent content addressed store of blobs on disk. A blob is written once
+//as <dir>/<first 2 hex digits of key>/<rest of key>, and read back by
+//mapping the file, so its layout should be usable in place.
+
+struct cache_key {
+    uint64_t h[2];
+};
+
+struct cache_blob {
+    void *data;
+    size_t len;
+};
+
+void cache_key_init(struct cache_key *k, char *domain);
+void cache_key_add(struct cache_key *k, const void *data, size_t len);
+bool cache_get(char *dir, struct cache_key *k, struct cache_blob *b);
+void cache_release(struct cache_blob *b);
+bool cache_put(char *dir, struct cache_key *k, const void *data, size_t len);
@@ -1 +1,5 @@
-#pragma ONCE
+#pragma once
+
+//Version of the compiler, part of the key of everything it caches on disk.
+//Bump it whenever cached results would change.
+#define ZEN2CC_VERSION "zen2cc 0.1.0"
@@ -0,0 +1,981 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "ct.h"
+#include "cval.h"
+#include "parse.h"
+#include "timing.h"
+
+//Compile time execution. Each # line is compiled to bytecode for the vm in a
+//single pass over its expression, with registers allocated as a stack, and
+//run straight away. Consts used at compile time are compiled in place from
+//their definition, as they are not folded until the whole file is parsed.
+//
+//Lines with loops may take a while, so with a cache directory set their
+//results are kept on disk, keyed by the program run and its inputs.
+
+//Builtins, in the order registered by ct_init()
+enum {CT_WARN, CT_ERR, CT_SOURCE, CT_BUILTIN_MAX};
+static char *ct_builtin_str[CT_BUILTIN_MAX] = {"warn", "err", "source"};
+
+struct ctc {
+    struct parse *p;
+    struct ct *ct;
+    struct vm_code code;
+    int reg_n;
+
+    struct val *consts[CT_CONST_DEPTH];     //Consts being compiled
+    int consts_n;
+
+    struct token at;            //Keyword of the innermost for or block, for its empty parts
+
+    struct {struct token name; int reg;} locals[CT_LOCALS_MAX];    //In scope, innermost last
+    int locals_n;
+    int scope;                  //First local of the innermost for or block, -1 outside any
+
+    int errnum;
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static bool tok_is(struct token t, char *s) {
+    return t.len == strlen(s) && strncmp(t.str, s, t.len) == 0;
+}
+
+static bool tok_eq(struct token a, struct token b) {
+    return a.len == b.len && memcmp(a.str, b.str, a.len) == 0;
+}
+
+static void ct_error(struct ctc *c, struct token t, char *msg) {
+    c->p->error(c->p->ts, t, msg);
+    c->errnum++;
+}
+
+//Format args[0] with the rest of args, replacing each %s (or %i, %f) with
+//the next argument and %% with %. Returns an error, or NULL with the
+//malloc'd result in out.
+static char *ct_format(struct vm_val *args, int n, char **out) {
+    if(n < 1 || args[0].type != VM_STR) return "Expected format string";
+
+    struct vm_str *f = args[0].s;
+    size_t len = 0, cap = f->len + 1;
+    char *s = malloc(cap);
+    assert(s);
+
+    int arg = 1;
+    for(uint32_t i = 0; i < f->len; i++) {
+        char *part = NULL, ch = f->s[i];
+        if(ch == '%' && i + 1 < f->len) {
+            char spec = f->s[++i];
+            if(spec == 's' || spec == 'i' || spec == 'f') {
+                if(arg >= n) {
+                    free(s);
+                    return "Not enough arguments for format";
+                }
+                part = vm_val_str(&args[arg++]);
+            } else if(spec != '%') {
+                i--;
+            }
+        }
+
+        size_t part_len = part ? strlen(part) : 1;
+        if(len + part_len + 1 > cap) {
+            cap = (len + part_len + 1) * 2;
+            s = realloc(s, cap);
+            assert(s);
+        }
+        if(part) memcpy(s + len, part, part_len);
+        else s[len] = ch;
+        len += part_len;
+        free(part);
+    }
+
+    s[len] = '\0';
+    if(arg < n) {
+        free(s);
+        return "Too many arguments for format";
+    }
+
+    *out = s;
+    return NULL;
+}
+
+//warn(fmt, ...) reports a warning and continues
+static char *ct_warn(struct vm *vm, struct vm_val *args, int n, struct vm_val *ret) {
+    struct parse *p = vm->ctx;
+    char *msg, *err = ct_format(args, n, &msg);
+    if(err) return err;
+
+    p->warn(p->ts, vm->tok, msg);
+
+    struct ct *ct = &p->ct;
+    if(ct->warns_n == ct->warns_c) {
+        ct->warns_c = ct->warns_c ? ct->warns_c * 2 : 8;
+        ct->warns = realloc(ct->warns, sizeof(*ct->warns) * ct->warns_c);
+        assert(ct->warns);
+    }
+    ct->warns[ct->warns_n].pc = vm->pc;
+    ct->warns[ct->warns_n++].msg = msg;
+    return NULL;
+}
+
+//err(fmt, ...) reports an error and stops the # line
+static char *ct_err(struct vm *vm, struct vm_val *args, int n, struct vm_val *ret) {
+    char *msg, *err = ct_format(args, n, &msg);
+    if(err) return err;
+
+    snprintf(err_buf, ERRBUF_SIZE, "%s", msg);
+    free(msg);
+    return err_buf;
+}
+
+static void ct_source_add(struct ct *ct, char *s, size_t len) {
+    if(ct->source_len + len > ct->source_cap) {
+        ct->source_cap = (ct->source_len + len) * 2;
+        ct->source = realloc(ct->source, ct->source_cap);
+        assert(ct->source);
+    }
+    memcpy(ct->source + ct->source_len, s, len);
+    ct->source_len += len;
+}
+
+//source(fmt, ...) adds code to the file, after the # line. Lines of compile
+//time code without # call it with their text.
+static char *ct_source(struct vm *vm, struct vm_val *args, int n, struct vm_val *ret) {
+    struct parse *p = vm->ctx;
+    struct ct *ct = &p->ct;
+    char *text, *err = ct_format(args, n, &text);
+    if(err) return err;
+
+    size_t len = strlen(text);
+    if(vm->mem + len > vm->mem_max) {
+        free(text);
+        return "Compile time memory budget exceeded";
+    }
+    vm->mem += len;
+
+    if(!ct->source_len) ct->source_pc = vm->pc;
+    ct_source_add(ct, text, len);
+    free(text);
+    return NULL;
+}
+
+void ct_init(struct ct *ct) {
+    assert(ct);
+
+    *ct = (struct ct){{0}};
+    vm_init(&ct->vm);
+
+    int warn = vm_builtin_add(&ct->vm, ct_warn);
+    int err = vm_builtin_add(&ct->vm, ct_err);
+    int source = vm_builtin_add(&ct->vm, ct_source);
+    assert(warn == CT_WARN && err == CT_ERR && source == CT_SOURCE);
+}
+
+void ct_free(struct ct *ct) {
+    if(!ct) return;
+    for(int i = 0; i < ct->names_n; i++) free(ct->names[i]);
+    free(ct->names);
+    free(ct->warns);
+    free(ct->source);
+    vm_free(&ct->vm);
+}
+
+//Global of the compile time variable t, or -1
+static int ct_lookup(struct ct *ct, struct token t) {
+    for(int i = 0; i < ct->names_n; i++)
+        if(tok_is(t, ct->names[i])) return i;
+    return -1;
+}
+
+static int ct_var(struct ct *ct, char *name) {
+    if(ct->names_n == ct->names_c) {
+        ct->names_c = ct->names_c ? ct->names_c * 2 : 16;
+        ct->names = realloc(ct->names, sizeof(*ct->names) * ct->names_c);
+        assert(ct->names);
+    }
+    ct->names[ct->names_n++] = name;
+
+    int g = vm_global(&ct->vm);
+    assert(g == ct->names_n - 1);
+    return g;
+}
+
+//Define the compile time variable name as value, as an integer or float if
+//it reads as one and a string otherwise
+void ct_define(struct ct *ct, char *name, char *value) {
+    assert(ct); assert(name); assert(value);
+
+    struct token t = {TOKEN_IDENT, name, strlen(name)};
+    int g = ct_lookup(ct, t);
+    if(g < 0) g = ct_var(ct, strdup(name));
+
+    char *end;
+    struct vm_val v = {VM_INT, .i = strtoll(value, &end, 0)};
+    if(*end || !*value) v = (struct vm_val){VM_FLOAT, .f = strtod(value, &end)};
+    if(*end || !*value) v = (struct vm_val){VM_STR, .s = vm_str(&ct->vm, value, strlen(value))};
+    assert(v.type != VM_STR || v.s);
+
+    ct->vm.g[g] = v;
+}
+
+//Print compile time variables and their final values
+void ct_print(struct out *o, struct ct *ct) {
+    static char *types[] = {"VOID", "INT", "FLOAT", "STR"};
+    for(int i = 0; i < ct->names_n; i++) {
+        struct vm_val *v = &ct->vm.g[i];
+        out_str(o, ct->names[i]);
+        out_str(o, ": ");
+        out_str(o, types[v->type]);
+        if(v->type != VM_VOID) {
+            char *s = vm_val_str(v);
+            out_str(o, v->type == VM_STR ? " \"" : " ");
+            out_str(o, s);
+            if(v->type == VM_STR) out_char(o, '"');
+            free(s);
+        }
+        out_char(o, '\n');
+    }
+}
+
+//Allocate a register, returning -1 after reporting an error if there are
+//none left
+static int reg(struct ctc *c, struct token t) {
+    if(c->reg_n >= VM_REG_MAX) {
+        ct_error(c, t, "Compile time expression too complex");
+        return -1;
+    }
+    c->reg_n++;
+    if(c->reg_n > c->code.regs) c->code.regs = c->reg_n;
+    return c->reg_n - 1;
+}
+
+static int emit(struct ctc *c, vm_ins i, struct token t) {
+    return vm_emit(&c->code, i, t);
+}
+
+static bool load_const(struct ctc *c, int dst, struct vm_val k, struct token t) {
+    if(c->code.k_n > 0xffff) {
+        ct_error(c, t, "Compile time expression too large");
+        return false;
+    }
+    emit(c, VM_INSX(VM_LOADK, dst, vm_const(&c->code, k)), t);
+    return true;
+}
+
+//Jump instruction from j to the next instruction emitted
+static bool patch(struct ctc *c, int j) {
+    int off = c->code.n - (j + 1);
+    if(off > VM_SBX_MAX) {
+        ct_error(c, c->code.tok[j], "Compile time expression too large");
+        return false;
+    }
+    c->code.ins[j] = (c->code.ins[j] & 0xffff) | (vm_ins)(off + 0x8000) << 16;
+    return true;
+}
+
+static bool jump_back(struct ctc *c, int to, struct token t) {
+    int off = to - (c->code.n + 1);
+    if(off < -0x8000) {
+        ct_error(c, t, "Compile time expression too large");
+        return false;
+    }
+    emit(c, VM_INSX(VM_JMP, 0, off + 0x8000), t);
+    return true;
+}
+
+static bool compile(struct ctc *c, struct expr *e, int dst);
+
+//Locals and registers of the code around a for or block, restored by leave()
+struct ct_scope {
+    int locals_n, scope, reg_n;
+};
+
+static struct ct_scope enter(struct ctc *c) {
+    struct ct_scope s = {c->locals_n, c->scope, c->reg_n};
+    c->scope = c->locals_n;
+    return s;
+}
+
+static void leave(struct ctc *c, struct ct_scope s) {
+    c->locals_n = s.locals_n, c->scope = s.scope, c->reg_n = s.reg_n;
+}
+
+//Register of the local t, or -1
+static int local(struct ctc *c, struct token t) {
+    for(int i = c->locals_n - 1; i >= 0; i--)
+        if(tok_eq(c->locals[i].name, t)) return c->locals[i].reg;
+    return -1;
+}
+
+//Compile time variable: a local in a register, or global g
+struct ct_ref {
+    int reg, g;
+};
+
+static void load_ref(struct ctc *c, struct ct_ref r, int dst, struct token t) {
+    if(r.reg >= 0) emit(c, VM_INS(VM_MOV, dst, r.reg, 0), t);
+    else emit(c, VM_INSX(VM_LOADG, dst, r.g), t);
+}
+
+static void store_ref(struct ctc *c, struct ct_ref r, int src, struct token t) {
+    if(r.reg >= 0) emit(c, VM_INS(VM_MOV, r.reg, src, 0), t);
+    else emit(c, VM_INSX(VM_STOREG, src, r.g), t);
+}
+
+static bool compile_num(struct ctc *c, struct expr *e, int dst) {
+    struct cval v;
+    cval_init(&v);
+
+    char *err = cval_parse(&v, e->lit);
+    if(err) {
+        ct_error(c, e->lit, err);
+        cval_free(&v);
+        return false;
+    }
+
+    int64_t i;
+    struct vm_val k;
+    if(v.type == CVAL_INT && bn_to_int64(&v.num, &i)) k = (struct vm_val){VM_INT, .i = i};
+    else k = (struct vm_val){VM_FLOAT, .f = cval_to_double(&v)};
+    cval_free(&v);
+
+    return load_const(c, dst, k, e->lit);
+}
+
+//String literal, with escapes processed for "..."
+static bool compile_str(struct ctc *c, struct expr *e, int dst) {
+    struct token t = e->lit;
+    char *s = malloc(t.len + 1);
+    assert(s);
+    size_t n = token_unescape(t, s);
+
+    struct vm_str *str = vm_str(&c->ct->vm, s, n);
+    free(s);
+    if(!str) {
+        ct_error(c, t, "Compile time memory budget exceeded");
+        return false;
+    }
+
+    return load_const(c, dst, (struct vm_val){VM_STR, .s = str}, t);
+}
+
+//Compile time variables, then FILE and LINE, then consts
+static bool compile_ident(struct ctc *c, struct expr *e, int dst) {
+    struct token t = e->lit;
+
+    int r = local(c, t), g = r < 0 ? ct_lookup(c->ct, t) : -1;
+    if(r >= 0 || g >= 0) {
+        load_ref(c, (struct ct_ref){r, g}, dst, t);
+        return true;
+    }
+
+    if(tok_is(t, "FILE")) {
+        char *path = c->p->ts->path;
+        struct vm_str *s = vm_str(&c->ct->vm, path, strlen(path));
+        if(!s) {
+            ct_error(c, t, "Compile time memory budget exceeded");
+            return false;
+        }
+        return load_const(c, dst, (struct vm_val){VM_STR, .s = s}, t);
+    }
+
+    if(tok_is(t, "LINE")) {
+        int row, col;
+        token_pos(c->p->ts, t, &row, &col);
+        return load_const(c, dst, (struct vm_val){VM_INT, .i = row}, t);
+    }
+
+    char *ident = token_str(t);
+    struct val *v = ns_get(&c->p->globals, ident);
+    free(ident);
+
+    if(!v || v->type != VAL_CONST) {
+        snprintf(err_buf, ERRBUF_SIZE, "'%.*s' is not defined at compile time", t.len, t.str);
+        ct_error(c, t, err_buf);
+        return false;
+    }
+
+    for(int i = 0; i < c->consts_n; i++) {
+        if(c->consts[i] == v) {
+            snprintf(err_buf, ERRBUF_SIZE, "Cyclic definition of '%.*s'", t.len, t.str);
+            ct_error(c, t, err_buf);
+            return false;
+        }
+    }
+
+    if(c->consts_n >= CT_CONST_DEPTH) {
+        ct_error(c, t, "Consts nested too deeply");
+        return false;
+    }
+
+    //Consts do not see the locals of where they are used
+    int locals_n = c->locals_n;
+    c->consts[c->consts_n++] = v;
+    c->locals_n = 0;
+    bool ok = compile(c, &v->expr, dst);
+    c->locals_n = locals_n;
+    c->consts_n--;
+    return ok;
+}
+
+static int binary_op(enum expr_type t, bool *swap) {
+    *swap = false;
+    switch(t) {
+    case EXPR_MUL: return VM_MUL;
+    case EXPR_DIV: return VM_DIV;
+    case EXPR_MOD: return VM_MOD;
+    case EXPR_ADD: return VM_ADD;
+    case EXPR_SUB: return VM_SUB;
+    case EXPR_BSL: return VM_SHL;
+    case EXPR_BSR: return VM_SHR;
+    case EXPR_LT: return VM_LT;
+    case EXPR_LE: return VM_LE;
+    case EXPR_GT: *swap = true; return VM_LT;
+    case EXPR_GE: *swap = true; return VM_LE;
+    case EXPR_EQ: return VM_EQ;
+    case EXPR_NE: return VM_NE;
+    case EXPR_BAND: return VM_BAND;
+    case EXPR_XOR: return VM_XOR;
+    case EXPR_BOR: return VM_BOR;
+    default: assert(0); return 0;
+    }
+}
+
+//Short circuit && and ||, valued 0 or 1
+static bool compile_logic(struct ctc *c, struct expr *e, int dst) {
+    int jmp = e->type == EXPR_AND ? VM_JMPF : VM_JMPT;
+
+    if(!compile(c, e->l, dst)) return false;
+    int j0 = emit(c, VM_INSX(jmp, dst, 0), e->op);
+    if(!compile(c, e->r, dst)) return false;
+    int j1 = emit(c, VM_INSX(jmp, dst, 0), e->op);
+
+    if(!load_const(c, dst, (struct vm_val){VM_INT, .i = e->type == EXPR_AND}, e->op)) return false;
+    int j2 = emit(c, VM_INSX(VM_JMP, 0, 0), e->op);
+
+    if(!patch(c, j0) || !patch(c, j1)) return false;
+    if(!load_const(c, dst, (struct vm_val){VM_INT, .i = e->type != EXPR_AND}, e->op)) return false;
+    return patch(c, j2);
+}
+
+static bool compile_binary(struct ctc *c, struct expr *e, int dst) {
+    if(e->type == EXPR_AND || e->type == EXPR_OR) return compile_logic(c, e, dst);
+
+    bool swap;
+    int op = binary_op(e->type, &swap);
+
+    int r = reg(c, e->op);
+    if(r < 0 || !compile(c, e->l, dst) || !compile(c, e->r, r)) return false;
+
+    if(swap) emit(c, VM_INS(op, dst, r, dst), e->op);
+    else emit(c, VM_INS(op, dst, dst, r), e->op);
+
+    c->reg_n--;
+    return true;
+}
+
+//Compile time variable assigned to by l, with g -1 after reporting an error
+//if there is none
+static struct ct_ref assign_target(struct ctc *c, struct expr *l) {
+    struct ct_ref r = {-1, -1};
+    if(l->type == EXPR_IDENT) {
+        r.reg = local(c, l->lit);
+        if(r.reg < 0) r.g = ct_lookup(c->ct, l->lit);
+    }
+    if(r.reg < 0 && r.g < 0) ct_error(c, expr_tok(l), "Only compile time variables can be assigned at compile time");
+    return r;
+}
+
+//Variable defined by l: a global at the top level of a line, otherwise a
+//local of the innermost for or block
+static struct ct_ref define_target(struct ctc *c, struct expr *l) {
+    struct token t = l->lit;
+    if(c->scope < 0) {
+        int g = ct_lookup(c->ct, t);
+        return (struct ct_ref){-1, g >= 0 ? g : ct_var(c->ct, token_str(t))};
+    }
+
+    for(int i = c->scope; i < c->locals_n; i++)
+        if(tok_eq(c->locals[i].name, t)) return (struct ct_ref){c->locals[i].reg, -1};
+
+    if(c->locals_n == CT_LOCALS_MAX) {
+        ct_error(c, t, "Too many compile time locals");
+        return (struct ct_ref){-1, -1};
+    }
+    int r = reg(c, t);
+    if(r >= 0) {
+        c->locals[c->locals_n].name = t;
+        c->locals[c->locals_n++].reg = r;
+    }
+    return (struct ct_ref){r, -1};
+}
+
+static bool compile_assign(struct ctc *c, struct expr *e, int dst) {
+    struct ct_ref r;
+    if(e->type == EXPR_DEFINE) {
+        if(!compile(c, e->r, dst)) return false;
+        r = define_target(c, e->l);
+    } else {
+        r = assign_target(c, e->l);
+        if(r.reg < 0 && r.g < 0) return false;
+        if(!compile(c, e->r, dst)) return false;
+    }
+    if(r.reg < 0 && r.g < 0) return false;
+
+    if(r.g > 0xffff) {
+        ct_error(c, e->op, "Too many compile time variables");
+        return false;
+    }
+
+    store_ref(c, r, dst, e->op);
+    return true;
+}
+
+//++ and --, valued as before (postfix) or after (prefix) the step
+static bool compile_step(struct ctc *c, struct expr *e, int dst) {
+    struct ct_ref r = assign_target(c, e->l);
+    if(r.reg < 0 && r.g < 0) return false;
+    int one = reg(c, e->op);
+    if(one < 0) return false;
+
+    int op = e->type == EXPR_PREINC || e->type == EXPR_POSTINC ? VM_ADD : VM_SUB;
+    bool post = e->type == EXPR_POSTINC || e->type == EXPR_POSTDEC;
+
+    load_ref(c, r, dst, e->op);
+    if(!load_const(c, one, (struct vm_val){VM_INT, .i = 1}, e->op)) return false;
+    if(post) {
+        emit(c, VM_INS(op, one, dst, one), e->op);
+        store_ref(c, r, one, e->op);
+    } else {
+        emit(c, VM_INS(op, dst, dst, one), e->op);
+        store_ref(c, r, dst, e->op);
+    }
+
+    c->reg_n--;
+    return true;
+}
+
+static bool compile_cast(struct ctc *c, struct expr *e, int dst) {
+    struct type *t = e->tacc.t;
+    if(t->type != TYPE_PRIMATIVE || t->primative == TYPE_VOID) {
+        ct_error(c, expr_tok(e->tacc.m), "Cast is not available at compile time");
+        return false;
+    }
+
+    if(!compile(c, e->tacc.m, dst)) return false;
+    emit(c, VM_INS(VM_CAST, dst, dst, t->primative), expr_tok(e->tacc.m));
+    return true;
+}
+
+//Line of compile time code without #, run as source("%s", line)
+static bool compile_source(struct ctc *c, struct expr *e, int dst) {
+    struct token t = e->lit;
+    int base = c->reg_n;
+    if(reg(c, t) < 0 || reg(c, t) < 0) return false;
+
+    struct vm_str *f = vm_str(&c->ct->vm, "%s", 2);
+    struct vm_str *line = vm_str(&c->ct->vm, NULL, t.len + 1);
+    if(!f || !line) {
+        ct_error(c, t, "Compile time memory budget exceeded");
+        return false;
+    }
+    memcpy(line->s, t.str, t.len);
+    line->s[t.len] = '\n';
+
+    if(!load_const(c, base, (struct vm_val){VM_STR, .s = f}, t)) return false;
+    if(!load_const(c, base + 1, (struct vm_val){VM_STR, .s = line}, t)) return false;
+    emit(c, VM_INS(VM_CALL, base, CT_SOURCE, 2), t);
+    emit(c, VM_INS(VM_MOV, dst, base, 0), t);
+
+    c->reg_n = base;
+    return true;
+}
+
+//Calls to builtins, with arguments in consecutive registers
+static bool compile_call(struct ctc *c, struct expr *e, int dst) {
+    int b = -1;
+    if(e->f->type == EXPR_IDENT)
+        for(int i = 0; i < CT_BUILTIN_MAX; i++)
+            if(tok_is(e->f->lit, ct_builtin_str[i])) b = i;
+
+    struct token t = expr_tok(e->f);
+    if(b < 0) {
+        ct_error(c, t, "Only builtin functions can be called at compile time");
+        return false;
+    }
+
+    int base = c->reg_n;
+    for(int i = 0; i < e->args_n || i == 0; i++)
+        if(reg(c, t) < 0) return false;
+
+    for(int i = 0; i < e->args_n; i++)
+        if(!compile(c, &e->args[i], base + i)) return false;
+
+    emit(c, VM_INS(VM_CALL, base, b, e->args_n), t);
+    emit(c, VM_INS(VM_MOV, dst, base, 0), t);
+
+    c->reg_n = base;
+    return true;
+}
+
+static bool compile_void(struct ctc *c, int dst, struct token t) {
+    return load_const(c, dst, (struct vm_val){VM_VOID}, t);
+}
+
+static bool compile_if(struct ctc *c, struct expr *e, int dst) {
+    struct token t = e->ctl.kw;
+
+    if(!compile(c, e->ctl.cond, dst)) return false;
+    int j0 = emit(c, VM_INSX(VM_JMPF, dst, 0), t);
+    if(!compile(c, e->ctl.body, dst)) return false;
+    int j1 = emit(c, VM_INSX(VM_JMP, 0, 0), t);
+
+    if(!patch(c, j0)) return false;
+    if(e->ctl.els ? !compile(c, e->ctl.els, dst) : !compile_void(c, dst, t)) return false;
+    return patch(c, j1);
+}
+
+static bool compile_for(struct ctc *c, struct expr *e, int dst) {
+    struct token t = e->ctl.kw, at = c->at;
+    struct ct_scope scope = enter(c);
+    c->at = t;
+
+    if(e->ctl.init && !compile(c, e->ctl.init, dst)) return false;
+
+    int loop = c->code.n, j = -1;
+    if(e->ctl.cond) {
+        if(!compile(c, e->ctl.cond, dst)) return false;
+        j = emit(c, VM_INSX(VM_JMPF, dst, 0), t);
+    }
+
+    if(!compile(c, e->ctl.body, dst)) return false;
+    if(e->ctl.step && !compile(c, e->ctl.step, dst)) return false;
+    if(!jump_back(c, loop, t)) return false;
+
+    if(j >= 0 && !patch(c, j)) return false;
+    leave(c, scope);
+    c->at = at;
+    return compile_void(c, dst, t);
+}
+
+//Compile e, leaving its value in register dst
+static bool compile(struct ctc *c, struct expr *e, int dst) {
+    switch(e->type) {
+    case EXPR_NONE: return compile_void(c, dst, c->at);
+    case EXPR_NUM: return compile_num(c, e, dst);
+    case EXPR_STR:
+        if(e->lit.type == TOKEN_SOURCE) return compile_source(c, e, dst);
+        return compile_str(c, e, dst);
+    case EXPR_IDENT: return compile_ident(c, e, dst);
+
+    case EXPR_NEG: case EXPR_LNOT: case EXPR_BNOT: {
+        if(!compile(c, e->l, dst)) return false;
+        int op = e->type == EXPR_NEG ? VM_NEG : e->type == EXPR_LNOT ? VM_NOT : VM_BNOT;
+        emit(c, VM_INS(op, dst, dst, 0), e->op);
+        return true;
+    }
+
+    EXPR_CASE_BINARY: return compile_binary(c, e, dst);
+    case EXPR_CAST: return compile_cast(c, e, dst);
+    case EXPR_FCALL: return compile_call(c, e, dst);
+
+    case EXPR_ASSIGN: case EXPR_DEFINE: return compile_assign(c, e, dst);
+    case EXPR_PREINC: case EXPR_PREDEC: case EXPR_POSTINC: case EXPR_POSTDEC:
+        return compile_step(c, e, dst);
+
+    case EXPR_BLOCK: {
+        if(e->vals_n == 0) return compile_void(c, dst, e->lcurl);
+
+        //The statements of a line itself define globals
+        bool line = e->lcurl.type == TOKEN_HASH;
+        struct token at = c->at;
+        struct ct_scope scope = line ? (struct ct_scope){c->locals_n, c->scope, c->reg_n} : enter(c);
+        c->at = e->lcurl.str ? e->lcurl : at;
+        for(int i = 0; i < e->vals_n; i++)
+            if(!compile(c, &e->vals[i], dst)) return false;
+        leave(c, scope);
+        c->at = at;
+        return true;
+    }
+
+    case EXPR_IF: return compile_if(c, e, dst);
+    case EXPR_FOR: return compile_for(c, e, dst);
+
+    default: break;
+    }
+
+    ct_error(c, expr_tok(e), "Expression is not available at compile time");
+    return false;
+}
+
+//Cached result of a run: the header, then vals_n struct ct_entry_val, then
+//warns_n struct ct_entry_warn, then data_len bytes of strings. The text
+//passed to source() is in the data, from the instruction source_pc.
+struct ct_entry {
+    char magic[4];
+    uint32_t vals_n, warns_n, data_len;
+    uint32_t source_pc, source_off, source_len, pad;
+};
+
+#define CT_ENTRY_MAGIC "ZCT2"
+
+struct ct_entry_val {       //Value of global g after the run
+    uint32_t g, type;
+    union {
+        int64_t i;
+        double f;
+        struct {uint32_t off, len;} s;
+    };
+};
+
+struct ct_entry_warn {      //Warning from the instruction pc
+    uint32_t pc, off, len, pad;
+};
+
+static bool code_loops(struct vm_code *code) {
+    for(int i = 0; i < code->n; i++)
+        if(VM_OP(code->ins[i]) == VM_JMP && VM_SBX(code->ins[i]) < 0) return true;
+    return false;
+}
+
+static void key_val(struct cache_key *k, struct vm_val *v) {
+    uint32_t type = v->type;
+    cache_key_add(k, &type, sizeof type);
+    switch(v->type) {
+    case VM_VOID: break;
+    case VM_INT: cache_key_add(k, &v->i, sizeof v->i); break;
+    case VM_FLOAT: cache_key_add(k, &v->f, sizeof v->f); break;
+    case VM_STR:
+        cache_key_add(k, &v->s->len, sizeof v->s->len);
+        cache_key_add(k, v->s->s, v->s->len);
+        break;
+    }
+}
+
+//Key of running code: the program with its constants, which hold the values
+//of any consts and of FILE and LINE, and the values of the compile time
+//variables it reads. The compiler version is part of every key.
+static void ct_key(struct ct *ct, struct vm_code *code, struct cache_key *k) {
+    cache_key_init(k, "ct");
+    cache_key_add(k, code->ins, sizeof(*code->ins) * code->n);
+    for(int i = 0; i < code->k_n; i++) key_val(k, &code->k[i]);
+    for(int i = 0; i < code->n; i++)
+        if(VM_OP(code->ins[i]) == VM_LOADG) key_val(k, &ct->vm.g[VM_BX(code->ins[i])]);
+}
+
+//Apply a cached result, returning false if it is not valid
+static bool ct_load(struct parse *p, struct vm_code *code, struct cache_blob *b) {
+    struct ct *ct = &p->ct;
+    struct ct_entry *h = b->data;
+    if(b->len < sizeof *h || memcmp(h->magic, CT_ENTRY_MAGIC, 4) != 0) return false;
+
+    uint64_t size = sizeof *h + (uint64_t)h->vals_n * sizeof(struct ct_entry_val)
+        + (uint64_t)h->warns_n * sizeof(struct ct_entry_warn) + h->data_len;
+    if(size != b->len) return false;
+
+    struct ct_entry_val *vals = (void*)(h + 1);
+    struct ct_entry_warn *warns = (void*)(vals + h->vals_n);
+    char *data = (char*)(warns + h->warns_n);
+
+    for(uint32_t i = 0; i < h->vals_n; i++) {
+        struct ct_entry_val *v = &vals[i];
+        if(v->g >= (uint32_t)ct->vm.g_n || v->type > VM_STR) return false;
+        if(v->type == VM_STR && (v->s.off > h->data_len || v->s.len > h->data_len - v->s.off))
+            return false;
+    }
+    for(uint32_t i = 0; i < h->warns_n; i++) {
+        struct ct_entry_warn *w = &warns[i];
+        if(w->pc >= (uint32_t)code->n || w->off > h->data_len || w->len > h->data_len - w->off)
+            return false;
+    }
+    if(h->source_len && (h->source_pc >= (uint32_t)code->n || h->source_off > h->data_len
+            || h->source_len > h->data_len - h->source_off))
+        return false;
+
+    for(uint32_t i = 0; i < h->vals_n; i++) {
+        struct ct_entry_val *v = &vals[i];
+        struct vm_val *g = &ct->vm.g[v->g];
+        switch(v->type) {
+        case VM_VOID: *g = (struct vm_val){VM_VOID}; break;
+        case VM_INT: *g = (struct vm_val){VM_INT, .i = v->i}; break;
+        case VM_FLOAT: *g = (struct vm_val){VM_FLOAT, .f = v->f}; break;
+        case VM_STR: {
+            struct vm_str *s = vm_str(&ct->vm, data + v->s.off, v->s.len);
+            if(!s) return false;
+            *g = (struct vm_val){VM_STR, .s = s};
+            break;
+        }
+        }
+    }
+
+    for(uint32_t i = 0; i < h->warns_n; i++) {
+        struct ct_entry_warn *w = &warns[i];
+        snprintf(err_buf, ERRBUF_SIZE, "%.*s", (int)w->len, data + w->off);
+        p->warn(p->ts, code->tok[w->pc], err_buf);
+    }
+
+    if(h->source_len) {
+        ct->source_pc = h->source_pc;
+        ct_source_add(ct, data + h->source_off, h->source_len);
+    }
+
+    return true;
+}
+
+//Store the result of a run, the globals it writes, its warnings and source
+static void ct_store(struct ct *ct, struct vm_code *code, struct cache_key *k) {
+    bool *written = calloc(ct->vm.g_n + 1, sizeof *written);
+    assert(written);
+
+    struct ct_entry h = {CT_ENTRY_MAGIC};
+    for(int i = 0; i < code->n; i++) {
+        if(VM_OP(code->ins[i]) != VM_STOREG || written[VM_BX(code->ins[i])]) continue;
+        written[VM_BX(code->ins[i])] = true;
+        h.vals_n++;
+        struct vm_val *v = &ct->vm.g[VM_BX(code->ins[i])];
+        if(v->type == VM_STR) h.data_len += v->s->len;
+    }
+    h.warns_n = ct->warns_n;
+    for(int i = 0; i < ct->warns_n; i++) h.data_len += strlen(ct->warns[i].msg);
+    h.source_pc = ct->source_pc;
+    h.source_off = h.data_len;
+    h.source_len = ct->source_len;
+    h.data_len += ct->source_len;
+
+    size_t len = sizeof h + h.vals_n * sizeof(struct ct_entry_val)
+        + h.warns_n * sizeof(struct ct_entry_warn) + h.data_len;
+    char *buf = calloc(1, len);
+    assert(buf);
+
+    memcpy(buf, &h, sizeof h);
+    struct ct_entry_val *vals = (void*)(buf + sizeof h);
+    struct ct_entry_warn *warns = (void*)(vals + h.vals_n);
+    char *data = (char*)(warns + h.warns_n);
+    uint32_t off = 0, n = 0;
+
+    for(int g = 0; g < ct->vm.g_n; g++) {
+        if(!written[g]) continue;
+        struct vm_val *v = &ct->vm.g[g];
+        struct ct_entry_val *e = &vals[n++];
+        e->g = g;
+        e->type = v->type;
+        if(v->type == VM_INT) e->i = v->i;
+        if(v->type == VM_FLOAT) e->f = v->f;
+        if(v->type == VM_STR) {
+            e->s.off = off;
+            e->s.len = v->s->len;
+            memcpy(data + off, v->s->s, v->s->len);
+            off += v->s->len;
+        }
+    }
+
+    for(int i = 0; i < ct->warns_n; i++) {
+        uint32_t l = strlen(ct->warns[i].msg);
+        warns[i] = (struct ct_entry_warn){ct->warns[i].pc, off, l};
+        memcpy(data + off, ct->warns[i].msg, l);
+        off += l;
+    }
+
+    if(ct->source_len) memcpy(data + off, ct->source, ct->source_len);
+
+    cache_put(ct->cache_dir, k, buf, len);
+    free(buf);
+    free(written);
+}
+
+//Splice the text from source() in to the file, after the # line
+static void ct_splice(struct parse *p, struct vm_code *code) {
+    struct ct *ct = &p->ct;
+    if(!ct->source_len) return;
+
+    char *text = malloc(ct->source_len + 1);
+    assert(text);
+    memcpy(text, ct->source, ct->source_len);
+    text[ct->source_len] = '\0';
+    token_stream_splice(p->ts, text, ct->source_len, code->tok[ct->source_pc]);
+    ct->source_len = 0;
+}
+
+//Run compiled code, or apply its cached result. Returns number of errors.
+static int ct_exec(struct parse *p, struct vm_code *code) {
+    struct ct *ct = &p->ct;
+    bool cache = ct->cache_dir && code_loops(code);
+    struct cache_key k;
+
+    if(cache) {
+        ct_key(ct, code, &k);
+
+        timing_start(TIMING_CT_HIT);
+        struct cache_blob b;
+        bool hit = cache_get(ct->cache_dir, &k, &b);
+        if(hit) {
+            hit = ct_load(p, code, &b);
+            cache_release(&b);
+        }
+        timing_stop(TIMING_CT_HIT);
+
+        if(hit) {
+            timing_count(TIMING_CT_HIT, 1);
+            ct_splice(p, code);
+            return 0;
+        }
+        ct->source_len = 0;
+        timing_count(TIMING_CT_MISS, 1);
+    }
+
+    struct vm_val ret;
+    uint64_t steps = ct->vm.steps;
+    ct->vm.ctx = p;
+    ct->warns_n = 0;
+    char *err = vm_run(&ct->vm, code, &ret);
+    steps = ct->vm.steps - steps;
+    timing_count(TIMING_CT, steps);
+
+    if(!err && cache && steps >= CT_CACHE_STEPS) {
+        timing_start(TIMING_CT_MISS);
+        ct_store(ct, code, &k);
+        timing_stop(TIMING_CT_MISS);
+    }
+
+    for(int i = 0; i < ct->warns_n; i++) free(ct->warns[i].msg);
+    ct->warns_n = 0;
+
+    if(!err) {
+        ct_splice(p, code);
+        return 0;
+    }
+    ct->source_len = 0;
+    p->error(p->ts, ct->vm.tok, err);
+    return 1;
+}
+
+//Compile and run e, from a # line. Returns number of errors, which are
+//reported through p->error
+int ct_run(struct parse *p, struct expr *e) {
+    assert(p); assert(e);
+
+    timing_start(TIMING_CT);
+
+    struct ct *ct = &p->ct;
+    struct ctc c = {p, ct, .at = expr_tok(e), .scope = -1};
+    vm_code_init(&c.code);
+
+    int r = reg(&c, expr_tok(e));
+    if(compile(&c, e, r)) {
+        emit(&c, VM_INS(VM_HALT, r, 0, 0), expr_tok(e));
+        c.errnum += ct_exec(p, &c.code);
+    }
+
+    vm_code_free(&c.code);
+    ct->errnum += c.errnum;
+
+    timing_stop(TIMING_CT);
+
+    return c.errnum;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "expr.h"
+#include "vm.h"
+#include "out.h"
+
+struct parse;
+
+#define CT_CONST_DEPTH 64       //Nesting of consts used at compile time
+#define CT_LOCALS_MAX 64        //Locals in scope at once in compile time code
+#define CT_CACHE_STEPS 10000    //Instructions a run takes before its result is cached
+
+//Compile time execution of lines starting with #. Each is compiled to
+//bytecode and run as soon as it is parsed. Variables defined by the
+//statements of a line live in one namespace for the rest of the file, as vm
+//globals named by names; those defined in a block or loop are local to it.
+//Text passed to source() is spliced in to the file after the line.
+struct ct {
+    struct vm vm;
+
+    char **names;
+    int names_n, names_c;
+
+    char *cache_dir;            //Results of # lines with loops are cached here, if set
+    struct {int pc; char *msg;} *warns;     //Warnings of the current run
+    int warns_n, warns_c;
+
+    char *source;               //Text from source() in the current run
+    size_t source_len, source_cap;
+    int source_pc;              //First call of source(), which the text is at
+
+    int errnum;
+};
+
+void ct_init(struct ct *ct);
+void ct_free(struct ct *ct);
+void ct_define(struct ct *ct, char *name, char *value);
+int ct_run(struct parse *p, struct expr *e);
+void ct_print(struct out *o, struct ct *ct);
@@ -0,0 +1,444 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cval.h"
+
+void cval_init(struct cval *v) {
+    assert(v);
+    *v = (struct cval){CVAL_NONE};
+    bn_init(&v->num);
+    bn_init(&v->den);
+}
+
+void cval_free(struct cval *v) {
+    if(!v) return;
+    bn_free(&v->num);
+    bn_free(&v->den);
+    v->type = CVAL_NONE;
+}
+
+void cval_set(struct cval *r, struct cval *a) {
+    if(r == a) return;
+    r->type = a->type;
+    r->str = a->str;
+    r->bits = a->bits;
+    r->sign = a->sign;
+    bn_set(&r->num, &a->num);
+    bn_set(&r->den, &a->den);
+}
+
+void cval_set_int(struct cval *r, int64_t i) {
+    r->type = CVAL_INT;
+    r->bits = 0;
+    bn_set_int(&r->num, i);
+    bn_set_int(&r->den, 1);
+}
+
+//Reduce a real to lowest terms with a positive denominator
+static void cval_norm(struct cval *r) {
+    if(r->type != CVAL_REAL) return;
+
+    if(r->den.neg) {
+        bn_neg(&r->num, &r->num);
+        bn_neg(&r->den, &r->den);
+    }
+
+    struct bn g;
+    bn_init(&g);
+    bn_gcd(&g, &r->num, &r->den);
+    if(!bn_is_zero(&g)) {
+        bn_divmod(&r->num, NULL, &r->num, &g);
+        bn_divmod(&r->den, NULL, &r->den, &g);
+    }
+    bn_free(&g);
+}
+
+static int digit(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'z') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    return 99;
+}
+
+#define ERRBUF_SIZE 128
+static char err_buf[ERRBUF_SIZE];
+
+//Value of a numeric literal. Integers may be written in base 10, 16 (0x),
+//8 (0o) or 2 (0b), with _ separating digits. A '.' or exponent (e for
+//decimal, p for a power of two otherwise) makes the literal real.
+//Returns NULL, or an error message.
+char *cval_parse(struct cval *r, struct token t) {
+    char *s = t.str, *end = t.str + t.len;
+
+    uint32_t base = 10;
+    if(end - s > 2 && s[0] == '0') {
+        switch(s[1]) {
+        case 'x': case 'X': base = 16; s += 2; break;
+        case 'o': case 'O': base = 8; s += 2; break;
+        case 'b': case 'B': base = 2; s += 2; break;
+        }
+    }
+
+    bool real = false;
+    int frac = 0;
+    struct bn num;
+    bn_init(&num);
+
+    for(; s < end; s++) {
+        if(*s == '_') continue;
+        if(*s == '.' && !real) { real = true; continue; }
+        if(base == 10 && (*s == 'e' || *s == 'E')) break;
+        if(base != 10 && (*s == 'p' || *s == 'P')) break;
+
+        uint32_t d = digit(*s);
+        if(d >= base) {
+            bn_free(&num);
+            snprintf(err_buf, ERRBUF_SIZE, "Invalid digit '%c' in number", *s);
+            return err_buf;
+        }
+
+        bn_mul_add_small(&num, base, d);
+        if(real) frac++;
+    }
+
+    //Exponent, always written in decimal
+    long exp = 0;
+    if(s < end) {
+        real = true;
+        s++;
+        bool neg = s < end && *s == '-';
+        if(s < end && (*s == '-' || *s == '+')) s++;
+        if(s == end) {
+            bn_free(&num);
+            return "Expected exponent in number";
+        }
+        for(; s < end; s++) {
+            if(*s == '_') continue;
+            if(*s < '0' || *s > '9') {
+                bn_free(&num);
+                snprintf(err_buf, ERRBUF_SIZE, "Invalid digit '%c' in exponent", *s);
+                return err_buf;
+            }
+            if(exp <= CVAL_EXP_MAX) exp = exp * 10 + (*s - '0');
+        }
+        if(neg) exp = -exp;
+    }
+
+    if(exp > CVAL_EXP_MAX || exp < -CVAL_EXP_MAX) {
+        bn_free(&num);
+        return "Exponent out of range";
+    }
+
+    r->type = real ? CVAL_REAL : CVAL_INT;
+    bn_set(&r->num, &num);
+    bn_free(&num);
+    bn_set_int(&r->den, 1);
+    if(!real) return NULL;
+
+    //num * base^-frac * (10 or 2)^exp
+    struct bn p;
+    bn_init(&p);
+    bn_pow_small(&p, base, frac);
+    bn_mul(&r->den, &r->den, &p);
+
+    bn_pow_small(&p, base == 10 ? 10 : 2, exp < 0 ? -exp : exp);
+    if(exp < 0) bn_mul(&r->den, &r->den, &p);
+    else bn_mul(&r->num, &r->num, &p);
+    bn_free(&p);
+
+    cval_norm(r);
+    return NULL;
+}
+
+//a as a fraction num/den, integers have den 1
+static void cval_frac(struct cval *a, struct bn *num, struct bn *den) {
+    bn_set(num, &a->num);
+    if(a->type == CVAL_REAL) bn_set(den, &a->den);
+    else bn_set_int(den, 1);
+}
+
+//Compare a and b by cross multiplying fractions
+static int cval_cmp(struct cval *a, struct cval *b) {
+    struct bn xn, xd, yn, yd;
+    bn_init(&xn); bn_init(&xd); bn_init(&yn); bn_init(&yd);
+    cval_frac(a, &xn, &xd);
+    cval_frac(b, &yn, &yd);
+
+    bn_mul(&xn, &xn, &yd);
+    bn_mul(&yn, &yn, &xd);
+    int c = bn_cmp(&xn, &yn);
+
+    bn_free(&xn); bn_free(&xd); bn_free(&yn); bn_free(&yd);
+    return c;
+}
+
+bool cval_is_true(struct cval *v) {
+    return !bn_is_zero(&v->num);
+}
+
+static bool is_num(struct cval *v) {
+    return v->type == CVAL_INT || v->type == CVAL_REAL;
+}
+
+//r = op a, returns NULL or an error message
+char *cval_unop(struct cval *r, enum expr_type op, struct cval *a) {
+    if(!is_num(a)) return "Operand is not a number";
+
+    switch(op) {
+    case EXPR_NEG:
+        cval_set(r, a);
+        bn_neg(&r->num, &r->num);
+        return NULL;
+
+    case EXPR_LNOT:
+        cval_set_int(r, !cval_is_true(a));
+        return NULL;
+
+    case EXPR_BNOT:
+        if(a->type != CVAL_INT) return "Operator requires integer operands";
+        cval_set(r, a);
+        bn_not(&r->num, &r->num);
+        return NULL;
+
+    default: return "Operator is not constant";
+    }
+}
+
+//Integer only operations
+static char *cval_binop_int(struct cval *r, enum expr_type op, struct cval *a, struct cval *b) {
+    if(a->type != CVAL_INT || b->type != CVAL_INT) return "Operator requires integer operands";
+
+    int64_t shift = 0;
+    if(op == EXPR_BSL || op == EXPR_BSR) {
+        if(!bn_to_int64(&b->num, &shift) || shift > BN_SHIFT_MAX) return "Shift amount too large";
+        if(shift < 0) return "Negative shift amount";
+    }
+
+    struct bn *x = &r->num;
+    switch(op) {
+    case EXPR_MOD: if(!bn_divmod(NULL, x, &a->num, &b->num)) return "Division by zero"; break;
+    case EXPR_BSL: bn_shl(x, &a->num, shift); break;
+    case EXPR_BSR: bn_shr(x, &a->num, shift); break;
+    case EXPR_BAND: bn_and(x, &a->num, &b->num); break;
+    case EXPR_XOR: bn_xor(x, &a->num, &b->num); break;
+    case EXPR_BOR: bn_or(x, &a->num, &b->num); break;
+    default: assert(0);
+    }
+
+    r->type = CVAL_INT;
+    bn_set_int(&r->den, 1);
+    return NULL;
+}
+
+//Arithmetic on two numbers. Integer division truncates as in C, any real
+//operand makes the result an exact real.
+static char *cval_arith(struct cval *r, enum expr_type op, struct cval *a, struct cval *b) {
+    if(a->type == CVAL_INT && b->type == CVAL_INT) {
+        switch(op) {
+        case EXPR_ADD: bn_add(&r->num, &a->num, &b->num); break;
+        case EXPR_SUB: bn_sub(&r->num, &a->num, &b->num); break;
+        case EXPR_MUL: bn_mul(&r->num, &a->num, &b->num); break;
+        case EXPR_DIV:
+            if(!bn_divmod(&r->num, NULL, &a->num, &b->num)) return "Division by zero";
+            break;
+        default: assert(0);
+        }
+
+        r->type = CVAL_INT;
+        bn_set_int(&r->den, 1);
+        return NULL;
+    }
+
+    struct bn xn, xd, yn, yd;
+    bn_init(&xn); bn_init(&xd); bn_init(&yn); bn_init(&yd);
+    cval_frac(a, &xn, &xd);
+    cval_frac(b, &yn, &yd);
+
+    char *err = NULL;
+    switch(op) {
+    case EXPR_ADD: case EXPR_SUB:
+        bn_mul(&xn, &xn, &yd);
+        bn_mul(&yn, &yn, &xd);
+        if(op == EXPR_ADD) bn_add(&r->num, &xn, &yn);
+        else bn_sub(&r->num, &xn, &yn);
+        bn_mul(&r->den, &xd, &yd);
+        break;
+    case EXPR_MUL:
+        bn_mul(&r->num, &xn, &yn);
+        bn_mul(&r->den, &xd, &yd);
+        break;
+    case EXPR_DIV:
+        if(bn_is_zero(&yn)) {
+            err = "Division by zero";
+            break;
+        }
+        bn_mul(&r->num, &xn, &yd);
+        bn_mul(&r->den, &xd, &yn);
+        break;
+    default: assert(0);
+    }
+
+    bn_free(&xn); bn_free(&xd); bn_free(&yn); bn_free(&yd);
+    if(err) return err;
+
+    r->type = CVAL_REAL;
+    cval_norm(r);
+    return NULL;
+}
+
+//r = a op b, returns NULL or an error message
+char *cval_binop(struct cval *r, enum expr_type op, struct cval *a, struct cval *b) {
+    if(!is_num(a) || !is_num(b)) return "Operand is not a number";
+
+    int c;
+    switch(op) {
+    case EXPR_ADD: case EXPR_SUB: case EXPR_MUL: case EXPR_DIV:
+        return cval_arith(r, op, a, b);
+
+    case EXPR_MOD: case EXPR_BSL: case EXPR_BSR:
+    case EXPR_BAND: case EXPR_XOR: case EXPR_BOR:
+        return cval_binop_int(r, op, a, b);
+
+    case EXPR_LT: case EXPR_LE: case EXPR_GT:
+    case EXPR_GE: case EXPR_EQ: case EXPR_NE:
+        c = cval_cmp(a, b);
+        switch(op) {
+        case EXPR_LT: c = c < 0; break;
+        case EXPR_LE: c = c <= 0; break;
+        case EXPR_GT: c = c > 0; break;
+        case EXPR_GE: c = c >= 0; break;
+        case EXPR_EQ: c = c == 0; break;
+        default: c = c != 0; break;
+        }
+        cval_set_int(r, c);
+        return NULL;
+
+    case EXPR_AND: cval_set_int(r, cval_is_true(a) && cval_is_true(b)); return NULL;
+    case EXPR_OR: cval_set_int(r, cval_is_true(a) || cval_is_true(b)); return NULL;
+
+    default: return "Operator is not constant";
+    }
+}
+
+//Truncate toward zero to an integer
+void cval_trunc(struct cval *r, struct cval *a) {
+    cval_set(r, a);
+    if(r->type != CVAL_REAL) return;
+    bn_divmod(&r->num, NULL, &r->num, &r->den);
+    bn_set_int(&r->den, 1);
+    r->type = CVAL_INT;
+}
+
+//Wrap an integer to a bits wide two's complement integer, as a cast would
+void cval_wrap(struct cval *r, struct cval *a, int bits, bool sign) {
+    cval_set(r, a);
+    if(r->type != CVAL_INT) return;
+
+    struct bn m;
+    bn_init(&m);
+    bn_set_int(&m, 1);
+    bn_shl(&m, &m, bits);
+
+    //x & (2^bits - 1), then subtract 2^bits if the sign bit is set
+    struct bn mask;
+    bn_init(&mask);
+    bn_set_int(&mask, -1);
+    bn_add(&mask, &mask, &m);
+    bn_and(&r->num, &r->num, &mask);
+
+    if(sign && bn_bits(&r->num) == bits) bn_sub(&r->num, &r->num, &m);
+
+    bn_free(&m);
+    bn_free(&mask);
+}
+
+static double bn_to_double(struct bn *a) {
+    double d = 0;
+    for(int i = a->n - 1; i >= 0; i--) d = d * 4294967296.0 + a->d[i];
+    return a->neg ? -d : d;
+}
+
+//Value of a number as a double, the nearest or close to it
+double cval_to_double(struct cval *v) {
+    if(v->type == CVAL_INT) return bn_to_double(&v->num);
+    if(v->type != CVAL_REAL) return 0;
+
+    //Scale both down so neither overflows
+    int n = bn_bits(&v->num), d = bn_bits(&v->den);
+    int s = (n > d ? n : d) - 1000;
+    if(s <= 0) return bn_to_double(&v->num) / bn_to_double(&v->den);
+
+    struct bn a, b;
+    bn_init(&a);
+    bn_init(&b);
+    bn_shr(&a, &v->num, s);
+    bn_shr(&b, &v->den, s);
+    double r = bn_is_zero(&b) ? (v->num.neg ? -HUGE_VAL : HUGE_VAL)
+        : bn_to_double(&a) / bn_to_double(&b);
+    bn_free(&a);
+    bn_free(&b);
+    return r;
+}
+
+//Print exactly, reals as a decimal when it terminates and as a fraction
+//otherwise
+void cval_print(struct out *o, struct cval *v) {
+    char *s;
+
+    switch(v->type) {
+    case CVAL_NONE: return;
+    case CVAL_STR: out_mem(o, v->str.str, v->str.len); return;
+    case CVAL_INT:
+        s = bn_str(&v->num);
+        out_str(o, s);
+        free(s);
+        return;
+    case CVAL_REAL: break;
+    }
+
+    //den == 2^i 5^j terminates after max(i, j) decimal places
+    struct bn d, q, m, five;
+    bn_init(&d); bn_init(&q); bn_init(&m); bn_init(&five);
+    bn_set(&d, &v->den);
+    bn_set_int(&five, 5);
+
+    int twos = 0, fives = 0;
+    while(d.n && !(d.d[0] & 1)) bn_shr(&d, &d, 1), twos++;
+    for(;;) {
+        bn_divmod(&q, &m, &d, &five);
+        if(!bn_is_zero(&m)) break;
+        bn_set(&d, &q);
+        fives++;
+    }
+
+    if(bn_bits(&d) != 1) {
+        char *n = bn_str(&v->num), *dn = bn_str(&v->den);
+        out_str(o, n); out_char(o, '/'); out_str(o, dn);
+        free(n); free(dn);
+    } else {
+        //Scale to an integer, then place the decimal point
+        int places = twos > fives ? twos : fives;
+        bn_pow_small(&q, 10, places);
+        bn_mul(&q, &q, &v->num);
+        bn_divmod(&q, NULL, &q, &v->den);
+        bool neg = q.neg;
+        q.neg = false;
+        s = bn_str(&q);
+
+        int len = strlen(s);
+        if(neg) out_str(o, "-");
+        if(len <= places) {
+            out_str(o, "0.");
+            for(int i = len; i < places; i++) out_str(o, "0");
+            out_str(o, s);
+        }
+        else if(places == 0) out_str(o, s), out_str(o, ".0");
+        else out_mem(o, s, len - places), out_char(o, '.'), out_str(o, s + len - places);
+        free(s);
+    }
+
+    bn_free(&d); bn_free(&q); bn_free(&m); bn_free(&five);
+}
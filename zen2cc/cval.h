@@ -0,0 +1,42 @@
+#pragma once
+
+#include "bn.h"
+#include "token.h"
+#include "expr.h"
+#include "out.h"
+
+//Compile time constant values. Integers are exact, and real numbers are kept
+//as exact fractions, so constants never lose precision however they are
+//combined. Rounding happens only when a constant is used as a run time value.
+
+enum cval_type {
+    CVAL_NONE,          //Not a constant
+    CVAL_INT,           //Integer num
+    CVAL_REAL,          //Real num/den, den positive and coprime to num
+    CVAL_STR,           //String literal str
+};
+
+#define CVAL_EXP_MAX 4096     //Largest exponent in a real literal
+
+struct cval {
+    enum cval_type type;
+    struct bn num, den;
+    struct token str;
+    int bits;           //Width of the sized integer type num wraps to, 0 if exact
+    bool sign;          //Whether that type is signed
+};
+
+void cval_init(struct cval *v);
+void cval_free(struct cval *v);
+void cval_set(struct cval *r, struct cval *a);
+void cval_set_int(struct cval *r, int64_t i);
+
+char *cval_parse(struct cval *r, struct token t);
+char *cval_unop(struct cval *r, enum expr_type op, struct cval *a);
+char *cval_binop(struct cval *r, enum expr_type op, struct cval *a, struct cval *b);
+void cval_trunc(struct cval *r, struct cval *a);
+void cval_wrap(struct cval *r, struct cval *a, int bits, bool sign);
+bool cval_is_true(struct cval *v);
+double cval_to_double(struct cval *v);
+
+void cval_print(struct out *o, struct cval *v);
@@ -0,0 +1,2345 @@
+#include <assert.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "emit.h"
+#include "ir.h"
+#include "layout.h"
+#include "lower.h"
+#include "sema.h"
+#include "timing.h"
+
+//C backend. A module is emitted as one translation unit, a unity build, so
+//the C compiler sees all of it at once and can inline across the module
+//without LTO. Globals are named <module>__<name>, methods
+//<module>__<type>__<name>, and only exported definitions have external
+//linkage, functions of included modules declared by those names too. Consts
+//are not emitted, their uses stand for their folded value.
+//
+//Expressions map to GNU C: blocks, ifs and loops used as values become
+//statement expressions, and are plain statements elsewhere. Switches are
+//gotos to labeled cases, dispatched as lower() planned.
+//
+//Constant compound literals in functions are emitted once as static const
+//data, shared by identical literals, instead of being built on each use.
+//
+//Functions lowered to IR by ir() are emitted from it rather than their AST,
+//as vars declared up front and blocks joined by gotos.
+//
+//Functions returning several values return a struct of them when it fits in
+//the return registers. Larger tuples are stored through out-parameters, which
+//a definition (a, b) := f() points at its new locals.
+//
+//With lines set, each function and statement is preceded by a #line naming
+//its line in the Zen source, so debuggers and profilers show that instead.
+//Functions emitted from IR only have the line they start at.
+
+//C names of vals, struct and enum types, and shared compound literals, by
+//pointer. For TYPE_IDENT nodes idx is the index of the named type, for struct
+//and enum nodes state tracks their definition, and for locals and arguments
+//(keyed by their name in args) idx is 1 when they may be written to.
+struct emit_ent {
+    void *key;
+    char *name;
+    int idx;
+    enum {EMIT_NONE, EMIT_DECLARED, EMIT_BUSY, EMIT_DONE} state;
+};
+
+struct emit {
+    struct parse *p;
+    struct out *o;
+    char *mod;
+    int indent;
+    struct token at;            //Near what is being emitted, for errors
+    char *path;                 //Source as a C string literal for #line, or NULL for none
+
+    struct emit_ent *ents;
+    int ents_n, ents_c;
+    int anon_n;                 //Unnamed structs and enums so far
+
+    struct expr **lits;         //Compound literals emitted as static data
+    int lits_n, lits_c;
+
+    int *ts_state;              //Named types, by index in p->types
+
+    struct val *func;           //Function being emitted
+    char **args;                //Its argument names
+    char **rets;                //Its out-parameter names, if any
+    struct expr **locals;       //Its locals, named by local_names
+    char **local_names;
+    int locals_n, locals_c;
+    int switches_n;             //Its switches so far, numbering their labels
+    char *ret_to;               //Local emit_ret() assigns the value to, or NULL to return it
+    bool struct_ret;            //Return every tuple as a struct, as a baseline
+    bool checked;               //Whether any index is bounds checked
+
+    int errnum;
+};
+
+static char *c_prim[TYPE_NUM] = {
+    [TYPE_VOID] = "void", [TYPE_BOOL] = "int",
+    [TYPE_INT] = "int", [TYPE_INT8] = "int8_t", [TYPE_INT16] = "int16_t",
+    [TYPE_INT32] = "int32_t", [TYPE_INT64] = "int64_t",
+    [TYPE_UINT] = "unsigned", [TYPE_UINT8] = "uint8_t", [TYPE_UINT16] = "uint16_t",
+    [TYPE_UINT32] = "uint32_t", [TYPE_UINT64] = "uint64_t",
+    [TYPE_FLOAT] = "double", [TYPE_FLOAT16] = "_Float16",
+    [TYPE_FLOAT32] = "float", [TYPE_FLOAT64] = "double",
+};
+
+static char *c_reserved[] = {
+    "auto", "break", "case", "char", "const", "continue", "default", "do",
+    "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline",
+    "int", "long", "register", "restrict", "return", "short", "signed",
+    "sizeof", "static", "struct", "switch", "typedef", "union", "unsigned",
+    "void", "volatile", "while", "main", "zen_bound", NULL
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static void emit_error(struct emit *m, struct token t, char *msg) {
+    m->p->error(m->p->ts, t.str ? t : m->at, msg);
+    m->errnum++;
+}
+
+//malloc'd printf
+static char *fmt(const char *f, ...) {
+    va_list ap;
+    va_start(ap, f);
+    int n = vsnprintf(NULL, 0, f, ap);
+    va_end(ap);
+
+    char *s = malloc(n + 1);
+    assert(s);
+    va_start(ap, f);
+    vsnprintf(s, n + 1, f, ap);
+    va_end(ap);
+    return s;
+}
+
+static bool tok_is(struct token t, char *s) {
+    return t.len == strlen(s) && strncmp(t.str, s, t.len) == 0;
+}
+
+static struct emit_ent *ent(struct emit *m, void *key) {
+    if(2 * (m->ents_n + 1) > m->ents_c) {
+        struct emit_ent *old = m->ents;
+        int old_c = m->ents_c;
+        m->ents_c = old_c ? old_c * 2 : EMIT_MAP_INITIAL_CAP;
+        m->ents = calloc(m->ents_c, sizeof *m->ents);
+        assert(m->ents);
+        for(int i = 0; i < old_c; i++) {
+            if(!old[i].key) continue;
+            unsigned long h = (unsigned long)old[i].key >> 4;
+            int j = h & (m->ents_c - 1);
+            while(m->ents[j].key) j = (j + 1) & (m->ents_c - 1);
+            m->ents[j] = old[i];
+        }
+        free(old);
+    }
+
+    unsigned long h = (unsigned long)key >> 4;
+    int i = h & (m->ents_c - 1);
+    for(; m->ents[i].key; i = (i + 1) & (m->ents_c - 1))
+        if(m->ents[i].key == key) return &m->ents[i];
+
+    m->ents[i] = (struct emit_ent){key, NULL, -1, EMIT_NONE};
+    m->ents_n++;
+    return &m->ents[i];
+}
+
+static char *mangle(struct emit *m, char *mod, char *type, char *name) {
+    if(mod) return fmt("%s__%s__%s__%s", m->mod, mod, type, name);
+    if(type) return fmt("%s__%s__%s", m->mod, type, name);
+    return fmt("%s__%s", m->mod, name);
+}
+
+//Names of locals, arguments and members, clear of C keywords
+static char *c_ident(char *name) {
+    for(char **r = c_reserved; *r; r++)
+        if(strcmp(*r, name) == 0) return fmt("%s_", name);
+    return strdup(name);
+}
+
+static void indent(struct emit *m) {
+    for(int i = 0; i < m->indent; i++) out_str(m->o, "    ");
+}
+
+//Attribute the C lines that follow to the line of t in the source
+static void emit_line(struct emit *m, struct token t) {
+    if(!m->path || !t.str) return;
+    int row, col;
+    token_pos(m->p->ts, t, &row, &col);
+    if(row) out_fmt(m->o, "#line %i %s\n", row, m->path);
+}
+
+
+//Types
+
+static void need(struct emit *m, struct type *t, bool complete);
+static bool is_void(struct type *t);
+
+static struct type *enum_repr(struct type *t) {
+    return t->repr ? t->repr : type_prim(TYPE_INT);
+}
+
+//Whether functions returning tuple t store it through out-parameters
+static bool tuple_out(struct emit *m, struct type *t) {
+    if(m->struct_ret) return false;
+    layout_type(t);
+    return t->size < 0 || t->size > EMIT_RET_REGS;
+}
+
+//C return type of functions returning the n types ret, void if they are
+//stored through out-parameters
+static struct type *ret_type(struct emit *m, struct type **ret, int n) {
+    if(n == 0) return type_prim(TYPE_VOID);
+    if(n == 1) return ret[0];
+    struct type *t = sema_tuple(ret, n);
+    return tuple_out(m, t) ? type_prim(TYPE_VOID) : t;
+}
+
+static struct type *ptr_to(struct type *of) {
+    return type_intern((struct type){TYPE_PTR, .of=of});
+}
+
+static int ts_index(struct emit *m, struct type *t) {
+    struct emit_ent *e = ent(m, t);
+    if(e->idx < 0)
+        for(int i = 0; i < m->p->types.n; i++)
+            if(strcmp(m->p->types.key[i], t->ident) == 0) e->idx = i;
+    return e->idx;
+}
+
+//Declaration of name as type t, which may be "" for a type name. Returns a
+//malloc'd string.
+static char *decl(struct emit *m, struct type *t, char *name) {
+    char *base, *inner, *r;
+
+    switch(t->type) {
+    case TYPE_PRIMATIVE: base = strdup(c_prim[t->primative]); break;
+    case TYPE_IDENT:
+        if(t->mod) {
+            snprintf(err_buf, ERRBUF_SIZE, "Type '%s' of module '%s' is not available to the C backend",
+                    t->ident, t->mod);
+            emit_error(m, t->tok, err_buf);
+        }
+        base = mangle(m, NULL, NULL, t->ident);
+        break;
+    case TYPE_STRUCT: base = fmt("struct %s", ent(m, t)->name); break;
+    case TYPE_ENUM: return decl(m, enum_repr(t), name);
+    case TYPE_VEC: base = strdup(ent(m, t)->name); break;
+
+    case TYPE_PTR:
+        inner = t->of->type == TYPE_ARRAY && t->of->n >= 0 ? fmt("(*%s)", name) : fmt("*%s", name);
+        r = decl(m, t->of, inner);
+        free(inner);
+        return r;
+
+    //Arrays without a length are their pointer
+    case TYPE_ARRAY:
+        if(t->n < 0) inner = fmt("*%s", name);
+        else inner = fmt("%s[%i]", name, t->n);
+        r = decl(m, t->of, inner);
+        free(inner);
+        return r;
+
+    //Function values are function pointers
+    case TYPE_FUNC: {
+        struct type *rt = ret_type(m, t->ret, t->ret_n);
+        int outs = t->ret_n > 1 && is_void(rt) ? t->ret_n : 0;
+
+        char *args = strdup(t->args_n + outs ? "" : "void");
+        for(int i = 0; i < t->args_n + outs; i++) {
+            struct type *at = i < t->args_n ? t->args[i] : ptr_to(t->ret[i - t->args_n]);
+            char *a = decl(m, at, ""), *s = fmt("%s%s%s", args, i ? ", " : "", a);
+            free(a); free(args);
+            args = s;
+        }
+        inner = fmt("(*%s)(%s)", name, args);
+        r = decl(m, rt, inner);
+        free(inner); free(args);
+        return r;
+    }
+
+    default:
+        emit_error(m, m->at, "Type can not be inferred");
+        base = strdup("int");
+    }
+
+    r = *name ? fmt("%s %s", base, name) : strdup(base);
+    free(base);
+    return r;
+}
+
+static void out_decl(struct emit *m, struct type *t, char *name) {
+    char *d = decl(m, t, name);
+    out_str(m->o, d);
+    free(d);
+}
+
+static void emit_typedef(struct emit *m, int i) {
+    if(m->ts_state[i]) return;
+    m->ts_state[i] = EMIT_DONE;
+
+    struct type *def = m->p->types.val[i];
+    need(m, def, false);
+
+    char *name = mangle(m, NULL, NULL, m->p->types.key[i]);
+    out_str(m->o, "typedef ");
+    out_decl(m, def, name);
+    out_str(m->o, ";\n");
+    free(name);
+}
+
+static void emit_struct(struct emit *m, struct type *t) {
+    struct emit_ent *e = ent(m, t);
+    if(e->state == EMIT_DONE) return;
+    if(e->state == EMIT_BUSY) {
+        emit_error(m, m->at, "Struct contains itself");
+        return;
+    }
+    e->state = EMIT_BUSY;
+
+    for(int i = 0; i < t->mem_n; i++) need(m, t->types[i], true);
+
+    //Bools are bit-fields, which the C compiler packs as layout_type() does,
+    //and alignments asked for are attributes
+    out_str(m->o, "struct ");
+    if(t->align_to) out_fmt(m->o, "__attribute__((aligned(%i))) ", t->align_to);
+    out_str(m->o, ent(m, t)->name);
+    out_str(m->o, " {\n");
+    for(int i = 0; i < t->mem_n; i++) {
+        char *name = c_ident(t->idents[i]);
+        out_str(m->o, "    ");
+        if(layout_is_bit(t, i)) out_fmt(m->o, "unsigned %s : 1", name);
+        else out_decl(m, t->types[i], name);
+        if(t->aligns && t->aligns[i]) out_fmt(m->o, " __attribute__((aligned(%i)))", t->aligns[i]);
+        out_str(m->o, ";\n");
+        free(name);
+    }
+    out_str(m->o, "};\n");
+
+    layout_type(t);
+    if(t->size >= 0) {
+        char *name = ent(m, t)->name;
+        out_fmt(m->o, "_Static_assert(sizeof(struct %s) == %i && _Alignof(struct %s) == %i, \"layout of %s\");\n",
+                name, t->size, name, t->align, name);
+    }
+
+    ent(m, t)->state = EMIT_DONE;
+}
+
+static void emit_expr(struct emit *m, struct expr *e);
+
+static void emit_enum(struct emit *m, struct type *t) {
+    struct emit_ent *e = ent(m, t);
+    if(e->state != EMIT_NONE) return;
+    e->state = EMIT_DONE;
+    if(!e->name) e->name = fmt("%s__e%i", m->mod, m->anon_n++);
+
+    need(m, enum_repr(t), false);
+
+    out_str(m->o, "enum {\n");
+    for(int i = 0; i < t->opts_n; i++) {
+        out_str(m->o, "    ");
+        out_str(m->o, ent(m, t)->name);
+        out_str(m->o, "__");
+        out_str(m->o, t->opts[i]);
+        if(t->vals[i].type != EXPR_NONE && t->ivals) {
+            out_str(m->o, " = ");
+            out_int(m->o, t->ivals[i]);
+        }
+        out_str(m->o, ",\n");
+    }
+    out_str(m->o, "};\n");
+}
+
+//Vectors are GCC vector types. Where the target has no registers this wide
+//the C compiler splits operations on them, down to scalar code.
+static void emit_vec(struct emit *m, struct type *t) {
+    struct emit_ent *e = ent(m, t);
+    if(e->state != EMIT_NONE) return;
+    e->state = EMIT_DONE;
+    e->name = fmt("%s__v%i%s", m->mod, t->n, type_primative_str[t->of->primative]);
+
+    //Alignment is explicit, as C compilers align vectors by target
+    layout_type(t);
+    char *elem = c_prim[t->of->primative];
+    out_fmt(m->o, "typedef %s %s __attribute__((vector_size(%i * sizeof(%s)), aligned(%i)));\n",
+            elem, ent(m, t)->name, t->n, elem, t->align);
+}
+
+//Emit the definitions t needs to be declared, or used by value if complete
+static void need(struct emit *m, struct type *t, bool complete) {
+    if(!t) return;
+
+    switch(t->type) {
+    case TYPE_IDENT:
+        if(t->mod || !t->def) break;
+        if(ts_index(m, t) >= 0) emit_typedef(m, ts_index(m, t));
+        if(complete) need(m, t->def, true);
+        break;
+
+    case TYPE_STRUCT: {
+        struct emit_ent *e = ent(m, t);
+        if(!e->name) e->name = fmt("%s__s%i", m->mod, m->anon_n++);
+        if(e->state == EMIT_NONE) {
+            e->state = EMIT_DECLARED;
+            out_str(m->o, "struct ");
+            out_str(m->o, e->name);
+            out_str(m->o, ";\n");
+        }
+        if(complete) emit_struct(m, t);
+        break;
+    }
+
+    case TYPE_ENUM: emit_enum(m, t); break;
+    case TYPE_VEC: emit_vec(m, t); break;
+    case TYPE_PTR: need(m, t->of, false); break;
+    case TYPE_ARRAY: need(m, t->of, t->n >= 0); break;
+
+    case TYPE_FUNC:
+        for(int i = 0; i < t->args_n; i++) need(m, t->args[i], false);
+        for(int i = 0; i < t->ret_n; i++) need(m, t->ret[i], false);
+        if(t->ret_n > 1) need(m, sema_tuple(t->ret, t->ret_n), false);
+        break;
+
+    default: break;
+    }
+}
+
+//Emit definitions of the types used in e, and note bounds checks
+static void need_expr(struct emit *m, struct expr *e) {
+    if(!e) return;
+    if(e->ty) need(m, e->ty, true);
+    if(e->type == EXPR_ARRSUB && e->check) m->checked = true;
+
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: return;
+
+    case EXPR_FCALL:
+        need_expr(m, e->f);
+        for(int i = 0; i < e->args_n; i++) need_expr(m, &e->args[i]);
+        return;
+
+    case EXPR_COMP_LIT: need(m, e->t, true); //fallthrough
+    case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) need_expr(m, &e->vals[i]);
+        return;
+
+    EXPR_CASE_CTL: {
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        for(int i = 0; i < 5; i++) need_expr(m, c[i]);
+        return;
+    }
+
+    case EXPR_TACC: need(m, e->tacc.t, true); return;
+    case EXPR_CAST: need(m, e->tacc.t, true); need_expr(m, e->tacc.m); return;
+
+    //Members of pointers need the struct
+    case EXPR_SACC: {
+        need_expr(m, e->l);
+        struct type *t = e->l->ty ? sema_resolve(e->l->ty) : NULL;
+        if(t && t->type == TYPE_PTR) need(m, t->of, true);
+        return;
+    }
+    case EXPR_MACC: need_expr(m, e->l); return;
+
+    case EXPR_DEFINE: need(m, e->l->ty, true); //fallthrough
+    case EXPR_ARRSUB: EXPR_CASE_BINARY: case EXPR_ASSIGN:
+        need_expr(m, e->r);
+        //fallthrough
+    default: need_expr(m, e->l); return;
+    }
+}
+
+
+//Expressions
+
+static void emit_mem(struct emit *m, uint8_t *s, int64_t n) {
+    out_char(m->o, '"');
+    for(int64_t i = 0; i < n; i++) {
+        unsigned char c = s[i];
+        if(c == '"' || c == '\\') out_char(m->o, '\\'), out_char(m->o, c);
+        else if(c == '\n') out_str(m->o, "\\n");
+        else if(c == '\t') out_str(m->o, "\\t");
+        else if(c < ' ' || c >= 127 || c == '?') {
+            char oct[5] = {'\\', '0' + (c >> 6), '0' + (c >> 3 & 7), '0' + (c & 7)};
+            out_str(m->o, oct);
+        } else out_char(m->o, c);
+    }
+    out_char(m->o, '"');
+}
+
+static void emit_bytes(struct emit *m, struct token t) {
+    char *s = malloc(t.len + 1);
+    assert(s);
+    int n = token_unescape(t, s);
+    emit_mem(m, (uint8_t *)s, n);
+    free(s);
+}
+
+static void emit_int(struct emit *m, int64_t i) {
+    if(i == INT64_MIN) out_str(m->o, "(-9223372036854775807LL - 1)");
+    else {
+        if(i < 0) out_str(m->o, "(");
+        out_int(m->o, i);
+        if(i < INT32_MIN || i > INT32_MAX) out_str(m->o, "LL");
+        if(i < 0) out_str(m->o, ")");
+    }
+}
+
+//0 of type t, a compound literal for aggregates
+static void emit_zero(struct emit *m, struct type *t) {
+    struct type *r = sema_resolve(t);
+    if(r->type != TYPE_STRUCT && r->type != TYPE_ARRAY && r->type != TYPE_VEC) {
+        out_str(m->o, "0");
+        return;
+    }
+    out_str(m->o, "((");
+    out_decl(m, t, "");
+    out_str(m->o, "){0})");
+}
+
+static void emit_cval(struct emit *m, struct cval *c, struct token t) {
+    int64_t i;
+
+    switch(c->type) {
+    case CVAL_INT:
+        if(bn_to_int64(&c->num, &i)) emit_int(m, i);
+        else if(!c->num.neg && bn_bits(&c->num) <= 64) {
+            char *s = bn_str(&c->num);
+            out_str(m->o, s);
+            out_str(m->o, "ULL");
+            free(s);
+        } else emit_error(m, t, "Integer does not fit in 64 bits");
+        return;
+
+    case CVAL_REAL: {
+        double d = cval_to_double(c);
+        if(!isfinite(d)) {
+            emit_error(m, t, "Number does not fit in a float64");
+            return;
+        }
+        char buf[64];
+        snprintf(buf, sizeof buf, "%.17g", d);
+        if(!strpbrk(buf, ".e")) strcat(buf, ".0");
+        if(d < 0) out_fmt(m->o, "(%s)", buf);
+        else out_str(m->o, buf);
+        return;
+    }
+
+    case CVAL_STR:
+        out_str(m->o, "(uint8_t *)");
+        emit_bytes(m, c->str);
+        return;
+
+    case CVAL_NONE: return;   //Reported by fold()
+    }
+}
+
+static void emit_num(struct emit *m, struct token t) {
+    struct cval c;
+    cval_init(&c);
+    char *err = cval_parse(&c, t);
+    if(err) emit_error(m, t, err);
+    else emit_cval(m, &c, t);
+    cval_free(&c);
+}
+
+static char *local_name(struct emit *m, struct expr *l) {
+    for(int i = m->locals_n - 1; i >= 0; i--)
+        if(m->locals[i] == l) return m->local_names[i];
+    return NULL;
+}
+
+static bool name_used(struct emit *m, char *name) {
+    for(int i = 0; i < m->locals_n; i++)
+        if(strcmp(m->local_names[i], name) == 0) return true;
+    for(int i = 0; m->func && i < m->func->args_n; i++)
+        if(strcmp(m->args[i], name) == 0) return true;
+    for(int i = 0; m->func && i < m->func->ret_n; i++)
+        if(m->rets[i] && strcmp(m->rets[i], name) == 0) return true;
+    return false;
+}
+
+//Name a local for key from ident, unique within the function so that
+//shadowing (x := x + 1) reads the outer x
+//Name the local of key as name, which is taken
+static char *local_set(struct emit *m, struct expr *key, char *name) {
+    if(m->locals_n >= m->locals_c) {
+        m->locals_c = m->locals_c ? m->locals_c * 2 : 16;
+        m->locals = realloc(m->locals, m->locals_c * sizeof *m->locals);
+        m->local_names = realloc(m->local_names, m->locals_c * sizeof *m->local_names);
+        assert(m->locals); assert(m->local_names);
+    }
+    m->locals[m->locals_n] = key;
+    m->local_names[m->locals_n++] = name;
+    return name;
+}
+
+static char *local_new(struct emit *m, struct expr *key, char *ident) {
+    char *name = c_ident(ident);
+    for(int n = 1; name_used(m, name); n++) {
+        free(name);
+        name = fmt("%s_%i", ident, n);
+    }
+    return local_set(m, key, name);
+}
+
+//Name the local defined by l
+static char *local_add(struct emit *m, struct expr *l) {
+    char *ident = token_str(l->lit), *name = local_new(m, l, strcmp(ident, "_") ? ident : "discard");
+    free(ident);
+    return name;
+}
+
+static void emit_ident(struct emit *m, struct expr *e) {
+    if(e->local) {
+        char *name = local_name(m, e->local);
+        if(name) out_str(m->o, name);
+        else emit_error(m, e->lit, "Local used outside of its definition");
+        return;
+    }
+
+    if(e->arg >= 0) {
+        out_str(m->o, m->args[e->arg]);
+        return;
+    }
+
+    struct val *v = e->val;
+    switch(v ? v->type : VAL_MODULE) {
+    case VAL_CONST: emit_cval(m, v->cval, e->lit); return;
+    case VAL_VAR: case VAL_FUNC: out_str(m->o, ent(m, v)->name); return;
+    case VAL_MODULE:
+        snprintf(err_buf, ERRBUF_SIZE, "'%.*s' of another module is not available to the C backend",
+                e->lit.len, e->lit.str);
+        emit_error(m, e->lit, err_buf);
+        return;
+    }
+}
+
+static void emit_args(struct emit *m, struct expr *recv, bool deref, struct expr *args, int n,
+        char **outs, int outs_n) {
+    out_char(m->o, '(');
+    if(recv) {
+        if(deref) out_str(m->o, "*");
+        emit_expr(m, recv);
+    }
+    for(int i = 0; i < n; i++) {
+        if(i || recv) out_str(m->o, ", ");
+        emit_expr(m, &args[i]);
+    }
+    for(int i = 0; i < outs_n; i++) {
+        if(i || recv || n) out_str(m->o, ", ");
+        out_str(m->o, outs[i]);
+    }
+    out_char(m->o, ')');
+}
+
+//Whether call e stores the values returned through out-parameters
+static bool call_out(struct emit *m, struct expr *e) {
+    struct expr *f = e->f;
+    struct type *t = f->type == EXPR_MACC && f->r->val ? NULL : f->ty ? sema_resolve(f->ty) : type_none();
+    int ret_n = t ? (t->type == TYPE_FUNC ? t->ret_n : 0) : f->r->val->ret_n;
+    return ret_n > 1 && e->ty && tuple_out(m, sema_resolve(e->ty));
+}
+
+//Methods are called with the receiver as first argument, dereferenced if
+//the method is of the type pointed to. Calls returning through
+//out-parameters pass outs, pointers to where each value is stored.
+static void emit_call(struct emit *m, struct expr *e, char **outs) {
+    struct expr *f = e->f;
+    int outs_n = outs ? sema_resolve(e->ty)->mem_n : 0;
+
+    if(f->type == EXPR_MACC && f->r->val) {
+        struct val *v = f->r->val;
+        struct type *l = f->l->ty ? sema_resolve(f->l->ty) : type_none();
+        bool deref = l->type == TYPE_PTR && sema_resolve(v->args_type[0])->type != TYPE_PTR;
+        out_str(m->o, ent(m, v)->name);
+        emit_args(m, f->l, deref, e->args, e->args_n, outs, outs_n);
+        return;
+    }
+
+    emit_expr(m, f);
+    emit_args(m, NULL, false, e->args, e->args_n, outs, outs_n);
+}
+
+//Call e returning through out-parameters, storing to the members of a new
+//local tuple. Returns the name of the local.
+static char *emit_call_tmp(struct emit *m, struct expr *e) {
+    struct type *t = sema_resolve(e->ty);
+    char *tmp = local_new(m, e, "ret"), *outs[t->mem_n];
+    for(int i = 0; i < t->mem_n; i++) outs[i] = fmt("&%s._%i", tmp, i);
+
+    indent(m);
+    out_decl(m, e->ty, tmp);
+    out_str(m->o, ";\n");
+    indent(m);
+    emit_call(m, e, outs);
+    out_str(m->o, ";\n");
+    for(int i = 0; i < t->mem_n; i++) free(outs[i]);
+    return tmp;
+}
+
+static void emit_tacc(struct emit *m, struct expr *e) {
+    struct token mt = e->tacc.m->lit;
+    struct type *t = sema_resolve(e->tacc.t);
+
+    if(e->tacc.m->val) {
+        out_str(m->o, ent(m, e->tacc.m->val)->name);
+        return;
+    }
+
+    if(tok_is(mt, "size") || tok_is(mt, "align")) {
+        out_str(m->o, tok_is(mt, "size") ? "sizeof(" : "_Alignof(");
+        out_decl(m, e->tacc.t, "");
+        out_str(m->o, ")");
+        return;
+    }
+
+    int member = layout_offset_of(t, mt);
+    if(member >= 0 && !layout_is_bit(t, member)) {
+        layout_type(t);
+        if(t->size >= 0) {
+            out_int(m->o, t->offsets[member] / 8);
+            out_char(m->o, 'u');
+            return;
+        }
+    }
+
+    if(tok_is(mt, "num") && t->type == TYPE_ARRAY && t->n >= 0) {
+        out_int(m->o, t->n);
+        out_char(m->o, 'u');
+        return;
+    }
+
+    if(t->type == TYPE_ENUM)
+        for(int i = 0; i < t->opts_n; i++)
+            if(tok_is(mt, t->opts[i])) {
+                out_str(m->o, ent(m, t)->name);
+                out_str(m->o, "__");
+                out_str(m->o, t->opts[i]);
+                return;
+            }
+
+    snprintf(err_buf, ERRBUF_SIZE, "Type information '%.*s' is not available to the C backend",
+            mt.len, mt.str);
+    emit_error(m, mt, err_buf);
+}
+
+static void emit_stmt(struct emit *m, struct expr *e);
+static void emit_switch(struct emit *m, struct expr *e, bool ret);
+static void emit_operand(struct emit *m, struct expr *e, struct type *other);
+static void emit_unpack(struct emit *m, struct expr *e);
+static void emit_init(struct emit *m, struct expr *e);
+static bool is_bit_member(struct expr *e);
+static bool is_array_val(struct type *t);
+static void emit_copy(struct emit *m, struct expr *l, char *name, struct expr *r);
+static void emit_member(struct emit *m, struct expr *e);
+
+//Statements of a block, or e as a single statement
+static void emit_body(struct emit *m, struct expr *e) {
+    m->indent++;
+    if(e->type == EXPR_BLOCK)
+        for(int i = 0; i < e->vals_n; i++) emit_stmt(m, &e->vals[i]);
+    else emit_stmt(m, e);
+    m->indent--;
+}
+
+//Statement expression ({...}), valued as the last statement in e
+static void emit_stmt_expr(struct emit *m, struct expr *e) {
+    out_str(m->o, "({\n");
+    emit_body(m, e);
+
+    //A definition is valued as its locals
+    struct expr *last = e->type == EXPR_BLOCK ? &e->vals[e->vals_n-1] : e;
+    if(last->type == EXPR_DEFINE) {
+        m->indent++;
+        indent(m);
+        if(last->l->type == EXPR_TUPLE) emit_expr(m, last->l);
+        else out_str(m->o, local_name(m, last->l));
+        out_str(m->o, ";\n");
+        m->indent--;
+    }
+
+    indent(m);
+    out_str(m->o, "})");
+}
+
+static void emit_expr(struct emit *m, struct expr *e) {
+    switch(e->type) {
+    case EXPR_NONE: out_str(m->o, "((void)0)"); return;
+    case EXPR_NUM: emit_num(m, e->lit); return;
+    case EXPR_STR: out_str(m->o, "(uint8_t *)"); emit_bytes(m, e->lit); return;
+    case EXPR_IDENT: emit_ident(m, e); return;
+
+    case EXPR_POSTINC: case EXPR_POSTDEC:
+        out_char(m->o, '(');
+        emit_expr(m, e->l);
+        out_str(m->o, e->type == EXPR_POSTINC ? "++)" : "--)");
+        return;
+
+    case EXPR_PREINC: case EXPR_PREDEC: case EXPR_LNOT: case EXPR_BNOT:
+    case EXPR_NEG: case EXPR_DEFER: case EXPR_ADDR: {
+        if(e->type == EXPR_ADDR && is_bit_member(e->l))
+            emit_error(m, e->op, "Can not take the address of a bool struct member");
+        static char *ops[] = {
+            [EXPR_PREINC] = "++", [EXPR_PREDEC] = "--", [EXPR_LNOT] = "!",
+            [EXPR_BNOT] = "~", [EXPR_NEG] = "-", [EXPR_DEFER] = "*", [EXPR_ADDR] = "&",
+        };
+        out_char(m->o, '(');
+        out_str(m->o, ops[e->type]);
+        emit_expr(m, e->l);
+        out_char(m->o, ')');
+        return;
+    }
+
+    //A call returning through out-parameters stores to a local, taken as the
+    //value of a statement expression
+    case EXPR_FCALL: {
+        if(!call_out(m, e)) {
+            emit_call(m, e, NULL);
+            return;
+        }
+        out_str(m->o, "({\n");
+        m->indent++;
+        char *tmp = emit_call_tmp(m, e);
+        indent(m);
+        out_str(m->o, tmp);
+        out_str(m->o, ";\n");
+        m->indent--;
+        indent(m);
+        out_str(m->o, "})");
+        return;
+    }
+
+    //Checked indices trap when out of bounds
+    case EXPR_ARRSUB:
+        emit_expr(m, e->l);
+        out_str(m->o, e->check ? "[zen_bound(" : "[");
+        emit_expr(m, e->r);
+        if(e->check) out_fmt(m->o, ", %i)", sema_resolve(e->l->ty)->n);
+        out_char(m->o, ']');
+        return;
+
+    //. dereferences pointers
+    case EXPR_SACC: {
+        struct type *t = e->l->ty ? sema_resolve(e->l->ty) : type_none();
+        emit_expr(m, e->l);
+        out_str(m->o, t->type == TYPE_PTR ? "->" : ".");
+        char *name = token_str(e->r->lit), *c = c_ident(name);
+        out_str(m->o, c);
+        free(name); free(c);
+        return;
+    }
+
+    case EXPR_TACC: emit_tacc(m, e); return;
+
+    case EXPR_MACC:
+        emit_error(m, e->r->lit, "Methods can only be called");
+        return;
+
+    case EXPR_COMP_LIT:
+        if(ent(m, e)->name) {
+            out_str(m->o, ent(m, e)->name);
+            return;
+        }
+        out_str(m->o, "((");
+        out_decl(m, e->t, "");
+        out_char(m->o, ')');
+        emit_init(m, e);
+        out_char(m->o, ')');
+        return;
+
+    case EXPR_TUPLE:
+        out_str(m->o, "((");
+        out_decl(m, e->ty, "");
+        out_str(m->o, "){");
+        for(int i = 0; i < e->vals_n; i++) {
+            if(i) out_str(m->o, ", ");
+            emit_member(m, &e->vals[i]);
+        }
+        out_str(m->o, "})");
+        return;
+
+    case EXPR_CAST:
+        out_str(m->o, "((");
+        out_decl(m, e->tacc.t, "");
+        out_char(m->o, ')');
+        emit_expr(m, e->tacc.m);
+        out_char(m->o, ')');
+        return;
+
+    //(a, b) = ... is valued as the tuple assigned
+    case EXPR_ASSIGN:
+        if(e->l->type != EXPR_TUPLE) goto binary;
+        out_str(m->o, "({\n");
+        m->indent++;
+        emit_unpack(m, e);
+        indent(m);
+        emit_expr(m, e->l);
+        out_str(m->o, ";\n");
+        m->indent--;
+        indent(m);
+        out_str(m->o, "})");
+        return;
+
+    binary:
+    EXPR_CASE_BINARY: {
+        struct type *lt = e->l->ty ? sema_resolve(e->l->ty) : type_none();
+        struct type *rt = e->r->ty ? sema_resolve(e->r->ty) : type_none();
+        bool shift = e->type == EXPR_BSL || e->type == EXPR_BSR;
+        if(e->type == EXPR_ASSIGN && is_array_val(lt)) {
+            emit_copy(m, e->l, NULL, e->r);
+            return;
+        }
+
+        out_char(m->o, '(');
+        emit_operand(m, e->l, shift ? NULL : rt);
+        out_char(m->o, ' ');
+        out_str(m->o, expr_op_str[e->type]);
+        out_char(m->o, ' ');
+        if(e->type == EXPR_ASSIGN && is_bit_member(e->l)) out_str(m->o, "!!");
+        emit_operand(m, e->r, shift ? NULL : lt);
+        out_char(m->o, ')');
+        return;
+    }
+
+    case EXPR_DEFINE:
+        emit_error(m, e->l->lit, "Definitions can not be used as values by the C backend");
+        return;
+
+    case EXPR_BLOCK:
+        if(e->vals_n == 0) out_str(m->o, "((void)0)");
+        else emit_stmt_expr(m, e);
+        return;
+
+    case EXPR_IF:
+        if(!e->ctl.els) break;
+        out_char(m->o, '(');
+        emit_expr(m, e->ctl.cond);
+        out_str(m->o, " ? ");
+        emit_expr(m, e->ctl.body);
+        out_str(m->o, " : ");
+        emit_expr(m, e->ctl.els);
+        out_char(m->o, ')');
+        return;
+
+    //A switch with a value assigns it to a local, taken as the value of a
+    //statement expression
+    case EXPR_SWITCH: {
+        if(is_void(e->ty)) break;
+        char *r = local_new(m, e, "sw_value"), *ret_to = m->ret_to;
+        out_str(m->o, "({\n");
+        m->indent++;
+        indent(m);
+        out_decl(m, e->ty, r);
+        out_str(m->o, ";\n");
+        m->ret_to = r;
+        emit_switch(m, e, true);
+        m->ret_to = ret_to;
+        indent(m);
+        out_str(m->o, r);
+        out_str(m->o, ";\n");
+        m->indent--;
+        indent(m);
+        out_str(m->o, "})");
+        return;
+    }
+
+    case EXPR_FOR: break;
+    default: break;
+    }
+
+    emit_stmt_expr(m, e);
+}
+
+//Initializer {...} of compound literal e. Bit-field bools take the truth of
+//their value, rather than its lowest bit.
+static void emit_init(struct emit *m, struct expr *e) {
+    struct type *t = sema_resolve(e->t);
+
+    out_char(m->o, '{');
+    for(int i = 0; i < e->vals_n; i++) {
+        if(i) out_str(m->o, ", ");
+        if(t->type == TYPE_STRUCT && i < t->mem_n && layout_is_bit(t, i)) out_str(m->o, "!!");
+        emit_member(m, &e->vals[i]);
+    }
+    out_str(m->o, e->vals_n ? "}" : "0}");
+}
+
+//Whether e accesses a struct member packed to a bit
+static bool is_bit_member(struct expr *e) {
+    if(e->type != EXPR_SACC || !e->l->ty) return false;
+
+    struct type *t = sema_resolve(e->l->ty);
+    if(t->type == TYPE_PTR) t = sema_resolve(t->of);
+    if(t->type != TYPE_STRUCT) return false;
+
+    for(int i = 0; i < t->mem_n; i++)
+        if(tok_is(e->r->lit, t->idents[i])) return layout_is_bit(t, i);
+    return false;
+}
+
+//Operand e of a binary operator with the other operand of type other.
+//Scalars with vectors are converted to the element type, as C only allows
+//conversions that can not lose precision.
+static void emit_operand(struct emit *m, struct expr *e, struct type *other) {
+    struct type *t = e->ty ? sema_resolve(e->ty) : type_none();
+    if(!other || other->type != TYPE_VEC || t->type == TYPE_VEC
+            || (t->type == TYPE_PRIMATIVE && t->primative == other->of->primative)) {
+        emit_expr(m, e);
+        return;
+    }
+
+    out_str(m->o, "((");
+    out_str(m->o, c_prim[other->of->primative]);
+    out_char(m->o, ')');
+    emit_expr(m, e);
+    out_char(m->o, ')');
+}
+
+//Whether values of type t are arrays with a length, which C does not assign
+static bool is_array_val(struct type *t) {
+    t = t ? sema_resolve(t) : type_none();
+    return t->type == TYPE_ARRAY && t->n >= 0;
+}
+
+//Copy array r to l, or to the local named name if l is NULL. Arrays
+//returned by calls have no storage in C to copy from.
+static void emit_copy(struct emit *m, struct expr *l, char *name, struct expr *r) {
+    if(r->type == EXPR_FCALL) {
+        emit_error(m, l ? expr_tok(l) : r->f->lit, "Array values are not supported by the C backend");
+        return;
+    }
+
+    out_str(m->o, "__builtin_memcpy(");
+    if(l) emit_expr(m, l);
+    else out_str(m->o, name);
+    out_str(m->o, ", ");
+    emit_expr(m, r);
+    out_str(m->o, ", sizeof ");
+    if(l) emit_expr(m, l);
+    else out_str(m->o, name);
+    out_char(m->o, ')');
+}
+
+//Member e of a literal. An array member is only initialized from a literal,
+//as C has no array values to copy.
+static void emit_member(struct emit *m, struct expr *e) {
+    if(is_array_val(e->ty) && e->type != EXPR_COMP_LIT && e->type != EXPR_STR)
+        emit_error(m, expr_tok(e), "Array values are not supported by the C backend");
+    else emit_expr(m, e);
+}
+
+//Define the local of e, as declared type and initial value
+static void emit_define(struct emit *m, struct expr *e) {
+    if(e->l->type == EXPR_TUPLE) {
+        emit_error(m, e->op, "Definitions of several locals can only be statements in the C backend");
+        return;
+    }
+
+    struct type *t = e->l->ty;
+    char *name = local_add(m, e->l);
+    if(!t || t->type == TYPE_NONE || t->type == TYPE_ERR) {
+        emit_error(m, e->l->lit, "Can not infer type of local");
+        return;
+    }
+
+    //Arrays are initialized in place, strings without a terminator
+    struct type *rt = sema_resolve(t);
+
+    //A shared constant array is pointed to by a local only read, and copied
+    //to one that may be written
+    if(rt->type == TYPE_ARRAY && e->r->type == EXPR_COMP_LIT) {
+        char *lit = ent(m, e->r)->name;
+        if(lit && ent(m, e->l)->idx != 1 && sema_resolve(rt->of)->type != TYPE_ARRAY) {
+            char *d = fmt("const *%s", name);
+            out_decl(m, rt->of, d);
+            out_fmt(m->o, " = %s", lit);
+            free(d);
+            return;
+        }
+        out_decl(m, t, name);
+        if(!lit) {
+            out_str(m->o, " = ");
+            emit_init(m, e->r);
+            return;
+        }
+        out_str(m->o, ";\n");
+        indent(m);
+        out_fmt(m->o, "__builtin_memcpy(%s, %s, sizeof %s)", name, lit, name);
+        return;
+    }
+
+    //Other arrays are copied, as C does not initialize an array from one
+    out_decl(m, t, name);
+    if(is_array_val(rt) && e->r->type != EXPR_STR) {
+        out_str(m->o, ";\n");
+        indent(m);
+        emit_copy(m, NULL, name, e->r);
+        return;
+    }
+    out_str(m->o, " = ");
+    if(e->r->type == EXPR_STR && rt->type == TYPE_ARRAY) emit_bytes(m, e->r->lit);
+    else emit_expr(m, e->r);
+}
+
+static void emit_stmt(struct emit *m, struct expr *e) {
+    m->at = expr_tok(e).str ? expr_tok(e) : m->at;
+    if(e->type != EXPR_NONE) emit_line(m, expr_tok(e));
+
+    switch(e->type) {
+    case EXPR_NONE: return;
+
+    //Values with no effect are dropped, as C warns of them
+    case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: return;
+
+    case EXPR_BLOCK:
+        indent(m);
+        out_str(m->o, "{\n");
+        emit_body(m, e);
+        indent(m);
+        out_str(m->o, "}\n");
+        return;
+
+    case EXPR_IF:
+        indent(m);
+        out_str(m->o, "if(");
+        emit_expr(m, e->ctl.cond);
+        out_str(m->o, ") {\n");
+        emit_body(m, e->ctl.body);
+        if(e->ctl.els) {
+            indent(m);
+            out_str(m->o, "} else {\n");
+            emit_body(m, e->ctl.els);
+        }
+        indent(m);
+        out_str(m->o, "}\n");
+        return;
+
+    case EXPR_SWITCH: emit_switch(m, e, false); return;
+
+    case EXPR_FOR:
+        indent(m);
+        out_str(m->o, "for(");
+        if(e->ctl.init && e->ctl.init->type == EXPR_DEFINE) emit_define(m, e->ctl.init);
+        else if(e->ctl.init) emit_expr(m, e->ctl.init);
+        out_str(m->o, "; ");
+        if(e->ctl.cond) emit_expr(m, e->ctl.cond);
+        out_str(m->o, "; ");
+        if(e->ctl.step) emit_expr(m, e->ctl.step);
+        out_str(m->o, ") {\n");
+        emit_body(m, e->ctl.body);
+        indent(m);
+        out_str(m->o, "}\n");
+        return;
+
+    case EXPR_DEFINE:
+        if(e->l->type == EXPR_TUPLE) {
+            emit_unpack(m, e);
+            return;
+        }
+        indent(m);
+        emit_define(m, e);
+        out_str(m->o, ";\n");
+        return;
+
+    case EXPR_ASSIGN:
+        if(e->l->type == EXPR_TUPLE) {
+            emit_unpack(m, e);
+            return;
+        }
+        //fallthrough
+    default:
+        indent(m);
+        emit_expr(m, e);
+        out_str(m->o, ";\n");
+        return;
+    }
+}
+
+//(a, b) := r or (a, b) = r as statements. Calls returning through
+//out-parameters store straight to new locals, and to a local tuple when
+//assigning, as what is assigned to may be read by the callee.
+static void emit_unpack(struct emit *m, struct expr *e) {
+    struct expr *l = e->l, *r = e->r;
+    struct type *t = e->l->ty ? sema_resolve(e->l->ty) : type_none();
+    if(!sema_is_tuple(t) || t->mem_n != l->vals_n) {
+        emit_error(m, e->op, "Can not infer type of values");
+        return;
+    }
+
+    //Each _ is a local of its own, even when assigning. It is only declared
+    //when stored to, and otherwise stands for the member it discards.
+    char *names[l->vals_n];
+    bool def = e->type == EXPR_DEFINE, discard[l->vals_n];
+    for(int i = 0; i < l->vals_n; i++) {
+        struct expr *v = &l->vals[i];
+        discard[i] = v->local == v && v->lit.len == 1 && v->lit.str[0] == '_';
+        names[i] = v->local == v && !discard[i] ? local_add(m, v) : NULL;
+    }
+    bool out = r->type == EXPR_FCALL && call_out(m, r);
+    for(int i = 0; i < l->vals_n; i++)
+        if(discard[i] && def && (r->type == EXPR_TUPLE || out)) names[i] = local_add(m, &l->vals[i]);
+
+    //A tuple is defined in order, as new locals are not yet in scope of
+    //its values
+    if(def && r->type == EXPR_TUPLE) {
+        for(int i = 0; i < l->vals_n; i++) {
+            indent(m);
+            out_decl(m, t->types[i], names[i]);
+            if(discard[i]) out_str(m->o, " __attribute__((unused))");
+            if(is_array_val(t->types[i])) {
+                out_str(m->o, ";\n");
+                indent(m);
+                emit_copy(m, NULL, names[i], &r->vals[i]);
+            } else {
+                out_str(m->o, " = ");
+                emit_expr(m, &r->vals[i]);
+            }
+            out_str(m->o, ";\n");
+        }
+        return;
+    }
+
+    if(def && out) {
+        char *outs[l->vals_n];
+        for(int i = 0; i < l->vals_n; i++) {
+            indent(m);
+            out_decl(m, t->types[i], names[i]);
+            out_str(m->o, ";\n");
+            outs[i] = fmt("&%s", names[i]);
+        }
+        indent(m);
+        emit_call(m, r, outs);
+        out_str(m->o, ";\n");
+        for(int i = 0; i < l->vals_n; i++) free(outs[i]);
+        return;
+    }
+
+    char *tmp;
+    if(out) tmp = emit_call_tmp(m, r);
+    else {
+        tmp = local_new(m, r, "tuple");
+        indent(m);
+        out_decl(m, l->ty, tmp);
+        out_str(m->o, " = ");
+        emit_expr(m, r);
+        out_str(m->o, ";\n");
+    }
+    for(int i = 0; i < l->vals_n; i++) {
+        if(discard[i]) {
+            local_set(m, &l->vals[i], fmt("%s._%i", tmp, i));
+            continue;
+        }
+        indent(m);
+        if(is_array_val(t->types[i])) {
+            if(names[i]) {
+                out_decl(m, t->types[i], names[i]);
+                out_str(m->o, ";\n");
+                indent(m);
+            }
+            out_str(m->o, "__builtin_memcpy(");
+            if(names[i]) out_str(m->o, names[i]);
+            else emit_expr(m, &l->vals[i]);
+            out_fmt(m->o, ", %s._%i, sizeof %s._%i);\n", tmp, i, tmp, i);
+            continue;
+        }
+        if(names[i]) out_decl(m, t->types[i], names[i]);
+        else emit_expr(m, &l->vals[i]);
+        out_fmt(m->o, " = %s._%i;\n", tmp, i);
+    }
+}
+
+//Return e, a tuple, from a function returning several values: as a struct,
+//or by storing each through its out-parameter
+static void emit_ret_tuple(struct emit *m, struct expr *e) {
+    struct val *v = m->func;
+    if(!m->rets[0]) {
+        indent(m);
+        out_str(m->o, "return ");
+        emit_expr(m, e);
+        out_str(m->o, ";\n");
+        return;
+    }
+
+    if(e->type == EXPR_TUPLE && e->vals_n == v->ret_n) {
+        for(int i = 0; i < v->ret_n; i++) {
+            indent(m);
+            out_fmt(m->o, "*%s = ", m->rets[i]);
+            emit_expr(m, &e->vals[i]);
+            out_str(m->o, ";\n");
+        }
+    } else if(e->type == EXPR_FCALL && call_out(m, e)) {
+        //A call returning the same passes the out-parameters on
+        indent(m);
+        emit_call(m, e, m->rets);
+        out_str(m->o, ";\n");
+    } else {
+        struct type *t = e->ty ? sema_resolve(e->ty) : type_none();
+        if(!sema_is_tuple(t) || t->mem_n != v->ret_n) {
+            snprintf(err_buf, ERRBUF_SIZE, "Expected %i values", v->ret_n);
+            emit_error(m, expr_tok(e).str ? expr_tok(e) : m->at, err_buf);
+            return;
+        }
+        char *tmp = local_new(m, e, "tuple");
+        indent(m);
+        out_decl(m, e->ty, tmp);
+        out_str(m->o, " = ");
+        emit_expr(m, e);
+        out_str(m->o, ";\n");
+        for(int i = 0; i < v->ret_n; i++) {
+            indent(m);
+            out_fmt(m->o, "*%s = %s._%i;\n", m->rets[i], tmp, i);
+        }
+    }
+    indent(m);
+    out_str(m->o, "return;\n");
+}
+
+static void emit_ret_to(struct emit *m) {
+    if(m->ret_to) out_fmt(m->o, "%s = ", m->ret_to);
+    else out_str(m->o, "return ");
+}
+
+//Statements of e, returning its value, or assigning it to m->ret_to
+static void emit_ret(struct emit *m, struct expr *e) {
+    switch(e->type) {
+    case EXPR_NONE: return;
+
+    case EXPR_BLOCK:
+        for(int i = 0; i < e->vals_n - 1; i++) emit_stmt(m, &e->vals[i]);
+        if(e->vals_n) emit_ret(m, &e->vals[e->vals_n-1]);
+        return;
+
+    case EXPR_IF:
+        if(!e->ctl.els) break;
+        emit_line(m, expr_tok(e));
+        indent(m);
+        out_str(m->o, "if(");
+        emit_expr(m, e->ctl.cond);
+        out_str(m->o, ") {\n");
+        m->indent++;
+        emit_ret(m, e->ctl.body);
+        m->indent--;
+        indent(m);
+        out_str(m->o, "} else {\n");
+        m->indent++;
+        emit_ret(m, e->ctl.els);
+        m->indent--;
+        indent(m);
+        out_str(m->o, "}\n");
+        return;
+
+    case EXPR_SWITCH:
+        if(!e->ctl.els && is_void(e->ty)) break;
+        emit_switch(m, e, true);
+        return;
+
+    case EXPR_DEFINE:
+        emit_stmt(m, e);
+        if(e->l->type == EXPR_TUPLE) {
+            emit_ret(m, e->l);
+            return;
+        }
+        emit_line(m, expr_tok(e));
+        indent(m);
+        emit_ret_to(m);
+        out_str(m->o, local_name(m, e->l));
+        out_str(m->o, ";\n");
+        return;
+
+    case EXPR_FOR: break;
+
+    default:
+        emit_line(m, expr_tok(e));
+        if(!m->ret_to && m->func && m->func->ret_n > 1) {
+            emit_ret_tuple(m, e);
+            return;
+        }
+        indent(m);
+        emit_ret_to(m);
+        emit_expr(m, e);
+        out_str(m->o, ";\n");
+        return;
+    }
+
+    emit_stmt(m, e);
+}
+
+//Decision tree over the labels a to b of sw, comparing arg with the middle
+//one until few are left
+static void emit_tree(struct emit *m, struct lower_switch *sw, char *arg, int id, char *dflt,
+        int a, int b) {
+    if(b - a <= LOWER_CHAIN_MAX) {
+        for(int i = a; i < b; i++) {
+            indent(m);
+            out_fmt(m->o, "if(%s == ", arg);
+            emit_int(m, sw->labels[i].val);
+            out_fmt(m->o, ") goto sw%i_%i;\n", id, sw->labels[i].c);
+        }
+        indent(m);
+        out_fmt(m->o, "goto sw%i_%s;\n", id, dflt);
+        return;
+    }
+
+    int mid = a + (b - a) / 2;
+    indent(m);
+    out_fmt(m->o, "if(%s < ", arg);
+    emit_int(m, sw->labels[mid].val);
+    out_str(m->o, ") {\n");
+    m->indent++;
+    emit_tree(m, sw, arg, id, dflt, a, mid);
+    m->indent--;
+    indent(m);
+    out_str(m->o, "} else {\n");
+    m->indent++;
+    emit_tree(m, sw, arg, id, dflt, mid, b);
+    m->indent--;
+    indent(m);
+    out_str(m->o, "}\n");
+}
+
+//Jump table of label addresses indexed by arg - lo, the default for values
+//without a case
+static void emit_table(struct emit *m, struct expr *e, char *arg, int id, char *dflt) {
+    struct lower_switch *sw = e->ctl.plan;
+    char *tab = local_new(m, e->ctl.body, "sw_table");
+
+    indent(m);
+    out_fmt(m->o, "static void *const %s[] = {", tab);
+    int k = 0;
+    for(uint64_t i = 0; i <= (uint64_t)sw->hi - (uint64_t)sw->lo; i++) {
+        out_str(m->o, i ? "," : "");
+        out_str(m->o, i % 8 ? " " : "\n");
+        if(i % 8 == 0) m->indent++, indent(m), m->indent--;
+        if(k < sw->n && (uint64_t)sw->labels[k].val - (uint64_t)sw->lo == i)
+            out_fmt(m->o, "&&sw%i_%i", id, sw->labels[k++].c);
+        else out_fmt(m->o, "&&sw%i_%s", id, dflt);
+    }
+    out_str(m->o, "\n");
+    indent(m);
+    out_str(m->o, "};\n");
+
+    if(sw->check) {
+        indent(m);
+        out_fmt(m->o, "if((uint64_t)%s - (uint64_t)", arg);
+        emit_int(m, sw->lo);
+        out_fmt(m->o, " > %lluu) goto sw%i_%s;\n",
+                (unsigned long long)((uint64_t)sw->hi - (uint64_t)sw->lo), id, dflt);
+    }
+    indent(m);
+    out_fmt(m->o, "goto *%s[(uint64_t)%s - (uint64_t)", tab, arg);
+    emit_int(m, sw->lo);
+    out_str(m->o, "];\n");
+}
+
+//Labels a to b of sw, all of one length, confirmed by memcmp against the
+//string arg, in the one slot of their perfect hash or in turn
+static void emit_hash(struct emit *m, struct expr *e, char *arg, int id, char *dflt, int a, int b) {
+    struct lower_switch *sw = e->ctl.plan;
+    struct lower_label *l = &sw->labels[a];
+    struct expr *c = &e->ctl.body->vals[l->c];
+
+    if(l->size <= 1) {
+        for(int i = a; i < b; i++) {
+            indent(m);
+            out_fmt(m->o, "if(__builtin_memcmp(%s, ", arg);
+            emit_mem(m, sw->labels[i].str, sw->labels[i].val);
+            out_fmt(m->o, ", %llu) == 0) goto sw%i_%i;\n",
+                    (unsigned long long)sw->labels[i].val, id, sw->labels[i].c);
+        }
+        indent(m);
+        out_fmt(m->o, "goto sw%i_%s;\n", id, dflt);
+        return;
+    }
+
+    char *keys = local_new(m, c, "sw_keys"), *tab = local_new(m, c, "sw_table");
+    char *h = local_new(m, c, "sw_hash"), *i = local_new(m, c, "i");
+    int slot[l->size];
+    for(int k = 0; k < l->size; k++) slot[k] = -1;
+    for(int k = a; k < b; k++) slot[sw->labels[k].slot] = k;
+
+    indent(m);
+    out_fmt(m->o, "static const uint8_t *const %s[] = {", keys);
+    for(int k = 0; k < l->size; k++) {
+        out_str(m->o, k ? ", " : "");
+        if(slot[k] < 0) {
+            out_str(m->o, "0");
+            continue;
+        }
+        out_str(m->o, "(const uint8_t *)");
+        emit_mem(m, sw->labels[slot[k]].str, l->val);
+    }
+    out_str(m->o, "};\n");
+    indent(m);
+    out_fmt(m->o, "static void *const %s[] = {", tab);
+    for(int k = 0; k < l->size; k++) {
+        out_str(m->o, k ? ", " : "");
+        if(slot[k] < 0) out_fmt(m->o, "&&sw%i_%s", id, dflt);
+        else out_fmt(m->o, "&&sw%i_%i", id, sw->labels[slot[k]].c);
+    }
+    out_str(m->o, "};\n");
+
+    indent(m);
+    out_fmt(m->o, "uint32_t %s = %uu;\n", h, LOWER_HASH_BASIS ^ l->seed);
+    indent(m);
+    out_fmt(m->o, "for(uint64_t %s = 0; %s < %llu; %s++) %s = (%s ^ %s[%s]) * %uu;\n",
+            i, i, (unsigned long long)l->val, i, h, h, arg, i, LOWER_HASH_PRIME);
+    indent(m);
+    out_fmt(m->o, "%s = (%s ^ %s >> 16) & %i;\n", h, h, h, l->size - 1);
+    indent(m);
+    out_fmt(m->o, "if(%s[%s] && __builtin_memcmp(%s, %s[%s], %llu) == 0) goto *%s[%s];\n",
+            keys, h, arg, keys, h, (unsigned long long)l->val, tab, h);
+    indent(m);
+    out_fmt(m->o, "goto sw%i_%s;\n", id, dflt);
+}
+
+//Switch on the length of string arg, then a hash of it for each length
+static void emit_string(struct emit *m, struct expr *e, char *arg, int id, char *dflt) {
+    struct lower_switch *sw = e->ctl.plan;
+    char *len = local_new(m, e->ctl.body, "sw_len");
+
+    indent(m);
+    out_fmt(m->o, "uint64_t %s = ", len);
+    if(e->ctl.step) emit_expr(m, e->ctl.step);
+    else out_int(m->o, sema_resolve(e->ctl.cond->ty)->n);
+    out_str(m->o, ";\n");
+
+    for(int a = 0, b; a < sw->n; a = b) {
+        for(b = a; b < sw->n && sw->labels[b].val == sw->labels[a].val; b++);
+        if(!e->ctl.step && sw->labels[a].val != sema_resolve(e->ctl.cond->ty)->n) continue;
+        indent(m);
+        out_fmt(m->o, "if(%s == %llu) {\n", len, (unsigned long long)sw->labels[a].val);
+        m->indent++;
+        emit_hash(m, e, arg, id, dflt, a, b);
+        m->indent--;
+        indent(m);
+        out_str(m->o, "}\n");
+    }
+    indent(m);
+    out_fmt(m->o, "goto sw%i_%s;\n", id, dflt);
+}
+
+//Body of a case, without the fallthrough ending it. If ret, its value is
+//returned through emit_ret().
+static void emit_case(struct emit *m, struct expr *b, bool ret, bool falls) {
+    m->indent++;
+    int n = b->vals_n - falls;
+    for(int i = 0; i < n; i++) {
+        if(ret && !falls && i == n - 1) emit_ret(m, &b->vals[i]);
+        else emit_stmt(m, &b->vals[i]);
+    }
+    m->indent--;
+}
+
+//Whether the dispatch planned in sw can take no case
+static bool reaches_default(struct lower_switch *sw) {
+    return sw->kind != LOWER_TABLE || sw->check || (uint64_t)sw->hi - (uint64_t)sw->lo >= (uint64_t)sw->n;
+}
+
+//Switch e dispatches to its cases, labeled sw<id>_<case> in order, so
+//falling through is leaving out the jump to the end, which is only labeled
+//if jumped to. If ret, the value of each case is returned through
+//emit_ret(), and without a default 0 is when no case is taken.
+static void emit_switch(struct emit *m, struct expr *e, bool ret) {
+    struct lower_switch *sw = e->ctl.plan;
+    struct expr *cases = e->ctl.body->vals;
+    int n = e->ctl.body->vals_n, id = m->switches_n++;
+    bool zero = ret && !e->ctl.els;
+    char *dflt = e->ctl.els || zero ? "default" : "end";
+    assert(sw);
+
+    bool end = !e->ctl.els && !zero && reaches_default(sw);
+    for(int i = 0; i < n; i++) {
+        struct expr *b = cases[i].ctl.body;
+        bool falls = b->vals_n && b->vals[b->vals_n-1].type == EXPR_FALLTHROUGH;
+        if(!falls && !(ret && !m->ret_to)) end = true;
+    }
+
+    indent(m);
+    out_str(m->o, "{\n");
+    m->indent++;
+
+    char *arg = NULL;
+    if(e->ctl.cond) {
+        arg = local_new(m, e, "sw");
+        indent(m);
+        if(sw->kind == LOWER_HASH) out_fmt(m->o, "const uint8_t *%s", arg);
+        else out_decl(m, e->ctl.cond->ty, arg);
+        out_str(m->o, " = ");
+        emit_expr(m, e->ctl.cond);
+        out_str(m->o, ";\n");
+    }
+
+    switch(sw->kind) {
+    case LOWER_CHAIN:
+        for(int i = 0; i < n; i++) {
+            indent(m);
+            out_str(m->o, "if(");
+            if(arg) out_fmt(m->o, "%s == ", arg);
+            emit_expr(m, cases[i].ctl.cond);
+            out_fmt(m->o, ") goto sw%i_%i;\n", id, i);
+        }
+        indent(m);
+        out_fmt(m->o, "goto sw%i_%s;\n", id, dflt);
+        break;
+    case LOWER_TREE: emit_tree(m, sw, arg, id, dflt, 0, sw->n); break;
+    case LOWER_TABLE: emit_table(m, e, arg, id, dflt); break;
+    case LOWER_HASH: emit_string(m, e, arg, id, dflt); break;
+    }
+
+    for(int i = 0; i < n; i++) {
+        struct expr *b = cases[i].ctl.body;
+        bool falls = b->vals_n && b->vals[b->vals_n-1].type == EXPR_FALLTHROUGH;
+        indent(m);
+        out_fmt(m->o, "sw%i_%i: {\n", id, i);
+        emit_case(m, b, ret, falls);
+        if(!falls && !(ret && !m->ret_to)) {
+            m->indent++;
+            indent(m);
+            out_fmt(m->o, "goto sw%i_end;\n", id);
+            m->indent--;
+        }
+        indent(m);
+        out_str(m->o, "}\n");
+    }
+    if(e->ctl.els) {
+        indent(m);
+        out_fmt(m->o, "sw%i_default: {\n", id);
+        emit_case(m, e->ctl.els, ret, false);
+        indent(m);
+        out_str(m->o, "}\n");
+    } else if(zero) {
+        indent(m);
+        out_fmt(m->o, "sw%i_default: {\n", id);
+        m->indent++;
+        indent(m);
+        emit_ret_to(m);
+        emit_zero(m, e->ty);
+        out_str(m->o, ";\n");
+        m->indent--;
+        indent(m);
+        out_str(m->o, "}\n");
+    }
+    if(end) {
+        indent(m);
+        out_fmt(m->o, "sw%i_end:;\n", id);
+    }
+
+    m->indent--;
+    indent(m);
+    out_str(m->o, "}\n");
+}
+
+
+//Globals
+
+static bool is_void(struct type *t) {
+    t = sema_resolve(t);
+    return t->type == TYPE_PRIMATIVE && t->primative == TYPE_VOID;
+}
+
+//Whether e is a C constant expression, so it can initialize a global
+static bool is_static(struct expr *e) {
+    switch(e->type) {
+    case EXPR_NUM: case EXPR_STR: case EXPR_TACC: return true;
+    case EXPR_IDENT: return e->val && !e->local && e->arg < 0
+        && (e->val->type == VAL_CONST || e->val->type == VAL_FUNC);
+    case EXPR_NEG: case EXPR_BNOT: case EXPR_LNOT: return is_static(e->l);
+    case EXPR_CAST: return is_static(e->tacc.m);
+    case EXPR_ADDR:
+        return e->l->type == EXPR_IDENT && e->l->val && !e->l->local && e->l->arg < 0
+            && e->l->val->type == VAL_VAR;
+    EXPR_CASE_BINARY: return is_static(e->l) && is_static(e->r);
+    case EXPR_COMP_LIT:
+        for(int i = 0; i < e->vals_n; i++) if(!is_static(&e->vals[i])) return false;
+        return true;
+    default: return false;
+    }
+}
+
+//Whether e is an array, which decays to a pointer that may be written through
+static bool decays(struct expr *e) {
+    return e->ty && sema_resolve(e->ty)->type == TYPE_ARRAY;
+}
+
+//Share constant compound literal e, unless it is an array without a length.
+//Returns whether it is.
+static bool share_lit(struct emit *m, struct expr *e) {
+    struct type *t = sema_resolve(e->t);
+    if(!is_static(e) || (t->type == TYPE_ARRAY && t->n < 0)) return false;
+
+    for(int i = 0; i < m->lits_n; i++) {
+        if(!expr_eq(m->lits[i], e)) continue;
+        ent(m, e)->name = strdup(ent(m, m->lits[i])->name);
+        return true;
+    }
+
+    if(m->lits_n == m->lits_c) {
+        m->lits_c = m->lits_c ? m->lits_c * 2 : EMIT_MAP_INITIAL_CAP;
+        m->lits = realloc(m->lits, m->lits_c * sizeof *m->lits);
+        assert(m->lits);
+    }
+    m->lits[m->lits_n] = e;
+    ent(m, e)->name = fmt("%s__lit%i", m->mod, m->lits_n++);
+    return true;
+}
+
+//Find the compound literals of e to share, where read is whether the value
+//of e is only read. A literal that may be written or addressed is built
+//where used, and locals that may be are marked.
+static void share_lits(struct emit *m, struct expr *e, bool read) {
+    if(!e) return;
+
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_TACC: return;
+
+    case EXPR_IDENT:
+        if(e->local && !read) ent(m, e->local)->idx = 1;
+        else if(e->arg >= 0 && !read && m->func) ent(m, &m->func->args[e->arg])->idx = 1;
+        return;
+
+    case EXPR_COMP_LIT:
+        if(read && share_lit(m, e)) return;
+        //fallthrough
+    case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) share_lits(m, &e->vals[i], !decays(&e->vals[i]));
+        return;
+
+    case EXPR_FCALL:
+        share_lits(m, e->f, false);
+        for(int i = 0; i < e->args_n; i++) share_lits(m, &e->args[i], !decays(&e->args[i]));
+        return;
+
+    //Arrays defined by a for can not be copied to, those switched on are
+    //only compared
+    EXPR_CASE_CTL: {
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        if(e->type == EXPR_FOR && c[0] && c[0]->type == EXPR_DEFINE) c[0] = c[0]->r;
+        for(int i = 0; i < 5; i++)
+            share_lits(m, c[i], c[i] && (!decays(c[i]) || (i == 1 && e->type == EXPR_SWITCH)));
+        return;
+    }
+
+    case EXPR_CAST: share_lits(m, e->tacc.m, !decays(e->tacc.m)); return;
+
+    //Elements read are read from the array, as are members
+    case EXPR_ARRSUB:
+        share_lits(m, e->l, read && !decays(e));
+        share_lits(m, e->r, true);
+        return;
+    case EXPR_SACC: share_lits(m, e->l, read); return;
+
+    case EXPR_DEFINE:
+        if(e->l->type == EXPR_TUPLE) share_lits(m, e->r, true);
+        else share_lits(m, e->r, e->r->type == EXPR_COMP_LIT || !decays(e->r));
+        return;
+
+    case EXPR_ASSIGN:
+        share_lits(m, e->l, false);
+        share_lits(m, e->r, !decays(e->r));
+        return;
+
+    case EXPR_POSTINC: case EXPR_POSTDEC: case EXPR_PREINC: case EXPR_PREDEC:
+    case EXPR_ADDR: case EXPR_DEFER: case EXPR_MACC:
+        share_lits(m, e->l, false);
+        return;
+
+    EXPR_CASE_BINARY: share_lits(m, e->r, !decays(e->r)); //fallthrough
+    default: share_lits(m, e->l, !decays(e->l)); return;
+    }
+}
+
+static struct type *var_type(struct val *v) {
+    if(v->expr_type->type != TYPE_NONE) return v->expr_type;
+    return v->expr.ty ? v->expr.ty : type_none();
+}
+
+static void emit_var(struct emit *m, struct val *v) {
+    struct type *t = var_type(v);
+    m->at = expr_tok(&v->expr);
+
+    if(!v->export) out_str(m->o, "static ");
+    out_decl(m, t, ent(m, v)->name);
+
+    if(v->expr.type != EXPR_NONE && is_static(&v->expr)) {
+        out_str(m->o, " = ");
+        if(v->expr.type == EXPR_STR && sema_resolve(t)->type == TYPE_ARRAY) emit_bytes(m, v->expr.lit);
+        else if(v->expr.type == EXPR_COMP_LIT) emit_init(m, &v->expr);
+        else emit_expr(m, &v->expr);
+    }
+    out_str(m->o, ";\n");
+}
+
+//Name of out-parameter i of v, apart from its arguments
+static char *ret_name(struct val *v, int i) {
+    char *name = fmt("ret_%i", i);
+    for(int j = 0; j < v->args_n; j++) {
+        char *a = c_ident(v->args[j]);
+        if(strcmp(a, name) == 0) {
+            char *s = fmt("%s_", name);
+            free(name);
+            name = s;
+            j = -1;
+        }
+        free(a);
+    }
+    return name;
+}
+
+//Signature of function v, with a pointer to each value it returns if they
+//are stored through out-parameters. params names the arguments, or is NULL
+//to name them as in Zen.
+static void emit_sig(struct emit *m, struct val *v, char **params) {
+    if(!v->export || v->generic) out_str(m->o, "static ");
+
+    struct type *rt = ret_type(m, v->ret_type, v->ret_n);
+    int outs = v->ret_n > 1 && is_void(rt) ? v->ret_n : 0;
+
+    char *args = strdup(v->args_n + outs ? "" : "void");
+    for(int i = 0; i < v->args_n + outs; i++) {
+        char *a = i >= v->args_n ? ret_name(v, i - v->args_n)
+            : params ? strdup(params[i]) : c_ident(v->args[i]);
+        struct type *t = i < v->args_n ? v->args_type[i] : ptr_to(v->ret_type[i - v->args_n]);
+        char *d = decl(m, t, a);
+        char *s = fmt("%s%s%s", args, i ? ", " : "", d);
+        free(a); free(d); free(args);
+        args = s;
+    }
+
+    char *inner = fmt("%s(%s)", ent(m, v)->name, args);
+    out_decl(m, rt, inner);
+    free(inner); free(args);
+}
+
+//Integer i of type t, written to have that type in C, or int if narrower
+static void emit_typed_int(struct emit *m, int64_t i, struct type *t) {
+    t = sema_resolve(t);
+    if(t->type == TYPE_ENUM) t = sema_resolve(enum_repr(t));
+    enum type_primative p = t->type == TYPE_PRIMATIVE ? t->primative : TYPE_INT;
+
+    if(p == TYPE_UINT || p == TYPE_UINT32) out_fmt(m->o, "%lluu", (unsigned long long)(uint32_t)i);
+    else if(p == TYPE_UINT64) out_fmt(m->o, "%lluULL", (unsigned long long)i);
+    else if(p == TYPE_INT64 && i >= INT32_MIN && i <= INT32_MAX)
+        out_fmt(m->o, i < 0 ? "(%lldLL)" : "%lldLL", (long long)i);
+    else emit_int(m, i);
+}
+
+static void emit_ir_val(struct emit *m, char **names, struct ir_val v) {
+    switch(v.kind) {
+    case IR_NONE: return;
+    case IR_VAR: out_str(m->o, names[v.var]); return;
+    case IR_INT: emit_typed_int(m, v.i, v.ty); return;
+    case IR_LEAF: emit_expr(m, v.leaf); return;
+    case IR_GLOBAL: out_str(m->o, ent(m, v.global)->name); return;
+    }
+}
+
+//Memory loaded or stored by in
+static void emit_ir_mem(struct emit *m, char **names, struct ir_ins *in) {
+    emit_ir_val(m, names, in->a);
+    if(in->b.kind == IR_NONE) return;
+    out_str(m->o, in->n >= 0 ? "[zen_bound(" : "[");
+    emit_ir_val(m, names, in->b);
+    if(in->n >= 0) out_fmt(m->o, ", %i)", in->n);
+    out_char(m->o, ']');
+}
+
+static void emit_ir_ins(struct emit *m, struct ir_func *f, char **names, struct ir_ins *in) {
+    static char *unary[] = {[IR_NEG] = "-", [IR_BNOT] = "~", [IR_LNOT] = "!"};
+
+    indent(m);
+    if(in->d >= 0 && names[in->d]) out_fmt(m->o, "%s = ", names[in->d]);
+
+    switch(in->op) {
+    case IR_COPY:
+        if(!ir_same(ir_type(f, in->a), f->vars[in->d].ty)) {
+            out_char(m->o, '(');
+            out_decl(m, f->vars[in->d].ty, "");
+            out_char(m->o, ')');
+        }
+        emit_ir_val(m, names, in->a);
+        break;
+
+    case IR_NEG: case IR_BNOT: case IR_LNOT:
+        out_str(m->o, unary[in->op]);
+        emit_ir_val(m, names, in->a);
+        break;
+
+    case IR_LOAD: emit_ir_mem(m, names, in); break;
+    case IR_STORE:
+        emit_ir_mem(m, names, in);
+        out_str(m->o, " = ");
+        emit_ir_val(m, names, in->c);
+        break;
+
+    case IR_CALL:
+        out_str(m->o, ent(m, in->f)->name);
+        out_char(m->o, '(');
+        for(int i = 0; i < in->args_n; i++) {
+            if(i) out_str(m->o, ", ");
+            emit_ir_val(m, names, in->args[i]);
+        }
+        out_char(m->o, ')');
+        break;
+
+    default:
+        emit_ir_val(m, names, in->a);
+        out_fmt(m->o, " %s ", expr_op_str[EXPR_MUL + (in->op - IR_MUL)]);
+        emit_ir_val(m, names, in->b);
+        break;
+    }
+    out_str(m->o, ";\n");
+}
+
+//Copies the phis of block s make on the edge from block k, through
+//temporaries where one reads the var of another
+static void emit_ir_phis(struct emit *m, struct ir_func *f, char **names, int k, int s) {
+    struct ir_block *bs = &f->blocks[s];
+    int e = 0, n = 0;
+    while(bs->preds[e] != k) e++;
+    while(n < bs->ins_n && bs->ins[n].op == IR_PHI) n++;
+
+    bool tmp = false;
+    for(int i = 0; i < n; i++)
+        for(int j = 0; j < n; j++) {
+            struct ir_val a = bs->ins[j].args[e];
+            tmp |= i != j && a.kind == IR_VAR && a.var == bs->ins[i].d;
+        }
+
+    char *t[n + 1];
+    if(tmp) {
+        indent(m);
+        out_str(m->o, "{\n");
+        m->indent++;
+        for(int i = 0; i < n; i++) {
+            t[i] = local_new(m, NULL, "phi");
+            indent(m);
+            out_decl(m, f->vars[bs->ins[i].d].ty, t[i]);
+            out_str(m->o, " = ");
+            emit_ir_val(m, names, bs->ins[i].args[e]);
+            out_str(m->o, ";\n");
+        }
+    }
+
+    for(int i = 0; i < n; i++) {
+        struct ir_val a = bs->ins[i].args[e];
+        if(!tmp && a.kind == IR_VAR && a.var == bs->ins[i].d) continue;
+        indent(m);
+        out_fmt(m->o, "%s = ", names[bs->ins[i].d]);
+        if(tmp) out_str(m->o, t[i]);
+        else emit_ir_val(m, names, a);
+        out_str(m->o, ";\n");
+    }
+
+    if(tmp) {
+        m->indent--;
+        indent(m);
+        out_str(m->o, "}\n");
+    }
+}
+
+static bool is_jump(struct ir_block *bk) {
+    return bk->ins_n == 1 && bk->ins[0].op == IR_JUMP;
+}
+
+//Whether block k only jumps on to a block that does more, and so is emitted
+//right before it
+static bool is_edge(struct ir_func *f, int k) {
+    int s = f->blocks[k].succ[0];
+    return k && is_jump(&f->blocks[k]) && !(s && is_jump(&f->blocks[s]));
+}
+
+//Body of a function from its IR. Vars are declared first, named after the
+//locals they are versions of. Blocks are labeled where jumped to, falling
+//through to the next, and phis are copies on the edges into their block.
+static void emit_ir(struct emit *m, struct ir_func *f) {
+    char **names = calloc(f->vars_n + 1, sizeof *names);
+    int *uses = calloc(f->vars_n + 1, sizeof *uses), *order = malloc((f->blocks_n + 1) * sizeof *order);
+    bool *label = calloc(f->blocks_n + 1, sizeof *label);
+    assert(names); assert(uses); assert(order); assert(label);
+
+    //Blocks only jumping on, such as those on edges to phis, come right
+    //before where they jump to
+    int n = 0;
+    for(int i = 0; i < f->blocks_n; i++) {
+        if(f->blocks[i].dead || is_edge(f, i)) continue;
+        for(int j = 1; j < f->blocks_n; j++)
+            if(!f->blocks[j].dead && is_edge(f, j) && f->blocks[j].succ[0] == i) order[n++] = j;
+        order[n++] = i;
+    }
+    for(int i = 0; i < n; i++) {
+        struct ir_block *bk = &f->blocks[order[i]];
+        for(int j = 0; j < bk->ins_n; j++) {
+            struct ir_ins *in = &bk->ins[j];
+            struct ir_val ops[] = {in->a, in->b, in->c};
+            for(int k = 0; k < 3; k++) if(ops[k].kind == IR_VAR) uses[ops[k].var]++;
+            for(int k = 0; k < in->args_n; k++) if(in->args[k].kind == IR_VAR) uses[in->args[k].var]++;
+        }
+    }
+    for(int i = 0; i < f->vars_n; i++)
+        if(f->vars[i].arg >= 0) names[i] = m->args[f->vars[i].arg];
+
+    for(int i = 0; i < n; i++) {
+        struct ir_block *bk = &f->blocks[order[i]];
+        for(int j = 0; j < bk->ins_n; j++) {
+            int d = bk->ins[j].d;
+            if(d < 0 || !uses[d]) continue;
+            names[d] = local_new(m, NULL, f->vars[d].name ? f->vars[d].name : "t");
+            indent(m);
+            out_decl(m, f->vars[d].ty, names[d]);
+            out_str(m->o, ";\n");
+        }
+
+        //Labels of the blocks not fallen through to
+        struct ir_ins *end = &bk->ins[bk->ins_n - 1];
+        int next = i + 1 < n ? order[i + 1] : -1;
+        if(end->op == IR_JUMP && bk->succ[0] != next) label[bk->succ[0]] = true;
+        if(end->op == IR_BRANCH) {
+            label[bk->succ[0]] |= bk->succ[0] != next;
+            label[bk->succ[1]] |= bk->succ[0] == next || bk->succ[1] != next;
+        }
+    }
+
+    for(int i = 0; i < n; i++) {
+        int k = order[i], next = i + 1 < n ? order[i + 1] : -1;
+        struct ir_block *bk = &f->blocks[k];
+        if(label[k]) {
+            indent(m);
+            out_fmt(m->o, "b%i:;\n", k);
+        }
+
+        for(int j = 0; j < bk->ins_n - 1; j++) {
+            struct ir_ins *in = &bk->ins[j];
+            if(in->op != IR_PHI && in->op != IR_UNDEF) emit_ir_ins(m, f, names, in);
+        }
+
+        struct ir_ins *end = &bk->ins[bk->ins_n - 1];
+        int s0 = bk->succ[0], s1 = bk->succ[1];
+        switch(end->op) {
+        case IR_JUMP:
+            emit_ir_phis(m, f, names, k, s0);
+            if(s0 == next) break;
+            indent(m);
+            out_fmt(m->o, "goto b%i;\n", s0);
+            break;
+
+        case IR_BRANCH:
+            indent(m);
+            out_str(m->o, s0 == next ? "if(!" : "if(");
+            emit_ir_val(m, names, end->a);
+            out_fmt(m->o, ") goto b%i;\n", s0 == next ? s1 : s0);
+            if(s0 == next || s1 == next) break;
+            indent(m);
+            out_fmt(m->o, "goto b%i;\n", s1);
+            break;
+
+        default:
+            indent(m);
+            out_str(m->o, end->a.kind == IR_NONE ? "return" : "return ");
+            emit_ir_val(m, names, end->a);
+            out_str(m->o, ";\n");
+            break;
+        }
+    }
+
+    free(names); free(uses); free(order); free(label);
+}
+
+static void emit_func(struct emit *m, struct val *v) {
+    timing_count(TIMING_EMIT, 1);
+
+    m->func = v;
+    m->at = expr_tok(&v->func_expr);
+    m->args = malloc((v->args_n + 1) * sizeof *m->args);
+    assert(m->args);
+    for(int i = 0; i < v->args_n; i++) m->args[i] = c_ident(v->args[i]);
+    bool outs = v->ret_n > 1 && is_void(ret_type(m, v->ret_type, v->ret_n));
+    m->rets = malloc((v->ret_n + 1) * sizeof *m->rets);
+    assert(m->rets);
+    for(int i = 0; i < v->ret_n; i++) m->rets[i] = outs ? ret_name(v, i) : NULL;
+
+    //Arrays are passed as pointers, so those written are copied first
+    char *params[v->args_n + 1];
+    for(int i = 0; i < v->args_n; i++) {
+        params[i] = m->args[i];
+        if(!is_array_val(v->args_type[i]) || ent(m, &v->args[i])->idx != 1) continue;
+        char *in = fmt("%s_in", m->args[i]);
+        params[i] = local_new(m, NULL, in);
+        free(in);
+    }
+
+    out_char(m->o, '\n');
+    emit_line(m, m->at);
+    emit_sig(m, v, params);
+    out_str(m->o, " {\n");
+    for(int i = 0; i < v->args_n; i++) {
+        if(params[i] == m->args[i]) continue;
+        out_str(m->o, "    ");
+        out_decl(m, v->args_type[i], m->args[i]);
+        out_fmt(m->o, ";\n    __builtin_memcpy(%s, %s, sizeof %s);\n", m->args[i], params[i], m->args[i]);
+    }
+    if(v->ir) {
+        m->indent = 1;
+        emit_ir(m, v->ir);
+    } else if(v->ret_n > 1 || (v->ret_n == 1 && !is_void(v->ret_type[0]))) {
+        m->indent = 1;
+        emit_ret(m, &v->func_expr);
+    } else emit_body(m, &v->func_expr);
+    m->indent = 0;
+    out_str(m->o, "}\n");
+
+    for(int i = 0; i < v->args_n; i++) free(m->args[i]);
+    free(m->args);
+    for(int i = 0; i < v->ret_n; i++) free(m->rets[i]);
+    free(m->rets);
+    for(int i = 0; i < m->locals_n; i++) free(m->local_names[i]);
+    m->locals_n = 0;
+    m->switches_n = 0;
+    m->func = NULL;
+}
+
+//Functions to emit: globals, methods and instances, without generics
+static int funcs(struct parse *p, struct val **f) {
+    int n = 0;
+    for(int i = 0; i < p->globals.n; i++)
+        if(p->globals.val[i].type == VAL_FUNC && !func_is_generic(&p->globals.val[i]))
+            f[n++] = &p->globals.val[i];
+    for(int i = 0; i < p->methods.n; i++)
+        if(!func_is_generic(&p->methods.val[i])) f[n++] = &p->methods.val[i];
+    for(int i = 0; i < p->instances.n; i++) f[n++] = p->instances.inst[i];
+    return n;
+}
+
+//Whether f, if lowered, checks an index. Those of functions inlined from
+//other modules are not in the AST need_expr() walks.
+static bool ir_checked(struct ir_func *f) {
+    for(int k = 0; f && k < f->blocks_n; k++)
+        for(int j = 0; j < f->blocks[k].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[k].ins[j];
+            bool mem = in->op == IR_LOAD || in->op == IR_STORE || in->op == IR_INDEX;
+            if(mem && in->b.kind != IR_NONE && in->n >= 0) return true;
+        }
+    return false;
+}
+
+//Functions p can call of the modules the driver loaded for it, declared as
+//their own C defines them. Fills f unless NULL, and returns how many there
+//are.
+static int imports(struct parse *p, struct val **f) {
+    int n = 0;
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_MODULE || !v->loaded) continue;
+        struct ns *ns = &v->loaded->globals;
+        for(int j = 0; j < ns->n; j++) {
+            if(!val_is_portable(&ns->val[j])) continue;
+            if(f) f[n] = &ns->val[j];
+            n++;
+        }
+    }
+    return n;
+}
+
+static void name_vals(struct emit *m) {
+    struct parse *p = m->p;
+
+    //Functions of other modules are named as their C names them
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_MODULE || !v->loaded) continue;
+        struct ns *ns = &v->loaded->globals;
+        for(int j = 0; j < ns->n; j++)
+            if(val_is_portable(&ns->val[j]))
+                ent(m, &ns->val[j])->name = fmt("%s__%s", v->mod_name, ns->key[j]);
+    }
+
+    for(int i = 0; i < p->globals.n; i++)
+        ent(m, &p->globals.val[i])->name = mangle(m, NULL, NULL, p->globals.key[i]);
+    for(int i = 0; i < p->methods.n; i++) {
+        struct val *v = &p->methods.val[i];
+        ent(m, v)->name = mangle(m, v->mod, v->type_ident, p->methods.key[i]);
+    }
+    for(int i = 0; i < p->instances.n; i++) {
+        struct val *v = p->instances.inst[i];
+        ent(m, v)->name = mangle(m, v->mod, v->type_ident, p->instances.name[i]);
+    }
+
+    //Named structs and enums take the first name they are given
+    for(int i = 0; i < p->types.n; i++) {
+        struct type *t = p->types.val[i];
+        if((t->type == TYPE_STRUCT || t->type == TYPE_ENUM) && !ent(m, t)->name)
+            ent(m, t)->name = mangle(m, NULL, NULL, p->types.key[i]);
+    }
+}
+
+//Emit the module in p as a C translation unit to o. mod names the module,
+//path is its source. If struct_ret, tuples are returned as structs however
+//large, and if lines, code is attributed to its lines in path. Returns
+//number of errors, which are reported through p->error, and nothing is
+//written to o if there are any.
+int emit_c(struct parse *p, struct out *to, char *path, char *mod, bool struct_ret, bool lines) {
+    assert(p); assert(to); assert(mod);
+
+    timing_start(TIMING_EMIT);
+
+    //The C is held back until the whole module is emitted
+    struct out c, *o = &c;
+    out_init(o, OUT_MEMORY);
+
+    struct emit m = {p, o, mod, .struct_ret = struct_ret};
+    if(lines) {
+        struct out lit;
+        out_init(&lit, OUT_MEMORY);
+        emit_mem(&(struct emit){.o = &lit}, (uint8_t *)path, strlen(path));
+        out_char(&lit, '\0');
+        m.path = out_take(&lit, &(size_t){0});
+        out_close(&lit);
+    }
+    m.ts_state = calloc(p->types.n + 1, sizeof *m.ts_state);
+    assert(m.ts_state);
+    name_vals(&m);
+
+    struct val **f = malloc((p->globals.n + p->methods.n + p->instances.n + 1) * sizeof *f);
+    assert(f);
+    int f_n = funcs(p, f);
+    struct val **ext = malloc((imports(p, NULL) + 1) * sizeof *ext);
+    assert(ext);
+    int ext_n = imports(p, ext);
+
+    out_str(o, "//Generated by " ZEN2CC_VERSION " from ");
+    out_str(o, path);
+    out_str(o, "\n#include <stdint.h>\n\n");
+
+    //Types, each after those it depends on
+    for(int i = 0; i < p->types.n; i++) emit_typedef(&m, i);
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_VAR) continue;
+        need(&m, var_type(v), true);
+        need_expr(&m, &v->expr);
+    }
+    for(int i = 0; i < f_n; i++) {
+        for(int j = 0; j < f[i]->args_n; j++) need(&m, f[i]->args_type[j], true);
+        for(int j = 0; j < f[i]->ret_n; j++) need(&m, f[i]->ret_type[j], true);
+        if(f[i]->ret_n > 1) need(&m, sema_tuple(f[i]->ret_type, f[i]->ret_n), true);
+        need_expr(&m, &f[i]->func_expr);
+    }
+    for(int i = 0; i < ext_n; i++) {
+        for(int j = 0; j < ext[i]->args_n; j++) need(&m, ext[i]->args_type[j], true);
+        for(int j = 0; j < ext[i]->ret_n; j++) need(&m, ext[i]->ret_type[j], true);
+    }
+
+    for(int i = 0; i < f_n; i++) m.checked |= ir_checked(f[i]->ir);
+
+    if(m.checked) out_str(o, "\nstatic inline uint64_t zen_bound(uint64_t i, uint64_t n) {\n"
+            "    if(__builtin_expect(i >= n, 0)) __builtin_trap();\n"
+            "    return i;\n"
+            "}\n");
+
+    out_char(o, '\n');
+    for(int i = 0; i < ext_n; i++) {
+        emit_sig(&m, ext[i], NULL);
+        out_str(o, ";\n");
+    }
+    for(int i = 0; i < f_n; i++) {
+        emit_sig(&m, f[i], NULL);
+        out_str(o, ";\n");
+    }
+
+    //Globals with a constant value are initialized statically, others by a
+    //constructor in order of definition
+    bool init = false;
+    out_char(o, '\n');
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_VAR) continue;
+        emit_var(&m, v);
+        init |= v->expr.type != EXPR_NONE && !is_static(&v->expr);
+    }
+
+    //Shared compound literals, after the globals they may point to
+    for(int i = 0; i < f_n; i++) {
+        m.func = f[i];
+        share_lits(&m, &f[i]->func_expr, !decays(&f[i]->func_expr));
+    }
+    m.func = NULL;
+    if(m.lits_n) out_char(o, '\n');
+    for(int i = 0; i < m.lits_n; i++) {
+        struct expr *e = m.lits[i];
+        char *name = fmt("const %s", ent(&m, e)->name);
+        m.at = expr_tok(e);
+        out_str(o, "static ");
+        out_decl(&m, e->t, name);
+        out_str(o, " = ");
+        emit_init(&m, e);
+        out_str(o, ";\n");
+        free(name);
+    }
+
+    if(init) {
+        out_str(o, "\n__attribute__((constructor)) static void ");
+        out_str(o, mod);
+        out_str(o, "__init(void) {\n");
+        m.indent = 1;
+        for(int i = 0; i < p->globals.n; i++) {
+            struct val *v = &p->globals.val[i];
+            if(v->type != VAL_VAR || v->expr.type == EXPR_NONE || is_static(&v->expr)) continue;
+            m.at = expr_tok(&v->expr);
+            emit_line(&m, m.at);
+            indent(&m);
+            if(is_array_val(var_type(v))) emit_copy(&m, NULL, ent(&m, v)->name, &v->expr);
+            else {
+                out_str(o, ent(&m, v)->name);
+                out_str(o, " = ");
+                emit_expr(&m, &v->expr);
+            }
+            out_str(o, ";\n");
+        }
+        m.indent = 0;
+        out_str(o, "}\n");
+    }
+
+    for(int i = 0; i < f_n; i++) emit_func(&m, f[i]);
+
+    //The module's main function is the program's
+    struct val *main = ns_get(&p->globals, "main");
+    if(main && main->type == VAL_FUNC && !func_is_generic(main)) {
+        bool ret = main->ret_n == 1 && !is_void(main->ret_type[0]);
+        if(main->ret_n > 1) emit_error(&m, expr_tok(&main->func_expr), "main can not return several values");
+        out_char(o, '\n');
+        emit_line(&m, expr_tok(&main->func_expr));
+        out_str(o, "int main(void) {\n    ");
+        out_str(o, ret ? "return " : "");
+        out_str(o, ent(&m, main)->name);
+        out_str(o, ret ? "();\n}\n" : "();\n    return 0;\n}\n");
+    }
+
+    for(int i = 0; i < m.ents_c; i++) free(m.ents[i].name);
+    free(m.ents);
+    free(m.ts_state);
+    free(m.locals);
+    free(m.local_names);
+    free(m.lits);
+    free(m.path);
+    free(f);
+    free(ext);
+
+    size_t len;
+    char *code = out_take(o, &len);
+    if(!m.errnum) out_mem(to, code, len);
+    free(code);
+    out_close(o);
+
+    timing_stop(TIMING_EMIT);
+
+    return m.errnum;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "parse.h"
+#include "out.h"
+
+#define EMIT_MAP_INITIAL_CAP 64
+#define EMIT_RET_REGS 16        //Most bytes of a tuple returned by value, as
+                                //the SysV ABI returns in two registers
+
+int emit_c(struct parse *p, struct out *to, char *path, char *mod, bool struct_ret, bool lines);
@@ -1,10 +1,29 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "expr.h"
+#include "ns.h"
 #include "type.h"
 
+char *expr_op_str[] = {
+    [EXPR_MUL] = "*", [EXPR_DIV] = "/", [EXPR_MOD] = "%",
+    [EXPR_ADD] = "+", [EXPR_SUB] = "-",
+    [EXPR_BSL] = "<<", [EXPR_BSR] = ">>",
+    [EXPR_LT] = "<", [EXPR_LE] = "<=", [EXPR_GT] = ">", [EXPR_GE] = ">=",
+    [EXPR_EQ] = "==", [EXPR_NE] = "!=",
+    [EXPR_BAND] = "&", [EXPR_XOR] = "^", [EXPR_BOR] = "|",
+    [EXPR_AND] = "&&", [EXPR_OR] = "||",
+    [EXPR_ASSIGN] = "=", [EXPR_DEFINE] = ":=",
+};
+
+static void expr_free_ptr(struct expr *e) {
+    if(!e) return;
+    expr_free(e);
+    free(e);
+}
+
 void expr_free(struct expr *e) {
     assert(e);
     switch(e->type) {
@@ -16,16 +35,17 @@ void expr_free(struct expr *e) {
     case EXPR_POSTDEC: expr_free(e->l); break;
     case EXPR_FCALL: expr_free(e->f);
                      for(int i=0; i<e->args_n; i++)
-                         expr_free(e->args);
+                         expr_free(&e->args[i]);
                      e->args_n = 0;
                      free(e->args);
                      break;
     case EXPR_ARRSUB:expr_free(e->l); expr_free(e->r); break;
     case EXPR_SACC:expr_free(e->l); expr_free(e->r); break;
-    case EXPR_TACC:type_free(&e->tacc.t); expr_free(e->tacc.m); break;
-    case EXPR_COMP_LIT: type_free(&e->t);
+    case EXPR_MACC:expr_free(e->l); expr_free(e->r); break;
+    case EXPR_TACC:expr_free(e->tacc.m); break;
+    case EXPR_COMP_LIT: case EXPR_TUPLE:
                      for(int i=0; i<e->vals_n; i++)
-                         expr_free(e->vals);
+                         expr_free(&e->vals[i]);
                      e->vals_n = 0;
                      free(e->vals);
                      break;
@@ -34,59 +54,352 @@ void expr_free(struct expr *e) {
     case EXPR_PREDEC: expr_free(e->l); break;
     case EXPR_LNOT:   expr_free(e->l); break;
     case EXPR_BNOT:   expr_free(e->l); break;
-    case EXPR_CAST:   type_free(&e->t); expr_free(e->tacc.m); break;
+    case EXPR_CAST:   expr_free(e->tacc.m); break;
     case EXPR_DEFER:   expr_free(e->l); break;
     case EXPR_ADDR:   expr_free(e->l); break;
+    case EXPR_NEG:    expr_free(e->l); break;
+    EXPR_CASE_BINARY: expr_free(e->l); expr_free(e->r); break;
+    case EXPR_ASSIGN: case EXPR_DEFINE:
+                      expr_free_ptr(e->l); expr_free_ptr(e->r); break;
+    case EXPR_BLOCK:
+                     for(int i=0; i<e->vals_n; i++)
+                         expr_free(&e->vals[i]);
+                     e->vals_n = 0;
+                     free(e->vals);
+                     break;
+    EXPR_CASE_CTL:
+                     expr_free_ptr(e->ctl.init); expr_free_ptr(e->ctl.cond);
+                     expr_free_ptr(e->ctl.step); expr_free_ptr(e->ctl.body);
+                     expr_free_ptr(e->ctl.els);
+                     free(e->ctl.plan);
+                     break;
     }
 }
 
-void expr_print(struct expr *e) {
+static void expr_print_opt(struct out *o, struct expr *e) {
+    if(e) expr_print(o, e);
+}
+
+void expr_print(struct out *o, struct expr *e) {
     assert(e);
 
     switch(e->type) {
     case EXPR_NONE:     return;
-    case EXPR_STR:      printf("STR %.*s", e->lit.len, e->lit.str); return;
-    case EXPR_IDENT:    printf("IDENT %.*s", e->lit.len, e->lit.str); return;
-    case EXPR_NUM:      printf("NUM %.*s", e->lit.len, e->lit.str); return;
-    case EXPR_POSTINC:  expr_print(e->l); printf(" ++"); return;
-    case EXPR_POSTDEC:  expr_print(e->l); printf(" --"); return;
+    case EXPR_STR:
+        out_str(o, e->lit.type == TOKEN_SOURCE ? "SOURCE " : "STR ");
+        out_mem(o, e->lit.str, e->lit.len);
+        return;
+    case EXPR_IDENT:
+        out_str(o, "IDENT ");
+        out_mem(o, e->lit.str, e->lit.len);
+        if(e->val && e->val->type == VAL_MODULE)
+            out_str(o, " in module '"), out_str(o, e->val->mod_path), out_char(o, '\'');
+        return;
+    case EXPR_NUM:      out_str(o, "NUM "); out_mem(o, e->lit.str, e->lit.len); return;
+    case EXPR_POSTINC:  expr_print(o, e->l); out_str(o, " ++"); return;
+    case EXPR_POSTDEC:  expr_print(o, e->l); out_str(o, " --"); return;
     case EXPR_FCALL:
-        expr_print(e->f);
-        printf("(");
+        expr_print(o, e->f);
+        out_str(o, "(");
         for(int i=0; i < e->args_n; i++) {
-            if(i>0) printf(", ");
-            expr_print(&e->args[i]);
+            if(i>0) out_str(o, ", ");
+            expr_print(o, &e->args[i]);
         }
-        printf(")");
+        out_str(o, ")");
         return;
     case EXPR_ARRSUB:
-        expr_print(e->l); printf("["); expr_print(e->r); printf("]"); return;
-    case EXPR_SACC: expr_print(e->l); printf(" SACC "); expr_print(e->r); return;
-    case EXPR_TACC: type_print(&e->tacc.t); printf(" TACC "); expr_print(e->tacc.m); return;
+        expr_print(o, e->l); out_str(o, "["); expr_print(o, e->r); out_str(o, "]"); return;
+    case EXPR_SACC: expr_print(o, e->l); out_str(o, " SACC "); expr_print(o, e->r); return;
+    case EXPR_MACC: expr_print(o, e->l); out_str(o, " MACC "); expr_print(o, e->r); return;
+    case EXPR_TACC: type_print(o, e->tacc.t); out_str(o, " TACC "); expr_print(o, e->tacc.m); return;
     case EXPR_COMP_LIT:
-        printf("(");
-        type_print(&e->t);
-        printf("){");
+        out_str(o, "(");
+        type_print(o, e->t);
+        out_str(o, "){");
+        for(int i=0; i < e->vals_n; i++) {
+            if(i>0) out_str(o, ", ");
+            expr_print(o, &e->vals[i]);
+        }
+        out_str(o, "}");
+        return;
+    case EXPR_TUPLE:
+        out_str(o, "TUPLE (");
+        for(int i=0; i < e->vals_n; i++) {
+            if(i>0) out_str(o, ", ");
+            expr_print(o, &e->vals[i]);
+        }
+        out_str(o, ")");
+        return;
+    case EXPR_PREINC:  out_str(o, "++ "); expr_print(o, e->l); return;
+    case EXPR_PREDEC:  out_str(o, "-- "); expr_print(o, e->l); return;
+    case EXPR_LNOT:  out_str(o, "! "); expr_print(o, e->l); return;
+    case EXPR_BNOT:  out_str(o, "~ "); expr_print(o, e->l); return;
+    case EXPR_CAST:  out_str(o, "("); type_print(o, e->t); out_str(o, ") "); expr_print(o, e->tacc.m); return;
+    case EXPR_DEFER:  out_str(o, "* "); expr_print(o, e->l); return;
+    case EXPR_ADDR:  out_str(o, "& "); expr_print(o, e->l); return;
+    case EXPR_NEG:  out_str(o, "- "); expr_print(o, e->l); return;
+    EXPR_CASE_BINARY:
+        out_str(o, "("); expr_print(o, e->l);
+        out_char(o, ' '); out_str(o, expr_op_str[e->type]); out_char(o, ' ');
+        expr_print(o, e->r); out_str(o, ")");
+        return;
+    case EXPR_ASSIGN: case EXPR_DEFINE:
+        expr_print(o, e->l);
+        out_char(o, ' '); out_str(o, expr_op_str[e->type]); out_char(o, ' ');
+        expr_print(o, e->r);
+        return;
+    case EXPR_BLOCK:
+        out_str(o, "{");
         for(int i=0; i < e->vals_n; i++) {
-            if(i>0) printf(", ");
-            expr_print(&e->vals[i]);
+            if(i>0) out_str(o, "; ");
+            expr_print(o, &e->vals[i]);
         }
-        printf("}");
+        out_str(o, "}");
+        return;
+    case EXPR_IF:
+        out_str(o, "IF ("); expr_print(o, e->ctl.cond); out_str(o, ") "); expr_print(o, e->ctl.body);
+        if(e->ctl.els) { out_str(o, " ELSE "); expr_print(o, e->ctl.els); }
         return;
-    case EXPR_PREINC:  printf("++ "); expr_print(e->l); return;
-    case EXPR_PREDEC:  printf("-- "); expr_print(e->l); return;
-    case EXPR_LNOT:  printf("! "); expr_print(e->l); return;
-    case EXPR_BNOT:  printf("~ "); expr_print(e->l); return;
-    case EXPR_CAST:  printf("("); type_print(&e->t); printf(") "); expr_print(e->tacc.m); return;
-    case EXPR_DEFER:  printf("* "); expr_print(e->l); return;
-    case EXPR_ADDR:  printf("& "); expr_print(e->l); return;
+    case EXPR_FOR:
+        out_str(o, "FOR (");
+        expr_print_opt(o, e->ctl.init); out_str(o, "; ");
+        expr_print_opt(o, e->ctl.cond); out_str(o, "; ");
+        expr_print_opt(o, e->ctl.step); out_str(o, ") ");
+        expr_print(o, e->ctl.body);
+        return;
+    case EXPR_SWITCH:
+        out_str(o, "SWITCH ");
+        if(e->ctl.cond) {
+            out_str(o, "("); expr_print(o, e->ctl.cond);
+            if(e->ctl.step) { out_str(o, ", "); expr_print(o, e->ctl.step); }
+            out_str(o, ") ");
+        }
+        expr_print(o, e->ctl.body);
+        if(e->ctl.els) { out_str(o, " DEFAULT "); expr_print(o, e->ctl.els); }
+        return;
+    case EXPR_CASE:
+        out_str(o, "CASE "); expr_print(o, e->ctl.cond); out_str(o, ": "); expr_print(o, e->ctl.body);
+        return;
+    case EXPR_FALLTHROUGH: out_str(o, "FALLTHROUGH"); return;
     default:
-        printf("Reached DEFAULT %i\n", e->type);
+        out_fmt(o, "Reached DEFAULT %i\n", e->type);
     }
 
     assert(0); //Should not be reached
 }
 
+//Structural hash of an expression, consistent with expr_eq()
+unsigned expr_hash(struct expr *e) {
+    assert(e);
+
+    unsigned h = (2166136261u ^ e->type) * 16777619u;
+
+    switch(e->type) {
+    case EXPR_NONE: break;
+    case EXPR_NUM: case EXPR_STR: case EXPR_IDENT:
+        for(uint32_t i = 0; i < e->lit.len; i++)
+            h = (h ^ (unsigned char)e->lit.str[i]) * 16777619u;
+        break;
+    case EXPR_FCALL:
+        h = (h ^ expr_hash(e->f)) * 16777619u;
+        for(int i = 0; i < e->args_n; i++)
+            h = (h ^ expr_hash(&e->args[i])) * 16777619u;
+        break;
+    case EXPR_COMP_LIT:
+        h = (h ^ e->t->hash) * 16777619u;
+        for(int i = 0; i < e->vals_n; i++)
+            h = (h ^ expr_hash(&e->vals[i])) * 16777619u;
+        break;
+    case EXPR_TACC: case EXPR_CAST:
+        h = (h ^ e->tacc.t->hash) * 16777619u;
+        h = (h ^ expr_hash(e->tacc.m)) * 16777619u;
+        break;
+    case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++)
+            h = (h ^ expr_hash(&e->vals[i])) * 16777619u;
+        break;
+    EXPR_CASE_CTL: {
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        for(int i = 0; i < 5; i++)
+            h = (h ^ (c[i] ? expr_hash(c[i]) : 0)) * 16777619u;
+        break;
+    }
+    case EXPR_ARRSUB: case EXPR_SACC: case EXPR_MACC: EXPR_CASE_BINARY:
+    case EXPR_ASSIGN: case EXPR_DEFINE:
+        h = (h ^ expr_hash(e->r)) * 16777619u;
+        //fallthrough
+    default:
+        h = (h ^ expr_hash(e->l)) * 16777619u;
+        break;
+    }
+
+    return h;
+}
+
+//Structural equality of two expressions. Types are compared by pointer, as
+//they are canonical.
+bool expr_eq(struct expr *a, struct expr *b) {
+    assert(a); assert(b);
+
+    if(a->type != b->type) return false;
+
+    switch(a->type) {
+    case EXPR_NONE: return true;
+    case EXPR_NUM: case EXPR_STR: case EXPR_IDENT:
+        return a->lit.type == b->lit.type && a->lit.len == b->lit.len
+            && memcmp(a->lit.str, b->lit.str, a->lit.len) == 0;
+    case EXPR_FCALL:
+        if(a->args_n != b->args_n || !expr_eq(a->f, b->f)) return false;
+        for(int i = 0; i < a->args_n; i++)
+            if(!expr_eq(&a->args[i], &b->args[i])) return false;
+        return true;
+    case EXPR_COMP_LIT:
+        if(a->t != b->t || a->vals_n != b->vals_n) return false;
+        for(int i = 0; i < a->vals_n; i++)
+            if(!expr_eq(&a->vals[i], &b->vals[i])) return false;
+        return true;
+    case EXPR_TACC: case EXPR_CAST:
+        return a->tacc.t == b->tacc.t && expr_eq(a->tacc.m, b->tacc.m);
+    case EXPR_BLOCK: case EXPR_TUPLE:
+        if(a->vals_n != b->vals_n) return false;
+        for(int i = 0; i < a->vals_n; i++)
+            if(!expr_eq(&a->vals[i], &b->vals[i])) return false;
+        return true;
+    EXPR_CASE_CTL: {
+        struct expr *x[] = {a->ctl.init, a->ctl.cond, a->ctl.step, a->ctl.body, a->ctl.els};
+        struct expr *y[] = {b->ctl.init, b->ctl.cond, b->ctl.step, b->ctl.body, b->ctl.els};
+        for(int i = 0; i < 5; i++)
+            if(!x[i] != !y[i] || (x[i] && !expr_eq(x[i], y[i]))) return false;
+        return true;
+    }
+    case EXPR_ARRSUB: case EXPR_SACC: case EXPR_MACC: EXPR_CASE_BINARY:
+    case EXPR_ASSIGN: case EXPR_DEFINE:
+        return expr_eq(a->l, b->l) && expr_eq(a->r, b->r);
+    default:
+        return expr_eq(a->l, b->l);
+    }
+}
+
+//Locals defined inside the expression being cloned, so their uses can be
+//bound to the copies of the definitions
+static struct {struct expr **from, **to; int n, c;} clone_locals;
+
+static struct expr clone(struct expr *e);
+
+//Bind uses of the local defined by from to its copy to
+static void clone_local(struct expr *from, struct expr *to) {
+    if(from->local != from) return;
+    if(clone_locals.n == clone_locals.c) {
+        clone_locals.c = clone_locals.c ? clone_locals.c * 2 : 16;
+        clone_locals.from = realloc(clone_locals.from, sizeof(struct expr*) * clone_locals.c);
+        clone_locals.to = realloc(clone_locals.to, sizeof(struct expr*) * clone_locals.c);
+        assert(clone_locals.from && clone_locals.to);
+    }
+    clone_locals.from[clone_locals.n] = from;
+    clone_locals.to[clone_locals.n++] = to;
+    to->local = to;
+}
+
+static struct expr *clone_opt(struct expr *e) {
+    return e ? expr_alloc(clone(e)) : NULL;
+}
+
+static struct expr *expr_clone_array(struct expr *a, int n) {
+    if(n == 0) return NULL;
+    struct expr *ret = malloc(sizeof(*ret) * n);
+    assert(ret);
+    for(int i = 0; i < n; i++) ret[i] = clone(&a[i]);
+    return ret;
+}
+
+static struct expr clone(struct expr *e) {
+    assert(e);
+
+    struct expr ret = *e;
+    ret.ty = NULL;
+
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: break;
+    case EXPR_IDENT:
+        for(int i = clone_locals.n - 1; i >= 0; i--)
+            if(clone_locals.from[i] == e->local) {
+                ret.local = clone_locals.to[i];
+                break;
+            }
+        break;
+    case EXPR_DEFINE:
+        ret.r = expr_alloc(clone(e->r));
+        ret.l = expr_alloc(clone(e->l));
+        if(e->l->type == EXPR_TUPLE)
+            for(int i = 0; i < e->l->vals_n; i++) clone_local(&e->l->vals[i], &ret.l->vals[i]);
+        else clone_local(e->l, ret.l);
+        break;
+    case EXPR_BLOCK: case EXPR_TUPLE:
+        ret.vals = expr_clone_array(e->vals, e->vals_n);
+        break;
+    EXPR_CASE_CTL:
+        ret.ctl.plan = NULL;
+        ret.ctl.init = clone_opt(e->ctl.init);
+        ret.ctl.cond = clone_opt(e->ctl.cond);
+        ret.ctl.step = clone_opt(e->ctl.step);
+        ret.ctl.body = clone_opt(e->ctl.body);
+        ret.ctl.els = clone_opt(e->ctl.els);
+        break;
+    case EXPR_FCALL:
+        ret.f = expr_alloc(clone(e->f));
+        ret.args = expr_clone_array(e->args, e->args_n);
+        break;
+    case EXPR_COMP_LIT:
+        ret.vals = expr_clone_array(e->vals, e->vals_n);
+        break;
+    case EXPR_TACC: case EXPR_CAST:
+        ret.tacc.m = expr_alloc(clone(e->tacc.m));
+        break;
+    case EXPR_ARRSUB: case EXPR_SACC: case EXPR_MACC: EXPR_CASE_BINARY:
+    case EXPR_ASSIGN:
+        ret.r = expr_alloc(clone(e->r));
+        //fallthrough
+    default:
+        ret.l = expr_alloc(clone(e->l));
+        break;
+    }
+
+    return ret;
+}
+
+//Deep copy of e. Symbol bindings are kept, except that locals defined within
+//e are rebound to their copies. Inferred types are cleared.
+struct expr expr_clone(struct expr *e) {
+    int n = clone_locals.n;
+    struct expr ret = clone(e);
+    clone_locals.n = n;
+    return ret;
+}
+
+//Leftmost token of e, used to locate diagnostics. Returns a token with a
+//NULL str if e has none.
+struct token expr_tok(struct expr *e) {
+    assert(e);
+
+    switch(e->type) {
+    case EXPR_NONE: return (struct token){TOKEN_ERR};
+    case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: return e->lit;
+    case EXPR_FCALL: return expr_tok(e->f);
+    case EXPR_COMP_LIT:
+        if(e->vals_n) return expr_tok(&e->vals[0]);
+        return (struct token){TOKEN_ERR};
+    case EXPR_TACC: case EXPR_CAST: return expr_tok(e->tacc.m);
+    case EXPR_POSTINC: case EXPR_POSTDEC: case EXPR_ARRSUB: case EXPR_SACC:
+    case EXPR_MACC: EXPR_CASE_BINARY: case EXPR_ASSIGN: case EXPR_DEFINE:
+        return expr_tok(e->l);
+    case EXPR_BLOCK: case EXPR_TUPLE: return e->lcurl;
+    EXPR_CASE_CTL: return e->ctl.kw;
+    default:
+        if(e->op.str) return e->op;
+        return expr_tok(e->l);
+    }
+}
+
 struct expr *expr_alloc(struct expr e) {
     struct expr *ret = malloc(sizeof *ret);
     assert(ret);
@@ -2,11 +2,15 @@
 
 #include "token.h"
 #include "type.h"
+#include "out.h"
+
+struct val;
+struct lower_switch;
 
 enum expr_type {
     EXPR_NONE,                  //Empty expression
     EXPR_NUM,                   //A numeric literal
-    EXPR_STR,                   //A string literal
+    EXPR_STR,                   //A string literal, or a TOKEN_SOURCE line
     EXPR_IDENT,                 //An identifier
 
     EXPR_POSTINC,               //Postfix increment ++
@@ -15,7 +19,9 @@ enum expr_type {
     EXPR_ARRSUB,                //Array subscript []
     EXPR_SACC,                  //Structure access .
     EXPR_TACC,                  //Type info access ->
+    EXPR_MACC,                  //Method access <expr>->ident
     EXPR_COMP_LIT,              //Compound literal
+    EXPR_TUPLE,                 //Tuple (<expr>, <expr>...), as returned by functions of several values
 
     EXPR_PREINC,                //Prefix increment ++
     EXPR_PREDEC,                //Prefix increment --
@@ -24,19 +30,80 @@ enum expr_type {
     EXPR_CAST,                  //Type cast (<type>)<expr>
     EXPR_DEFER,                 //Pointer deference *<expr>
     EXPR_ADDR,                  //Address of &<expr>
+    EXPR_NEG,                   //Negation -<expr>
+
+    EXPR_MUL,                   //Multiplication *
+    EXPR_DIV,                   //Division /
+    EXPR_MOD,                   //Modulo %
+    EXPR_ADD,                   //Addition +
+    EXPR_SUB,                   //Subtraction -
+    EXPR_BSL,                   //Bit shift left <<
+    EXPR_BSR,                   //Bit shift right >>
+    EXPR_LT,                    //Less than <
+    EXPR_LE,                    //Less or equal <=
+    EXPR_GT,                    //Greater than >
+    EXPR_GE,                    //Greater or equal >=
+    EXPR_EQ,                    //Equal ==
+    EXPR_NE,                    //Not equal !=
+    EXPR_BAND,                  //Bit wise and &
+    EXPR_XOR,                   //Bit wise xor ^
+    EXPR_BOR,                   //Bit wise or |
+    EXPR_AND,                   //Logical and &&
+    EXPR_OR,                    //Logical or ||
+
+    EXPR_ASSIGN,                //Assignment =, a op= b is parsed as a = a op b
+    EXPR_DEFINE,                //Definition of a local <ident> := <expr>
+    EXPR_BLOCK,                 //Block {...}, valued as its last expression
+    EXPR_IF,                    //if(<cond>) <body> else <els>
+    EXPR_FOR,                   //for(<init>; <cond>; <step>) <body>
+    EXPR_SWITCH,                //switch(<cond>) {<body>... default: <els>}, body a block of cases
+    EXPR_CASE,                  //case <cond>: <body>, in a switch
+    EXPR_FALLTHROUGH,           //fallthrough, ending the body of a case
 };
 
+//Case labels of the binary operators, which use both l and r
+#define EXPR_CASE_BINARY \
+    case EXPR_MUL: case EXPR_DIV: case EXPR_MOD: case EXPR_ADD: case EXPR_SUB: \
+    case EXPR_BSL: case EXPR_BSR: case EXPR_LT: case EXPR_LE: case EXPR_GT: \
+    case EXPR_GE: case EXPR_EQ: case EXPR_NE: case EXPR_BAND: case EXPR_XOR: \
+    case EXPR_BOR: case EXPR_AND: case EXPR_OR
+
+//Case labels of the control expressions, which use ctl
+#define EXPR_CASE_CTL \
+    case EXPR_IF: case EXPR_FOR: case EXPR_SWITCH: case EXPR_CASE: case EXPR_FALLTHROUGH
+
+extern char *expr_op_str[];
+
 struct expr {
     enum expr_type type;
+    struct type *ty;            //Inferred type, memoized by sema()
     union {
-        struct token lit;
-        struct {struct expr *l, *r;};
+        struct {                    //EXPR_NUM, EXPR_STR, EXPR_IDENT
+            struct token lit;
+            struct val *val;        //Symbol bound by resolve(), NULL if unresolved
+            int arg;                //Argument index when val is the enclosing function, or -1
+            struct expr *local;     //Defining EXPR_IDENT of a local, itself for the definition
+        };
+        struct {                    //op is the operator, for diagnostics
+            struct expr *l, *r;
+            struct token op;
+            bool check;             //Whether an EXPR_ARRSUB is bounds checked, set by bounds()
+        };
         struct {struct expr *f, *args; int args_n;};
-        struct {struct type t; struct expr *vals; int vals_n;};
-        struct {struct type t; struct expr *m;} tacc;
+        struct {struct type *t; struct expr *vals; int vals_n; struct token lcurl;};  //lcurl is '(' of a tuple
+        struct {struct type *t; struct expr *m;} tacc;
+        struct {                    //Any may be NULL
+            struct expr *init, *cond, *step, *body, *els;
+            struct token kw;
+            struct lower_switch *plan;  //Dispatch of an EXPR_SWITCH, set by lower()
+        } ctl;
     };
 };
 
 void expr_free(struct expr *e);
-void expr_print(struct expr *e);
+void expr_print(struct out *o, struct expr *e);
+unsigned expr_hash(struct expr *e);
+bool expr_eq(struct expr *a, struct expr *b);
 struct expr *expr_alloc(struct expr e);
+struct expr expr_clone(struct expr *e);
+struct token expr_tok(struct expr *e);
@@ -0,0 +1,549 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fold.h"
+#include "layout.h"
+#include "sema.h"
+#include "timing.h"
+
+//Constant folding pass. Every const is evaluated with exact integer and
+//rational arithmetic, and array lengths written as constant expressions are
+//bound to the types. Consts are folded on first use, so dependencies are
+//always evaluated first whatever their order in the source, and the result
+//is memoized in val->cval. Uses of a const then stand for its value, as if it
+//were a literal.
+
+struct fold {
+    struct parse *p;
+    int errnum;
+    bool quiet;             //Errors are counted but not reported
+};
+
+//Marks a const whose value is currently being folded
+static struct cval folding;
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static void fold_error(struct fold *f, struct token t, char *msg) {
+    if(!f->quiet) f->p->error(f->p->ts, t, msg);
+    f->errnum++;
+}
+
+static bool eval(struct fold *f, struct expr *e, struct cval *r);
+
+//Value of const v, used at token t. Returns NULL after reporting an error.
+static struct cval *fold_const(struct fold *f, struct val *v, struct token t) {
+    assert(v->type == VAL_CONST);
+
+    if(v->cval == &folding) {
+        snprintf(err_buf, ERRBUF_SIZE, "Cyclic definition of '%.*s'", t.len, t.str);
+        fold_error(f, t, err_buf);
+        return NULL;
+    }
+
+    if(!v->cval) {
+        timing_count(TIMING_FOLD, 1);
+
+        v->cval = &folding;
+        struct cval *c = malloc(sizeof *c);
+        assert(c);
+        cval_init(c);
+        if(!eval(f, &v->expr, c)) cval_free(c);
+        v->cval = c;
+    }
+
+    return v->cval->type == CVAL_NONE ? NULL : v->cval;
+}
+
+static bool eval_ident(struct fold *f, struct expr *e, struct cval *r) {
+    if(!e->val && !e->local) return false;   //Reported by resolve()
+
+    if(!e->local && e->arg < 0 && e->val->type == VAL_CONST) {
+        struct cval *c = fold_const(f, e->val, e->lit);
+        if(!c) return false;
+        cval_set(r, c);
+        return true;
+    }
+
+    snprintf(err_buf, ERRBUF_SIZE, "'%.*s' is not constant", e->lit.len, e->lit.str);
+    fold_error(f, e->lit, err_buf);
+    return false;
+}
+
+//Keep integer r to the width of a, as arithmetic on a value of a sized
+//integer type is done in the type of its left operand. Values of literals
+//alone, and of int and uint, stay exact.
+static void fold_width(struct cval *r, struct cval *a) {
+    r->bits = r->type == CVAL_INT ? a->bits : 0;
+    r->sign = a->sign;
+    if(r->bits) cval_wrap(r, r, r->bits, r->sign);
+}
+
+//Casts to numeric types convert the value, integer casts truncate and wrap
+//to the width of the type as they would at run time, and bool casts give 0
+//or 1
+static bool eval_cast(struct fold *f, struct expr *e, struct cval *r) {
+    if(!eval(f, e->tacc.m, r)) return false;
+
+    struct type *t = sema_resolve(e->tacc.t);
+    enum type_primative pt = t->primative;
+    if(t->type != TYPE_PRIMATIVE || pt == TYPE_VOID || r->type == CVAL_STR) {
+        fold_error(f, expr_tok(e->tacc.m), "Cast is not constant");
+        return false;
+    }
+
+    if(pt == TYPE_BOOL) {
+        cval_set_int(r, cval_is_true(r));
+        return true;
+    }
+
+    r->bits = 0;
+    if(pt >= TYPE_FLOAT) {
+        if(r->type == CVAL_INT) r->type = CVAL_REAL;
+        return true;
+    }
+
+    cval_trunc(r, r);
+
+    static const int bits[TYPE_NUM] = {
+        [TYPE_INT8] = 8, [TYPE_INT16] = 16, [TYPE_INT32] = 32, [TYPE_INT64] = 64,
+        [TYPE_UINT8] = 8, [TYPE_UINT16] = 16, [TYPE_UINT32] = 32, [TYPE_UINT64] = 64,
+    };
+    if(bits[pt]) cval_wrap(r, r, bits[pt], pt < TYPE_UINT);
+    r->bits = bits[pt];
+    r->sign = pt < TYPE_UINT;
+
+    return true;
+}
+
+static bool tok_is(struct token t, char *s) {
+    return t.len == strlen(s) && strncmp(t.str, s, t.len) == 0;
+}
+
+static struct type *fold_type(struct fold *f, struct type *t);
+
+//Enum options, and type accessors given by the layout: T->size, T->align
+//and T->offset_of_<member>, the offset of a member in bytes
+static bool eval_tacc(struct fold *f, struct expr *e, struct cval *r) {
+    struct token m = e->tacc.m->lit;
+    struct type *t = sema_resolve(e->tacc.t);
+
+    if(t->type == TYPE_ENUM && !e->tacc.m->val) {
+        if(!t->ivals) fold_type(f, t);
+        for(int i = 0; i < t->opts_n; i++)
+            if(tok_is(m, t->opts[i])) {
+                cval_set_int(r, t->ivals[i]);
+                return true;
+            }
+    }
+
+    //Accessors a type does not have are reported by sema()
+    int member = layout_offset_of(t, m);
+    if(!tok_is(m, "size") && !tok_is(m, "align") && member < 0) {
+        bool known = e->tacc.m->val || tok_is(m, "num") || tok_is(m, "id") || tok_is(m, "name");
+        for(int i = 0; t->type == TYPE_STRUCT && i < t->mem_n; i++) known |= tok_is(m, t->idents[i]);
+        if(known) fold_error(f, m, "Expression is not constant");
+        return false;
+    }
+
+    e->tacc.t = fold_type(f, e->tacc.t);
+    t = sema_resolve(e->tacc.t);
+    layout_type(e->tacc.t);
+    if(e->tacc.t->size < 0) {
+        fold_error(f, m, "Size of type is not known");
+        return false;
+    }
+
+    if(member >= 0 && layout_is_bit(t, member)) {
+        fold_error(f, m, "Member packed to a bit has no offset");
+        return false;
+    }
+
+    if(member >= 0) cval_set_int(r, t->offsets[member] / 8);
+    else cval_set_int(r, tok_is(m, "size") ? e->tacc.t->size : e->tacc.t->align);
+    return true;
+}
+
+static bool eval_binary(struct fold *f, struct expr *e, struct cval *r) {
+    struct cval a, b;
+    char *err = NULL;
+    bool ok;
+
+    cval_init(&a);
+    cval_init(&b);
+
+    //Short circuit as at run time, so the right hand side may be invalid
+    if(e->type == EXPR_AND || e->type == EXPR_OR) {
+        bool or = e->type == EXPR_OR;
+        ok = eval(f, e->l, &a);
+        if(ok && a.type == CVAL_STR) err = "Operand is not a number";
+        else if(ok && cval_is_true(&a) == or) cval_set_int(r, or);
+        else if(ok && (ok = eval(f, e->r, &b))) {
+            if(b.type == CVAL_STR) err = "Operand is not a number";
+            else cval_set_int(r, cval_is_true(&b));
+        }
+    } else {
+        ok = eval(f, e->l, &a) && eval(f, e->r, &b);
+        if(ok) err = cval_binop(r, e->type, &a, &b);
+
+        //Comparisons are ints, other operators typed as their left operand
+        bool cmp = e->type == EXPR_LT || e->type == EXPR_LE || e->type == EXPR_GT
+            || e->type == EXPR_GE || e->type == EXPR_EQ || e->type == EXPR_NE;
+        if(ok && !err) fold_width(r, cmp ? &(struct cval){CVAL_INT} : &a);
+    }
+
+    if(err) fold_error(f, e->op, err);
+    cval_free(&a);
+    cval_free(&b);
+    return ok && !err;
+}
+
+static bool eval(struct fold *f, struct expr *e, struct cval *r) {
+    struct cval a;
+    char *err = NULL;
+    bool ok;
+
+    switch(e->type) {
+    case EXPR_NUM:
+        if((err = cval_parse(r, e->lit))) {
+            fold_error(f, e->lit, err);
+            return false;
+        }
+        return true;
+
+    case EXPR_STR:
+        r->type = CVAL_STR;
+        r->str = e->lit;
+        return true;
+
+    case EXPR_IDENT: return eval_ident(f, e, r);
+    case EXPR_CAST: return eval_cast(f, e, r);
+    case EXPR_TACC: return eval_tacc(f, e, r);
+
+    case EXPR_NEG: case EXPR_LNOT: case EXPR_BNOT:
+        cval_init(&a);
+        ok = eval(f, e->l, &a);
+        if(ok && (err = cval_unop(r, e->type, &a))) fold_error(f, e->op, err);
+        if(ok && !err) fold_width(r, e->type == EXPR_LNOT ? &(struct cval){CVAL_INT} : &a);
+        cval_free(&a);
+        return ok && !err;
+
+    EXPR_CASE_BINARY: return eval_binary(f, e, r);
+
+    default: break;
+    }
+
+    struct token t = expr_tok(e);
+    if(t.str) fold_error(f, t, "Expression is not constant");
+    return false;
+}
+
+static void fold_expr_types(struct fold *f, struct expr *e);
+
+//Least integer type holding all of lo to hi, unsigned unless lo is negative
+static struct type *enum_least(int64_t lo, int64_t hi) {
+    static const enum type_primative u[] = {TYPE_UINT8, TYPE_UINT16, TYPE_UINT32, TYPE_UINT64};
+    static const enum type_primative s[] = {TYPE_INT8, TYPE_INT16, TYPE_INT32, TYPE_INT64};
+    for(int i = 0; i < 3; i++) {
+        int bits = 8 << i;
+        if(lo >= 0 && (uint64_t)hi < (uint64_t)1 << bits) return type_prim(u[i]);
+        if(lo < 0 && lo >= -((int64_t)1 << (bits - 1)) && hi < (int64_t)1 << (bits - 1))
+            return type_prim(s[i]);
+    }
+    return type_prim(lo < 0 ? s[3] : u[3]);
+}
+
+//Width of integer types, int and uint being 32 bits
+static const int int_bits[TYPE_NUM] = {
+    [TYPE_INT] = 32, [TYPE_INT8] = 8, [TYPE_INT16] = 16, [TYPE_INT32] = 32, [TYPE_INT64] = 64,
+    [TYPE_UINT] = 32, [TYPE_UINT8] = 8, [TYPE_UINT16] = 16, [TYPE_UINT32] = 32, [TYPE_UINT64] = 64,
+};
+
+//Whether all of lo to hi fit integer type t
+static bool enum_fits(struct type *t, int64_t lo, int64_t hi) {
+    int n = t->type == TYPE_PRIMATIVE ? int_bits[t->primative] : 0;
+    if(!n) return false;
+    if(n == 64) return t->primative < TYPE_UINT || lo >= 0;
+    if(t->primative >= TYPE_UINT) return lo >= 0 && hi < (int64_t)1 << n;
+    return lo >= -((int64_t)1 << (n - 1)) && hi < (int64_t)1 << (n - 1);
+}
+
+//Bind the values of the options of enum t, each the value given or one more
+//than the one before, and its storage type, the one asked for or the least
+//covering the values
+static void fold_enum(struct fold *f, struct type *t) {
+    if(t->enum_type) fold_type(f, t->enum_type);
+
+    timing_count(TIMING_FOLD, 1);
+
+    free(t->ivals);
+    t->ivals = calloc(t->opts_n + 1, sizeof *t->ivals);
+    assert(t->ivals);
+
+    int64_t next = 0, lo = 0, hi = 0;
+    struct token at = t->tok;
+    for(int i = 0; i < t->opts_n; i++) {
+        struct expr *v = &t->vals[i];
+        if(v->type != EXPR_NONE) {
+            struct cval c;
+            cval_init(&c);
+            at = expr_tok(v);
+            if(eval(f, v, &c)) {
+                if(c.type != CVAL_INT || !bn_to_int64(&c.num, &next))
+                    fold_error(f, at, "Enum value must be a 64 bit integer");
+            }
+            cval_free(&c);
+        }
+
+        t->ivals[i] = next;
+        if(!i || next < lo) lo = next;
+        if(!i || next > hi) hi = next;
+        next = (int64_t)((uint64_t)next + 1);
+    }
+
+    if(!t->enum_type || t->enum_type->type == TYPE_NONE) {
+        t->repr = enum_least(lo, hi);
+        return;
+    }
+
+    t->repr = t->enum_type;
+    struct type *r = sema_resolve(t->enum_type);
+    if(r->type == TYPE_IDENT) return;   //Unresolved, reported by resolve()
+    if(!enum_fits(r, lo, hi))
+        fold_error(f, at.str ? at : t->tok, "Enum values do not fit its type");
+}
+
+//Type t with its children folded as in kids, which replace those of t. The
+//canonical node is reinterned if any changed.
+static struct type *refold(struct type *t, struct type **kids) {
+    struct type k = {t->type, .tok = t->tok};
+    bool same = true;
+
+    switch(t->type) {
+    case TYPE_FUNC:
+        for(int i = 0; i < t->args_n + t->ret_n; i++) same &= kids[i] == (i < t->args_n ? t->args[i] : t->ret[i - t->args_n]);
+        if(same) return t;
+        k.args_n = t->args_n, k.ret_n = t->ret_n;
+        k.args = malloc(sizeof *k.args * (t->args_n + 1));
+        k.ret = malloc(sizeof *k.ret * (t->ret_n + 1));
+        assert(k.args && k.ret);
+        memcpy(k.args, kids, sizeof *k.args * t->args_n);
+        memcpy(k.ret, kids + t->args_n, sizeof *k.ret * t->ret_n);
+        break;
+
+    case TYPE_STRUCT:
+        for(int i = 0; i < t->mem_n; i++) same &= kids[i] == t->types[i];
+        if(same) return t;
+        k.mem_n = t->mem_n, k.align_to = t->align_to;
+        k.types = malloc(sizeof *k.types * (t->mem_n + 1));
+        k.idents = malloc(sizeof *k.idents * (t->mem_n + 1));
+        assert(k.types && k.idents);
+        memcpy(k.types, kids, sizeof *k.types * t->mem_n);
+        for(int i = 0; i < t->mem_n; i++) k.idents[i] = strdup(t->idents[i]);
+        if(t->aligns) {
+            k.aligns = malloc(sizeof *k.aligns * t->mem_n);
+            assert(k.aligns);
+            memcpy(k.aligns, t->aligns, sizeof *k.aligns * t->mem_n);
+        }
+        break;
+
+    default: assert(0);
+    }
+
+    struct type *r = type_intern(k);
+    r->folded = r;
+    return r;
+}
+
+//Canonical node equal to t with the length of arrays reachable from it bound,
+//through named types too so their layout is known to eval_tacc(). Arrays are
+//reinterned as {of, n}, so every way of writing a length is the same type.
+static struct type *fold_type(struct fold *f, struct type *t) {
+    if(t->folded) return t->folded;
+    t->folded = t;  //Named types reach themselves through their definition
+
+    switch(t->type) {
+    case TYPE_IDENT: if(t->def) t->def = fold_type(f, t->def); return t;
+
+    case TYPE_ARRAY: case TYPE_PTR: case TYPE_VEC: {
+        int64_t n = t->n;
+        if(t->type == TYPE_ARRAY && t->len && t->n < 0) {
+            timing_count(TIMING_FOLD, 1);
+
+            struct cval c;
+            cval_init(&c);
+            if(eval(f, t->len, &c)) {
+                if(c.type != CVAL_INT || !bn_to_int64(&c.num, &n) || n < 0 || n > INT32_MAX)
+                    fold_error(f, expr_tok(t->len), "Array length must be a non-negative integer"), n = -1;
+            }
+            cval_free(&c);
+        }
+
+        struct type *of = fold_type(f, t->of);
+        if((of == t->of && n == t->n) || (n < 0 && t->len)) return t;
+        struct type *r = type_intern((struct type){t->type, .tok = t->tok, .of = of, .n = n});
+        r->folded = r;
+        return t->folded = r;
+    }
+
+    case TYPE_FUNC: {
+        struct type *kids[t->args_n + t->ret_n + 1];
+        for(int i = 0; i < t->args_n; i++) kids[i] = fold_type(f, t->args[i]);
+        for(int i = 0; i < t->ret_n; i++) kids[t->args_n + i] = fold_type(f, t->ret[i]);
+        return t->folded = refold(t, kids);
+    }
+
+    case TYPE_STRUCT: {
+        struct type *kids[t->mem_n + 1];
+        for(int i = 0; i < t->mem_n; i++) kids[i] = fold_type(f, t->types[i]);
+        return t->folded = refold(t, kids);
+    }
+
+    case TYPE_ENUM: fold_enum(f, t); return t;
+
+    default: return t;
+    }
+}
+
+//Fold types written inside expressions, by casts and compound literals
+static void fold_expr_types(struct fold *f, struct expr *e) {
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: return;
+
+    case EXPR_FCALL:
+        fold_expr_types(f, e->f);
+        for(int i = 0; i < e->args_n; i++) fold_expr_types(f, &e->args[i]);
+        return;
+
+    case EXPR_COMP_LIT:
+        e->t = fold_type(f, e->t);
+        for(int i = 0; i < e->vals_n; i++) fold_expr_types(f, &e->vals[i]);
+        return;
+
+    case EXPR_TACC: e->tacc.t = fold_type(f, e->tacc.t); return;
+    case EXPR_CAST:
+        e->tacc.t = fold_type(f, e->tacc.t);
+        fold_expr_types(f, e->tacc.m);
+        return;
+
+    case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) fold_expr_types(f, &e->vals[i]);
+        return;
+    EXPR_CASE_CTL: {
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        for(int i = 0; i < 5; i++) if(c[i]) fold_expr_types(f, c[i]);
+        return;
+    }
+
+    case EXPR_SACC: case EXPR_MACC: fold_expr_types(f, e->l); return;
+    case EXPR_ARRSUB: EXPR_CASE_BINARY: case EXPR_ASSIGN: case EXPR_DEFINE:
+        fold_expr_types(f, e->r);
+        //fallthrough
+    default: fold_expr_types(f, e->l); return;
+    }
+}
+
+//Report a constant value of e that integer type t can not hold, which C
+//would silently wrap
+static void fold_fits(struct fold *f, struct type *t, struct expr *e) {
+    if(e->type != EXPR_NONE && fold_overflows(f->p, t, e))
+        fold_error(f, expr_tok(e), "Constant does not fit its type");
+}
+
+static void fold_val(struct fold *f, struct val *v) {
+    switch(v->type) {
+    case VAL_CONST:
+        v->expr_type = fold_type(f, v->expr_type);
+        fold_expr_types(f, &v->expr);
+        if(!v->cval) fold_const(f, v, expr_tok(&v->expr));
+        fold_fits(f, v->expr_type, &v->expr);
+        break;
+    case VAL_VAR:
+        v->expr_type = fold_type(f, v->expr_type);
+        fold_expr_types(f, &v->expr);
+        fold_fits(f, v->expr_type, &v->expr);
+        break;
+    case VAL_FUNC:
+        for(int j = 0; j < v->args_n; j++) v->args_type[j] = fold_type(f, v->args_type[j]);
+        for(int j = 0; j < v->ret_n; j++) v->ret_type[j] = fold_type(f, v->ret_type[j]);
+        fold_expr_types(f, &v->func_expr);
+        break;
+    default: break;
+    }
+}
+
+//Fold all consts and constant array lengths, after resolve(). Returns number
+//of errors, which are reported through p->error
+int fold(struct parse *p) {
+    assert(p);
+
+    timing_start(TIMING_FOLD);
+
+    struct fold f = {p, 0, false};
+
+    for(int i = 0; i < p->types.n; i++) p->types.val[i] = fold_type(&f, p->types.val[i]);
+    for(int i = 0; i < p->globals.n; i++) fold_val(&f, &p->globals.val[i]);
+    for(int i = 0; i < p->methods.n; i++) fold_val(&f, &p->methods.val[i]);
+
+    timing_stop(TIMING_FOLD);
+
+    return f.errnum;
+}
+
+//Value of e if a constant integer, after fold(). Nothing is reported if not.
+bool fold_int(struct parse *p, struct expr *e, int64_t *v) {
+    struct fold f = {p, 0, true};
+    struct cval c;
+    cval_init(&c);
+    bool ok = eval(&f, e, &c) && c.type == CVAL_INT && bn_to_int64(&c.num, v);
+    cval_free(&c);
+    return ok;
+}
+
+//Whether e is a constant integer that integer type t can not hold, after
+//fold(). Nothing is reported.
+bool fold_overflows(struct parse *p, struct type *t, struct expr *e) {
+    t = sema_resolve(t);
+    int n = t->type == TYPE_PRIMATIVE ? int_bits[t->primative] : 0;
+    if(!n) return false;
+
+    struct fold f = {p, 0, true};
+    struct cval c, w;
+    cval_init(&c);
+    cval_init(&w);
+    bool over = false;
+    if(eval(&f, e, &c) && c.type == CVAL_INT) {
+        cval_wrap(&w, &c, n, t->primative < TYPE_UINT);
+        over = bn_cmp(&w.num, &c.num) != 0;
+    }
+    cval_free(&c);
+    cval_free(&w);
+    return over;
+}
+
+//Value of e if a constant number, as a double, after fold(). Nothing is
+//reported if not.
+bool fold_real(struct parse *p, struct expr *e, double *v) {
+    struct fold f = {p, 0, true};
+    struct cval c;
+    cval_init(&c);
+    bool ok = eval(&f, e, &c) && (c.type == CVAL_INT || c.type == CVAL_REAL);
+    if(ok) *v = cval_to_double(&c);
+    cval_free(&c);
+    return ok;
+}
+
+//String literal e stands for if constant, after fold(). Nothing is reported
+//if not.
+bool fold_str(struct parse *p, struct expr *e, struct token *s) {
+    struct fold f = {p, 0, true};
+    struct cval c;
+    cval_init(&c);
+    bool ok = eval(&f, e, &c) && c.type == CVAL_STR;
+    if(ok) *s = c.str;
+    cval_free(&c);
+    return ok;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "parse.h"
+
+int fold(struct parse *p);
+bool fold_int(struct parse *p, struct expr *e, int64_t *v);
+bool fold_overflows(struct parse *p, struct type *t, struct expr *e);
+bool fold_real(struct parse *p, struct expr *e, double *v);
+bool fold_str(struct parse *p, struct expr *e, struct token *s);
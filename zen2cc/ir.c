@@ -0,0 +1,2281 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fold.h"
+#include "ir.h"
+#include "layout.h"
+#include "lower.h"
+#include "mono.h"
+#include "sema.h"
+#include "timing.h"
+
+//Definitions of locals in a block, while building
+struct ir_defs {
+    int *var;                   //Var holding each local at the end of the block, or -1
+    int n;
+    bool sealed;                //Whether all the predecessors of the block are known
+};
+
+//Phi of an unsealed block, given its operands once the block is sealed
+struct ir_pending {
+    int block, var, local;
+};
+
+//SSA is built directly from the AST, reading a local in a block from its
+//definitions in the predecessors, as Braun et al. do
+struct ir_build {
+    struct parse *p;
+    struct ir_func *f;
+    int cur;                    //Block being appended to
+    struct ir_defs *defs;       //By block
+    struct expr **locals;       //Locals by defining expression, after the arguments
+    struct type **types;
+    char **names;
+    int *slots;                 //Var of the stack slot each local lives in, or -1
+    int locals_n, locals_c;
+    struct ir_pending *pending;
+    int pending_n, pending_c;
+    struct expr **taken;        //Locals whose address is taken
+    int taken_n, taken_c;
+    bool *taken_args;           //By argument
+    bool native;                //Lower what only the native backend takes, see ir()
+    bool fail;                  //Whether the function uses what the IR does not have
+};
+
+//Functions of the module, as the call graph inlining walks. Functions are
+//inlined into their callers in the order Tarjan's algorithm completes their
+//strongly connected components, so callees are final before their callers,
+//and calls within a component, being recursive, are not inlined. Functions
+//other modules export follow those of the module, final already.
+struct ir_graph {
+    struct parse *p;
+    bool report;                //Report inlining decisions through p->warn
+    bool native;                //Lowering for the native backend
+    struct val **funcs;
+    char **names;               //Those from own on are module->name, malloc'd
+    int n, c, own;
+    int *index, *low, *comp;    //Visit order, least reachable on the stack, component
+    int *stack, stack_n;
+    int next, comp_n;
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static const struct ir_val none = {IR_NONE};
+
+//Room for one more of n elements of size in a, of capacity c
+static void *grow(void *a, int n, int *c, size_t size) {
+    if(n < *c) return a;
+    *c = *c ? *c * 2 : IR_INITIAL_CAP;
+    a = realloc(a, *c * size);
+    assert(a);
+    return a;
+}
+
+static struct ir_val var(int v) {
+    return (struct ir_val){IR_VAR, .var = v};
+}
+
+static struct ir_val int_val(int64_t i, struct type *t) {
+    return (struct ir_val){IR_INT, t, .i = i};
+}
+
+static bool val_eq(struct ir_val a, struct ir_val b) {
+    if(a.kind != b.kind) return false;
+    switch(a.kind) {
+    case IR_NONE: return true;
+    case IR_VAR: return a.var == b.var;
+    case IR_INT: return a.i == b.i && ir_same(a.ty, b.ty);
+    case IR_LEAF: return a.leaf == b.leaf;
+    case IR_GLOBAL: return a.global == b.global;
+    }
+    return false;
+}
+
+struct type *ir_type(struct ir_func *f, struct ir_val v) {
+    switch(v.kind) {
+    case IR_VAR: return f->vars[v.var].ty;
+    case IR_GLOBAL: return NULL;
+    default: return v.ty;
+    }
+}
+
+void ir_free(struct ir_func *f) {
+    if(!f) return;
+    for(int i = 0; i < f->blocks_n; i++) {
+        struct ir_block *k = &f->blocks[i];
+        for(int j = 0; j < k->ins_n; j++) free(k->ins[j].args);
+        free(k->ins);
+        free(k->preds);
+    }
+    free(f->blocks);
+    for(int i = 0; i < f->vars_n; i++) free(f->vars[i].name);
+    free(f->vars);
+    free(f);
+}
+
+static bool tok_is(struct token t, char *s) {
+    return t.len == strlen(s) && strncmp(t.str, s, t.len) == 0;
+}
+
+
+//Types
+
+//t as C stores it, named types resolved and enums as their representation
+static struct type *storage(struct type *t) {
+    t = sema_resolve(t);
+    if(t->type == TYPE_ENUM) t = sema_resolve(t->repr ? t->repr : type_prim(TYPE_INT));
+    return t;
+}
+
+//Whether a var can hold a value of type t: numbers, pointers and arrays
+//without a length, which are their pointer
+static bool scalar(struct type *t) {
+    if(!t) return false;
+    t = storage(t);
+    switch(t->type) {
+    case TYPE_PRIMATIVE: return t->primative != TYPE_VOID;
+    case TYPE_PTR: case TYPE_FUNC: return true;
+    case TYPE_ARRAY: return t->n < 0;
+    default: return false;
+    }
+}
+
+static bool is_ptr(struct type *t) {
+    t = storage(t);
+    return t->type == TYPE_PTR || t->type == TYPE_FUNC || t->type == TYPE_ARRAY;
+}
+
+static bool is_void(struct type *t) {
+    t = storage(t);
+    return t->type == TYPE_PRIMATIVE && t->primative == TYPE_VOID;
+}
+
+//Whether a and b are one type in C, where bools are ints and typedefs their
+//definition
+bool ir_same(struct type *a, struct type *b) {
+    if(!a || !b) return a == b;
+    a = storage(a), b = storage(b);
+    if(a == b) return true;
+    if(a->type != TYPE_PRIMATIVE || b->type != TYPE_PRIMATIVE) return false;
+
+    static const enum type_primative c[TYPE_NUM] = {
+        [TYPE_BOOL] = TYPE_INT, [TYPE_INT] = TYPE_INT, [TYPE_INT8] = TYPE_INT8,
+        [TYPE_INT16] = TYPE_INT16, [TYPE_INT32] = TYPE_INT, [TYPE_INT64] = TYPE_INT64,
+        [TYPE_UINT] = TYPE_UINT, [TYPE_UINT8] = TYPE_UINT8, [TYPE_UINT16] = TYPE_UINT16,
+        [TYPE_UINT32] = TYPE_UINT, [TYPE_UINT64] = TYPE_UINT64, [TYPE_FLOAT] = TYPE_FLOAT64,
+        [TYPE_FLOAT16] = TYPE_FLOAT16, [TYPE_FLOAT32] = TYPE_FLOAT32, [TYPE_FLOAT64] = TYPE_FLOAT64,
+    };
+    return c[a->primative] == c[b->primative];
+}
+
+//Type arithmetic on t is done in, integers narrower than int promoted as in
+//C, or NULL if t is not a number
+static struct type *promote(struct type *t) {
+    t = storage(t);
+    if(t->type != TYPE_PRIMATIVE) return NULL;
+    switch(t->primative) {
+    case TYPE_VOID: return NULL;
+    case TYPE_BOOL: case TYPE_INT: case TYPE_INT8: case TYPE_INT16: case TYPE_INT32:
+    case TYPE_UINT8: case TYPE_UINT16:
+        return type_prim(TYPE_INT);
+    case TYPE_UINT: case TYPE_UINT32: return type_prim(TYPE_UINT);
+    case TYPE_FLOAT: return type_prim(TYPE_FLOAT64);
+    default: return t;
+    }
+}
+
+static bool is_float(struct type *t) {
+    return t->primative >= TYPE_FLOAT;
+}
+
+//Width and signedness of integer type t as C stores it, false if t is not
+//an integer
+static bool int_of(struct type *t, int *bits, bool *sign) {
+    t = storage(t);
+    if(t->type != TYPE_PRIMATIVE || t->primative == TYPE_VOID || is_float(t)) return false;
+    if(t->primative == TYPE_BOOL) {
+        *bits = 32, *sign = true;
+        return true;
+    }
+    layout_type(t);
+    *bits = t->size * 8;
+    *sign = t->primative < TYPE_UINT;
+    return true;
+}
+
+//Usual arithmetic conversions of promoted types a and b
+static struct type *common(struct type *a, struct type *b) {
+    if(is_float(a) || is_float(b)) {
+        if(!is_float(b)) return a;
+        if(!is_float(a)) return b;
+        return a->primative >= b->primative ? a : b;
+    }
+
+    int ab, bb;
+    bool as, bs;
+    int_of(a, &ab, &as);
+    int_of(b, &bb, &bs);
+    if(as == bs) return ab >= bb ? a : b;
+
+    //The unsigned type, unless the signed one holds all its values
+    struct type *u = as ? b : a, *s = as ? a : b;
+    return ab == bb || (u == a ? ab > bb : bb > ab) ? u : s;
+}
+
+static int64_t wrap(int64_t v, int bits, bool sign) {
+    if(bits >= 64) return v;
+    uint64_t m = ((uint64_t)1 << bits) - 1, u = (uint64_t)v & m;
+    if(sign && u >> (bits - 1)) u |= ~m;
+    return (int64_t)u;
+}
+
+//Integer i converted to type t, false if t is not an integer
+static bool convert_int(int64_t i, struct type *t, int64_t *r) {
+    int bits;
+    bool sign;
+    if(!int_of(t, &bits, &sign)) return false;
+    *r = wrap(i, bits, sign);
+    return true;
+}
+
+static struct type *ptr_to(struct type *t) {
+    return type_intern((struct type){TYPE_PTR, .of = t});
+}
+
+//Whether values of t are held in memory, and lowered natively as a pointer
+//to it: structs, vectors and arrays with a length
+static bool aggregate(struct type *t) {
+    if(!t) return false;
+    t = storage(t);
+    return t->type == TYPE_STRUCT || t->type == TYPE_VEC || (t->type == TYPE_ARRAY && t->n >= 0);
+}
+
+//Type of a pointer to memory of type t, to the first element of arrays and
+//vectors as C decays them
+static struct type *ref(struct type *t) {
+    struct type *s = storage(t);
+    if(s->type == TYPE_ARRAY || s->type == TYPE_VEC) return ptr_to(s->of);
+    return ptr_to(t);
+}
+
+static struct type *var_type(struct val *v) {
+    if(v->expr_type->type != TYPE_NONE) return v->expr_type;
+    return v->expr.ty ? v->expr.ty : type_none();
+}
+
+
+//Building
+
+static int var_new(struct ir_func *f, struct type *ty, char *name, int arg) {
+    f->vars = grow(f->vars, f->vars_n, &f->vars_c, sizeof *f->vars);
+    f->vars[f->vars_n] = (struct ir_var){ty, name ? strdup(name) : NULL, arg};
+    return f->vars_n++;
+}
+
+static int block_new(struct ir_build *b) {
+    struct ir_func *f = b->f;
+    int c = f->blocks_c;
+    f->blocks = grow(f->blocks, f->blocks_n, &f->blocks_c, sizeof *f->blocks);
+    if(c != f->blocks_c) {
+        b->defs = realloc(b->defs, f->blocks_c * sizeof *b->defs);
+        assert(b->defs);
+    }
+    f->blocks[f->blocks_n] = (struct ir_block){0};
+    b->defs[f->blocks_n] = (struct ir_defs){0};
+    return f->blocks_n++;
+}
+
+//Insert ins into block k at i
+static void ins_insert(struct ir_func *f, int k, int i, struct ir_ins ins) {
+    struct ir_block *bk = &f->blocks[k];
+    bk->ins = grow(bk->ins, bk->ins_n, &bk->ins_c, sizeof *bk->ins);
+    memmove(&bk->ins[i + 1], &bk->ins[i], (bk->ins_n - i) * sizeof *bk->ins);
+    bk->ins[i] = ins;
+    bk->ins_n++;
+}
+
+static void ins_add(struct ir_build *b, struct ir_ins ins) {
+    ins_insert(b->f, b->cur, b->f->blocks[b->cur].ins_n, ins);
+}
+
+//Append ins defining a new var of type t, named after name, returning it
+static struct ir_val def_named(struct ir_build *b, struct ir_ins ins, struct type *t, char *name) {
+    ins.d = var_new(b->f, t, name, -1);
+    if(!ins.n) ins.n = -1;
+    ins_add(b, ins);
+    return var(ins.d);
+}
+
+static struct ir_val def(struct ir_build *b, struct ir_ins ins, struct type *t) {
+    return def_named(b, ins, t, NULL);
+}
+
+static void add_pred(struct ir_func *f, int k, int pred) {
+    struct ir_block *bk = &f->blocks[k];
+    bk->preds = grow(bk->preds, bk->preds_n, &bk->preds_c, sizeof *bk->preds);
+    bk->preds[bk->preds_n++] = pred;
+}
+
+//End the current block with ins, going to succ
+static void end(struct ir_build *b, struct ir_ins ins, int s0, int s1) {
+    ins.d = ins.n = -1;
+    ins_add(b, ins);
+    struct ir_block *k = &b->f->blocks[b->cur];
+    k->succ_n = 0;
+    if(s0 >= 0) k->succ[k->succ_n++] = s0, add_pred(b->f, s0, b->cur);
+    if(s1 >= 0) k->succ[k->succ_n++] = s1, add_pred(b->f, s1, b->cur);
+}
+
+static void jump(struct ir_build *b, int to) {
+    end(b, (struct ir_ins){IR_JUMP}, to, -1);
+}
+
+static void branch(struct ir_build *b, struct ir_val c, int t, int f) {
+    end(b, (struct ir_ins){IR_BRANCH, .a = c}, t, f);
+}
+
+static struct ir_val fail(struct ir_build *b) {
+    b->fail = true;
+    return none;
+}
+
+//Local of key, defining expression of a local or the expression it holds
+//the value of, added as of type t if new
+static int local(struct ir_build *b, struct expr *key, struct type *t, char *name) {
+    for(int i = 0; i < b->locals_n; i++) if(key && b->locals[i] == key) return i;
+
+    int c = b->locals_c;
+    b->locals = grow(b->locals, b->locals_n, &b->locals_c, sizeof *b->locals);
+    if(c != b->locals_c) {
+        b->types = realloc(b->types, b->locals_c * sizeof *b->types);
+        b->names = realloc(b->names, b->locals_c * sizeof *b->names);
+        b->slots = realloc(b->slots, b->locals_c * sizeof *b->slots);
+        assert(b->types); assert(b->names); assert(b->slots);
+    }
+    b->locals[b->locals_n] = key;
+    b->types[b->locals_n] = t;
+    b->names[b->locals_n] = name;
+    b->slots[b->locals_n] = -1;
+    return b->locals_n++;
+}
+
+static void write(struct ir_build *b, int k, int l, int v) {
+    struct ir_defs *d = &b->defs[k];
+    if(l >= d->n) {
+        d->var = realloc(d->var, (l + 1) * sizeof *d->var);
+        assert(d->var);
+        while(d->n <= l) d->var[d->n++] = -1;
+    }
+    d->var[l] = v;
+}
+
+static int read(struct ir_build *b, int k, int l);
+
+//Give phi v of block k its operands, local l in each predecessor
+static void phi_fill(struct ir_build *b, int k, int v, int l) {
+    int n = b->f->blocks[k].preds_n;
+    struct ir_val *args = malloc((n + 1) * sizeof *args);
+    assert(args);
+    for(int i = 0; i < n; i++) args[i] = var(read(b, b->f->blocks[k].preds[i], l));
+
+    struct ir_block *bk = &b->f->blocks[k];
+    for(int i = 0; i < bk->ins_n && bk->ins[i].op == IR_PHI; i++)
+        if(bk->ins[i].d == v) {
+            bk->ins[i].args = args;
+            bk->ins[i].args_n = n;
+            return;
+        }
+    assert(0);
+}
+
+static int phi_new(struct ir_build *b, int k, int l) {
+    int v = var_new(b->f, b->types[l], b->names[l], -1), i = 0;
+    while(i < b->f->blocks[k].ins_n && b->f->blocks[k].ins[i].op == IR_PHI) i++;
+    ins_insert(b->f, k, i, (struct ir_ins){IR_PHI, v, .n = -1});
+    return v;
+}
+
+//Var holding local l at the end of block k
+static int read(struct ir_build *b, int k, int l) {
+    if(l < b->defs[k].n && b->defs[k].var[l] >= 0) return b->defs[k].var[l];
+
+    struct ir_block *bk = &b->f->blocks[k];
+    int v;
+    if(!b->defs[k].sealed) {
+        v = phi_new(b, k, l);
+        b->pending = grow(b->pending, b->pending_n, &b->pending_c, sizeof *b->pending);
+        b->pending[b->pending_n++] = (struct ir_pending){k, v, l};
+    } else if(bk->preds_n == 1) v = read(b, bk->preds[0], l);
+    else if(bk->preds_n == 0) {
+        v = var_new(b->f, b->types[l], b->names[l], -1);
+        ins_insert(b->f, 0, 0, (struct ir_ins){IR_UNDEF, v, .n = -1});
+    } else {
+        v = phi_new(b, k, l);
+        write(b, k, l, v);
+        phi_fill(b, k, v, l);
+    }
+    write(b, k, l, v);
+    return v;
+}
+
+//All the predecessors of block k are known
+static void seal(struct ir_build *b, int k) {
+    for(int i = 0; i < b->pending_n; i++) {
+        struct ir_pending q = b->pending[i];
+        if(q.block != k) continue;
+        b->pending[i--] = b->pending[--b->pending_n];
+        phi_fill(b, q.block, q.var, q.local);
+    }
+    b->defs[k].sealed = true;
+}
+
+//v converted to type t, in a new var named name if it is not already one of t
+static struct ir_val convert(struct ir_build *b, struct ir_val v, struct type *t, char *name) {
+    int64_t i;
+    if(v.kind == IR_INT && convert_int(v.i, t, &i)) v = int_val(i, t);
+    if(!name && (v.kind == IR_VAR || v.kind == IR_INT) && ir_same(ir_type(b->f, v), t)) return v;
+    return def_named(b, (struct ir_ins){IR_COPY, .ty = t, .a = v}, t, name);
+}
+
+//v converted to type t, in a var
+static int to_var(struct ir_build *b, struct ir_val v, struct type *t) {
+    v = convert(b, v, t, NULL);
+    if(v.kind != IR_VAR) v = def(b, (struct ir_ins){IR_COPY, .ty = t, .a = v}, t);
+    return v.var;
+}
+
+//New stack slot of type t, valued as its address
+static struct ir_val slot(struct ir_build *b, struct type *t) {
+    return def(b, (struct ir_ins){IR_SLOT, .ty = t}, ref(t));
+}
+
+//Value of type t at p[i]
+static struct ir_val load_at(struct ir_build *b, struct ir_val p, int i, struct type *t) {
+    return def(b, (struct ir_ins){IR_LOAD, .ty = t, .a = p, .b = int_val(i, type_prim(TYPE_INT))}, t);
+}
+
+//Store v to p[i], of type t
+static void store_at(struct ir_build *b, struct ir_val p, int i, struct type *t, struct ir_val v) {
+    if(b->fail) return;
+    v = convert(b, v, t, NULL);
+    ins_add(b, (struct ir_ins){IR_STORE, -1, t, p, int_val(i, type_prim(TYPE_INT)), v, .n = -1});
+}
+
+//Address of element i of type t at p
+static struct ir_val elem_at(struct ir_build *b, struct ir_val p, int i, struct type *t) {
+    return def(b, (struct ir_ins){IR_INDEX, .ty = t, .a = p, .b = int_val(i, type_prim(TYPE_INT))}, ref(t));
+}
+
+//Address of member i of the struct of type t at p. Bools packed as bits
+//have none.
+static struct ir_val member(struct ir_build *b, struct ir_val p, struct type *t, int i) {
+    t = storage(t);
+    layout_type(t);
+    if(b->fail || t->type != TYPE_STRUCT || i < 0 || i >= t->mem_n || t->size < 0 || layout_is_bit(t, i))
+        return fail(b);
+    struct ir_val off = int_val(t->offsets[i] / 8, type_prim(TYPE_INT));
+    return def(b, (struct ir_ins){IR_INDEX, .ty = type_prim(TYPE_UINT8), .a = p, .b = off}, ref(t->types[i]));
+}
+
+static void zero(struct ir_build *b, struct ir_val p, struct type *t) {
+    if(!b->fail) ins_add(b, (struct ir_ins){IR_ZERO, -1, t, p, .n = -1});
+}
+
+static void move(struct ir_build *b, struct ir_val to, struct ir_val from, struct type *t) {
+    if(!b->fail) ins_add(b, (struct ir_ins){IR_MOVE, -1, t, to, from, .n = -1});
+}
+
+//Integer literal of value c, typed as the C backend writes it
+static struct ir_val int_lit(struct ir_build *b, struct cval *c) {
+    int64_t i;
+    if(bn_to_int64(&c->num, &i))
+        return int_val(i, type_prim(i >= INT32_MIN && i <= INT32_MAX ? TYPE_INT : TYPE_INT64));
+    if(c->num.neg || bn_bits(&c->num) > 64) return fail(b);
+
+    uint64_t u = 0;
+    char *s = bn_str(&c->num);
+    for(char *d = s; *d; d++) u = u * 10 + (*d - '0');
+    free(s);
+    return int_val((int64_t)u, type_prim(TYPE_UINT64));
+}
+
+static struct ir_val leaf(struct expr *e, struct type *t) {
+    return (struct ir_val){IR_LEAF, t, .leaf = e};
+}
+
+static struct ir_val cval(struct ir_build *b, struct expr *e, struct cval *c) {
+    switch(c->type) {
+    case CVAL_INT: return int_lit(b, c);
+    case CVAL_REAL: return leaf(e, type_prim(TYPE_FLOAT64));
+    case CVAL_STR:
+        return leaf(e, type_intern((struct type){TYPE_PTR, .of = type_prim(TYPE_UINT8)}));
+    default: return fail(b);
+    }
+}
+
+static struct ir_val num(struct ir_build *b, struct expr *e) {
+    struct cval c;
+    cval_init(&c);
+    struct ir_val v = cval_parse(&c, e->lit) ? fail(b) : cval(b, e, &c);
+    cval_free(&c);
+    return v;
+}
+
+//Type information of e known as the C backend writes it
+static struct ir_val tacc(struct ir_build *b, struct expr *e) {
+    struct token mt = e->tacc.m->lit;
+    struct type *t = sema_resolve(e->tacc.t);
+    if(e->tacc.m->val) return fail(b);
+
+    bool size = mt.len == 4 && strncmp(mt.str, "size", 4) == 0;
+    if(size || (mt.len == 5 && strncmp(mt.str, "align", 5) == 0)) {
+        layout_type(t);
+        if(t->size < 0) return fail(b);
+        return int_val(size ? t->size : t->align, type_prim(TYPE_UINT64));
+    }
+
+    int member = layout_offset_of(t, mt);
+    if(member >= 0) {
+        layout_type(t);
+        if(layout_is_bit(t, member) || t->size < 0) return fail(b);
+        return int_val(t->offsets[member] / 8, type_prim(TYPE_UINT));
+    }
+
+    if(mt.len == 3 && strncmp(mt.str, "num", 3) == 0 && t->type == TYPE_ARRAY && t->n >= 0)
+        return int_val(t->n, type_prim(TYPE_UINT));
+
+    if(t->type == TYPE_ENUM && t->ivals)
+        for(int i = 0; i < t->opts_n; i++)
+            if((int)strlen(t->opts[i]) == mt.len && strncmp(mt.str, t->opts[i], mt.len) == 0)
+                return int_val(t->ivals[i], type_prim(TYPE_INT));
+    return fail(b);
+}
+
+//Where a local or memory is read and written
+struct ir_lv {
+    int local;                  //Local, or -1 for memory
+    struct ir_val base, index;  //Memory at base[index], or global base if index is IR_NONE
+    struct type *ty;            //Type stored
+    int n;                      //Length a checked index is bounded by, else -1
+    uint8_t mask;               //Bit of the byte a packed bool is, or 0
+};
+
+static struct ir_val lower_expr(struct ir_build *b, struct expr *e);
+static struct ir_val arith(struct ir_build *b, enum ir_op op, struct ir_val x, struct ir_val y);
+
+static bool is_global(struct expr *e) {
+    return e->type == EXPR_IDENT && !e->local && e->arg < 0 && e->val && e->val->type == VAL_VAR;
+}
+
+static bool is_arg(struct expr *e) {
+    return e->type == EXPR_IDENT && !e->local && e->arg >= 0;
+}
+
+//Whether e is an element of an array argument with a length. The C backend
+//copies arrays written, so once inlined a store would reach the caller's.
+static bool arg_elem(struct expr *e) {
+    if(e->type != EXPR_ARRSUB || !is_arg(e->l)) return false;
+    struct type *t = sema_resolve(e->l->ty);
+    return t->type == TYPE_ARRAY && t->n >= 0;
+}
+
+//Slot local or argument e lives in, or -1 if it is held in a var
+static int slot_of(struct ir_build *b, struct expr *e) {
+    if(e->local) return b->slots[local(b, e->local, NULL, NULL)];
+    return e->arg >= 0 ? b->slots[e->arg] : -1;
+}
+
+static struct ir_val address(struct ir_build *b, struct expr *e);
+
+//Place of member i of the struct of type t at p, natively. Bools packed as
+//bits are a bit of the byte they are in.
+static struct ir_lv field(struct ir_build *b, struct ir_val p, struct type *t, int i) {
+    struct ir_lv lv = {-1, none, int_val(0, type_prim(TYPE_INT)), type_none(), -1};
+    t = storage(t);
+    layout_type(t);
+    if(b->fail || t->type != TYPE_STRUCT || i < 0 || i >= t->mem_n || t->size < 0) {
+        fail(b);
+        return lv;
+    }
+    lv.ty = t->types[i];
+    if(!layout_is_bit(t, i)) {
+        lv.base = member(b, p, t, i);
+        return lv;
+    }
+    lv.base = elem_at(b, p, t->offsets[i] / 8, type_prim(TYPE_UINT8));
+    lv.mask = 1 << t->offsets[i] % 8;
+    return lv;
+}
+
+//Struct SACC e is a member of, at the address returned, and the index of
+//the member
+static struct ir_val object(struct ir_build *b, struct expr *e, struct type **t, int *i) {
+    struct ir_val p;
+    *t = storage(e->l->ty);
+    if((*t)->type == TYPE_PTR) p = lower_expr(b, e->l), *t = storage((*t)->of);
+    else p = address(b, e->l);
+    for(*i = 0; (*t)->type == TYPE_STRUCT && *i < (*t)->mem_n; ++*i)
+        if(tok_is(e->r->lit, (*t)->idents[*i])) break;
+    return p;
+}
+
+//Base the elements indexed by EXPR_ARRSUB e are at. Elements of arrays held
+//by value are only reached through globals and arguments, which are
+//pointers in C, but natively through the memory they are held in.
+static bool element(struct ir_build *b, struct expr *e, struct ir_val *base) {
+    struct type *t = sema_resolve(e->l->ty);
+    if(is_global(e->l) && t->type == TYPE_ARRAY) *base = (struct ir_val){IR_GLOBAL, .global = e->l->val};
+    else if(b->native && aggregate(t)) *base = address(b, e->l);
+    else if(t->type == TYPE_PTR || (t->type == TYPE_ARRAY && (t->n < 0 || is_arg(e->l))))
+        *base = lower_expr(b, e->l);
+    else return false;
+    return true;
+}
+
+static bool lvalue(struct ir_build *b, struct expr *e, struct ir_lv *lv) {
+    *lv = (struct ir_lv){-1, none, none, e->ty, -1};
+
+    switch(e->type) {
+    case EXPR_IDENT:
+        if(b->native && (e->local || e->arg >= 0) && slot_of(b, e) >= 0) {
+            lv->base = var(slot_of(b, e));
+            lv->index = int_val(0, type_prim(TYPE_INT));
+        } else if(e->local) lv->local = local(b, e->local, NULL, NULL);
+        else if(e->arg >= 0) lv->local = e->arg;
+        else if(is_global(e)) lv->base = (struct ir_val){IR_GLOBAL, .global = e->val};
+        else return false;
+        if(lv->local >= 0) lv->ty = b->types[lv->local];
+        return scalar(lv->ty);
+
+    case EXPR_DEFER:
+        if(!scalar(e->ty)) return false;
+        lv->base = lower_expr(b, e->l);
+        lv->index = int_val(0, type_prim(TYPE_INT));
+        return true;
+
+    case EXPR_ARRSUB: {
+        struct type *t = storage(e->l->ty);
+        if(!element(b, e, &lv->base) || !scalar(e->ty)) return false;
+        lv->index = lower_expr(b, e->r);
+        if(e->check) lv->n = t->n;
+        return true;
+    }
+
+    case EXPR_SACC: {
+        struct type *t;
+        int i;
+        if(!b->native || !scalar(e->ty)) return false;
+        struct ir_val p = object(b, e, &t, &i);
+        *lv = field(b, p, t, i);
+        return !b->fail;
+    }
+
+    default: return false;
+    }
+}
+
+//Address of what e is, natively: a place in memory, or the memory an
+//aggregate value is held in
+static struct ir_val address(struct ir_build *b, struct expr *e) {
+    if(b->fail) return none;
+    struct type *t = storage(e->ty), *l;
+    struct ir_val p;
+
+    switch(e->type) {
+    case EXPR_IDENT:
+        if((e->local || e->arg >= 0) && slot_of(b, e) >= 0) return var(slot_of(b, e));
+        if(is_global(e)) return leaf(e, ref(e->ty));
+        break;
+
+    case EXPR_DEFER: return convert(b, lower_expr(b, e->l), ref(e->ty), NULL);
+
+    case EXPR_ARRSUB:
+        l = storage(e->l->ty);
+        if(!element(b, e, &p)) return fail(b);
+        if(p.kind == IR_GLOBAL) p = leaf(e->l, ref(e->l->ty));
+        return def(b, (struct ir_ins){IR_INDEX, .ty = e->ty, .a = p, .b = lower_expr(b, e->r),
+                .n = e->check ? l->n : -1}, ref(e->ty));
+
+    case EXPR_SACC: {
+        int i;
+        p = object(b, e, &l, &i);
+        return member(b, p, l, i);
+    }
+
+    default: break;
+    }
+    if(!aggregate(t)) return fail(b);
+    return lower_expr(b, e);
+}
+
+static struct ir_val load(struct ir_build *b, struct ir_lv *lv) {
+    if(lv->local >= 0) return var(read(b, b->cur, lv->local));
+    if(lv->mask) {
+        struct ir_val byte = load_at(b, lv->base, 0, type_prim(TYPE_UINT8));
+        struct ir_val bit = arith(b, IR_BAND, byte, int_val(lv->mask, type_prim(TYPE_INT)));
+        return convert(b, arith(b, IR_NE, bit, int_val(0, type_prim(TYPE_INT))), lv->ty, NULL);
+    }
+    return def(b, (struct ir_ins){IR_LOAD, .ty = lv->ty, .a = lv->base, .b = lv->index, .n = lv->n}, lv->ty);
+}
+
+//Store v, returning it as converted to the type stored
+static struct ir_val store(struct ir_build *b, struct ir_lv *lv, struct ir_val v) {
+    if(b->fail) return none;
+    if(lv->local >= 0) {
+        v = convert(b, v, lv->ty, b->names[lv->local]);
+        write(b, b->cur, lv->local, v.var);
+        return v;
+    }
+    v = convert(b, v, lv->ty, NULL);
+    if(lv->mask) {
+        struct type *u8 = type_prim(TYPE_UINT8);
+        struct ir_val byte = arith(b, IR_BAND, load_at(b, lv->base, 0, u8), int_val(~lv->mask & 0xff, u8));
+        struct ir_val bit = arith(b, IR_NE, v, int_val(0, type_prim(TYPE_INT)));
+        bit = arith(b, IR_MUL, bit, int_val(lv->mask, type_prim(TYPE_INT)));
+        store_at(b, lv->base, 0, u8, arith(b, IR_BOR, byte, bit));
+        return v;
+    }
+    ins_add(b, (struct ir_ins){IR_STORE, -1, lv->ty, lv->base, lv->index, v, .n = lv->n});
+    return v;
+}
+
+//x op y, in the type C does it in
+static struct ir_val arith(struct ir_build *b, enum ir_op op, struct ir_val x, struct ir_val y) {
+    if(b->fail) return none;
+    struct type *tx = ir_type(b->f, x), *ty = ir_type(b->f, y);
+    if(!scalar(tx) || !scalar(ty)) return fail(b);
+
+    struct type *px = promote(tx), *py = promote(ty), *t, *d;
+    bool cmp = op >= IR_LT && op <= IR_NE;
+
+    if(px && py) {
+        t = op == IR_BSL || op == IR_BSR ? px : common(px, py);
+        d = cmp ? type_prim(TYPE_INT) : t;
+    } else if(cmp) t = is_ptr(tx) ? tx : ty, d = type_prim(TYPE_INT);
+    else if(op == IR_ADD && px) t = d = ty;
+    else if((op == IR_ADD || op == IR_SUB) && py) t = d = tx;
+    else if(op == IR_SUB && !px && !py) t = tx, d = type_prim(TYPE_INT64);
+    else return fail(b);
+
+    return def(b, (struct ir_ins){op, .ty = t, .a = x, .b = y}, d);
+}
+
+static struct ir_val unary(struct ir_build *b, enum ir_op op, struct ir_val x) {
+    if(b->fail) return none;
+    struct type *t = ir_type(b->f, x), *p = promote(t);
+    if(op == IR_LNOT && scalar(t)) return def(b, (struct ir_ins){op, .ty = t, .a = x}, type_prim(TYPE_INT));
+    if(!p) return fail(b);
+    return def(b, (struct ir_ins){op, .ty = p, .a = x}, p);
+}
+
+//++ and --, valued as the value stored if prefix, else as the value before
+static struct ir_val step(struct ir_build *b, struct expr *e) {
+    struct ir_lv lv;
+    if((!b->native && arg_elem(e->l)) || !lvalue(b, e->l, &lv)) return fail(b);
+    struct ir_val old = load(b, &lv);
+    bool inc = e->type == EXPR_POSTINC || e->type == EXPR_PREINC;
+    struct ir_val v = store(b, &lv, arith(b, inc ? IR_ADD : IR_SUB, old, int_val(1, type_prim(TYPE_INT))));
+    return e->type == EXPR_PREINC || e->type == EXPR_PREDEC ? v : old;
+}
+
+static struct ir_val ident(struct ir_build *b, struct expr *e) {
+    struct val *v = e->val;
+    struct ir_lv lv;
+
+    if(!e->local && e->arg < 0 && v && v->type == VAL_CONST && v->cval) return cval(b, e, v->cval);
+    if(!e->local && e->arg < 0 && v && v->type == VAL_FUNC) return leaf(e, e->ty);
+
+    //Global arrays decay to a pointer to their first element
+    struct type *t = sema_resolve(e->ty);
+    if(is_global(e) && t->type == TYPE_ARRAY)
+        return leaf(e, type_intern((struct type){TYPE_PTR, .of = t->of}));
+    if(b->native && aggregate(t)) return address(b, e);
+    if(!lvalue(b, e, &lv)) return fail(b);
+    return load(b, &lv);
+}
+
+//Whether calls of v return through out-parameters, natively those of
+//several values or of an aggregate
+static bool outs(struct ir_build *b, struct val *v) {
+    return b->native && (v->ret_n > 1 || (v->ret_n == 1 && aggregate(v->ret_type[0])));
+}
+
+//Direct calls of functions returning at most one value. Natively also calls
+//of methods, the receiver passed first and dereferenced if the method is of
+//the type pointed to, and of functions returning through out-parameters, to
+//the members of a new slot the call is valued as.
+static struct ir_val call(struct ir_build *b, struct expr *e) {
+    struct expr *f = e->f, *recv = NULL;
+    struct val *v = f->val;
+    if(b->native && f->type == EXPR_MACC) v = f->r->val, recv = f->l;
+    else if(b->native && f->type == EXPR_TACC) v = f->tacc.m->val;
+    else if(f->type != EXPR_IDENT || f->local || f->arg >= 0) return fail(b);
+    if(!v || v->type != VAL_FUNC || func_is_generic(v) || (v->ret_n > 1 && !outs(b, v))
+            || e->args_n + !!recv != v->args_n)
+        return fail(b);
+
+    int n = v->args_n + (outs(b, v) ? v->ret_n : 0), a = 0;
+    struct ir_val *args = malloc((n + 1) * sizeof *args);
+    assert(args);
+    if(recv) {
+        struct type *l = recv->ty ? storage(recv->ty) : type_none(), *r = storage(v->args_type[0]);
+        args[a] = lower_expr(b, recv);
+        if(l->type == TYPE_PTR && r->type != TYPE_PTR && !b->fail)
+            args[a] = aggregate(r) ? convert(b, args[a], ref(r), NULL) : load_at(b, args[a], 0, r);
+        a++;
+    }
+    for(int i = 0; i < e->args_n; i++, a++) {
+        args[a] = lower_expr(b, &e->args[i]);
+        if(b->native && !b->fail && !aggregate(v->args_type[a]))
+            args[a] = convert(b, args[a], v->args_type[a], NULL);
+    }
+
+    //Bools packed in the tuple returned are returned to a slot of their own,
+    //copied in after the call
+    struct ir_val r = none;
+    struct ir_lv out[v->ret_n + 1];
+    for(int i = 0; i < v->ret_n && outs(b, v); i++) {
+        if(!i) r = slot(b, e->ty);
+        out[i] = v->ret_n > 1 ? field(b, r, e->ty, i) : (struct ir_lv){.base = r};
+        args[a++] = out[i].mask ? slot(b, out[i].ty) : out[i].base;
+    }
+
+    struct ir_ins ins = {IR_CALL, -1, .args = args, .args_n = a, .f = v, .n = -1};
+    if(b->fail || (!outs(b, v) && v->ret_n && !is_void(v->ret_type[0]) && !scalar(v->ret_type[0]))) {
+        free(args);
+        return fail(b);
+    }
+    if(!outs(b, v) && v->ret_n && !is_void(v->ret_type[0])) return def(b, ins, v->ret_type[0]);
+    ins_add(b, ins);
+    for(int i = 0; i < v->ret_n && outs(b, v); i++)
+        if(out[i].mask) store(b, &out[i], load_at(b, args[a - v->ret_n + i], 0, out[i].ty));
+    return r;
+}
+
+//Whether e is valued 0 or 1
+static bool truth(struct expr *e) {
+    switch(e->type) {
+    case EXPR_LT: case EXPR_LE: case EXPR_GT: case EXPR_GE: case EXPR_EQ: case EXPR_NE:
+    case EXPR_AND: case EXPR_OR: case EXPR_LNOT:
+        return true;
+    default: return false;
+    }
+}
+
+//&& and || are valued 0 or 1, as the right operand is only evaluated if the
+//left does not decide it
+static struct ir_val logical(struct ir_build *b, struct expr *e) {
+    struct type *t = type_prim(TYPE_INT);
+    int r = local(b, e, t, NULL);
+    bool and = e->type == EXPR_AND;
+
+    struct ir_val c = lower_expr(b, e->l);
+    write(b, b->cur, r, to_var(b, int_val(!and, t), t));
+    int rhs = block_new(b), join = block_new(b);
+    branch(b, c, and ? rhs : join, and ? join : rhs);
+    seal(b, rhs);
+
+    b->cur = rhs;
+    struct ir_val v = lower_expr(b, e->r);
+    if(!truth(e->r)) v = arith(b, IR_NE, v, int_val(0, t));
+    if(!b->fail) write(b, b->cur, r, to_var(b, v, t));
+    jump(b, join);
+    seal(b, join);
+
+    b->cur = join;
+    return var(read(b, join, r));
+}
+
+//Type an if is valued as, from the values of its branches
+static struct type *if_type(struct ir_build *b, struct ir_val x, struct ir_val y) {
+    struct type *tx = ir_type(b->f, x), *ty = ir_type(b->f, y);
+    if(!scalar(tx) || !scalar(ty)) return NULL;
+    if(promote(tx) && promote(ty)) return common(promote(tx), promote(ty));
+    return ir_same(tx, ty) ? tx : NULL;
+}
+
+static struct ir_val lower_if(struct ir_build *b, struct expr *e) {
+    struct ir_val c = lower_expr(b, e->ctl.cond);
+    int body = block_new(b), els = e->ctl.els ? block_new(b) : -1, join = block_new(b);
+    branch(b, c, body, els >= 0 ? els : join);
+    seal(b, body);
+    if(els >= 0) seal(b, els);
+
+    b->cur = body;
+    struct ir_val x = lower_expr(b, e->ctl.body);
+    int body_end = b->cur;
+    if(els < 0) {
+        jump(b, join);
+        seal(b, join);
+        b->cur = join;
+        return none;
+    }
+
+    b->cur = els;
+    struct ir_val y = lower_expr(b, e->ctl.els);
+    int els_end = b->cur;
+
+    //Both branches convert their value to that of the if
+    int r = -1;
+    if(!is_void(e->ty) && x.kind != IR_NONE && y.kind != IR_NONE && !b->fail) {
+        struct type *t = if_type(b, x, y);
+        if(!t) return fail(b);
+        r = local(b, e, t, NULL);
+        b->cur = body_end;
+        write(b, body_end, r, to_var(b, x, t));
+        b->cur = els_end;
+        write(b, els_end, r, to_var(b, y, t));
+    }
+
+    b->cur = body_end;
+    jump(b, join);
+    b->cur = els_end;
+    jump(b, join);
+    seal(b, join);
+    b->cur = join;
+    return r >= 0 ? var(read(b, join, r)) : none;
+}
+
+static struct ir_val lower_for(struct ir_build *b, struct expr *e) {
+    if(e->ctl.init) lower_expr(b, e->ctl.init);
+    int head = block_new(b);
+    jump(b, head);
+
+    b->cur = head;
+    int body = block_new(b), exit = block_new(b);
+    if(e->ctl.cond) branch(b, lower_expr(b, e->ctl.cond), body, exit);
+    else jump(b, body);
+    seal(b, body);
+    seal(b, exit);
+
+    b->cur = body;
+    if(e->ctl.body) lower_expr(b, e->ctl.body);
+    if(e->ctl.step) lower_expr(b, e->ctl.step);
+    jump(b, head);
+    seal(b, head);
+
+    b->cur = exit;
+    return none;
+}
+
+//Fill the new memory of type t at p with the value of e: a compound literal
+//or tuple a member at a time, the rest zeroed, a string as C copies it into
+//an array
+static void fill(struct ir_build *b, struct ir_val p, struct type *t, struct expr *e) {
+    struct type *s = storage(t);
+    if(b->fail) return;
+
+    if(e->type == EXPR_COMP_LIT || e->type == EXPR_TUPLE) {
+        bool st = s->type == TYPE_STRUCT;
+        int n = st ? s->mem_n : s->type == TYPE_ARRAY || s->type == TYPE_VEC ? s->n : -1;
+        if(n < e->vals_n) {
+            fail(b);
+            return;
+        }
+        if(e->vals_n < n) zero(b, p, t);
+        for(int i = 0; i < e->vals_n; i++) {
+            struct type *m = st ? s->types[i] : s->of;
+            struct ir_lv lv = st ? field(b, p, s, i) : (struct ir_lv){-1, elem_at(b, p, i, m),
+                int_val(0, type_prim(TYPE_INT)), m, -1};
+            if(aggregate(m)) fill(b, lv.base, m, &e->vals[i]);
+            else store(b, &lv, lower_expr(b, &e->vals[i]));
+        }
+        return;
+    }
+
+    struct token str;
+    if(s->type == TYPE_ARRAY && e->type == EXPR_STR && fold_str(b->p, e, &str)) {
+        char *bytes = malloc(str.len + 1);
+        assert(bytes);
+        int n = token_unescape(str, bytes) + 1;
+        free(bytes);
+        if(n > s->n) n = s->n;
+        zero(b, p, t);
+        move(b, p, lower_expr(b, e), type_intern((struct type){TYPE_ARRAY, .of = type_prim(TYPE_UINT8), .n = n}));
+        return;
+    }
+
+    if(aggregate(t)) move(b, p, lower_expr(b, e), t);
+    else store_at(b, p, 0, t, lower_expr(b, e));
+}
+
+static bool taken(struct ir_build *b, struct expr *l) {
+    for(int i = 0; i < b->taken_n; i++) if(b->taken[i] == l) return true;
+    return false;
+}
+
+//Note the locals and arguments whose address e takes, which natively live
+//in stack slots
+static void find_taken(struct ir_build *b, struct expr *e) {
+    if(!e) return;
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: case EXPR_TACC:
+        return;
+    case EXPR_FCALL:
+        find_taken(b, e->f);
+        for(int i = 0; i < e->args_n; i++) find_taken(b, &e->args[i]);
+        return;
+    case EXPR_COMP_LIT: case EXPR_TUPLE: case EXPR_BLOCK:
+        for(int i = 0; i < e->vals_n; i++) find_taken(b, &e->vals[i]);
+        return;
+    case EXPR_CAST: find_taken(b, e->tacc.m); return;
+    EXPR_CASE_CTL:
+        find_taken(b, e->ctl.init);
+        find_taken(b, e->ctl.cond);
+        find_taken(b, e->ctl.step);
+        find_taken(b, e->ctl.body);
+        find_taken(b, e->ctl.els);
+        return;
+    case EXPR_ADDR:
+        if(e->l->type == EXPR_IDENT && e->l->local) {
+            b->taken = grow(b->taken, b->taken_n, &b->taken_c, sizeof *b->taken);
+            b->taken[b->taken_n++] = e->l->local;
+        } else if(e->l->type == EXPR_IDENT && e->l->arg >= 0) b->taken_args[e->l->arg] = true;
+        //fallthrough
+    default:
+        find_taken(b, e->l);
+        if(e->type >= EXPR_MUL || e->type == EXPR_ARRSUB) find_taken(b, e->r);
+        return;
+    }
+}
+
+//Define local l, natively, as e or else as the value at from. Aggregates,
+//and locals whose address is taken, live in a slot of their own.
+static struct ir_val define_local(struct ir_build *b, struct expr *l, struct expr *e, struct ir_lv *from) {
+    struct type *t = l->ty;
+    struct ir_val v;
+    if(aggregate(t)) {
+        v = slot(b, t);
+        if(e) fill(b, v, t, e);
+        else move(b, v, from->base, t);
+    } else v = e ? lower_expr(b, e) : load(b, from);
+    if(b->fail) return none;
+
+    int k = local(b, l, t, token_str(l->lit));
+    struct ir_lv lv = {k, .ty = t, .n = -1};
+    if(aggregate(t)) {
+        b->slots[k] = v.var;
+        return v;
+    }
+    if(taken(b, l)) {
+        b->slots[k] = slot(b, t).var;
+        lv = (struct ir_lv){-1, var(b->slots[k]), int_val(0, type_prim(TYPE_INT)), t, -1};
+    }
+    return store(b, &lv, v);
+}
+
+//Definition e of locals held in memory, or of a tuple of locals each
+//defined from a member of its value
+static struct ir_val define(struct ir_build *b, struct expr *e) {
+    struct expr *l = e->l;
+    if(l->type != EXPR_TUPLE) return define_local(b, l, e->r, NULL);
+
+    struct type *t = storage(e->r->ty);
+    struct ir_val v = lower_expr(b, e->r);
+    if(b->fail || t->type != TYPE_STRUCT || t->mem_n != l->vals_n) return fail(b);
+    for(int i = 0; i < l->vals_n; i++) {
+        struct ir_lv m = field(b, v, t, i);
+        define_local(b, &l->vals[i], NULL, &m);
+    }
+    return v;
+}
+
+//Assignment e of an aggregate, or to a tuple, stored once its value is
+//whole, so a tuple is assigned in parallel
+static struct ir_val assign(struct ir_build *b, struct expr *e) {
+    struct expr *l = e->l;
+    struct ir_val v = lower_expr(b, e->r);
+    if(l->type != EXPR_TUPLE) {
+        struct ir_val p = address(b, l);
+        move(b, p, v, l->ty);
+        return p;
+    }
+
+    struct type *t = storage(e->r->ty);
+    if(b->fail || t->type != TYPE_STRUCT || t->mem_n != l->vals_n) return fail(b);
+    for(int i = 0; i < l->vals_n; i++) {
+        struct ir_lv m = field(b, v, t, i), lv;
+        if(l->vals[i].local == &l->vals[i]) define_local(b, &l->vals[i], NULL, &m);  //_
+        else if(aggregate(t->types[i])) move(b, address(b, &l->vals[i]), m.base, t->types[i]);
+        else if(lvalue(b, &l->vals[i], &lv)) store(b, &lv, load(b, &m));
+        else return fail(b);
+    }
+    return v;
+}
+
+//Vector operation e, done a lane at a time into a new vector. A scalar
+//operand is converted to the type of the lanes of the other, and compares
+//are valued -1 or 0 in each lane.
+static struct ir_val lanes(struct ir_build *b, struct expr *e) {
+    struct type *t = storage(e->ty), *ts[2] = {NULL, NULL};
+    bool bin = e->type >= EXPR_MUL;
+    struct ir_val v[2];
+    enum ir_op op = e->type == EXPR_NEG ? IR_NEG : e->type == EXPR_BNOT ? IR_BNOT : IR_MUL + (e->type - EXPR_MUL);
+    if(t->type != TYPE_VEC || (!bin && op != IR_NEG && op != IR_BNOT) || (bin && op > IR_BOR)) return fail(b);
+
+    for(int k = 0; k <= bin; k++) {
+        struct expr *o = k ? e->r : e->l;
+        ts[k] = storage(o->ty);
+        v[k] = lower_expr(b, o);
+    }
+    struct ir_val r = slot(b, e->ty);
+    for(int i = 0; i < t->n && !b->fail; i++) {
+        struct ir_val x[2];
+        for(int k = 0; k <= bin; k++) {
+            if(ts[k]->type == TYPE_VEC) x[k] = load_at(b, v[k], i, ts[k]->of);
+            else x[k] = convert(b, v[k], ts[!k]->of, NULL);
+        }
+        struct ir_val y = bin ? arith(b, op, x[0], x[1]) : unary(b, op, x[0]);
+        if(op >= IR_LT && op <= IR_NE) y = unary(b, IR_NEG, y);
+        store_at(b, r, i, t->of, y);
+    }
+    return r;
+}
+
+//Decision tree over the labels a to z of sw, comparing arg, of type t, with
+//the middle one until few are left, then in turn
+static void tree(struct ir_build *b, struct lower_switch *sw, struct ir_val arg, struct type *t,
+        int *blocks, int dflt, int a, int z) {
+    if(z - a <= LOWER_CHAIN_MAX) {
+        for(int i = a; i < z; i++) {
+            int next = block_new(b);
+            struct ir_val c = convert(b, int_val(sw->labels[i].val, type_prim(TYPE_INT64)), t, NULL);
+            branch(b, arith(b, IR_EQ, arg, c), blocks[sw->labels[i].c], next);
+            seal(b, next);
+            b->cur = next;
+        }
+        jump(b, dflt);
+        return;
+    }
+
+    int mid = a + (z - a) / 2, lo = block_new(b), hi = block_new(b);
+    struct ir_val c = convert(b, int_val(sw->labels[mid].val, type_prim(TYPE_INT64)), t, NULL);
+    branch(b, arith(b, IR_LT, arg, c), lo, hi);
+    seal(b, lo);
+    seal(b, hi);
+    b->cur = lo;
+    tree(b, sw, arg, t, blocks, dflt, a, mid);
+    b->cur = hi;
+    tree(b, sw, arg, t, blocks, dflt, mid, z);
+}
+
+//Switch on the length of string arg, then its bytes against each label of
+//that length in turn
+static void strings(struct ir_build *b, struct expr *e, struct ir_val arg, int *blocks, int dflt) {
+    struct lower_switch *sw = e->ctl.plan;
+    struct type *u64 = type_prim(TYPE_UINT64), *u8 = type_prim(TYPE_UINT8);
+    int n = storage(e->ctl.cond->ty)->n;
+    struct ir_val len = e->ctl.step ? convert(b, lower_expr(b, e->ctl.step), u64, NULL) : int_val(n, u64);
+
+    for(int a = 0, z; a < sw->n; a = z) {
+        for(z = a; z < sw->n && sw->labels[z].val == sw->labels[a].val; z++);
+        if(!e->ctl.step && sw->labels[a].val != n) continue;
+        int yes = block_new(b), no = block_new(b);
+        branch(b, arith(b, IR_EQ, len, int_val(sw->labels[a].val, u64)), yes, no);
+        seal(b, yes);
+        seal(b, no);
+
+        b->cur = yes;
+        for(int i = a; i < z; i++) {
+            struct lower_label *l = &sw->labels[i];
+            int next = block_new(b);
+            for(int j = 0; j < l->val; j++) {
+                int more = block_new(b);
+                struct ir_val c = arith(b, IR_EQ, load_at(b, arg, j, u8), int_val(l->str[j], type_prim(TYPE_INT)));
+                branch(b, c, more, next);
+                seal(b, more);
+                b->cur = more;
+            }
+            jump(b, blocks[l->c]);
+            seal(b, next);
+            b->cur = next;
+        }
+        jump(b, dflt);
+        b->cur = no;
+    }
+    jump(b, dflt);
+}
+
+//Switch e dispatches as planned to its cases, each falling through to the
+//next if it ends so. Jump tables are decision trees, and string labels are
+//compared a byte at a time. Valued as the case taken, or 0 if it takes none.
+static struct ir_val lower_switch(struct ir_build *b, struct expr *e) {
+    struct lower_switch *sw = e->ctl.plan;
+    struct expr *cases = e->ctl.body->vals;
+    int n = e->ctl.body->vals_n;
+    if(!sw) return fail(b);
+
+    struct ir_val arg = e->ctl.cond ? lower_expr(b, e->ctl.cond) : none;
+    int *blocks = malloc((n + 1) * sizeof *blocks);
+    assert(blocks);
+    for(int i = 0; i < n; i++) blocks[i] = block_new(b);
+    struct type *vt = e->ty && !is_void(e->ty) ? e->ty : NULL, *t = vt && aggregate(vt) ? ref(vt) : vt;
+    int r = t ? local(b, e, t, NULL) : -1;
+
+    //A valued switch without a default takes one writing 0
+    int els = e->ctl.els ? block_new(b) : -1, join = block_new(b);
+    int dflt = els >= 0 ? els : r >= 0 ? block_new(b) : join;
+    blocks[n] = dflt;
+
+    switch(sw->kind) {
+    case LOWER_CHAIN:
+        for(int i = 0; i < n && !b->fail; i++) {
+            struct ir_val c = lower_expr(b, cases[i].ctl.cond);
+            if(e->ctl.cond) c = arith(b, IR_EQ, arg, c);
+            int next = block_new(b);
+            branch(b, c, blocks[i], next);
+            seal(b, next);
+            b->cur = next;
+        }
+        jump(b, dflt);
+        break;
+    case LOWER_TREE: case LOWER_TABLE:
+        tree(b, sw, arg, storage(e->ctl.cond->ty), blocks, dflt, 0, sw->n);
+        break;
+    case LOWER_HASH: strings(b, e, arg, blocks, dflt); break;
+    }
+
+    for(int i = 0; i <= n && !b->fail; i++) {
+        struct expr *body = i < n ? cases[i].ctl.body : e->ctl.els;
+        if(!body) continue;
+        bool falls = i < n && (!body->vals_n || body->vals[body->vals_n - 1].type == EXPR_FALLTHROUGH);
+        seal(b, blocks[i]);
+        b->cur = blocks[i];
+
+        struct ir_val v = none;
+        for(int j = 0; j < body->vals_n - falls; j++) v = lower_expr(b, &body->vals[j]);
+        if(r >= 0 && !falls && !b->fail) {
+            if(v.kind == IR_NONE) fail(b);
+            else write(b, b->cur, r, to_var(b, v, t));
+        }
+        jump(b, falls ? blocks[i + 1] : join);
+    }
+    if(els < 0 && r >= 0 && !b->fail) {
+        seal(b, dflt);
+        b->cur = dflt;
+        struct ir_val v = int_val(0, type_prim(TYPE_INT));
+        if(t != vt) zero(b, v = slot(b, vt), vt);
+        write(b, b->cur, r, to_var(b, v, t));
+        jump(b, join);
+    }
+    free(blocks);
+    if(b->fail) return none;
+
+    seal(b, join);
+    b->cur = join;
+    return r >= 0 ? var(read(b, join, r)) : none;
+}
+
+static struct ir_val lower_expr(struct ir_build *b, struct expr *e) {
+    if(b->fail) return none;
+    struct ir_lv lv;
+    struct ir_val v;
+
+    switch(e->type) {
+    case EXPR_NONE: return none;
+    case EXPR_NUM: return num(b, e);
+    case EXPR_STR: return leaf(e, type_intern((struct type){TYPE_PTR, .of = type_prim(TYPE_UINT8)}));
+    case EXPR_IDENT: return ident(b, e);
+    case EXPR_TACC: return tacc(b, e);
+
+    case EXPR_POSTINC: case EXPR_POSTDEC: case EXPR_PREINC: case EXPR_PREDEC:
+        return step(b, e);
+
+    case EXPR_LNOT: return unary(b, IR_LNOT, lower_expr(b, e->l));
+    case EXPR_BNOT: case EXPR_NEG:
+        if(b->native && aggregate(e->ty)) return lanes(b, e);
+        return unary(b, e->type == EXPR_NEG ? IR_NEG : IR_BNOT, lower_expr(b, e->l));
+
+    case EXPR_CAST:
+        v = lower_expr(b, e->tacc.m);
+        if(b->fail || !scalar(e->tacc.t) || !scalar(ir_type(b->f, v))) return fail(b);
+        return def(b, (struct ir_ins){IR_COPY, .ty = e->tacc.t, .a = v}, e->tacc.t);
+
+    case EXPR_DEFER: case EXPR_ARRSUB: case EXPR_SACC:
+        if(b->native && aggregate(e->ty)) return address(b, e);
+        if(!lvalue(b, e, &lv)) return fail(b);
+        return load(b, &lv);
+
+    case EXPR_ADDR:
+        if(!b->native) return fail(b);
+        v = address(b, e->l);
+        return b->fail ? none : convert(b, v, e->ty, NULL);
+
+    case EXPR_COMP_LIT: case EXPR_TUPLE:
+        if(!b->native || !aggregate(e->ty)) return fail(b);
+        v = slot(b, e->ty);
+        fill(b, v, e->ty, e);
+        return v;
+
+    case EXPR_FCALL: return call(b, e);
+
+    EXPR_CASE_BINARY:
+        if(e->type == EXPR_AND || e->type == EXPR_OR) return logical(b, e);
+        if(b->native && (aggregate(e->l->ty) || aggregate(e->r->ty))) return lanes(b, e);
+        v = lower_expr(b, e->l);
+        return arith(b, IR_MUL + (e->type - EXPR_MUL), v, lower_expr(b, e->r));
+
+    case EXPR_ASSIGN:
+        if(b->native && (e->l->type == EXPR_TUPLE || aggregate(e->l->ty))) return assign(b, e);
+        if((!b->native && arg_elem(e->l)) || !lvalue(b, e->l, &lv)) return fail(b);
+        return store(b, &lv, lower_expr(b, e->r));
+
+    case EXPR_DEFINE: {
+        struct expr *l = e->l;
+        if(b->native && (l->type == EXPR_TUPLE || aggregate(l->ty) || taken(b, l))) return define(b, e);
+        if(l->type != EXPR_IDENT || !scalar(l->ty)) return fail(b);
+        v = lower_expr(b, e->r);
+        char *name = token_str(l->lit);
+        lv = (struct ir_lv){local(b, l, l->ty, name), .ty = l->ty, .n = -1};
+        v = store(b, &lv, v);
+        return v;
+    }
+
+    case EXPR_BLOCK:
+        v = none;
+        for(int i = 0; i < e->vals_n; i++) v = lower_expr(b, &e->vals[i]);
+        return v;
+
+    case EXPR_IF: return lower_if(b, e);
+    case EXPR_FOR: return lower_for(b, e);
+    case EXPR_SWITCH: return b->native ? lower_switch(b, e) : fail(b);
+
+    default: return fail(b);
+    }
+}
+
+//Free what building took, returning the function built, or NULL if it
+//uses what the IR does not have. Names of the first args_n locals are the
+//function's.
+static struct ir_func *done(struct ir_build *b, int args_n) {
+    for(int i = 0; i < b->f->blocks_n; i++) free(b->defs[i].var);
+    free(b->defs);
+    for(int i = args_n; i < b->locals_n; i++) free(b->names[i]);
+    free(b->locals);
+    free(b->types);
+    free(b->names);
+    free(b->slots);
+    free(b->pending);
+    free(b->taken);
+    free(b->taken_args);
+
+    if(!b->fail) return b->f;
+    ir_free(b->f);
+    return NULL;
+}
+
+//IR of function v, or NULL if it uses what the IR does not have. Natively,
+//aggregate arguments are pointers to memory copied to a slot on entry, as
+//are arguments whose address is taken, and values returned through
+//out-parameters are pointers passed after the arguments. Functions exported
+//keep the C ABI, so take no structs or vectors and have no out-parameters.
+static struct ir_func *build(struct parse *p, struct val *v, bool native) {
+    struct ir_func *f = calloc(1, sizeof *f);
+    assert(f);
+    struct ir_build b = {p, f, .native = native};
+
+    b.cur = block_new(&b);
+    b.defs[0].sealed = true;
+    if(native) {
+        b.taken_args = calloc(v->args_n + 1, sizeof *b.taken_args);
+        assert(b.taken_args);
+        find_taken(&b, &v->func_expr);
+        b.fail = v->export && outs(&b, v);
+    }
+    for(int i = 0; i < v->args_n; i++) {
+        struct type *t = sema_resolve(v->args_type[i]);
+        if(t->type == TYPE_ARRAY && t->n >= 0) t = type_intern((struct type){TYPE_PTR, .of = t->of});
+        else if(native && aggregate(t) && !v->export) t = ref(v->args_type[i]);
+        else if(!scalar(t)) b.fail = true;
+        else t = v->args_type[i];
+        local(&b, NULL, t, v->args[i]);
+        write(&b, 0, i, var_new(f, t, v->args[i], i));
+    }
+    for(int i = 0; i < v->args_n && native; i++) {
+        struct type *t = v->args_type[i];
+        if(!aggregate(t) && !b.taken_args[i]) continue;
+        struct ir_val s = slot(&b, t), a = var(read(&b, 0, i));
+        if(aggregate(t)) move(&b, s, a, t);
+        else store_at(&b, s, 0, t, a);
+        b.slots[i] = s.var;
+    }
+    int out = f->vars_n;
+    for(int i = 0; i < v->ret_n && outs(&b, v); i++) var_new(f, ref(v->ret_type[i]), NULL, v->args_n + i);
+
+    struct ir_val r = lower_expr(&b, &v->func_expr);
+    struct type *rt = v->ret_n == 1 ? v->ret_type[0] : type_prim(TYPE_VOID);
+
+    //Values returned through out-parameters are copied from the members of
+    //the tuple the body is valued as, or the aggregate
+    if(outs(&b, v) && !b.fail && r.kind != IR_NONE) {
+        struct type *t = storage(v->func_expr.ty);
+        bool tuple = v->ret_n > 1;
+        if(tuple && (t->type != TYPE_STRUCT || t->mem_n != v->ret_n)) b.fail = true;
+        for(int i = 0; i < v->ret_n && !b.fail; i++) {
+            struct ir_lv from = tuple ? field(&b, r, t, i) : (struct ir_lv){-1, r,
+                int_val(0, type_prim(TYPE_INT)), v->ret_type[i], -1};
+            if(aggregate(v->ret_type[i])) move(&b, var(out + i), from.base, v->ret_type[i]);
+            else store_at(&b, var(out + i), 0, v->ret_type[i], load(&b, &from));
+        }
+        r = none;
+        rt = type_prim(TYPE_VOID);
+    } else if(v->ret_n > 1 || (!is_void(rt) && (!scalar(rt) || r.kind == IR_NONE))) b.fail = true;
+    if(!b.fail) {
+        if(!is_void(rt)) r = convert(&b, r, rt, NULL);
+        end(&b, (struct ir_ins){IR_RET, .a = is_void(rt) ? none : r}, -1, -1);
+    }
+    return done(&b, v->args_n);
+}
+
+//Function storing the globals that are not initialized as data, natively,
+//in the order they are defined. NULL if there are none, or one cannot be
+//lowered.
+static struct ir_func *globals(struct parse *p) {
+    struct ir_func *f = calloc(1, sizeof *f);
+    assert(f);
+    struct ir_build b = {p, f, .native = true};
+    bool any = false;
+
+    b.cur = block_new(&b);
+    b.defs[0].sealed = true;
+    for(int i = 0; i < p->globals.n && !b.fail; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_VAR || ir_data(p, var_type(v), &v->expr)) continue;
+        struct type *t = var_type(v);
+        struct ir_lv lv = {-1, {IR_GLOBAL, .global = v}, none, t, -1};
+        if(aggregate(t)) fill(&b, lv.base, t, &v->expr);
+        else store(&b, &lv, lower_expr(&b, &v->expr));
+        any = true;
+    }
+    if(!b.fail) end(&b, (struct ir_ins){IR_RET}, -1, -1);
+
+    f = done(&b, 0);
+    if(f && !any) {
+        ir_free(f);
+        f = NULL;
+    }
+    return f;
+}
+
+//Whether global initializer e, of type t, is data the native backend writes
+//as it is: a constant, the address of a function or global, or a compound
+//literal of those. Others are stored by p->init.
+bool ir_data(struct parse *p, struct type *t, struct expr *e) {
+    struct type *s = storage(t);
+    struct expr *l = e->type == EXPR_ADDR ? e->l : e;
+    struct token str;
+    int64_t i;
+    double d;
+
+    if(e->type == EXPR_NONE) return true;
+    if(e->type == EXPR_COMP_LIT) {
+        bool st = s->type == TYPE_STRUCT;
+        if(!aggregate(s) || e->vals_n > (st ? s->mem_n : s->n)) return false;
+        for(int k = 0; k < e->vals_n; k++)
+            if(!ir_data(p, st ? s->types[k] : s->of, &e->vals[k])) return false;
+        return true;
+    }
+    if(s->type == TYPE_ARRAY && s->n >= 0) return fold_str(p, e, &str);
+    if(aggregate(s)) return false;
+    if(fold_int(p, e, &i) || fold_real(p, e, &d) || fold_str(p, e, &str)) return true;
+    if(l->type != EXPR_IDENT || !l->val || l->local || l->arg >= 0) return false;
+    if(l->val->type == VAL_FUNC) return true;
+    return l->val->type == VAL_VAR && (l != e || sema_resolve(var_type(l->val))->type == TYPE_ARRAY);
+}
+
+
+//Optimization
+
+//Value v stands for after substitution
+static struct ir_val find(struct ir_val *subst, struct ir_val v) {
+    while(v.kind == IR_VAR && subst[v.var].kind != IR_NONE) v = subst[v.var];
+    return v;
+}
+
+//Replace each use of a var by its substitute
+static void rewrite(struct ir_func *f, struct ir_val *subst) {
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            in->a = find(subst, in->a);
+            in->b = find(subst, in->b);
+            in->c = find(subst, in->c);
+            for(int k = 0; k < in->args_n; k++) in->args[k] = find(subst, in->args[k]);
+        }
+}
+
+static void remove_ins(struct ir_ins *in) {
+    free(in->args);
+    *in = (struct ir_ins){IR_NOP, -1};
+}
+
+//Phis of one value, and copies between vars of one C type, are replaced by
+//their value. A var copied to a local takes its name. Returns whether any
+//were.
+static bool copies(struct ir_func *f, struct ir_val *subst) {
+    bool any = false;
+
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            struct ir_val u = none;
+
+            if(in->op == IR_PHI) {
+                bool one = true;
+                for(int k = 0; k < in->args_n; k++) {
+                    struct ir_val a = find(subst, in->args[k]);
+                    if(a.kind == IR_VAR && a.var == in->d) continue;
+                    if(u.kind == IR_NONE) u = a;
+                    else if(!val_eq(u, a)) one = false;
+                }
+                if(!one) continue;
+            } else if(in->op == IR_COPY) {
+                u = find(subst, in->a);
+                bool num = u.kind != IR_LEAF || u.leaf->type == EXPR_NUM;
+                if(!num || !ir_same(ir_type(f, u), f->vars[in->d].ty)) continue;
+                if(u.kind == IR_VAR && !f->vars[u.var].name && f->vars[in->d].name && f->vars[u.var].arg < 0) {
+                    f->vars[u.var].name = f->vars[in->d].name;
+                    f->vars[in->d].name = NULL;
+                }
+            } else continue;
+
+            if(u.kind == IR_NONE) continue;
+            subst[in->d] = u;
+            remove_ins(in);
+            any = true;
+        }
+
+    if(any) rewrite(f, subst);
+    return any;
+}
+
+//Value of in if its operands are integer constants it can be computed from
+//as C would, without undefined behavior
+static bool eval(struct ir_func *f, struct ir_ins *in, int64_t *r) {
+    struct type *t = in->d >= 0 ? f->vars[in->d].ty : NULL;
+    int bits;
+    bool sign;
+
+    if(in->op == IR_COPY) return in->a.kind == IR_INT && convert_int(in->a.i, t, r);
+    if(in->op == IR_LNOT && in->a.kind == IR_INT) {
+        *r = !in->a.i;
+        return true;
+    }
+    if(in->op < IR_NEG || in->op > IR_BOR || !int_of(in->ty, &bits, &sign)) return false;
+    if(in->a.kind != IR_INT || (in->op >= IR_MUL && in->b.kind != IR_INT)) return false;
+
+    int64_t x = wrap(in->a.i, bits, sign), y = wrap(in->b.i, bits, sign);
+    uint64_t ux = x, uy = y;
+    int64_t min = sign ? wrap((uint64_t)1 << (bits - 1), bits, sign) : 0;
+
+    switch(in->op) {
+    case IR_NEG: *r = -ux; break;
+    case IR_BNOT: *r = ~ux; break;
+    case IR_ADD: *r = ux + uy; break;
+    case IR_SUB: *r = ux - uy; break;
+    case IR_MUL: *r = ux * uy; break;
+    case IR_DIV: case IR_MOD:
+        if(y == 0 || (sign && x == min && y == -1)) return false;
+        if(in->op == IR_DIV) *r = sign ? x / y : (int64_t)(ux / uy);
+        else *r = sign ? x % y : (int64_t)(ux % uy);
+        break;
+
+    //The count of a shift is not converted
+    case IR_BSL: case IR_BSR:
+        if(in->b.i < 0 || in->b.i >= bits) return false;
+        if(in->op == IR_BSL) *r = ux << in->b.i;
+        else *r = sign ? x >> in->b.i : (int64_t)(ux >> in->b.i);
+        break;
+
+    case IR_LT: *r = sign ? x < y : ux < uy; return true;
+    case IR_LE: *r = sign ? x <= y : ux <= uy; return true;
+    case IR_GT: *r = sign ? x > y : ux > uy; return true;
+    case IR_GE: *r = sign ? x >= y : ux >= uy; return true;
+    case IR_EQ: *r = x == y; return true;
+    case IR_NE: *r = x != y; return true;
+    case IR_BAND: *r = ux & uy; break;
+    case IR_XOR: *r = ux ^ uy; break;
+    case IR_BOR: *r = ux | uy; break;
+    default: return false;
+    }
+    *r = wrap(*r, bits, sign);
+    return true;
+}
+
+//Remove the edge from block p to block k
+static void remove_pred(struct ir_func *f, int k, int p) {
+    struct ir_block *bk = &f->blocks[k];
+    int i = 0;
+    while(i < bk->preds_n && bk->preds[i] != p) i++;
+    if(i == bk->preds_n) return;
+
+    memmove(&bk->preds[i], &bk->preds[i + 1], (bk->preds_n - i - 1) * sizeof *bk->preds);
+    bk->preds_n--;
+    for(int j = 0; j < bk->ins_n; j++) {
+        struct ir_ins *in = &bk->ins[j];
+        if(in->op != IR_PHI) continue;
+        memmove(&in->args[i], &in->args[i + 1], (in->args_n - i - 1) * sizeof *in->args);
+        in->args_n--;
+    }
+}
+
+//Constant propagation: instructions of constant operands are replaced by
+//their value, and branches on constants by jumps. Returns whether any were.
+static bool consts(struct ir_func *f, struct ir_val *subst) {
+    bool any = false;
+
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            int64_t r;
+
+            if(in->op == IR_BRANCH && in->a.kind == IR_INT) {
+                struct ir_block *bk = &f->blocks[i];
+                int taken = bk->succ[!in->a.i], other = bk->succ[!!in->a.i];
+                *in = (struct ir_ins){IR_JUMP, -1, .n = -1};
+                bk->succ[0] = taken;
+                bk->succ_n = 1;
+                remove_pred(f, other, i);
+                any = true;
+                continue;
+            }
+
+            if(in->d < 0 || !eval(f, in, &r)) continue;
+            subst[in->d] = int_val(r, f->vars[in->d].ty);
+            remove_ins(in);
+            any = true;
+        }
+
+    if(any) rewrite(f, subst);
+    return any;
+}
+
+//Blocks in reverse postorder from the entry, returning how many are reached
+static int postorder(struct ir_func *f, int *order) {
+    int n = 0, sp = 0;
+    int *stack = malloc((f->blocks_n + 1) * sizeof *stack), *next = calloc(f->blocks_n + 1, sizeof *next);
+    bool *seen = calloc(f->blocks_n + 1, sizeof *seen);
+    assert(stack); assert(next); assert(seen);
+
+    stack[sp++] = 0;
+    seen[0] = true;
+    while(sp) {
+        int k = stack[sp - 1];
+        if(next[k] < f->blocks[k].succ_n) {
+            int s = f->blocks[k].succ[next[k]++];
+            if(!seen[s]) seen[s] = true, stack[sp++] = s;
+        } else order[n++] = k, sp--;
+    }
+    for(int i = 0; i < n / 2; i++) {
+        int t = order[i];
+        order[i] = order[n - 1 - i];
+        order[n - 1 - i] = t;
+    }
+
+    free(stack); free(next); free(seen);
+    return n;
+}
+
+//Remove the blocks not reached from the entry
+static void unreachable(struct ir_func *f) {
+    int *order = malloc((f->blocks_n + 1) * sizeof *order);
+    bool *reached = calloc(f->blocks_n + 1, sizeof *reached);
+    assert(order); assert(reached);
+    int n = postorder(f, order);
+    for(int i = 0; i < n; i++) reached[order[i]] = true;
+
+    for(int i = 0; i < f->blocks_n; i++) {
+        struct ir_block *bk = &f->blocks[i];
+        if(reached[i] || bk->dead) continue;
+        for(int j = 0; j < bk->succ_n; j++) remove_pred(f, bk->succ[j], i);
+        for(int j = 0; j < bk->ins_n; j++) free(bk->ins[j].args);
+        bk->ins_n = bk->preds_n = bk->succ_n = 0;
+        bk->dead = true;
+    }
+    free(order); free(reached);
+}
+
+//Immediate dominator of each reached block, by Cooper, Harvey and Kennedy
+static void dominators(struct ir_func *f, int *order, int n, int *idom) {
+    int *index = malloc((f->blocks_n + 1) * sizeof *index);
+    assert(index);
+    for(int i = 0; i < f->blocks_n; i++) idom[i] = -1;
+    for(int i = 0; i < n; i++) index[order[i]] = i;
+    idom[0] = 0;
+
+    for(bool changed = true; changed; ) {
+        changed = false;
+        for(int i = 1; i < n; i++) {
+            struct ir_block *bk = &f->blocks[order[i]];
+            int d = -1;
+            for(int j = 0; j < bk->preds_n; j++) {
+                int p = bk->preds[j];
+                if(idom[p] < 0) continue;
+                if(d < 0) {
+                    d = p;
+                    continue;
+                }
+                while(p != d) {
+                    while(index[p] > index[d]) p = idom[p];
+                    while(index[d] > index[p]) d = idom[d];
+                }
+            }
+            if(idom[order[i]] != d) idom[order[i]] = d, changed = true;
+        }
+    }
+    free(index);
+}
+
+static bool dominates(int *idom, int a, int b) {
+    while(b != a && b != 0) b = idom[b];
+    return b == a;
+}
+
+static bool commutes(enum ir_op op) {
+    return op == IR_MUL || op == IR_ADD || op == IR_EQ || op == IR_NE
+        || op == IR_BAND || op == IR_XOR || op == IR_BOR;
+}
+
+//Whether in and by compute the same value from the same operands
+static bool same_value(struct ir_func *f, struct ir_ins *in, struct ir_ins *by) {
+    if(in->op != by->op || in->ty != by->ty || in->n != by->n
+            || f->vars[in->d].ty != f->vars[by->d].ty)
+        return false;
+    if(val_eq(in->a, by->a) && val_eq(in->b, by->b)) return true;
+    return commutes(in->op) && val_eq(in->a, by->b) && val_eq(in->b, by->a);
+}
+
+//A value computed earlier, or stored, for a load
+struct ir_avail {
+    struct ir_ins *in;          //Instruction computing it
+    int block;
+    struct ir_val stored;       //Value of a load, stored by in
+};
+
+//Common subexpression elimination: a computation done already, in a block
+//dominating it, is replaced by the var computed then. Loads are only
+//replaced within a block, until memory is stored to or a call made, and
+//take the value of a store to where they load from. Returns whether any
+//were replaced.
+static bool cse(struct ir_func *f, struct ir_val *subst) {
+    int *order = malloc((f->blocks_n + 1) * sizeof *order);
+    int *idom = malloc((f->blocks_n + 1) * sizeof *idom);
+    assert(order); assert(idom);
+    int n = postorder(f, order);
+    dominators(f, order, n, idom);
+
+    struct ir_avail *pure = NULL, *mem = NULL;
+    int pure_n = 0, pure_c = 0, mem_n = 0, mem_c = 0;
+    bool any = false;
+
+    for(int i = 0; i < n; i++) {
+        int k = order[i];
+        mem_n = 0;
+
+        for(int j = 0; j < f->blocks[k].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[k].ins[j];
+            in->a = find(subst, in->a);
+            in->b = find(subst, in->b);
+            in->c = find(subst, in->c);
+            for(int a = 0; a < in->args_n; a++) in->args[a] = find(subst, in->args[a]);
+
+            if(in->op == IR_CALL || in->op == IR_ZERO || in->op == IR_MOVE) mem_n = 0;
+            if(in->op == IR_STORE) {
+                mem_n = 0;
+                mem = grow(mem, mem_n, &mem_c, sizeof *mem);
+                mem[mem_n++] = (struct ir_avail){in, k, in->c};
+                continue;
+            }
+
+            if(in->op == IR_LOAD) {
+                struct ir_val r = none;
+                for(int a = 0; a < mem_n && r.kind == IR_NONE; a++) {
+                    struct ir_ins *by = mem[a].in;
+                    if(!val_eq(in->a, by->a) || !val_eq(in->b, by->b) || in->ty != by->ty) continue;
+                    if(by->op == IR_LOAD && by->n == in->n) r = var(by->d);
+                    if(by->op == IR_STORE && (in->n < 0 || by->n == in->n)) r = mem[a].stored;
+                }
+                if(r.kind != IR_NONE) {
+                    subst[in->d] = r;
+                    remove_ins(in);
+                    any = true;
+                    continue;
+                }
+                mem = grow(mem, mem_n, &mem_c, sizeof *mem);
+                mem[mem_n++] = (struct ir_avail){in, k, none};
+                continue;
+            }
+
+            if(in->op < IR_COPY || in->op > IR_BOR || in->op == IR_UNDEF) continue;
+            int a = 0;
+            while(a < pure_n && !(same_value(f, in, pure[a].in) && dominates(idom, pure[a].block, k))) a++;
+            if(a < pure_n) {
+                subst[in->d] = var(pure[a].in->d);
+                remove_ins(in);
+                any = true;
+                continue;
+            }
+            pure = grow(pure, pure_n, &pure_c, sizeof *pure);
+            pure[pure_n++] = (struct ir_avail){in, k, none};
+        }
+    }
+
+    if(any) rewrite(f, subst);
+    free(pure); free(mem);
+    free(order); free(idom);
+    return any;
+}
+
+static bool has_effect(struct ir_ins *in) {
+    return in->op == IR_STORE || in->op == IR_ZERO || in->op == IR_MOVE || in->op == IR_CALL
+        || in->op >= IR_JUMP || ((in->op == IR_LOAD || in->op == IR_INDEX) && in->n >= 0);
+}
+
+static void mark(bool *live, int *work, int *work_n, struct ir_val v) {
+    if(v.kind != IR_VAR || live[v.var]) return;
+    live[v.var] = true;
+    work[(*work_n)++] = v.var;
+}
+
+//Dead code elimination: instructions without effects whose value is not
+//used are removed
+static void dce(struct ir_func *f) {
+    bool *live = calloc(f->vars_n + 1, sizeof *live);
+    int *work = malloc((f->vars_n + 1) * sizeof *work), work_n = 0;
+    struct ir_ins **defs = calloc(f->vars_n + 1, sizeof *defs);
+    assert(live); assert(work); assert(defs);
+
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            if(in->d >= 0) defs[in->d] = in;
+        }
+
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            if(!has_effect(in)) continue;
+            mark(live, work, &work_n, in->a);
+            mark(live, work, &work_n, in->b);
+            mark(live, work, &work_n, in->c);
+            for(int k = 0; k < in->args_n; k++) mark(live, work, &work_n, in->args[k]);
+        }
+
+    while(work_n) {
+        struct ir_ins *in = defs[work[--work_n]];
+        if(!in) continue;
+        mark(live, work, &work_n, in->a);
+        mark(live, work, &work_n, in->b);
+        mark(live, work, &work_n, in->c);
+        for(int k = 0; k < in->args_n; k++) mark(live, work, &work_n, in->args[k]);
+    }
+
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            if(in->d >= 0 && !live[in->d] && !has_effect(in)) remove_ins(in);
+        }
+
+    free(live); free(work); free(defs);
+}
+
+//Drop removed instructions, returning how many were
+static int compact(struct ir_func *f) {
+    int removed = 0;
+    for(int i = 0; i < f->blocks_n; i++) {
+        struct ir_block *bk = &f->blocks[i];
+        int n = 0;
+        for(int j = 0; j < bk->ins_n; j++)
+            if(bk->ins[j].op != IR_NOP) bk->ins[n++] = bk->ins[j];
+        removed += bk->ins_n - n;
+        bk->ins_n = n;
+    }
+    return removed;
+}
+
+//Split the edges from blocks that branch to blocks with phis, so the copies
+//phis make can be placed on them
+static void split_edges(struct ir_func *f) {
+    int n = f->blocks_n;
+    for(int i = 0; i < n; i++) {
+        if(f->blocks[i].succ_n < 2) continue;
+        for(int j = 0; j < 2; j++) {
+            int s = f->blocks[i].succ[j];
+            if(!f->blocks[s].ins_n || f->blocks[s].ins[0].op != IR_PHI) continue;
+
+            f->blocks = grow(f->blocks, f->blocks_n, &f->blocks_c, sizeof *f->blocks);
+            int e = f->blocks_n++;
+            struct ir_block *be = &f->blocks[e];
+            *be = (struct ir_block){0};
+            be->ins = malloc(sizeof *be->ins);
+            be->preds = malloc(sizeof *be->preds);
+            assert(be->ins); assert(be->preds);
+            be->ins[0] = (struct ir_ins){IR_JUMP, -1, .n = -1};
+            be->ins_n = be->ins_c = 1;
+            be->preds[0] = i;
+            be->preds_n = be->preds_c = 1;
+            be->succ[0] = s;
+            be->succ_n = 1;
+
+            f->blocks[i].succ[j] = e;
+            struct ir_block *bs = &f->blocks[s];
+            for(int k = 0; k < bs->preds_n; k++)
+                if(bs->preds[k] == i) {
+                    bs->preds[k] = e;
+                    break;
+                }
+        }
+    }
+}
+
+//Blocks entered only by a jump from another are appended to it, their phis
+//of one value becoming copies. Returns whether any were.
+static bool merge(struct ir_func *f) {
+    bool any = false;
+    for(int i = 0; i < f->blocks_n; i++) {
+        struct ir_block *bk = &f->blocks[i];
+        while(!bk->dead && bk->ins[bk->ins_n - 1].op == IR_JUMP) {
+            int s = bk->succ[0];
+            struct ir_block *bs = &f->blocks[s];
+            if(s == 0 || s == i || bs->preds_n != 1) break;
+
+            bk->ins_n--;
+            for(int j = 0; j < bs->ins_n; j++) {
+                struct ir_ins in = bs->ins[j];
+                if(in.op == IR_PHI) {
+                    in = (struct ir_ins){IR_COPY, in.d, f->vars[in.d].ty, .a = in.args[0], .n = -1};
+                    free(bs->ins[j].args);
+                }
+                ins_insert(f, i, bk->ins_n, in);
+            }
+            bk->succ_n = bs->succ_n;
+            memcpy(bk->succ, bs->succ, sizeof bk->succ);
+            for(int j = 0; j < bs->succ_n; j++) {
+                struct ir_block *bt = &f->blocks[bs->succ[j]];
+                for(int k = 0; k < bt->preds_n; k++) if(bt->preds[k] == s) bt->preds[k] = i;
+            }
+
+            bs->ins_n = bs->preds_n = bs->succ_n = 0;
+            bs->dead = true;
+            any = true;
+        }
+    }
+    return any;
+}
+
+//Optimize f, returning how many instructions were removed
+static int optimize(struct ir_func *f) {
+    struct ir_val *subst = calloc(f->vars_n + 1, sizeof *subst);
+    assert(subst);
+
+    unreachable(f);
+    bool changed = true;
+    while(changed) {
+        changed = copies(f, subst);
+        if(consts(f, subst)) {
+            unreachable(f);
+            changed = true;
+        }
+        changed |= merge(f);
+        changed |= cse(f, subst);
+    }
+    dce(f);
+    int removed = compact(f);
+    split_edges(f);
+
+    free(subst);
+    return removed;
+}
+
+
+//Inlining
+
+//Instructions f is emitted as, jumps aside
+static int size(struct ir_func *f) {
+    int n = 0;
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            enum ir_op op = f->blocks[i].ins[j].op;
+            n += op != IR_NOP && op != IR_JUMP && op != IR_UNDEF;
+        }
+    return n;
+}
+
+static struct ir_val moved(struct ir_val v, int vars) {
+    return v.kind == IR_VAR ? var(v.var + vars) : v;
+}
+
+//Insert n empty blocks before block k, renumbering those after
+static void blocks_insert(struct ir_func *f, int k, int n) {
+    for(int i = 0; i < n; i++) f->blocks = grow(f->blocks, f->blocks_n + i, &f->blocks_c, sizeof *f->blocks);
+    memmove(&f->blocks[k + n], &f->blocks[k], (f->blocks_n - k) * sizeof *f->blocks);
+    memset(&f->blocks[k], 0, n * sizeof *f->blocks);
+    f->blocks_n += n;
+
+    for(int i = 0; i < f->blocks_n; i++) {
+        struct ir_block *bk = &f->blocks[i];
+        for(int j = 0; j < bk->succ_n; j++) if(bk->succ[j] >= k) bk->succ[j] += n;
+        for(int j = 0; j < bk->preds_n; j++) if(bk->preds[j] >= k) bk->preds[j] += n;
+    }
+}
+
+//Replace call j of block k of f by the body of the function called, placed
+//after block k. The rest of block k follows in a block of its own, which
+//each return of the body jumps to. Returns the index of that block.
+static int inline_call(struct ir_func *f, int k, int j) {
+    struct ir_ins call = f->blocks[k].ins[j];
+    struct ir_func *g = call.f->ir;
+    int vars = f->vars_n, first = k + 1, cont = k + 1 + g->blocks_n;
+
+    for(int i = 0; i < g->vars_n; i++) var_new(f, g->vars[i].ty, g->vars[i].name, -1);
+    blocks_insert(f, first, g->blocks_n + 1);
+
+    //The rest of block k, and its successors, move to cont
+    struct ir_block *bk = &f->blocks[k], *bc = &f->blocks[cont];
+    bc->ins_n = bc->ins_c = bk->ins_n - j - 1;
+    bc->ins = malloc(bc->ins_c * sizeof *bc->ins);
+    assert(bc->ins);
+    memcpy(bc->ins, &bk->ins[j + 1], bc->ins_n * sizeof *bc->ins);
+    bc->succ_n = bk->succ_n;
+    memcpy(bc->succ, bk->succ, sizeof bc->succ);
+    for(int s = 0; s < bc->succ_n; s++) {
+        struct ir_block *bs = &f->blocks[bc->succ[s]];
+        for(int i = 0; i < bs->preds_n; i++) if(bs->preds[i] == k) bs->preds[i] = cont;
+    }
+
+    //Block k ends assigning the arguments, then enters the body
+    bk->ins_n = j;
+    for(int i = 0; i < g->vars_n; i++) {
+        int a = g->vars[i].arg;
+        if(a < 0) continue;
+        ins_insert(f, k, f->blocks[k].ins_n,
+                (struct ir_ins){IR_COPY, vars + i, g->vars[i].ty, .a = call.args[a], .n = -1});
+    }
+    ins_insert(f, k, f->blocks[k].ins_n, (struct ir_ins){IR_JUMP, -1, .n = -1});
+    bk = &f->blocks[k];
+    bk->succ[0] = first;
+    bk->succ_n = 1;
+
+    //The body, its returns jumping to cont with the value returned
+    struct ir_ins phi = {IR_PHI, call.d, .n = -1};
+    if(call.d >= 0) {
+        phi.ty = f->vars[call.d].ty;
+        phi.args = malloc((g->blocks_n + 1) * sizeof *phi.args);
+        assert(phi.args);
+    }
+    for(int i = 0; i < g->blocks_n; i++) {
+        struct ir_block *from = &g->blocks[i], *to = &f->blocks[first + i];
+        to->dead = from->dead;
+        to->ins_n = to->ins_c = from->ins_n;
+        to->ins = malloc((to->ins_c + 1) * sizeof *to->ins);
+        to->preds_n = to->preds_c = from->preds_n;
+        to->preds = malloc((to->preds_c + 1) * sizeof *to->preds);
+        assert(to->ins); assert(to->preds);
+        for(int p = 0; p < from->preds_n; p++) to->preds[p] = first + from->preds[p];
+        to->succ_n = from->succ_n;
+        for(int s = 0; s < from->succ_n; s++) to->succ[s] = first + from->succ[s];
+        if(i == 0) add_pred(f, first, k);
+
+        for(int n = 0; n < from->ins_n; n++) {
+            struct ir_ins in = from->ins[n];
+            if(in.d >= 0) in.d += vars;
+            in.a = moved(in.a, vars);
+            in.b = moved(in.b, vars);
+            in.c = moved(in.c, vars);
+            if(in.args_n) {
+                in.args = malloc(in.args_n * sizeof *in.args);
+                assert(in.args);
+                for(int a = 0; a < in.args_n; a++) in.args[a] = moved(from->ins[n].args[a], vars);
+            }
+
+            if(in.op == IR_RET) {
+                if(call.d >= 0) phi.args[phi.args_n++] = in.a;
+                in = (struct ir_ins){IR_JUMP, -1, .n = -1};
+                to->succ[0] = cont;
+                to->succ_n = 1;
+                add_pred(f, cont, first + i);
+            }
+            to->ins[n] = in;
+        }
+    }
+    if(call.d >= 0) ins_insert(f, cont, 0, phi);
+
+    free(call.args);
+    return cont;
+}
+
+//Whether v, in a function of another module, is available outside it
+static bool exported(struct ir_val v) {
+    if(v.kind == IR_GLOBAL) return false;
+    if(v.kind != IR_LEAF || v.leaf->type != EXPR_IDENT || !v.leaf->val) return true;
+    struct val *g = v.leaf->val;
+    return g->type == VAL_CONST || (g->type == VAL_FUNC && val_is_portable(g));
+}
+
+//Whether f, a function of another module, only uses what it exports, and so
+//can be inlined outside it: no globals, and no types or functions it does
+//not export
+static bool portable(struct ir_func *f) {
+    for(int i = 0; i < f->vars_n; i++) if(type_is_named(f->vars[i].ty)) return false;
+    for(int k = 0; k < f->blocks_n; k++)
+        for(int j = 0; j < f->blocks[k].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[k].ins[j];
+            if((in->ty && type_is_named(in->ty)) || (in->f && !val_is_portable(in->f))) return false;
+            if(!exported(in->a) || !exported(in->b) || !exported(in->c)) return false;
+            for(int a = 0; a < in->args_n; a++) if(!exported(in->args[a])) return false;
+        }
+    return true;
+}
+
+//Decide whether to inline each call of function i of g, reporting why if
+//not, and optimize it again if any were
+static void inline_calls(struct ir_graph *g, int i) {
+    struct ir_func *f = g->funcs[i]->ir;
+    struct token at = expr_tok(&g->funcs[i]->func_expr);
+    int before = size(f), inlined = 0;
+
+    for(int k = 0; k < f->blocks_n; k++)
+        for(int j = 0; j < f->blocks[k].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[k].ins[j];
+            if(in->op != IR_CALL) continue;
+
+            int c = 0;
+            while(c < g->n && g->funcs[c] != in->f) c++;
+            if(c == g->n) continue;
+            int n = in->f->ir ? size(in->f->ir) : 0;
+            char *callee = g->names[c];
+
+            if(!in->f->ir) snprintf(err_buf, ERRBUF_SIZE, "Not inlining '%s' into '%s': not lowered to IR",
+                    callee, g->names[i]);
+            else if(g->comp[c] == g->comp[i]) snprintf(err_buf, ERRBUF_SIZE,
+                    "Not inlining '%s' into '%s': recursive", callee, g->names[i]);
+            else if(c >= g->own && !portable(in->f->ir)) snprintf(err_buf, ERRBUF_SIZE,
+                    "Not inlining '%s' into '%s': uses what its module does not export",
+                    callee, g->names[i]);
+            else if(n > IR_INLINE_SIZE) snprintf(err_buf, ERRBUF_SIZE,
+                    "Not inlining '%s' into '%s': %i instructions", callee, g->names[i], n);
+            else if(size(f) + n > IR_INLINE_LIMIT) snprintf(err_buf, ERRBUF_SIZE,
+                    "Not inlining '%s' into '%s': caller too large", callee, g->names[i]);
+            else {
+                snprintf(err_buf, ERRBUF_SIZE, "Inlining '%s' into '%s': %i instructions",
+                        callee, g->names[i], n);
+                if(g->report) g->p->warn(g->p->ts, at, err_buf);
+
+                //The body is not looked at again, so recursion inlined
+                //once is not again
+                k = inline_call(f, k, j);
+                j = -1;
+                inlined++;
+                continue;
+            }
+            if(g->report) g->p->warn(g->p->ts, at, err_buf);
+        }
+
+    if(!inlined) return;
+    timing_count(TIMING_IR, optimize(f));
+    if(!g->report) return;
+    snprintf(err_buf, ERRBUF_SIZE, "Size of '%s': %i instructions, %i after inlining %i calls",
+            g->names[i], before, size(f), inlined);
+    g->p->warn(g->p->ts, at, err_buf);
+}
+
+//Visit function i, inlining into the functions of each component completed
+static void visit(struct ir_graph *g, int i) {
+    g->index[i] = g->low[i] = g->next++;
+    g->stack[g->stack_n++] = i;
+
+    struct ir_func *f = g->funcs[i]->ir;
+    for(int k = 0; k < f->blocks_n; k++)
+        for(int j = 0; j < f->blocks[k].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[k].ins[j];
+            if(in->op != IR_CALL || !in->f->ir) continue;
+            int c = 0;
+            while(c < g->n && g->funcs[c] != in->f) c++;
+            if(g->index[c] < 0) {
+                visit(g, c);
+                if(g->low[c] < g->low[i]) g->low[i] = g->low[c];
+            } else if(g->comp[c] < 0 && g->index[c] < g->low[i]) g->low[i] = g->index[c];
+        }
+
+    if(g->low[i] != g->index[i]) return;
+    int from = g->stack_n;
+    do g->comp[g->stack[--from]] = g->comp_n;
+    while(g->stack[from] != i);
+    for(int j = from; j < g->stack_n; j++) inline_calls(g, g->stack[j]);
+    g->stack_n = from;
+    g->comp_n++;
+}
+
+static void func(struct ir_graph *g, struct val *v, char *name) {
+    v->ir = build(g->p, v, g->native);
+    if(v->ir) timing_count(TIMING_IR, optimize(v->ir));
+
+    g->funcs = grow(g->funcs, g->n, &g->c, sizeof *g->funcs);
+    g->names = realloc(g->names, g->c * sizeof *g->names);
+    assert(g->names);
+    g->funcs[g->n] = v;
+    g->names[g->n++] = name;
+}
+
+//Lower the functions of the module to IR where they can be, after bounds(),
+//optimize them, then inline small functions into their callers, those
+//exported by the modules the driver loaded for p too. Others keep only their
+//AST. Inlining decisions and the size of functions inlined into are reported
+//through p->warn if report. If native, lowers for the native
+//backend, and the globals initialized at run time to p->init. Returns number
+//of errors.
+int ir(struct parse *p, bool report, bool native) {
+    assert(p);
+
+    timing_start(TIMING_IR);
+
+    struct ir_graph g = {p, report, native};
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type == VAL_FUNC && !func_is_generic(v)) func(&g, v, p->globals.key[i]);
+    }
+    for(int i = 0; i < p->methods.n; i++)
+        if(!func_is_generic(&p->methods.val[i])) func(&g, &p->methods.val[i], p->methods.key[i]);
+    for(int i = 0; i < p->instances.n; i++) func(&g, p->instances.inst[i], p->instances.name[i]);
+
+    g.own = g.n;
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_MODULE || !v->loaded) continue;
+        struct ns *ns = &v->loaded->globals;
+        for(int j = 0; j < ns->n; j++) {
+            if(!val_is_portable(&ns->val[j])) continue;
+            g.funcs = grow(g.funcs, g.n, &g.c, sizeof *g.funcs);
+            g.names = realloc(g.names, g.c * sizeof *g.names);
+            assert(g.names);
+            g.funcs[g.n] = &ns->val[j];
+            g.names[g.n] = malloc(strlen(p->globals.key[i]) + strlen(ns->key[j]) + 3);
+            assert(g.names[g.n]);
+            sprintf(g.names[g.n++], "%s->%s", p->globals.key[i], ns->key[j]);
+        }
+    }
+
+    g.index = malloc((g.n + 1) * sizeof *g.index);
+    g.low = malloc((g.n + 1) * sizeof *g.low);
+    g.comp = malloc((g.n + 1) * sizeof *g.comp);
+    g.stack = malloc((g.n + 1) * sizeof *g.stack);
+    assert(g.index); assert(g.low); assert(g.comp); assert(g.stack);
+    for(int i = 0; i < g.n; i++) g.index[i] = g.comp[i] = -1;
+    for(int i = g.own; i < g.n; i++) g.index[i] = g.low[i] = g.next++, g.comp[i] = g.comp_n++;
+    for(int i = 0; i < g.own; i++) if(g.index[i] < 0 && g.funcs[i]->ir) visit(&g, i);
+
+    for(int i = g.own; i < g.n; i++) free(g.names[i]);
+    free(g.funcs); free(g.names);
+    free(g.index); free(g.low); free(g.comp); free(g.stack);
+
+    if(native) p->init = globals(p);
+    if(p->init) timing_count(TIMING_IR, optimize(p->init));
+
+    timing_stop(TIMING_IR);
+
+    return 0;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "parse.h"
+
+//Mid-level IR of a function, between the AST and the backends: typed three
+//address code over basic blocks, in SSA form. Each var is defined once, by
+//an instruction of one block, and the phis at the head of a block choose the
+//value a var takes by the predecessor control came from.
+//
+//Locals and arguments are vars, each write to them a new one, so only memory
+//reached through pointers, arrays and globals is loaded and stored. Values
+//are typed as C types them: arithmetic is done in the common type of its
+//operands, integers narrower than int promoted, so the backends need not
+//know Zen's rules.
+//
+//ir() lowers the functions it can and optimizes them, by constant and copy
+//propagation, common subexpression elimination and dead code elimination.
+//Functions using what the IR does not have are left to the backends as
+//ASTs. For the C backend those are switches, tuples, structs, arrays and
+//vectors as values, methods and addresses of locals.
+//
+//The native backend has no AST to fall back on, so for it ir() lowers those
+//too. Locals whose address is taken, and those held by value that are not
+//scalars, live in stack slots, and such values are pointers to where they
+//are held. They are passed by address and copied by the callee, returned
+//through out-parameters, and operated on a member or lane at a time.
+//Switches become compares, and the globals initialized at run time are
+//stored by a function of their own, in p->init.
+//
+//Small functions are then inlined into their callers in the module, callees
+//first, so a call of a function inlined into others inlines it whole.
+//Recursive calls, those within a cycle of the call graph, are not inlined.
+//Functions exported by the modules included, when the driver has loaded
+//them, are inlined as well, if they use nothing their module does not
+//export.
+
+#define IR_INITIAL_CAP 16
+#define IR_INLINE_SIZE 12       //Most instructions of a function inlined
+#define IR_INLINE_LIMIT 400     //Most instructions of a function inlined into
+
+enum ir_op {
+    IR_NOP,                     //Removed
+    IR_PHI,                     //d = args[i], coming from preds[i]
+    IR_UNDEF,                   //d is read before written, which only unreachable code does
+    IR_COPY,                    //d = a, converted to the type of d
+    IR_NEG, IR_BNOT, IR_LNOT,   //d = op a, in type ty
+
+    //d = a op b, the operands converted to ty but for the count of a shift.
+    //In the order of the binary EXPR_ operators.
+    IR_MUL, IR_DIV, IR_MOD, IR_ADD, IR_SUB, IR_BSL, IR_BSR,
+    IR_LT, IR_LE, IR_GT, IR_GE, IR_EQ, IR_NE,
+    IR_BAND, IR_XOR, IR_BOR,
+
+    IR_LOAD,                    //d = a[b], or global a if b is IR_NONE
+    IR_STORE,                   //a[b] = c, or global a = c if b is IR_NONE
+    IR_SLOT,                    //d = address of a stack slot of type ty, one per instruction
+    IR_INDEX,                   //d = &a[b], as IR_LOAD of type ty addresses it
+    IR_ZERO,                    //Memory of type ty at a = 0
+    IR_MOVE,                    //Memory of type ty at a = that at b
+    IR_CALL,                    //d = f(args), d -1 if f returns nothing
+
+    IR_JUMP,                    //goto succ[0], ending a block
+    IR_BRANCH,                  //goto a ? succ[0] : succ[1], ending a block
+    IR_RET,                     //return a, if any, ending a block
+};
+
+enum ir_kind {IR_NONE, IR_VAR, IR_INT, IR_LEAF, IR_GLOBAL};
+
+struct ir_val {
+    enum ir_kind kind;
+    struct type *ty;            //Type of an IR_INT or IR_LEAF
+    union {
+        int var;                //IR_VAR
+        int64_t i;              //IR_INT, wrapped to ty
+        struct expr *leaf;      //IR_LEAF, a constant the backend emits from the AST
+        struct val *global;     //IR_GLOBAL, loaded or stored
+    };
+};
+
+struct ir_ins {
+    enum ir_op op;
+    int d;                      //Var defined, or -1
+    struct type *ty;            //Type operated in, or stored
+    struct ir_val a, b, c;
+    struct ir_val *args;        //Of IR_PHI and IR_CALL
+    int args_n;
+    struct val *f;              //Function called
+    int n;                      //Length a checked index is bounded by, else -1
+};
+
+struct ir_block {
+    struct ir_ins *ins;         //Phis first, then a terminator last
+    int ins_n, ins_c;
+    int *preds;
+    int preds_n, preds_c;
+    int succ[2];
+    int succ_n;
+    bool dead;                  //Unreachable, and removed
+};
+
+struct ir_var {
+    struct type *ty;
+    char *name;                 //Local or argument it is a version of, or NULL
+    int arg;                    //Argument it is on entry, or -1
+};
+
+struct ir_func {
+    struct ir_block *blocks;    //Entered at the first
+    int blocks_n, blocks_c;
+    struct ir_var *vars;
+    int vars_n, vars_c;
+};
+
+int ir(struct parse *p, bool report, bool native);
+bool ir_data(struct parse *p, struct type *t, struct expr *e);
+void ir_free(struct ir_func *f);
+struct type *ir_type(struct ir_func *f, struct ir_val v);
+bool ir_same(struct type *a, struct type *b);
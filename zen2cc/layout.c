@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "layout.h"
+#include "sema.h"
+#include "timing.h"
+
+struct layout {
+    struct parse *p;
+    bool padding;           //Warn of padding in structs
+    int errnum;
+};
+
+static const int prim_size[TYPE_NUM] = {
+    [TYPE_VOID] = -1, [TYPE_BOOL] = LAYOUT_BOOL_SIZE,
+    [TYPE_INT] = 4, [TYPE_INT8] = 1, [TYPE_INT16] = 2, [TYPE_INT32] = 4, [TYPE_INT64] = 8,
+    [TYPE_UINT] = 4, [TYPE_UINT8] = 1, [TYPE_UINT16] = 2, [TYPE_UINT32] = 4, [TYPE_UINT64] = 8,
+    [TYPE_FLOAT] = 8, [TYPE_FLOAT16] = 2, [TYPE_FLOAT32] = 4, [TYPE_FLOAT64] = 8,
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static int align_up(int n, int a) {
+    return (n + a - 1) / a * a;
+}
+
+static bool is_bool(struct type *t) {
+    t = sema_resolve(t);
+    return t->type == TYPE_PRIMATIVE && t->primative == TYPE_BOOL;
+}
+
+//Whether member of struct t is packed to a bit. Bools asked to be aligned
+//are not.
+bool layout_is_bit(struct type *t, int member) {
+    assert(t->type == TYPE_STRUCT && member < t->mem_n);
+    return is_bool(t->types[member]) && !(t->aligns && t->aligns[member]);
+}
+
+//Member of struct t named by type accessor m of the form offset_of_<member>,
+//or -1
+int layout_offset_of(struct type *t, struct token m) {
+    static const char prefix[] = "offset_of_";
+    int n = sizeof prefix - 1;
+    if(t->type != TYPE_STRUCT || m.len <= n || strncmp(m.str, prefix, n) != 0) return -1;
+
+    for(int i = 0; i < t->mem_n; i++)
+        if((int)strlen(t->idents[i]) == m.len - n && strncmp(m.str + n, t->idents[i], m.len - n) == 0)
+            return i;
+    return -1;
+}
+
+//Range of values of integer type t, false if t is not an integer. Enums are
+//taken to hold one of their options.
+bool layout_int_range(struct type *t, int64_t *min, int64_t *max) {
+    if(t->type == TYPE_ENUM) {
+        if(!t->ivals || !t->repr) return false;
+        *min = *max = t->opts_n ? t->ivals[0] : 0;
+        for(int i = 1; i < t->opts_n; i++) {
+            if(t->ivals[i] < *min) *min = t->ivals[i];
+            if(t->ivals[i] > *max) *max = t->ivals[i];
+        }
+        return true;
+    }
+
+    enum type_primative pt = t->primative;
+    if(t->type != TYPE_PRIMATIVE || pt == TYPE_VOID || pt >= TYPE_FLOAT) return false;
+    if(pt == TYPE_BOOL) {
+        *min = 0, *max = 1;
+        return true;
+    }
+
+    layout_type(t);
+    int bits = t->size * 8;
+    if(pt >= TYPE_UINT) {
+        *min = 0;
+        *max = bits >= 64 ? INT64_MAX : ((int64_t)1 << bits) - 1;
+    } else {
+        *min = bits >= 64 ? INT64_MIN : -((int64_t)1 << (bits - 1));
+        *max = bits >= 64 ? INT64_MAX : ((int64_t)1 << (bits - 1)) - 1;
+    }
+    return true;
+}
+
+static void set(struct type *t, int size, int align) {
+    t->size = size;
+    t->align = align;
+}
+
+static void lay(struct layout *l, struct type *t);
+
+//C struct layout, each member at the next offset aligned for it, or as
+//asked for with align. Bools take the next bit, and the struct is aligned
+//for the int they are packed in.
+static void lay_struct(struct layout *l, struct type *t) {
+    timing_count(TIMING_LAYOUT, 1);
+
+    free(t->offsets);
+    t->offsets = calloc(t->mem_n + 1, sizeof *t->offsets);
+    assert(t->offsets);
+
+    int bits = 0, align = t->align_to ? t->align_to : 1;
+    for(int i = 0; i < t->mem_n; i++) {
+        struct type *m = t->types[i];
+        if(layout_is_bit(t, i)) {
+            t->offsets[i] = bits++;
+            if(align < LAYOUT_BOOL_SIZE) align = LAYOUT_BOOL_SIZE;
+            continue;
+        }
+
+        lay(l, m);
+        if(m->size < 0) {
+            set(t, -1, 1);
+            return;
+        }
+
+        int malign = m->align;
+        if(t->aligns && t->aligns[i] > malign) malign = t->aligns[i];
+
+        int off = align_up((bits + 7) / 8, malign);
+        t->offsets[i] = off * 8;
+        bits = (off + m->size) * 8;
+        if(malign > align) align = malign;
+    }
+
+    set(t, align_up((bits + 7) / 8, align), align);
+}
+
+static void lay(struct layout *l, struct type *t) {
+    //A struct reached while being laid out contains itself
+    if(t->align < 0 && t->type == TYPE_STRUCT && l) {
+        l->p->error(l->p->ts, t->tok, "Struct contains itself");
+        l->errnum++;
+    }
+    if(t->align) return;
+    set(t, -1, -1);     //Marks t as being laid out
+
+    struct type *of;
+    switch(t->type) {
+    case TYPE_PRIMATIVE:
+        if(prim_size[t->primative] < 0) set(t, -1, 1);
+        else set(t, prim_size[t->primative], prim_size[t->primative]);
+        break;
+
+    case TYPE_IDENT:
+        if(!t->def) {
+            set(t, -1, 1);
+            break;
+        }
+        lay(l, t->def);
+        set(t, t->def->size, t->def->size < 0 ? 1 : t->def->align);
+        break;
+
+    //Arrays without a length are their pointer, as are functions. Lengths
+    //not yet bound by fold() leave the layout unknown.
+    case TYPE_ARRAY:
+        if(t->n < 0 && t->len) {
+            set(t, -1, 1);
+            break;
+        }
+        if(t->n < 0) {
+            set(t, LAYOUT_PTR_SIZE, LAYOUT_PTR_SIZE);
+            break;
+        }
+        lay(l, t->of);
+        if(t->of->size < 0) set(t, -1, 1);
+        else set(t, t->n * t->of->size, t->of->align);
+        break;
+    case TYPE_PTR: case TYPE_FUNC: set(t, LAYOUT_PTR_SIZE, LAYOUT_PTR_SIZE); break;
+
+    //Vectors are aligned to their size, up to a cache line
+    case TYPE_VEC:
+        lay(l, t->of);
+        set(t, t->n * t->of->size, t->n * t->of->size);
+        if(t->align > LAYOUT_VEC_ALIGN_MAX) t->align = LAYOUT_VEC_ALIGN_MAX;
+        break;
+
+    //Enums are stored as the type chosen by fold()
+    case TYPE_ENUM:
+        of = t->repr ? t->repr : type_prim(TYPE_INT);
+        lay(l, of);
+        set(t, of->size, of->size < 0 ? 1 : of->align);
+        break;
+
+    case TYPE_STRUCT: lay_struct(l, t); break;
+
+    default: set(t, -1, 1); break;
+    }
+}
+
+//Compute the size and alignment of t, and the offsets of its members if a
+//struct. Does nothing if already done.
+void layout_type(struct type *t) {
+    lay(NULL, t);
+}
+
+//Warn of bytes of struct t spent on padding, between members and at the end
+static void report_padding(struct layout *l, struct type *t, char *name) {
+    int n = 0, total = 0, end = 0;
+    char list[ERRBUF_SIZE / 2] = "";
+
+    for(int i = 0; i < t->mem_n; i++) {
+        if(layout_is_bit(t, i)) {
+            end = t->offsets[i] + 1;
+            continue;
+        }
+
+        int gap = t->offsets[i] / 8 - (end + 7) / 8;
+        if(gap > 0) n += snprintf(list + n, sizeof list - n, "%s%i before '%s'",
+                n ? ", " : "", gap, t->idents[i]);
+        if(n >= (int)sizeof list) n = sizeof list - 1;
+        total += gap;
+        end = t->offsets[i] + sema_resolve(t->types[i])->size * 8;
+    }
+
+    int gap = t->size - (end + 7) / 8;
+    if(gap > 0) snprintf(list + n, sizeof list - n, "%s%i at the end", n ? ", " : "", gap);
+    total += gap;
+    if(!total) return;
+
+    snprintf(err_buf, ERRBUF_SIZE, "Struct%s%s%s of %i bytes has %i bytes of padding: %s",
+            name ? " '" : "", name ? name : "", name ? "'" : "", t->size, total, list);
+    l->p->warn(l->p->ts, t->tok, err_buf);
+}
+
+//Lay out the types reachable from t, reporting each struct once
+static void walk(struct layout *l, struct type *t, char *name) {
+    if(!type_visit(t)) return;
+    lay(l, t);
+
+    switch(t->type) {
+    case TYPE_IDENT: if(t->def) walk(l, t->def, t->ident); break;
+    case TYPE_PTR: case TYPE_ARRAY: case TYPE_VEC: walk(l, t->of, NULL); break;
+
+    case TYPE_FUNC:
+        for(int i = 0; i < t->args_n; i++) walk(l, t->args[i], NULL);
+        for(int i = 0; i < t->ret_n; i++) walk(l, t->ret[i], NULL);
+        break;
+
+    case TYPE_STRUCT:
+        if(l->padding && t->size >= 0) report_padding(l, t, name);
+        for(int i = 0; i < t->mem_n; i++) walk(l, t->types[i], NULL);
+        break;
+
+    default: break;
+    }
+}
+
+static void walk_func(struct layout *l, struct val *v) {
+    for(int i = 0; i < v->args_n; i++) walk(l, v->args_type[i], NULL);
+    for(int i = 0; i < v->ret_n; i++) walk(l, v->ret_type[i], NULL);
+}
+
+//Lay out the types of the module, named types first so structs are
+//reported by name. If padding is set, warn of padding in structs through
+//p->warn. Returns number of errors
+int layout(struct parse *p, bool padding) {
+    assert(p);
+
+    timing_start(TIMING_LAYOUT);
+
+    struct layout l = {p, padding, 0};
+    type_visit_begin();
+
+    for(int i = 0; i < p->types.n; i++) walk(&l, p->types.val[i], p->types.key[i]);
+
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type == VAL_VAR) {
+            walk(&l, v->expr_type, NULL);
+            if(v->expr.ty) walk(&l, v->expr.ty, NULL);
+        } else if(v->type == VAL_FUNC) walk_func(&l, v);
+    }
+    for(int i = 0; i < p->methods.n; i++) walk_func(&l, &p->methods.val[i]);
+    for(int i = 0; i < p->instances.n; i++) walk_func(&l, p->instances.inst[i]);
+
+    timing_stop(TIMING_LAYOUT);
+
+    return l.errnum;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "parse.h"
+
+//Data layout of types for the target, the x86-64 System V ABI as used by the
+//C backend. Sizes and alignments are in bytes, memoized in the type node.
+//Types without a layout, such as void or types of other modules, have size
+//-1.
+//
+//Bool members of structs are packed to single bits, consecutive ones
+//sharing an int, as C bit-fields are. Elsewhere a bool is an int.
+
+#define LAYOUT_PTR_SIZE 8
+#define LAYOUT_BOOL_SIZE 4     //Int a bool is stored in, alone or packed
+#define LAYOUT_VEC_ALIGN_MAX 64 //Vectors are aligned to their size up to this
+
+void layout_type(struct type *t);
+bool layout_is_bit(struct type *t, int member);
+int layout_offset_of(struct type *t, struct token m);
+bool layout_int_range(struct type *t, int64_t *min, int64_t *max);
+int layout(struct parse *p, bool padding);
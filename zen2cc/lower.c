@@ -0,0 +1,287 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fold.h"
+#include "layout.h"
+#include "lower.h"
+#include "mono.h"
+#include "sema.h"
+#include "timing.h"
+
+struct lower {
+    struct parse *p;
+    bool report;            //Report the dispatch chosen for each switch
+    int errnum;
+};
+
+char *lower_kind_str[] = {
+    [LOWER_CHAIN] = "compare chain",
+    [LOWER_TREE] = "decision tree",
+    [LOWER_TABLE] = "jump table",
+    [LOWER_HASH] = "perfect hash",
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static bool is_unsigned(struct type *t) {
+    if(t->type == TYPE_ENUM) t = sema_resolve(t->repr);
+    return t->type == TYPE_PRIMATIVE && t->primative >= TYPE_UINT && t->primative < TYPE_FLOAT;
+}
+
+//By value, then case, so the first case of a value comes first
+static int label_cmp(const void *a, const void *b) {
+    const struct lower_label *x = a, *y = b;
+    if(x->val != y->val) return x->val < y->val ? -1 : 1;
+    return x->c - y->c;
+}
+
+//By length, then bytes, then case
+static int str_label_cmp(const void *a, const void *b) {
+    const struct lower_label *x = a, *y = b;
+    if(x->val != y->val) return x->val < y->val ? -1 : 1;
+    int d = memcmp(x->str, y->str, x->val);
+    return d ? d : x->c - y->c;
+}
+
+//Slot of the n bytes s in a hash table of size slots, a power of two
+uint32_t lower_hash(uint32_t seed, uint8_t *s, int64_t n, int size) {
+    uint32_t h = LOWER_HASH_BASIS ^ seed;
+    for(int64_t i = 0; i < n; i++) h = (h ^ s[i]) * LOWER_HASH_PRIME;
+    return (h ^ h >> 16) & (size - 1);
+}
+
+//Find a seed hashing labels a to b, all of one length, to distinct slots of
+//the smallest table it can. Returns false if none is found, and they are to
+//be compared in turn.
+static bool perfect_hash(struct lower_label *a, struct lower_label *b) {
+    int n = b - a, size = 1;
+    while(size < n) size *= 2;
+    char *used = malloc(size << LOWER_HASH_GROW);
+    assert(used);
+
+    for(int grow = 0; grow <= LOWER_HASH_GROW; grow++, size *= 2)
+        for(uint32_t seed = 0; seed < LOWER_HASH_SEEDS; seed++) {
+            memset(used, 0, size);
+            struct lower_label *l = a;
+            for(; l < b; l++) {
+                l->slot = lower_hash(seed, l->str, l->val, size);
+                if(used[l->slot]) break;
+                used[l->slot] = 1;
+            }
+            if(l < b) continue;
+
+            for(l = a; l < b; l++) l->seed = seed, l->size = size;
+            free(used);
+            return true;
+        }
+
+    free(used);
+    for(struct lower_label *l = a; l < b; l++) l->seed = l->size = l->slot = 0;
+    return false;
+}
+
+static int tree_depth(int n) {
+    return n <= LOWER_CHAIN_MAX ? 0 : 1 + tree_depth(n - n / 2);
+}
+
+//Constant labels of switch e in sw, sorted. Returns why the switch is a
+//compare chain instead, or NULL.
+static char *switch_labels(struct lower *l, struct expr *e, struct lower_switch *sw) {
+    struct expr *cases = e->ctl.body->vals;
+    int n = e->ctl.body->vals_n;
+
+    if(!e->ctl.cond || !e->ctl.cond->ty) return "no argument";
+    struct type *t = sema_resolve(e->ctl.cond->ty);
+    int64_t min, max;
+    if(!layout_int_range(t, &min, &max)) return "argument is not an integer";
+
+    for(int i = 0; i < n; i++) {
+        int64_t v;
+        if(!fold_int(l->p, cases[i].ctl.cond, &v)) return "labels are not constant";
+        if(v < 0 && is_unsigned(t)) return "labels are negative";
+        sw->labels[sw->n++] = (struct lower_label){v, i};
+    }
+
+    qsort(sw->labels, sw->n, sizeof *sw->labels, label_cmp);
+    int k = 0;
+    for(int i = 0; i < sw->n; i++) {
+        if(k && sw->labels[k-1].val == sw->labels[i].val) {
+            l->p->warn(l->p->ts, cases[sw->labels[i].c].ctl.kw, "Case duplicates an earlier case");
+            continue;
+        }
+        sw->labels[k++] = sw->labels[i];
+    }
+    sw->n = k;
+
+    if(sw->n <= LOWER_CHAIN_MAX) return "few cases";
+
+    //Tables of enums span all options, but a cast can give an enum any value
+    //of its representation, so they are checked against that
+    sw->lo = sw->labels[0].val;
+    sw->hi = sw->labels[sw->n-1].val;
+    if(t->type == TYPE_ENUM) {
+        if(min < sw->lo) sw->lo = min;
+        if(max > sw->hi) sw->hi = max;
+        if(!layout_int_range(sema_resolve(t->repr), &min, &max)) return "argument is not an integer";
+    }
+    sw->check = sw->lo > min || sw->hi < max;
+    return NULL;
+}
+
+//Plan of switch e on a string, its labels grouped by length with a perfect
+//hash each. Labels must be constant.
+static struct lower_switch *plan_string(struct lower *l, struct expr *e) {
+    struct expr *cases = e->ctl.body->vals;
+    int n = e->ctl.body->vals_n;
+
+    struct token *toks = malloc((n + 1) * sizeof *toks);
+    assert(toks);
+    size_t bytes = 0;
+    for(int i = 0; i < n; i++) {
+        struct type *t = cases[i].ctl.cond->ty;
+        toks[i] = (struct token){0};
+        if(!fold_str(l->p, cases[i].ctl.cond, &toks[i]) && t && sema_is_string(t)) {
+            l->p->error(l->p->ts, expr_tok(cases[i].ctl.cond), "Case label of a string switch must be constant");
+            l->errnum++;
+        }
+        bytes += toks[i].len + 1;
+    }
+
+    struct lower_switch *sw = malloc(sizeof *sw + n * sizeof *sw->labels + bytes);
+    assert(sw);
+    *sw = (struct lower_switch){LOWER_HASH};
+    uint8_t *s = (uint8_t *)&sw->labels[n];
+    for(int i = 0; i < n; i++) {
+        int len = toks[i].len ? token_unescape(toks[i], (char *)s) : 0;
+        sw->labels[sw->n++] = (struct lower_label){len, i, s};
+        s += len + 1;
+    }
+    free(toks);
+
+    qsort(sw->labels, sw->n, sizeof *sw->labels, str_label_cmp);
+    int k = 0;
+    for(int i = 0; i < sw->n; i++) {
+        struct lower_label *a = &sw->labels[i];
+        if(k && sw->labels[k-1].val == a->val && !memcmp(sw->labels[k-1].str, a->str, a->val)) {
+            l->p->warn(l->p->ts, cases[a->c].ctl.kw, "Case duplicates an earlier case");
+            continue;
+        }
+        sw->labels[k++] = *a;
+    }
+    sw->n = k;
+
+    //Without a length, it is that of the argument's type
+    if(!e->ctl.step) {
+        int64_t len = sema_resolve(e->ctl.cond->ty)->n;
+        for(int i = 0; i < sw->n && len >= 0; i++) {
+            if(sw->labels[i].val == len) continue;
+            snprintf(err_buf, ERRBUF_SIZE, "Case never matches a string of %lli bytes", (long long)len);
+            l->p->warn(l->p->ts, cases[sw->labels[i].c].ctl.kw, err_buf);
+        }
+    }
+
+    int lens = 0, turn = 0;
+    for(int a = 0, b; a < sw->n; a = b, lens++) {
+        for(b = a; b < sw->n && sw->labels[b].val == sw->labels[a].val; b++);
+        if(!perfect_hash(&sw->labels[a], &sw->labels[b])) turn += b - a;
+    }
+
+    snprintf(err_buf, ERRBUF_SIZE, "Switch of %i case%s lowered to perfect hashes over %i length%s",
+            n, n == 1 ? "" : "s", lens, lens == 1 ? "" : "s");
+    if(turn) snprintf(err_buf + strlen(err_buf), ERRBUF_SIZE - strlen(err_buf),
+            ", %i compared in turn", turn);
+    return sw;
+}
+
+static void plan_switch(struct lower *l, struct expr *e) {
+    timing_count(TIMING_LOWER, 1);
+
+    if(e->ctl.cond && e->ctl.cond->ty && sema_is_string(e->ctl.cond->ty)) {
+        free(e->ctl.plan);
+        e->ctl.plan = plan_string(l, e);
+        if(l->report) l->p->warn(l->p->ts, e->ctl.kw, err_buf);
+        return;
+    }
+
+    int n = e->ctl.body->vals_n;
+    struct lower_switch *sw = malloc(sizeof *sw + n * sizeof *sw->labels);
+    assert(sw);
+    *sw = (struct lower_switch){LOWER_CHAIN};
+    free(e->ctl.plan);
+    e->ctl.plan = sw;
+
+    char *why = switch_labels(l, e, sw);
+    if(why) {
+        sw->kind = LOWER_CHAIN;
+        sw->n = 0;
+        snprintf(err_buf, ERRBUF_SIZE, "Switch of %i case%s lowered to a compare chain, %s", n, n == 1 ? "" : "s", why);
+    } else if((uint64_t)sw->hi - (uint64_t)sw->lo < LOWER_TABLE_MAX
+            && (uint64_t)sw->hi - (uint64_t)sw->lo < (uint64_t)LOWER_TABLE_SPAN * sw->n) {
+        sw->kind = LOWER_TABLE;
+        snprintf(err_buf, ERRBUF_SIZE, "Switch of %i cases lowered to a jump table of %llu entries%s",
+                n, (unsigned long long)((uint64_t)sw->hi - (uint64_t)sw->lo + 1),
+                sw->check ? "" : ", unchecked");
+    } else {
+        sw->kind = LOWER_TREE;
+        snprintf(err_buf, ERRBUF_SIZE, "Switch of %i cases lowered to a decision tree of depth %i",
+                n, tree_depth(sw->n));
+    }
+
+    if(l->report) l->p->warn(l->p->ts, e->ctl.kw, err_buf);
+}
+
+static void walk(struct lower *l, struct expr *e) {
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: case EXPR_TACC: return;
+
+    case EXPR_FCALL:
+        walk(l, e->f);
+        for(int i = 0; i < e->args_n; i++) walk(l, &e->args[i]);
+        return;
+    case EXPR_COMP_LIT: case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) walk(l, &e->vals[i]);
+        return;
+
+    EXPR_CASE_CTL: {
+        if(e->type == EXPR_SWITCH) plan_switch(l, e);
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        for(int i = 0; i < 5; i++) if(c[i]) walk(l, c[i]);
+        return;
+    }
+
+    case EXPR_CAST: walk(l, e->tacc.m); return;
+    case EXPR_SACC: case EXPR_MACC: walk(l, e->l); return;
+    case EXPR_ARRSUB: EXPR_CASE_BINARY: case EXPR_ASSIGN: case EXPR_DEFINE:
+        walk(l, e->r);
+        //fallthrough
+    default: walk(l, e->l); return;
+    }
+}
+
+//Choose the dispatch of every switch in the code to be emitted, after
+//sema() and monomorphize(). If report is set, each choice is reported
+//through p->warn. Returns number of errors, which are reported through
+//p->error.
+int lower(struct parse *p, bool report) {
+    assert(p);
+
+    timing_start(TIMING_LOWER);
+
+    struct lower l = {p, report};
+
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type == VAL_VAR) walk(&l, &v->expr);
+        else if(v->type == VAL_FUNC && !func_is_generic(v)) walk(&l, &v->func_expr);
+    }
+    for(int i = 0; i < p->methods.n; i++)
+        if(!func_is_generic(&p->methods.val[i])) walk(&l, &p->methods.val[i].func_expr);
+    for(int i = 0; i < p->instances.n; i++) walk(&l, &p->instances.inst[i]->func_expr);
+
+    timing_stop(TIMING_LOWER);
+
+    return l.errnum;
+}
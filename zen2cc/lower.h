@@ -0,0 +1,50 @@
+#pragma once
+
+#include "parse.h"
+
+//Dispatch of switches, chosen before emission rather than left to the C
+//compiler. A switch on an integer with constant case labels jumps through an
+//indexed table where the labels are dense, down a balanced binary decision
+//tree where they are sparse, and compares in turn where there are few.
+//Others, and switches without an argument, compare each case in order.
+//
+//A switch on a string dispatches on its length, then on a perfect hash of
+//the labels of that length, found here, confirming the one label in the
+//slot hashed to with a single memcmp.
+
+#define LOWER_CHAIN_MAX 3       //Most labels compared in turn
+#define LOWER_TABLE_SPAN 3      //Most jump table entries per label
+#define LOWER_TABLE_MAX 4096    //Most entries in a jump table
+#define LOWER_HASH_SEEDS 256    //Seeds tried for each size of hash table
+#define LOWER_HASH_GROW 3       //Times a hash table is doubled when no seed fits
+
+//FNV-1a, seeded by xor into the offset basis
+#define LOWER_HASH_BASIS 2166136261u
+#define LOWER_HASH_PRIME 16777619u
+
+enum lower_kind {LOWER_CHAIN, LOWER_TREE, LOWER_TABLE, LOWER_HASH};
+
+extern char *lower_kind_str[];
+
+struct lower_label {
+    int64_t val;                //Value, or length of a string label
+    int c;                      //Index of the case
+    uint8_t *str;               //String label, unescaped
+    uint32_t seed;              //Hash seed of the string labels of this length
+    int size, slot;             //Hash table size for this length, 0 if the
+                                //labels are compared in turn, and slot hashed to
+};
+
+//Plan of an EXPR_SWITCH, in e->ctl.plan. Allocated as one block, with the
+//bytes of string labels. For trees, tables and hashes, the labels sorted by
+//value then string, only the first case of a label kept.
+struct lower_switch {
+    enum lower_kind kind;
+    int64_t lo, hi;             //Values covered by a table
+    bool check;                 //Whether the argument is checked to be in lo..hi
+    int n;
+    struct lower_label labels[];
+};
+
+int lower(struct parse *p, bool report);
+uint32_t lower_hash(uint32_t seed, uint8_t *s, int64_t n, int size);
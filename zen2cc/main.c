@@ -1,9 +1,29 @@
 #include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "expr.h"
 #include "token.h"
 #include "parse.h"
+#include "resolve.h"
+#include "fold.h"
+#include "sema.h"
+#include "mono.h"
+#include "timing.h"
+#include "out.h"
+#include "emit.h"
+#include "layout.h"
+#include "lower.h"
+#include "bounds.h"
+#include "ir.h"
+#include "x64.h"
+#include "build.h"
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
 
 void print_err(struct token_stream *ts, struct token t, char *msg) {
     int row, col;
@@ -11,111 +31,421 @@ void print_err(struct token_stream *ts, struct token t, char *msg) {
     fprintf(stderr, "ERROR [%i:%i] %s\n", row, col, msg);
 }
 
-int main(int argc, char **argv) {
-    enum {TOKENS, PARSE, CC} output = CC;
+void print_warn(struct token_stream *ts, struct token t, char *msg) {
+    int row, col;
+    token_pos(ts, t, &row, &col);
+    fprintf(stderr, "WARNING [%i:%i] %s\n", row, col, msg);
+}
 
-    if(argc < 2 || argc > 3) {
-        fprintf(stderr, "Expected 1 argument <testfile>\n");
-        return 1;
+//Print type inferred by sema(), if any
+static void print_inferred(struct out *o, struct expr *e) {
+    if(!e->ty || e->ty->type == TYPE_NONE || e->ty->type == TYPE_ERR) return;
+    out_str(o, " inferred ");
+    type_print(o, e->ty);
+}
+
+static void print_val(struct out *o, struct val *v) {
+    switch(v->type){
+    case VAL_MODULE: out_str(o, "MODULE '"); out_str(o, v->mod_path); out_str(o, "'\n"); break;
+    case VAL_CONST:
+         out_str(o, v->export ? "CONST EXPORT " : "CONST "); expr_print(o, &v->expr);
+         if(v->cval && v->cval->type != CVAL_NONE) {
+             out_str(o, " = ");
+             cval_print(o, v->cval);
+         }
+         if(v->expr_type->type != TYPE_NONE) {
+             out_str(o, " as ");
+             type_print(o, v->expr_type);
+         } else print_inferred(o, &v->expr);
+         out_str(o, "\n"); break;
+    case VAL_VAR:
+         out_str(o, v->export ? "VAR EXPORT" : "VAR");
+         if(v->expr.type != EXPR_NONE){
+             out_str(o, " ");
+             expr_print(o, &v->expr);
+         }
+         if(v->expr_type->type != TYPE_NONE) {
+             out_str(o, " as ");
+             type_print(o, v->expr_type);
+         } else print_inferred(o, &v->expr);
+         out_str(o, "\n"); break;
+    case VAL_FUNC:
+         out_str(o, v->export ? "FUNC EXPORT" : "FUNC");
+         if(v->type_ident) out_str(o, " member of "), out_str(o, v->type_ident);
+         if(v->mod) out_str(o, " in module "), out_str(o, v->mod);
+         out_str(o, "(");
+         for(int j = 0; j < v->args_n; j++) {
+            if(j > 0) out_str(o, ", ");
+            out_str(o, v->args[j]);
+            if(v->args_type[j]->type != TYPE_NONE){
+                out_str(o, " ");
+                type_print(o, v->args_type[j]);
+            }
+         }
+         out_str(o, ")");
+         if(v->ret_n) out_str(o, " (");
+         for(int j = 0; j < v->ret_n; j++) {
+            if(j > 0) out_str(o, ", ");
+            type_print(o, v->ret_type[j]);
+         }
+         if(v->ret_n) out_str(o, ") ");
+         else out_str(o, " ");
+         expr_print(o, &v->func_expr);
+         out_str(o, "\n");
+         break;
+    default: assert(0);
+    }
+}
+
+//Size, alignment and member offsets of struct t, bools as byte.bit
+static void print_layout(struct out *o, char *name, struct type *t) {
+    out_str(o, name); out_str(o, ": SIZE "); out_int(o, t->size);
+    out_str(o, " ALIGN "); out_int(o, t->align); out_str(o, " {");
+    for(int i = 0; i < t->mem_n; i++) {
+        out_str(o, i ? ", " : ""); out_str(o, t->idents[i]); out_char(o, ' ');
+        out_int(o, t->offsets[i] / 8);
+        if(layout_is_bit(t, i)) out_char(o, '.'), out_int(o, t->offsets[i] % 8);
     }
+    out_str(o, "}\n");
+}
 
-    char *filename = argv[1];
+//Enum t as its storage type and option values
+static void print_enum(struct out *o, char *name, struct type *t) {
+    out_str(o, name); out_str(o, ": ");
+    type_print(o, t->repr);
+    out_str(o, " {");
+    for(int i = 0; i < t->opts_n; i++) {
+        out_str(o, i ? ", " : ""); out_str(o, t->opts[i]); out_char(o, ' ');
+        out_int(o, t->ivals[i]);
+    }
+    out_str(o, "}\n");
+}
 
-    if(argc == 3){
-        filename = argv[2];
-        if(strcmp(argv[1], "-t") == 0) output = TOKENS;
-        else if(strcmp(argv[1], "-p") == 0) output = PARSE;
-        else {
-            fprintf(stderr, "Unexpected argument \"%s\"\n", argv[1]);
-            return 1;
+//Module name from the file name, without directories or extension
+static char *module_name(char *path) {
+    char *base = strrchr(path, '/');
+    base = strdup(base ? base + 1 : path);
+    assert(base);
+
+    char *dot = strchr(base, '.');
+    if(dot && dot != base) *dot = '\0';
+    for(char *c = base; *c; c++) if(!isalnum((unsigned char)*c)) *c = '_';
+    if(isdigit((unsigned char)*base) || !*base) {
+        char *s = malloc(strlen(base) + 2);
+        assert(s);
+        s[0] = '_';
+        strcpy(s + 1, base);
+        free(base);
+        base = s;
+    }
+    return base;
+}
+
+struct options {
+    enum {TOKENS, PARSE, CC, OBJ, BUILD} output;
+    bool padding, switches, struct_ret, checked, report_bounds, optimize, report_inline, lines;
+    char *modname, *cache_dir;
+    char **defines;
+    int defines_n;
+};
+
+//Parse the file read by ts to p, with the compile time options of opt and
+//warnings reported through warn. Returns the number of errors.
+static int parse_file(struct options *opt, struct parse *p, struct token_stream *ts, error_func warn) {
+    parse_init(p, ts, print_err, warn);
+    p->ct.cache_dir = opt->cache_dir;
+    for(int i = 0; i < opt->defines_n; i++) {
+        char *eq = strchr(opt->defines[i], '=');
+        if(eq) *eq = '\0';
+        ct_define(&p->ct, opt->defines[i], eq ? eq + 1 : "1");
+        if(eq) *eq = '=';
+    }
+
+    timing_start(TIMING_PARSE);
+    int errnum = parse(p);
+    timing_stop(TIMING_PARSE);
+    return errnum;
+}
+
+//Run the passes after parse() on p, those opt asks for. Returns the number
+//of errors.
+static int passes(struct options *opt, struct parse *p) {
+    int errnum = resolve(p);
+    errnum += fold(p);
+    errnum += sema(p);
+    errnum += monomorphize(p);
+    errnum += layout(p, opt->padding);
+    errnum += lower(p, opt->switches);
+    errnum += bounds(p, opt->checked, opt->report_bounds);
+    if((opt->optimize || opt->output == OBJ) && !errnum) errnum += ir(p, opt->report_inline, opt->output == OBJ);
+    return errnum;
+}
+
+//Warnings of an included module are left to the build of the module itself
+static void no_warn(struct token_stream *ts, struct token t, char *msg) {
+    (void)ts; (void)t; (void)msg;
+}
+
+//Read the modules p includes by relative path, each the file <path>.zen
+//beside filename, and run the passes on them so p can call, and ir() inline,
+//the functions they export. Calls that are not inlined are to the symbols
+//of their module, built on its own. Modules they include are not read in
+//turn. Types are interned across modules, so a module naming a type p also
+//names is an error. Paths not found are left unread, as are absolute paths
+//to modules of the standard library. Returns the number of errors.
+static int load_modules(struct options *opt, struct parse *p, char *filename) {
+    int errnum = 0;
+    char *slash = strrchr(filename, '/');
+    int dir = slash ? slash - filename + 1 : 0;
+
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_MODULE || v->mod_path[0] == '/') continue;
+
+        char *path = malloc(dir + strlen(v->mod_path) + 5);
+        assert(path);
+        sprintf(path, "%.*s%s.zen", dir, filename, v->mod_path);
+        struct token_stream *ts = malloc(sizeof *ts);
+        assert(ts);
+        if(!token_stream_init(ts, path)) {
+            free(ts); free(path);
+            continue;
         }
+
+        struct parse *m = malloc(sizeof *m);
+        assert(m);
+        int n = parse_file(opt, m, ts, no_warn);
+        for(int j = 0; j < m->types.n; j++) {
+            struct type *t = ts_get(&p->types, m->types.key[j]);
+            if(!t) continue;
+            snprintf(err_buf, ERRBUF_SIZE, "Type '%s' is also defined by module '%s'",
+                    m->types.key[j], v->mod_path);
+            p->error(p->ts, t->tok, err_buf);
+            n++;
+        }
+        if(!n) n = passes(opt, m);
+
+        v->loaded = m;
+        v->mod_name = module_name(path);
+        errnum += n;
+        free(path);
+    }
+    return errnum;
+}
+
+//Free the modules load_modules() read for p
+static void free_modules(struct parse *p) {
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type != VAL_MODULE || !v->loaded) continue;
+        struct token_stream *ts = v->loaded->ts;
+        parse_free(v->loaded);
+        free(v->loaded);
+        token_stream_close(ts);
+        free(ts);
+        v->loaded = NULL;
     }
+}
 
+//Run the passes on filename and write what opt asks of it to o. Returns the
+//number of errors, or -1 if the file could not be read.
+static int translate(struct options *opt, char *filename, struct out *o) {
     struct token_stream ts;
     if(!token_stream_init(&ts, filename)) {
         fprintf(stderr, "ERR: Could not open file \"%s\"\n", filename);
-        return 2;
+        return -1;
     }
 
-    if(output == TOKENS) {
+    if(opt->output == TOKENS) {
         struct token t;
 
         do {
             t = token_stream_next(&ts);
-            token_print(&ts, t); printf("\n");
+            token_print(o, &ts, t); out_char(o, '\n');
         } while(t.type != TOKEN_ERR && t.type != TOKEN_EOF);
-
         return 0;
     }
 
     struct parse p;
-    parse_init(&p, &ts, print_err);
-    int errnum = parse(&p);
-    if(errnum) printf("GOT %i ERRORS\n", errnum);
+    int errnum = parse_file(opt, &p, &ts, print_warn);
+    errnum += load_modules(opt, &p, filename);
+    errnum += passes(opt, &p);
+    if(errnum && opt->output == PARSE) out_str(o, "GOT "), out_int(o, errnum), out_str(o, " ERRORS\n");
 
-    if(output == PARSE) {
-        printf("\nGlobal namespace\n");
+    //Only a module without errors is emitted
+    if(opt->output != PARSE) {
+        if(errnum) fprintf(stderr, "GOT %i ERRORS\n", errnum);
+        else {
+            char *mod = opt->modname ? strdup(opt->modname) : module_name(filename);
+            if(opt->output == OBJ) errnum = emit_x64(&p, o, mod);
+            else errnum = emit_c(&p, o, filename, mod, opt->struct_ret, opt->lines);
+            free(mod);
+        }
+    }
+
+    if(opt->output == PARSE) {
+        out_str(o, "\nGlobal namespace\n");
         struct ns ns = p.globals;
         for(int i = 0; i < ns.n; i++) {
-            printf("%s: ", ns.key[i]);
-            switch(ns.val[i].type){
-            case VAL_MODULE: printf("MODULE '%s'\n", ns.val[i].mod_path); break;
-            case VAL_CONST:
-                 printf("CONST "); expr_print(&ns.val[i].expr);
-                 if(ns.val[i].expr_type.type != TYPE_NONE) {
-                     printf(" as ");
-                     type_print(&ns.val[i].expr_type);
-                 }
-                 printf("\n"); break;
-            case VAL_VAR:
-                 printf("VAR");
-                 if(ns.val[i].expr.type != EXPR_NONE){
-                     printf(" ");
-                     expr_print(&ns.val[i].expr);
-                 }
-                 if(ns.val[i].expr_type.type != TYPE_NONE) {
-                     printf(" as ");
-                     type_print(&ns.val[i].expr_type);
-                 }
-                 printf("\n"); break;
-            case VAL_FUNC:
-                 printf("FUNC");
-                 if(ns.val[i].type_ident) printf(" member of %s", ns.val[i].type_ident);
-                 if(ns.val[i].mod) printf(" in module %s", ns.val[i].mod);
-                 printf("(");
-                 for(int j = 0; j < ns.val[i].args_n; j++) {
-                    if(j > 0) printf(", ");
-                    printf("%s", ns.val[i].args[j]);
-                    if(ns.val[i].args_type[j].type != TYPE_NONE){
-                        printf(" ");
-                        type_print(&ns.val[i].args_type[j]);
-                    }
-                 }
-                 printf(")");
-                 if(ns.val[i].ret_n) printf(" (");
-                 for(int j = 0; j < ns.val[i].ret_n; j++) {
-                    if(j > 0) printf(", ");
-                    type_print(&ns.val[i].ret_type[j]);
-                 }
-                 if(ns.val[i].ret_n) printf(") ");
-                 else printf(" ");
-                 expr_print(&ns.val[i].func_expr);
-                 printf("\n");
-                 break;
-            default: assert(0);
-            }
+            out_str(o, ns.key[i]); out_str(o, ": ");
+            print_val(o, &ns.val[i]);
+        }
+
+        if(p.methods.n) out_str(o, "\nMethods\n");
+        struct mt mt = p.methods;
+        for(int i = 0; i < mt.n; i++) {
+            if(mt.val[i].mod) out_str(o, mt.val[i].mod), out_str(o, "->");
+            out_str(o, mt.val[i].type_ident); out_str(o, "->");
+            out_str(o, mt.key[i]); out_str(o, ": ");
+            print_val(o, &mt.val[i]);
         }
 
-        printf("\nGlobal typespace\n");
+        if(p.instances.n) out_str(o, "\nInstances\n");
+        struct mono mono = p.instances;
+        for(int i = 0; i < mono.n; i++) {
+            out_str(o, mono.name[i]); out_str(o, ": ");
+            print_val(o, mono.inst[i]);
+        }
+
+        if(p.ct.names_n) out_str(o, "\nCompile time\n");
+        ct_print(o, &p.ct);
+
+        out_str(o, "\nGlobal typespace\n");
         struct ts ts = p.types;
         for(int i = 0; i < ts.n; i++) {
-            printf("%s: ", ts.key[i]);
-            type_print(&ts.val[i]);
-            printf("\n");
+            out_str(o, ts.key[i]); out_str(o, ": ");
+            type_print(o, ts.val[i]);
+            out_str(o, "\n");
+        }
+
+        bool any = false;
+        for(int i = 0; i < ts.n; i++) {
+            struct type *t = ts.val[i];
+            bool is_enum = t->type == TYPE_ENUM && t->repr;
+            if(!is_enum && (t->type != TYPE_STRUCT || t->size < 0)) continue;
+            if(!any) out_str(o, "\nLayout\n");
+            any = true;
+            if(is_enum) print_enum(o, ts.key[i], t);
+            else print_layout(o, ts.key[i], t);
         }
     }
 
+    free_modules(&p);
     parse_free(&p);
+    type_intern_free();
+    return errnum;
+}
+
+//Translate each file to C and compile it to an object with the C compiler,
+//named outname or after its module. Returns the number of files failed.
+static int build(struct options *opt, char **files, int files_n, char *outname,
+        char **cflags, int cflags_n, int jobs) {
+    char *cc = getenv("CC");
+    struct build b;
+    build_init(&b, cc && *cc ? cc : BUILD_CC, cflags, cflags_n, opt->cache_dir, jobs);
+
+    int failed = 0;
+    struct out out;
+    out_init(&out, OUT_MEMORY);
+    for(int i = 0; i < files_n; i++) {
+        if(translate(opt, files[i], &out)) {
+            failed++;
+            free(out_take(&out, &(size_t){0}));
+            continue;
+        }
+
+        size_t len;
+        char *c = out_take(&out, &len);
+        char *obj = outname;
+        if(!obj) {
+            char *mod = module_name(files[i]);
+            obj = malloc(strlen(mod) + 3);
+            assert(obj);
+            strcpy(obj, mod);
+            strcat(obj, ".o");
+            free(mod);
+        }
+
+        build_add(&b, c, len, obj);
+        if(obj != outname) free(obj);
+        free(c);
+    }
+    out_close(&out);
+
+    return failed + build_finish(&b);
+}
+
+int main(int argc, char **argv) {
+    struct options opt = {.output = CC};
+    bool timing = false;
+    char *outname = NULL, *cache_dir = getenv("ZEN2CC_CACHE");
+    char *files[argc], *defines[argc], *cflags[argc];
+    int files_n = 0, defines_n = 0, cflags_n = 0, jobs = 1;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-t") == 0) opt.output = TOKENS;
+        else if(strncmp(argv[i], "-D", 2) == 0 && argv[i][2]) defines[defines_n++] = &argv[i][2];
+        else if(strncmp(argv[i], "-C", 2) == 0 && argv[i][2]) cache_dir = &argv[i][2];
+        else if(strncmp(argv[i], "-Wc,", 4) == 0 && argv[i][4]) cflags[cflags_n++] = &argv[i][4];
+        else if(strcmp(argv[i], "-p") == 0) opt.output = PARSE;
+        else if(strcmp(argv[i], "-c") == 0) opt.output = OBJ;
+        else if(strcmp(argv[i], "-cc") == 0) opt.output = BUILD;
+        else if(strcmp(argv[i], "-T") == 0) timing = true;
+        else if(strcmp(argv[i], "-Wpadding") == 0) opt.padding = true;
+        else if(strcmp(argv[i], "-Wswitch-lowering") == 0) opt.switches = true;
+        else if(strcmp(argv[i], "-fstruct-return") == 0) opt.struct_ret = true;
+        else if(strcmp(argv[i], "-fbounds-check") == 0) opt.checked = true;
+        else if(strcmp(argv[i], "-Wbounds") == 0) opt.report_bounds = true;
+        else if(strcmp(argv[i], "-O") == 0) opt.optimize = true;
+        else if(strcmp(argv[i], "-Winline") == 0) opt.report_inline = true;
+        else if(strcmp(argv[i], "-g") == 0) opt.lines = true;
+        else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) outname = argv[++i];
+        else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc) opt.modname = argv[++i];
+        else if(strcmp(argv[i], "-j") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) jobs = atoi(argv[++i]);
+        else if(argv[i][0] == '-') {
+            fprintf(stderr, "Unexpected argument \"%s\"\n", argv[i]);
+            return 1;
+        } else files[files_n++] = argv[i];
+    }
+
+    if(!files_n || (files_n > 1 && opt.output != BUILD)) {
+        fprintf(stderr, "Expected 1 argument <testfile>\n");
+        return 1;
+    }
+    if(files_n > 1 && (outname || opt.modname)) {
+        fprintf(stderr, "Options -o and -m take a single file\n");
+        return 1;
+    }
+
+    opt.cache_dir = cache_dir && *cache_dir ? cache_dir : NULL;
+    opt.defines = defines;
+    opt.defines_n = defines_n;
+
+    if(opt.output == BUILD) {
+        int failed = build(&opt, files, files_n, outname, cflags, cflags_n, jobs);
+        if(timing) timing_print(stderr);
+        return failed ? 1 : 0;
+    }
+
+    char *filename = files[0];
+    int fd = STDOUT_FILENO;
+    bool code = opt.output == CC || opt.output == OBJ;
+    if(outname && code) fd = open(outname, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd < 0) {
+        fprintf(stderr, "ERR: Could not open file \"%s\"\n", outname);
+        return 2;
+    }
+
+    struct out out, *o = &out;
+    out_init(o, fd);
+
+    int errnum = translate(&opt, filename, o);
+    bool ok = out_close(o);
+
+    if(timing && opt.output != TOKENS) timing_print(stderr);
 
-    return 0;
+    if(!ok) fprintf(stderr, "ERR: Could not write output\n");
+    if((!ok || errnum) && outname && code) unlink(outname);
+    if(!ok || errnum < 0) return 2;
+    return errnum && code ? 1 : 0;
 }
@@ -0,0 +1,298 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mono.h"
+#include "parse.h"
+#include "sema.h"
+#include "timing.h"
+
+void mono_init(struct mono *m) {
+    assert(m);
+    *m = (struct mono){0};
+    m->tab_c = 2 * MONO_INITIAL_CAP;
+    m->tab = malloc(m->tab_c * sizeof *m->tab);
+    assert(m->tab);
+    for(int i = 0; i < m->tab_c; i++) m->tab[i] = -1;
+}
+
+void mono_free(struct mono *m) {
+    if(m == NULL) return;
+    for(int i = 0; i < m->n; i++) {
+        val_free(m->inst[i]);
+        free(m->inst[i]);
+        free(m->name[i]);
+    }
+    free(m->generic);
+    free(m->key);
+    free(m->inst);
+    free(m->name);
+    free(m->depth);
+    free(m->tab);
+    *m = (struct mono){0};
+}
+
+static unsigned mono_hash(struct val *generic, struct type *key) {
+    unsigned long g = (unsigned long)generic;
+    unsigned h = key->hash;
+    h = (h ^ (unsigned)g) * 16777619u;
+    return (h ^ (unsigned)(g >> 32)) * 16777619u;
+}
+
+static int mono_slot(struct mono *m, struct val *generic, struct type *key) {
+    int i = mono_hash(generic, key) & (m->tab_c - 1);
+    for(; m->tab[i] >= 0; i = (i + 1) & (m->tab_c - 1)) {
+        int j = m->tab[i];
+        if(m->generic[j] == generic && m->key[j] == key) break;
+    }
+    return i;
+}
+
+struct val *mono_get(struct mono *m, struct val *generic, struct type *key) {
+    assert(m); assert(generic); assert(key);
+
+    int i = mono_slot(m, generic, key);
+    if(m->tab[i] < 0) return NULL;
+    return m->inst[m->tab[i]];
+}
+
+static void mono_grow(struct mono *m) {
+    int new_c = m->c ? m->c * 2 : MONO_INITIAL_CAP;
+    m->generic = realloc(m->generic, new_c * sizeof *m->generic);
+    m->key = realloc(m->key, new_c * sizeof *m->key);
+    m->inst = realloc(m->inst, new_c * sizeof *m->inst);
+    m->name = realloc(m->name, new_c * sizeof *m->name);
+    m->depth = realloc(m->depth, new_c * sizeof *m->depth);
+    assert(m->generic); assert(m->key); assert(m->inst); assert(m->name); assert(m->depth);
+    m->c = new_c;
+
+    if(2 * new_c <= m->tab_c) return;
+
+    free(m->tab);
+    m->tab_c = 2 * new_c;
+    m->tab = malloc(m->tab_c * sizeof *m->tab);
+    assert(m->tab);
+    for(int i = 0; i < m->tab_c; i++) m->tab[i] = -1;
+    for(int j = 0; j < m->n; j++)
+        m->tab[mono_slot(m, m->generic[j], m->key[j])] = j;
+}
+
+bool func_is_generic(struct val *v) {
+    if(v->type != VAL_FUNC || v->generic) return false;
+    for(int i = 0; i < v->args_n; i++)
+        if(v->args_type[i]->type == TYPE_NONE) return true;
+    return false;
+}
+
+struct mono_pass {
+    struct parse *p;
+    int depth;              //Depth of the instance being scanned, 0 for non generic code
+    int errnum;
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static void mono_error(struct mono_pass *m, struct token t, char *msg) {
+    m->p->error(m->p->ts, t, msg);
+    m->errnum++;
+}
+
+//Point arguments of generic g in the cloned body e at instance v
+static void rebind_args(struct expr *e, struct val *g, struct val *v) {
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: return;
+    case EXPR_IDENT: if(e->val == g && (e->arg >= 0 || e->local)) e->val = v; return;
+    case EXPR_FCALL:
+        rebind_args(e->f, g, v);
+        for(int i = 0; i < e->args_n; i++) rebind_args(&e->args[i], g, v);
+        return;
+    case EXPR_COMP_LIT: case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) rebind_args(&e->vals[i], g, v);
+        return;
+    EXPR_CASE_CTL: {
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        for(int i = 0; i < 5; i++) if(c[i]) rebind_args(c[i], g, v);
+        return;
+    }
+    case EXPR_TACC: return;
+    case EXPR_CAST: rebind_args(e->tacc.m, g, v); return;
+    case EXPR_SACC: case EXPR_MACC: rebind_args(e->l, g, v); return;
+    case EXPR_ARRSUB: EXPR_CASE_BINARY: case EXPR_ASSIGN: case EXPR_DEFINE:
+        rebind_args(e->r, g, v);
+        //fallthrough
+    default: rebind_args(e->l, g, v); return;
+    }
+}
+
+static char *strdup_null(char *s) {
+    return s ? strdup(s) : NULL;
+}
+
+//Create instance of g for the argument types in key
+static struct val *instantiate(struct mono_pass *m, struct val *g, struct type *key, struct token name) {
+    struct mono *mono = &m->p->instances;
+    struct val *v = malloc(sizeof *v);
+    assert(v);
+
+    *v = *g;
+    v->generic = g;
+    v->mod = strdup_null(g->mod);
+    v->type_ident = strdup_null(g->type_ident);
+
+    v->args = malloc(sizeof(*v->args) * g->args_n);
+    v->args_type = malloc(sizeof(*v->args_type) * g->args_n);
+    assert(v->args); assert(v->args_type);
+    for(int i = 0; i < g->args_n; i++) {
+        v->args[i] = strdup(g->args[i]);
+        v->args_type[i] = key->args[i];
+    }
+
+    if(g->ret_n > 0) {
+        v->ret_type = malloc(sizeof(*v->ret_type) * g->ret_n);
+        assert(v->ret_type);
+        memcpy(v->ret_type, g->ret_type, sizeof(*v->ret_type) * g->ret_n);
+    }
+
+    v->func_expr = expr_clone(&g->func_expr);
+    rebind_args(&v->func_expr, g, v);
+
+    if(mono->n >= mono->c) mono_grow(mono);
+
+    int j = mono->n++;
+    mono->generic[j] = g;
+    mono->key[j] = key;
+    mono->inst[j] = v;
+    mono->depth[j] = m->depth + 1;
+
+    char buf[64];
+    snprintf(buf, sizeof buf, "__%i", j);
+    mono->name[j] = malloc(name.len + strlen(buf) + 1);
+    assert(mono->name[j]);
+    memcpy(mono->name[j], name.str, name.len);
+    strcpy(mono->name[j] + name.len, buf);
+
+    mono->tab[mono_slot(mono, g, key)] = j;
+
+    timing_count(TIMING_MONO, 1);
+    m->errnum += sema_func(m->p, v);
+
+    return v;
+}
+
+//Bind a call to generic g to the instance for the call's argument types
+static void mono_call(struct mono_pass *m, struct expr *e, struct expr *f, struct val *g, struct expr *recv) {
+    struct token name = f->lit;
+    int recv_n = recv != NULL;
+
+    if(e->args_n + recv_n != g->args_n) {
+        snprintf(err_buf, ERRBUF_SIZE, "Expected %i arguments, got %i",
+                g->args_n - recv_n, e->args_n);
+        mono_error(m, name, err_buf);
+        return;
+    }
+
+    struct type *args[g->args_n];
+    for(int i = 0; i < g->args_n; i++) {
+        struct expr *a = i < recv_n ? recv : &e->args[i - recv_n];
+        args[i] = g->args_type[i];
+        if(args[i]->type != TYPE_NONE) continue;
+
+        args[i] = a->ty;
+        if(!args[i] || args[i]->type == TYPE_NONE || args[i]->type == TYPE_ERR) {
+            snprintf(err_buf, ERRBUF_SIZE, "Can not infer type of argument '%s'", g->args[i]);
+            mono_error(m, name, err_buf);
+            return;
+        }
+    }
+
+    struct type key = {TYPE_FUNC};
+    key.args_n = g->args_n;
+    key.args = malloc(sizeof(*key.args) * g->args_n);
+    assert(key.args);
+    memcpy(key.args, args, sizeof(*key.args) * g->args_n);
+    key.ret = NULL;
+    key.ret_n = 0;
+
+    struct type *k = type_intern(key);
+    struct val *v = mono_get(&m->p->instances, g, k);
+    if(!v) {
+        if(m->depth >= MONO_DEPTH_MAX) {
+            snprintf(err_buf, ERRBUF_SIZE, "Instantiation of '%.*s' nested too deeply", name.len, name.str);
+            mono_error(m, name, err_buf);
+            return;
+        }
+        v = instantiate(m, g, k, name);
+    }
+
+    f->val = v;
+}
+
+static void mono_expr(struct mono_pass *m, struct expr *e) {
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: case EXPR_IDENT: return;
+
+    case EXPR_FCALL: {
+        mono_expr(m, e->f);
+        for(int i = 0; i < e->args_n; i++) mono_expr(m, &e->args[i]);
+
+        struct expr *f = e->f;
+        if(f->type == EXPR_IDENT && f->val && f->arg < 0 && func_is_generic(f->val))
+            mono_call(m, e, f, f->val, NULL);
+        else if(f->type == EXPR_MACC && f->r->val && func_is_generic(f->r->val))
+            mono_call(m, e, f->r, f->r->val, f->l);
+        else if(f->type == EXPR_TACC && f->tacc.m->val && func_is_generic(f->tacc.m->val))
+            mono_call(m, e, f->tacc.m, f->tacc.m->val, NULL);
+        return;
+    }
+
+    case EXPR_COMP_LIT: case EXPR_BLOCK: case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) mono_expr(m, &e->vals[i]);
+        return;
+    EXPR_CASE_CTL: {
+        struct expr *c[] = {e->ctl.init, e->ctl.cond, e->ctl.step, e->ctl.body, e->ctl.els};
+        for(int i = 0; i < 5; i++) if(c[i]) mono_expr(m, c[i]);
+        return;
+    }
+    case EXPR_TACC: return;
+    case EXPR_CAST: mono_expr(m, e->tacc.m); return;
+    case EXPR_SACC: case EXPR_MACC: mono_expr(m, e->l); return;
+    case EXPR_ARRSUB: EXPR_CASE_BINARY: case EXPR_ASSIGN: case EXPR_DEFINE:
+        mono_expr(m, e->r);
+        //fallthrough
+    default: mono_expr(m, e->l); return;
+    }
+}
+
+static void mono_val(struct mono_pass *m, struct val *v) {
+    switch(v->type) {
+    case VAL_CONST: case VAL_VAR: mono_expr(m, &v->expr); break;
+    case VAL_FUNC: if(!func_is_generic(v)) mono_expr(m, &v->func_expr); break;
+    default: break;
+    }
+}
+
+//Instantiate generic functions for every distinct tuple of argument types
+//they are called with, starting from non generic code, and bind each call
+//to its instance. Instances are scanned in turn for further calls.
+//Returns number of errors
+int monomorphize(struct parse *p) {
+    assert(p);
+
+    timing_start(TIMING_MONO);
+
+    struct mono_pass m = {p, 0, 0};
+
+    for(int i = 0; i < p->globals.n; i++) mono_val(&m, &p->globals.val[i]);
+    for(int i = 0; i < p->methods.n; i++) mono_val(&m, &p->methods.val[i]);
+
+    for(int i = 0; i < p->instances.n; i++) {
+        m.depth = p->instances.depth[i];
+        mono_expr(&m, &p->instances.inst[i]->func_expr);
+    }
+
+    timing_stop(TIMING_MONO);
+
+    return m.errnum;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "type.h"
+#include "ns.h"
+
+//Instances of generic functions, those with untyped trailing arguments.
+//Each instance is keyed by the generic function and the canonical function
+//type of its argument types, so every distinct argument type tuple is
+//instantiated once per module.
+
+#define MONO_INITIAL_CAP 8
+#define MONO_DEPTH_MAX 32
+
+struct parse;
+
+struct mono {
+    struct val **generic;   //Function instantiated
+    struct type **key;      //Canonical TYPE_FUNC of the instance argument types
+    struct val **inst;      //Instance, heap allocated so pointers are stable
+    char **name;            //Generic function name with instance number
+    int *depth;             //Instantiation depth, bounded by MONO_DEPTH_MAX
+    int c, n;
+
+    int *tab;               //Open addressed index in to the arrays above, -1 if empty
+    int tab_c;
+};
+
+void mono_init(struct mono *m);
+void mono_free(struct mono *m);
+struct val *mono_get(struct mono *m, struct val *generic, struct type *key);
+
+bool func_is_generic(struct val *v);
+int monomorphize(struct parse *p);
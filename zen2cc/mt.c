@@ -0,0 +1,100 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mt.h"
+
+void mt_init(struct mt *mt) {
+    assert(mt);
+    mt->type = malloc(MT_INITIAL_CAP * sizeof *mt->type);
+    mt->key = malloc(MT_INITIAL_CAP * sizeof *mt->key);
+    mt->val = malloc(MT_INITIAL_CAP * sizeof *mt->val);
+    mt->c = MT_INITIAL_CAP;
+    mt->n = 0;
+
+    mt->tab_c = 2 * MT_INITIAL_CAP;
+    mt->tab = malloc(mt->tab_c * sizeof *mt->tab);
+    for(int i = 0; i < mt->tab_c; i++) mt->tab[i] = -1;
+
+    assert(mt->type); assert(mt->key); assert(mt->val); assert(mt->tab);
+}
+
+void mt_free(struct mt *mt) {
+    if(mt == NULL) return;
+    for(int i = 0; i < mt->n; i++) {
+        free(mt->key[i]);
+        val_free(&mt->val[i]);
+    }
+    free(mt->type);
+    free(mt->key);
+    free(mt->val);
+    free(mt->tab);
+    mt->c = 0;
+    mt->n = 0;
+    mt->tab_c = 0;
+}
+
+static unsigned mt_hash(struct type *type, char *key) {
+    unsigned h = type->hash;
+    while(*key) h = (h ^ (unsigned char)*key++) * 16777619u;
+    return h;
+}
+
+//Returns slot in mt->tab holding (type, key), or the empty slot where it
+//would be inserted
+static int mt_slot(struct mt *mt, struct type *type, char *key) {
+    int i = mt_hash(type, key) & (mt->tab_c - 1);
+    for(; mt->tab[i] >= 0; i = (i + 1) & (mt->tab_c - 1)) {
+        int j = mt->tab[i];
+        if(mt->type[j] == type && strcmp(mt->key[j], key) == 0) break;
+    }
+    return i;
+}
+
+static void mt_grow(struct mt *mt) {
+    int new_c = mt->c * 2;
+    mt->type = realloc(mt->type, new_c * sizeof *mt->type);
+    mt->key = realloc(mt->key, new_c * sizeof *mt->key);
+    mt->val = realloc(mt->val, new_c * sizeof *mt->val);
+    assert(mt->type); assert(mt->key); assert(mt->val);
+    mt->c = new_c;
+
+    free(mt->tab);
+    mt->tab_c = 2 * new_c;
+    mt->tab = malloc(mt->tab_c * sizeof *mt->tab);
+    assert(mt->tab);
+    for(int i = 0; i < mt->tab_c; i++) mt->tab[i] = -1;
+    for(int j = 0; j < mt->n; j++)
+        mt->tab[mt_slot(mt, mt->type[j], mt->key[j])] = j;
+}
+
+void mt_set(struct mt *mt, struct type *type, char *key, struct val val) {
+    assert(mt); assert(type); assert(key);
+
+    int i = mt_slot(mt, type, key);
+    if(mt->tab[i] >= 0) {
+        int j = mt->tab[i];
+        val_free(&mt->val[j]);
+        mt->val[j] = val;
+        return;
+    }
+
+    if(mt->n >= mt->c) {
+        mt_grow(mt);
+        i = mt_slot(mt, type, key);
+    }
+
+    int j = mt->n++;
+    mt->type[j] = type;
+    mt->key[j] = strdup(key);
+    mt->val[j] = val;
+    mt->tab[i] = j;
+}
+
+struct val *mt_get(struct mt *mt, struct type *type, char *key) {
+    assert(mt); assert(type); assert(key);
+
+    int i = mt_slot(mt, type, key);
+    if(mt->tab[i] < 0) return NULL;
+    return &mt->val[mt->tab[i]];
+}
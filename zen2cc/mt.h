@@ -0,0 +1,24 @@
+#pragma once
+
+#include "type.h"
+#include "ns.h"
+
+//Method table, maps (receiver type, method name) to the method's VAL_FUNC.
+//Receiver types are canonical, so lookup hashes the type pointer and name.
+
+#define MT_INITIAL_CAP 8
+
+struct mt {
+    struct type **type;
+    char **key;
+    struct val *val;
+    int c, n;
+
+    int *tab;           //Open addressed index in to the arrays above, -1 if empty
+    int tab_c;
+};
+
+void mt_init(struct mt *mt);
+void mt_free(struct mt *mt);
+void mt_set(struct mt *mt, struct type *type, char *key, struct val val);
+struct val *mt_get(struct mt *mt, struct type *type, char *key);
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "ir.h"
+#include "mono.h"
 #include "ns.h"
 
 void ns_init(struct ns *ns) {
@@ -14,31 +16,44 @@ void ns_init(struct ns *ns) {
     assert(ns->val);
 }
 
+void val_free(struct val *v) {
+    switch(v->type) {
+    case VAL_MODULE: free(v->mod_path); free(v->mod_name); break;
+    case VAL_CONST: case VAL_VAR:
+         expr_free(&v->expr);
+         cval_free(v->cval);
+         free(v->cval);
+         break;
+    case VAL_FUNC:
+         free(v->mod);
+         free(v->type_ident);
+         for(int j = 0; j < v->args_n; j++)
+             free(v->args[j]);
+         free(v->args);
+         free(v->args_type);
+         free(v->ret_type);
+         expr_free(&v->func_expr);
+         ir_free(v->ir);
+         break;
+    }
+}
+
+//Whether v is a function other modules can call: exported, not a method or
+//generic, returning at most one value, and with a signature naming no types
+//of its module, which are not available outside it
+bool val_is_portable(struct val *v) {
+    if(v->type != VAL_FUNC || !v->export || v->type_ident || func_is_generic(v) || v->ret_n > 1)
+        return false;
+    for(int i = 0; i < v->args_n; i++) if(type_is_named(v->args_type[i])) return false;
+    for(int i = 0; i < v->ret_n; i++) if(type_is_named(v->ret_type[i])) return false;
+    return true;
+}
+
 void ns_free(struct ns *ns) {
     if(ns == NULL) return;
     for(int i = 0; i < ns->n; i++) {
         free(ns->key[i]);
-        switch(ns->val[i].type) {
-        case VAL_MODULE: free(ns->val[i].mod_path); break;
-        case VAL_CONST: case VAL_VAR:
-             type_free(&ns->val[i].expr_type);
-             expr_free(&ns->val[i].expr);
-             break;
-        case VAL_FUNC:
-             free(ns->val[i].mod);
-             free(ns->val[i].type_ident);
-             for(int j = 0; j < ns->val[i].args_n; j++) {
-                 free(ns->val[i].args[j]);
-                 type_free(&ns->val[i].args_type[j]);
-             }
-             for(int j = 0; j < ns->val[i].ret_n; j++)
-                 type_free(&ns->val[i].ret_type[j]);
-             free(ns->val[i].args);
-             free(ns->val[i].args_type);
-             free(ns->val[i].ret_type);
-             expr_free(&ns->val[i].func_expr);
-             break;
-        }
+        val_free(&ns->val[i]);
     }
     free(ns->key);
     free(ns->val);
@@ -61,12 +76,12 @@ void ns_set(struct ns *ns, char *key, struct val val) {
 
     int i = ns_find(ns, key);
     if(i < 0) {
-        if(ns->c >= ns->n) {
+        if(ns->n >= ns->c) {
             int new_c = ns->c * 2;
             if(new_c < NS_INITIAL_CAP) new_c = NS_INITIAL_CAP;
 
-            ns->key = reallocf(ns->key, new_c * sizeof *ns->key);
-            ns->val = reallocf(ns->val, new_c * sizeof *ns->val);
+            ns->key = realloc(ns->key, new_c * sizeof *ns->key);
+            ns->val = realloc(ns->val, new_c * sizeof *ns->val);
             assert(ns->key); assert(ns->val);
 
             ns->c = new_c;
@@ -2,6 +2,10 @@
 
 #include "type.h"
 #include "expr.h"
+#include "cval.h"
+
+struct ir_func;
+struct parse;
 
 enum val_type {
     VAL_MODULE,         //Reference to external module
@@ -12,18 +16,26 @@ enum val_type {
 
 struct val {
     enum val_type type;
+    bool export;            //Visible outside the module, see README
 
     union {
-        char *mod_path;
+        struct {            //VAL_MODULE
+            char *mod_path;
+            char *mod_name;         //Name its C symbols are prefixed with, once loaded
+            struct parse *loaded;   //Module read from mod_path, or NULL, see main.c
+        };
         struct {
             struct expr expr;
-            struct type expr_type;
+            struct type *expr_type;
+            struct cval *cval;      //VAL_CONST value, set by fold()
         };
-        struct {
+        struct {            //Methods (type_ident set) take the receiver as args[0]
             char *mod, *type_ident, **args;
-            struct type *args_type, *ret_type;
+            struct type **args_type, **ret_type;
             int args_n, ret_n;
             struct expr func_expr;
+            struct val *generic;    //Function this is an instance of, or NULL
+            struct ir_func *ir;     //Lowered by ir(), or NULL
         };
     };
 };
@@ -36,6 +48,9 @@ struct ns {
     int c, n;
 };
 
+void val_free(struct val *v);
+bool val_is_portable(struct val *v);
+
 void ns_init(struct ns *ns);
 void ns_free(struct ns *ns);
 void ns_set(struct ns *ns, char *key, struct val val);
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "out.h"
+
+void out_init(struct out *o, int fd) {
+    assert(o);
+    *o = (struct out){.fd = fd, .cap = OUT_BUF_SIZE};
+    o->buf = malloc(o->cap);
+    assert(o->buf);
+}
+
+//Make room for n more bytes in a writer to memory
+static void out_room(struct out *o, size_t n) {
+    if(o->fd != OUT_MEMORY || o->len + n <= o->cap) return;
+    while(o->len + n > o->cap) o->cap *= 2;
+    o->buf = realloc(o->buf, o->cap);
+    assert(o->buf);
+}
+
+//Write all of iov, resuming after short writes
+static bool out_writev(struct out *o, struct iovec *iov, int n) {
+    while(n > 0 && !o->err) {
+        ssize_t w = writev(o->fd, iov, n);
+        if(w < 0) {
+            if(errno == EINTR) continue;
+            o->err = true;
+            break;
+        }
+
+        while(n > 0 && (size_t)w >= iov->iov_len) w -= iov->iov_len, iov++, n--;
+        if(n > 0) {
+            iov->iov_base = (char*)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+    return !o->err;
+}
+
+//Write out the buffer. Returns false if any write has failed.
+bool out_flush(struct out *o) {
+    assert(o);
+    if(o->fd == OUT_MEMORY) return !o->err;
+    struct iovec iov = {o->buf, o->len};
+    if(o->len) out_writev(o, &iov, 1);
+    o->len = 0;
+    return !o->err;
+}
+
+//Flush and free the buffer, leaving fd open
+bool out_close(struct out *o) {
+    bool ok = out_flush(o);
+    free(o->buf);
+    o->buf = NULL;
+    o->cap = 0;
+    return ok;
+}
+
+//Hand over the output of a writer to memory, to be freed by the caller, and
+//leave it empty
+char *out_take(struct out *o, size_t *len) {
+    assert(o); assert(o->fd == OUT_MEMORY); assert(len);
+    char *buf = o->buf;
+    *len = o->len;
+    out_init(o, OUT_MEMORY);
+    return buf;
+}
+
+void out_mem(struct out *o, const char *s, size_t len) {
+    out_room(o, len);
+    if(o->len + len <= o->cap) {
+        memcpy(o->buf + o->len, s, len);
+        o->len += len;
+        return;
+    }
+
+    if(len < o->cap) {
+        out_flush(o);
+        memcpy(o->buf, s, len);
+        o->len = len;
+        return;
+    }
+
+    struct iovec iov[2] = {{o->buf, o->len}, {(char*)s, len}};
+    out_writev(o, iov, 2);
+    o->len = 0;
+}
+
+void out_str(struct out *o, const char *s) {
+    out_mem(o, s, strlen(s));
+}
+
+void out_char(struct out *o, char c) {
+    out_room(o, 1);
+    if(o->len == o->cap) out_flush(o);
+    o->buf[o->len++] = c;
+}
+
+void out_uint(struct out *o, uint64_t v) {
+    char d[20];
+    int i = sizeof d;
+    do d[--i] = '0' + v % 10; while(v /= 10);
+    out_mem(o, d + i, sizeof d - i);
+}
+
+void out_int(struct out *o, int64_t v) {
+    if(v < 0) out_char(o, '-');
+    out_uint(o, v < 0 ? -(uint64_t)v : (uint64_t)v);
+}
+
+//printf style output, for the odd case the other functions don't cover
+void out_fmt(struct out *o, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    size_t room = o->cap - o->len;
+    int n = vsnprintf(o->buf + o->len, room, fmt, ap);
+    va_end(ap);
+    assert(n >= 0);
+
+    if((size_t)n < room) {
+        o->len += n;
+        return;
+    }
+
+    char *s = malloc(n + 1);
+    assert(s);
+    va_start(ap, fmt);
+    vsnprintf(s, n + 1, fmt, ap);
+    va_end(ap);
+    out_mem(o, s, n);
+    free(s);
+}
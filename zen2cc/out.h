@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OUT_BUF_SIZE (64 << 10)
+#define OUT_MEMORY -1           //fd of a writer keeping all output in buf
+
+//Buffered writer to a file descriptor, for the dumps and emitted code.
+//Output collects in buf and goes out with a single write per flush; strings
+//larger than the buffer are written along with it by one writev. Without a
+//file, buf grows to hold everything, for out_take() to hand over.
+struct out {
+    int fd;
+    char *buf;
+    size_t len, cap;
+    bool err;                   //A write failed, later output is dropped
+};
+
+void out_init(struct out *o, int fd);
+bool out_flush(struct out *o);
+bool out_close(struct out *o);
+char *out_take(struct out *o, size_t *len);
+
+void out_mem(struct out *o, const char *s, size_t len);
+void out_str(struct out *o, const char *s);
+void out_char(struct out *o, char c);
+void out_int(struct out *o, int64_t v);
+void out_uint(struct out *o, uint64_t v);
+void out_fmt(struct out *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
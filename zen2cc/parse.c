@@ -3,7 +3,9 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "ir.h"
 #include "parse.h"
+#include "timing.h"
 
 /*
 #define token_stream_mark(ts) do{for(int i=0;i<ts->mark_n;i++)printf("\t");printf("mark %s\n", __func__); token_stream_mark(ts);}while(0)
@@ -11,19 +13,57 @@
 #define token_stream_rewind(ts) do{for(int i=0;i<ts->mark_n;i++)printf("\t");printf("rewind %s\n", __func__); token_stream_rewind(ts);}while(0)
 */
 
-void parse_init(struct parse *p, struct token_stream *ts, error_func err) {
+void parse_init(struct parse *p, struct token_stream *ts, error_func err, error_func warn) {
     assert(p); assert(ts);
 
     ns_init(&p->globals);
     ts_init(&p->types);
+    mt_init(&p->methods);
+    mono_init(&p->instances);
+    ct_init(&p->ct);
+    p->init = NULL;
     p->ts = ts;
     p->error = err;
+    p->warn = warn;
+    p->type = type_none();
+    p->expr = (struct expr){EXPR_NONE};
+    p->uses = NULL;
+    p->uses_n = p->uses_c = 0;
 }
 
 void parse_free(struct parse *p) {
     if(!p) return;
     ns_free(&p->globals);
     ts_free(&p->types);
+    mt_free(&p->methods);
+    mono_free(&p->instances);
+    ct_free(&p->ct);
+    ir_free(p->init);
+    free(p->uses);
+}
+
+//Mark and rewind the token stream. Named types used since a mark are
+//forgotten on rewinding to it, as their tokens are parsed again, perhaps as
+//something else.
+static void parse_mark(struct parse *p) {
+    assert(p->ts->mark_n < TOKEN_MARK_MAX);
+    p->uses_at[p->ts->mark_n] = p->uses_n;
+    token_stream_mark(p->ts);
+}
+
+static void parse_rewind(struct parse *p) {
+    token_stream_rewind(p->ts);
+    p->uses_n = p->uses_at[p->ts->mark_n];
+}
+
+//Record that named type t is used at tok
+static void type_use(struct parse *p, struct type *t, struct token tok) {
+    if(p->uses_n >= p->uses_c) {
+        p->uses_c = p->uses_c ? p->uses_c * 2 : PARSE_USES_INITIAL_CAP;
+        p->uses = realloc(p->uses, p->uses_c * sizeof *p->uses);
+        assert(p->uses);
+    }
+    p->uses[p->uses_n++] = (struct type_use){t, tok};
 }
 
 #define ERRBUF_SIZE 1024
@@ -33,7 +73,7 @@ static char err_buf[ERRBUF_SIZE];
     if(ignore_nl) while(token_stream_peek(p->ts).type == TOKEN_NEWLINE) token_stream_next(p->ts);\
     t = token_stream_next(p->ts);\
     if(t.type != ttype && !(ttype == TOKEN_NEWLINE && t.type == TOKEN_EOF)){\
-        token_stream_rewind(p->ts);\
+        parse_rewind(p);\
         snprintf(err_buf, ERRBUF_SIZE, "Expected token %s, got %s [%s,%i]", token_type_str[ttype], token_type_str[t.type], __FILE__, __LINE__);\
         return err_buf;\
     }\
@@ -46,12 +86,12 @@ static char err_buf[ERRBUF_SIZE];
     if(t.type == ttype)\
 
 #define ERRF(str, ...) do{\
-    token_stream_rewind(p->ts);\
+    parse_rewind(p);\
     snprintf(err_buf, ERRBUF_SIZE, str, __VA_ARGS__);\
     return err_buf;\
 }while(0)
 
-#define MUST(func) do{if((err = func(p))){token_stream_rewind(p->ts); return err;}}while(0)
+#define MUST(func) do{if((err = func(p))){parse_rewind(p); return err;}}while(0)
 
 
 #define BUF_MAX 10
@@ -61,7 +101,7 @@ static char *parse_expr(struct parse *p);
 
 static char *parse_ident(struct parse *p) {
     assert(p);
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     struct token t;
     char *err = NULL;
@@ -69,14 +109,282 @@ static char *parse_ident(struct parse *p) {
     EXPECT(TOKEN_IDENT);
     p->expr.type = EXPR_IDENT;
     p->expr.lit = t;
+    p->expr.val = NULL;
+    p->expr.arg = -1;
+    p->expr.local = NULL;
+
+    token_stream_unmark(p->ts);
+    return NULL;
+}
+
+//Parse expressions separated by ';', or also by newlines when nl is set,
+//up to a closing '}' with nl set or the end of the line otherwise. The
+//terminator is not consumed. Fills p->expr with an EXPR_BLOCK.
+static char *parse_block_items(struct parse *p, struct token lcurl, bool nl) {
+    assert(p);
+
+    char *err = NULL;
+    struct token t;
+
+    struct expr *vals = NULL;
+    int n = 0, c = 0;
+
+    for(;;) {
+        t = token_stream_peek(p->ts);
+        if(t.type == TOKEN_SEMICOLON || (nl && t.type == TOKEN_NEWLINE)) {
+            token_stream_next(p->ts);
+            continue;
+        }
+        if(nl && (t.type == TOKEN_RCURL || t.type == TOKEN_CASE || t.type == TOKEN_DEFAULT)) break;
+        if(!nl && (t.type == TOKEN_NEWLINE || t.type == TOKEN_EOF)) break;
+
+        if((err = parse_expr(p))) goto fail;
+
+        if(n == c) {
+            c = c ? c * 2 : 4;
+            vals = realloc(vals, sizeof(*vals) * c);
+            assert(vals);
+        }
+        vals[n++] = p->expr;
+
+        t = token_stream_peek(p->ts);
+        bool end = nl ? t.type == TOKEN_RCURL || t.type == TOKEN_CASE || t.type == TOKEN_DEFAULT
+                : t.type == TOKEN_EOF;
+        if(t.type != TOKEN_SEMICOLON && t.type != TOKEN_NEWLINE && !end) {
+            snprintf(err_buf, ERRBUF_SIZE, "Expected ';' or newline, got %s", token_type_str[t.type]);
+            err = err_buf;
+            goto fail;
+        }
+    }
+
+    p->expr = (struct expr){EXPR_BLOCK};
+    p->expr.vals = vals;
+    p->expr.vals_n = n;
+    p->expr.lcurl = lcurl;
+    return NULL;
+
+fail:
+    for(int i = 0; i < n; i++) expr_free(&vals[i]);
+    free(vals);
+    return err;
+}
+
+//Parse if(cond) body else els, after the if
+static char *parse_if(struct parse *p, struct token kw) {
+    assert(p);
+
+    char *err = NULL;
+    struct token t;
+    bool ignore_nl = true;
+
+    parse_mark(p);
+    struct expr e = {EXPR_IF, .ctl.kw = kw};
+
+    EXPECT(TOKEN_LPAREN);
+    MUST(parse_expr);
+    e.ctl.cond = expr_alloc(p->expr);
+    EXPECT(TOKEN_RPAREN);
+    MUST(parse_expr);
+    e.ctl.body = expr_alloc(p->expr);
+
+    parse_mark(p);
+    while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE);
+    if(t.type == TOKEN_ELSE) {
+        token_stream_unmark(p->ts);
+        MUST(parse_expr);
+        e.ctl.els = expr_alloc(p->expr);
+    } else {
+        parse_rewind(p);
+    }
+
+    token_stream_unmark(p->ts);
+    p->expr = e;
+    return NULL;
+}
+
+//Parse for(init; cond; step) body or for(cond) body, after the for
+static char *parse_for(struct parse *p, struct token kw) {
+    assert(p);
+
+    char *err = NULL;
+    struct token t;
+    bool ignore_nl = true;
+
+    parse_mark(p);
+    struct expr e = {EXPR_FOR, .ctl.kw = kw};
+
+    EXPECT(TOKEN_LPAREN);
+    MAYBE(TOKEN_SEMICOLON); else {
+        MUST(parse_expr);
+        e.ctl.init = expr_alloc(p->expr);
+        MAYBE(TOKEN_RPAREN) {
+            e.ctl.cond = e.ctl.init;
+            e.ctl.init = NULL;
+            goto body;
+        }
+        EXPECT(TOKEN_SEMICOLON);
+    }
+    MAYBE(TOKEN_SEMICOLON); else {
+        MUST(parse_expr);
+        e.ctl.cond = expr_alloc(p->expr);
+        EXPECT(TOKEN_SEMICOLON);
+    }
+    MAYBE(TOKEN_RPAREN); else {
+        MUST(parse_expr);
+        e.ctl.step = expr_alloc(p->expr);
+        EXPECT(TOKEN_RPAREN);
+    }
+
+body:
+    MUST(parse_expr);
+    e.ctl.body = expr_alloc(p->expr);
+
+    token_stream_unmark(p->ts);
+    p->expr = e;
+    return NULL;
+}
+
+static void add_expr(struct expr **cases, int *n, int *c, struct expr e) {
+    if(*n == *c) {
+        *c = *c ? *c * 2 : 4;
+        *cases = realloc(*cases, sizeof(**cases) * *c);
+        assert(*cases);
+    }
+    (*cases)[(*n)++] = e;
+}
+
+//Parse switch(cond) {case label: body ... default: els} or switch {...},
+//after the switch. Cases are a block of EXPR_CASE, each body a block that
+//ends at the next case. case a, b: is case a: fallthrough; case b:
+static char *parse_switch(struct parse *p, struct token kw) {
+    assert(p);
+
+    char *err = NULL;
+    struct token t;
+    bool ignore_nl = true;
+
+    parse_mark(p);
+    struct expr e = {EXPR_SWITCH, .ctl.kw = kw};
+    struct expr *cases = NULL;
+    int n = 0, c = 0;
+
+    MAYBE(TOKEN_LPAREN) {
+        if((err = parse_expr(p))) goto fail;
+        e.ctl.cond = expr_alloc(p->expr);
+        if(token_stream_peek(p->ts).type == TOKEN_COMMA) {
+            token_stream_next(p->ts);
+            if((err = parse_expr(p))) goto fail;
+            e.ctl.step = expr_alloc(p->expr);
+        }
+        if(token_stream_next(p->ts).type != TOKEN_RPAREN) {
+            err = "Expected ')' after switch argument";
+            goto fail;
+        }
+    }
+    while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE);
+    struct token lcurl = t;
+    if(t.type != TOKEN_LCURL) {
+        err = "Expected '{' after switch";
+        goto fail;
+    }
+
+    for(;;) {
+        while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE || t.type == TOKEN_SEMICOLON);
+        if(t.type == TOKEN_RCURL) break;
+
+        struct token at = t;
+        struct expr label = {EXPR_NONE};
+        if(t.type == TOKEN_CASE) {
+            if((err = parse_expr(p))) goto fail;
+            label = p->expr;
+            while(token_stream_peek(p->ts).type == TOKEN_COMMA) {
+                token_stream_next(p->ts);
+                struct expr fall = {EXPR_FALLTHROUGH, .ctl.kw = at};
+                struct expr body = {EXPR_BLOCK, .vals = expr_alloc(fall), .vals_n = 1, .lcurl = at};
+                add_expr(&cases, &n, &c, (struct expr){EXPR_CASE, .ctl.kw = at,
+                    .ctl.cond = expr_alloc(label), .ctl.body = expr_alloc(body)});
+                if((err = parse_expr(p))) goto fail;
+                label = p->expr;
+            }
+        } else if(t.type != TOKEN_DEFAULT || e.ctl.els) {
+            err = "Expected case or default in switch";
+            goto fail;
+        }
+
+        t = token_stream_peek(p->ts);
+        if(t.type == TOKEN_COLON) token_stream_next(p->ts);
+        else if(label.type != EXPR_NONE) {
+            expr_free(&label);
+            err = "Expected ':' after case";
+            goto fail;
+        }
+
+        if((err = parse_block_items(p, at, true))) {
+            expr_free(&label);
+            goto fail;
+        }
+
+        if(at.type == TOKEN_DEFAULT) {
+            e.ctl.els = expr_alloc(p->expr);
+            continue;
+        }
+
+        add_expr(&cases, &n, &c, (struct expr){EXPR_CASE, .ctl.kw = at,
+            .ctl.cond = expr_alloc(label), .ctl.body = expr_alloc(p->expr)});
+    }
+
+    e.ctl.body = expr_alloc((struct expr){EXPR_BLOCK, .vals = cases, .vals_n = n, .lcurl = lcurl});
+    token_stream_unmark(p->ts);
+    p->expr = e;
+    return NULL;
+
+fail:
+    for(int i = 0; i < n; i++) expr_free(&cases[i]);
+    free(cases);
+    struct expr *own[] = {e.ctl.cond, e.ctl.els};
+    for(int i = 0; i < 2; i++) if(own[i]) expr_free(own[i]), free(own[i]);
+    parse_rewind(p);
+    return err;
+}
+
+//Parse the rest of a tuple (a, b...), after the comma that follows its first
+//value in p->expr. Fills p->expr with an EXPR_TUPLE.
+static char *parse_tuple(struct parse *p, struct token lparen) {
+    assert(p);
+
+    char *err = NULL;
+    struct token t;
+    struct expr *vals = NULL;
+    int n = 0, c = 0;
+
+    parse_mark(p);
+    add_expr(&vals, &n, &c, p->expr);
+    do {
+        if((err = parse_expr(p))) goto fail;
+        add_expr(&vals, &n, &c, p->expr);
+        while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE);
+    } while(t.type == TOKEN_COMMA);
+
+    if(t.type != TOKEN_RPAREN) {
+        err = "Expected ',' or ')' in tuple";
+        goto fail;
+    }
 
     token_stream_unmark(p->ts);
+    p->expr = (struct expr){EXPR_TUPLE, .vals = vals, .vals_n = n, .lcurl = lparen};
     return NULL;
+
+fail:
+    for(int i = 1; i < n; i++) expr_free(&vals[i]);
+    p->expr = vals[0];
+    free(vals);
+    parse_rewind(p);
+    return err;
 }
 
 static char *parse_expr_basic(struct parse *p) {
     assert(p);
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     char *err = NULL;
     bool ignore_nl = true;
@@ -86,13 +394,137 @@ static char *parse_expr_basic(struct parse *p) {
     switch(t.type) {
     case TOKEN_NUM: p->expr.type = EXPR_NUM; p->expr.lit = t; break;
     case TOKEN_STR: //fallthrough
-    case TOKEN_STR_ESC: p->expr.type = EXPR_STR; p->expr.lit = t; break;
-    case TOKEN_IDENT: p->expr.type = EXPR_IDENT; p->expr.lit = t; break;
-    case TOKEN_LPAREN: MUST(parse_expr); EXPECT(TOKEN_RPAREN); break;
-    default: token_stream_rewind(p->ts); return "Not a basic expression";
+    case TOKEN_STR_ESC: //fallthrough
+    case TOKEN_SOURCE: p->expr.type = EXPR_STR; p->expr.lit = t; break;
+    case TOKEN_IDENT:
+        p->expr.type = EXPR_IDENT;
+        p->expr.lit = t;
+        p->expr.val = NULL;
+        p->expr.arg = -1;
+        p->expr.local = NULL;
+        break;
+    case TOKEN_LPAREN: {
+        struct token lparen = t;
+        MUST(parse_expr);
+        MAYBE(TOKEN_COMMA) {
+            if((err = parse_tuple(p, lparen))) {
+                expr_free(&p->expr);
+                parse_rewind(p);
+                return err;
+            }
+            break;
+        }
+        EXPECT(TOKEN_RPAREN);
+        break;
+    }
+    case TOKEN_LCURL:
+        if((err = parse_block_items(p, t, true))) {
+            parse_rewind(p);
+            return err;
+        }
+        EXPECT(TOKEN_RCURL);
+        break;
+    case TOKEN_IF:
+        if((err = parse_if(p, t))) {
+            parse_rewind(p);
+            return err;
+        }
+        break;
+    case TOKEN_FOR:
+        if((err = parse_for(p, t))) {
+            parse_rewind(p);
+            return err;
+        }
+        break;
+    case TOKEN_SWITCH:
+        if((err = parse_switch(p, t))) {
+            parse_rewind(p);
+            return err;
+        }
+        break;
+    case TOKEN_FALLTHROUGH: p->expr = (struct expr){EXPR_FALLTHROUGH, .ctl.kw = t}; break;
+    default: parse_rewind(p); return "Not a basic expression";
+    }
+
+    token_stream_unmark(p->ts);
+    return NULL;
+}
+
+//Parse type related expressions: type->ident, mod->ident and type{...}
+static char *parse_expr_type(struct parse *p) {
+    assert(p);
+
+    struct token t;
+    char *err = NULL;
+    bool ignore_nl = true;
+
+    parse_mark(p);
+    if((err = parse_type_expr(p))) {
+        parse_rewind(p);
+        return err;
+    }
+
+    struct type *type = p->type;
+    while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE);
+    switch(t.type) {
+        case TOKEN_RARR:        // type->ident | type accessors
+            MUST(parse_ident);
+            p->expr.tacc.m = expr_alloc(p->expr);
+            p->expr.tacc.t = type;
+            p->expr.type = EXPR_TACC;
+            break;
+
+        case TOKEN_LCURL: {     // type{...}   | initializers
+            //Lookup tables run long, so elements are not bounded
+            struct expr *vals = NULL;
+            int i, c = 0;
+            for(i = 0; 1; ) {
+               MAYBE(TOKEN_RCURL) break;
+               if(i > 0 && (t = token_stream_next(p->ts)).type != TOKEN_COMMA) {
+                   err = "Expected ',' or '}' in compound literal";
+                   break;
+               }
+               if((err = parse_expr(p))) break;
+               add_expr(&vals, &i, &c, p->expr);
+            }
+            if(err) {
+               for(int j = 0; j < i; j++) expr_free(&vals[j]);
+               free(vals);
+               parse_rewind(p);
+               return err;
+            }
+
+            p->expr.vals = vals;
+            p->expr.vals_n = i;
+            p->expr.t = type;
+            p->expr.type = EXPR_COMP_LIT;
+
+            break;
+        }
+
+        default:
+            if(type->type != TYPE_IDENT || !type->mod) {
+                parse_rewind(p);
+                return "Not a type expression";
+            }
+
+            // ident->ident is one of mod->ident, type->ident or
+            // value->method, which is decided by resolve()
+            parse_rewind(p);
+            parse_mark(p);
+
+            MUST(parse_ident);
+            struct expr l = p->expr;
+            EXPECT(TOKEN_RARR);
+            MUST(parse_ident);
+
+            p->expr.r = expr_alloc(p->expr);
+            p->expr.l = expr_alloc(l);
+            p->expr.type = EXPR_MACC;
     }
 
     token_stream_unmark(p->ts);
+
     return NULL;
 }
 
@@ -102,34 +534,64 @@ static char *parse_expr_1(struct parse *p) {
     struct token t;
     bool ignore_nl = true;
 
-    token_stream_mark(p->ts);
+    char *err = parse_expr_type(p);
+    if(err) err = parse_expr_basic(p);
+    if(err) return err;
+
+    parse_mark(p);
 
-    int level = 0;
-    char *err = parse_expr_basic(p);
-    while(!err) {
-        level ++;
+    for(;;) {
         struct expr l = p->expr;
 
-        while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE);
+        //A '(' on the next line starts a tuple or parenthesized expression,
+        //rather than calling this one
+        bool nl = false;
+        while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE) nl = true;
+        if(nl && t.type == TOKEN_LPAREN) t.type = TOKEN_NEWLINE;
         switch(t.type) {
             case TOKEN_INC:
                 p->expr.type = EXPR_POSTINC;
                 p->expr.l = expr_alloc(l);
                 p->expr.r = NULL;
+                p->expr.op = t;
                 break;
 
             case TOKEN_DEC:
                 p->expr.type = EXPR_POSTDEC;
                 p->expr.l = expr_alloc(l);
                 p->expr.r = NULL;
+                p->expr.op = t;
                 break;
 
+            case TOKEN_LBRA: {
+                struct token op = t;
+                MUST(parse_expr);
+                EXPECT(TOKEN_RBRA);
+                p->expr.r = expr_alloc(p->expr);
+
+                p->expr.type = EXPR_ARRSUB;
+                p->expr.l = expr_alloc(l);
+                p->expr.op = op;
+                p->expr.check = false;
+                break;
+            }
+
             case TOKEN_DOT:
                 MUST(parse_ident);
                 p->expr.r = expr_alloc(p->expr);
 
                 p->expr.type = EXPR_SACC;
                 p->expr.l = expr_alloc(l);
+                p->expr.op = t;
+                break;
+
+            case TOKEN_RARR:
+                MUST(parse_ident);
+                p->expr.r = expr_alloc(p->expr);
+
+                p->expr.type = EXPR_MACC;
+                p->expr.l = expr_alloc(l);
+                p->expr.op = t;
                 break;
 
             case TOKEN_LPAREN: {
@@ -161,69 +623,21 @@ static char *parse_expr_1(struct parse *p) {
             }
 
             default:
-               if(level > 1) {
-                   token_stream_rewind(p->ts);
-                   return NULL;
-               } else goto parse_type_expr;
+                parse_rewind(p);
+                return NULL;
         }
 
         token_stream_unmark(p->ts);
-        token_stream_mark(p->ts);
-
-    }
-
-parse_type_expr:
-    token_stream_rewind(p->ts);
-    token_stream_mark(p->ts);
-    if(parse_type_expr(p)) return parse_expr_basic(p);
-
-    //Handle type related expressions
-    struct type type = p->type;
-    while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE);
-    switch(t.type) {
-        case TOKEN_RARR:        // type->ident | type accessors
-            MUST(parse_ident);
-            p->expr.tacc.m = expr_alloc(p->expr);
-            p->expr.tacc.t = type;
-            p->expr.type = EXPR_TACC;
-            break;
-
-        case TOKEN_LCURL: {     // type{...}   | initializers
-            struct expr buf[BUF_MAX];
-            int i;
-            for(i = 0; 1; i++) {
-               MAYBE(TOKEN_RCURL) break;
-               if(i>0) EXPECT(TOKEN_COMMA);
-
-               assert(i < BUF_MAX);
-
-               //TODO: parse compound literal element
-               MUST(parse_expr);
-               buf[i] = p->expr;
-            }
-
-            if(i) {
-               p->expr.vals = malloc(sizeof(struct expr) * i);
-               assert(p->expr.vals);
-               memcpy(p->expr.vals, buf, sizeof(struct expr) * i);
-            } else {
-               p->expr.vals = NULL;
-            }
-
-            p->expr.vals_n = i;
-            p->expr.t = type;
-            p->expr.type = EXPR_COMP_LIT;
-
-            break;
-        }
-
-        default:  token_stream_rewind(p->ts);
-                  return parse_expr_basic(p);
+        parse_mark(p);
     }
+}
 
-    token_stream_unmark(p->ts);
-
-    return NULL;
+//Whether t is certainly a type, rather than an expression such as (x) or
+//(*x). Only types declared before this point are known.
+static bool type_is_known(struct parse *p, struct type *t) {
+    while(t->type == TYPE_PTR || t->type == TYPE_ARRAY) t = t->of;
+    if(t->type != TYPE_IDENT) return true;
+    return !t->mod && ts_get(&p->types, t->ident);
 }
 
 static char *parse_expr_2(struct parse *p) {
@@ -233,7 +647,7 @@ static char *parse_expr_2(struct parse *p) {
     bool ignore_nl = true;
 
     char *err = NULL;
-    token_stream_mark(p->ts);
+    parse_mark(p);
     while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE);
     switch(t.type) {
         case TOKEN_INC:
@@ -241,6 +655,7 @@ static char *parse_expr_2(struct parse *p) {
             p->expr.l = expr_alloc(p->expr);
             p->expr.type = EXPR_PREINC;
             p->expr.r = NULL;
+            p->expr.op = t;
             token_stream_unmark(p->ts);
             return NULL;
 
@@ -249,6 +664,7 @@ static char *parse_expr_2(struct parse *p) {
             p->expr.l = expr_alloc(p->expr);
             p->expr.type = EXPR_PREDEC;
             p->expr.r = NULL;
+            p->expr.op = t;
             token_stream_unmark(p->ts);
             return NULL;
 
@@ -257,6 +673,7 @@ static char *parse_expr_2(struct parse *p) {
             p->expr.l = expr_alloc(p->expr);
             p->expr.type = EXPR_LNOT;
             p->expr.r = NULL;
+            p->expr.op = t;
             token_stream_unmark(p->ts);
             return NULL;
 
@@ -265,6 +682,7 @@ static char *parse_expr_2(struct parse *p) {
             p->expr.l = expr_alloc(p->expr);
             p->expr.type = EXPR_BNOT;
             p->expr.r = NULL;
+            p->expr.op = t;
             token_stream_unmark(p->ts);
             return NULL;
 
@@ -273,6 +691,7 @@ static char *parse_expr_2(struct parse *p) {
             p->expr.l = expr_alloc(p->expr);
             p->expr.type = EXPR_DEFER;
             p->expr.r = NULL;
+            p->expr.op = t;
             token_stream_unmark(p->ts);
             return NULL;
 
@@ -281,36 +700,178 @@ static char *parse_expr_2(struct parse *p) {
             p->expr.l = expr_alloc(p->expr);
             p->expr.type = EXPR_ADDR;
             p->expr.r = NULL;
+            p->expr.op = t;
             token_stream_unmark(p->ts);
             return NULL;
 
-        case TOKEN_LPAREN:
-            err = parse_type_expr(p);
-            if(err) return parse_expr_basic(p);
-            struct type type = p->type;
-            EXPECT(TOKEN_RPAREN);
+        case TOKEN_SUB:
             MUST(parse_expr_2);
+            p->expr.l = expr_alloc(p->expr);
+            p->expr.type = EXPR_NEG;
+            p->expr.r = NULL;
+            p->expr.op = t;
+            token_stream_unmark(p->ts);
+            return NULL;
+
+        //Cast, otherwise a parenthesized expression parsed by parse_expr_1
+        case TOKEN_LPAREN:
+            if(parse_type_expr(p)) break;
+            struct type *type = p->type;
+            MAYBE(TOKEN_RPAREN); else break;
+            t = token_stream_peek(p->ts);
+            if((t.type == TOKEN_SUB || t.type == TOKEN_MUL || t.type == TOKEN_BAND)
+                    && !type_is_known(p, type)) break;
+            if(parse_expr_2(p)) break;
             p->expr.tacc.m = expr_alloc(p->expr);
             p->expr.tacc.t = type;
             p->expr.type = EXPR_CAST;
+            token_stream_unmark(p->ts);
             return NULL;
 
         default: break;
     }
 
-    token_stream_rewind(p->ts);
+    parse_rewind(p);
     return parse_expr_1(p);
 }
 
+//Binary operator of token type tt and its precedence, higher binds tighter
+//as in C. Returns 0 if tt is not a binary operator.
+static int binary_op(enum token_type tt, enum expr_type *op) {
+    switch(tt) {
+    case TOKEN_MUL: *op = EXPR_MUL; return 10;
+    case TOKEN_DIV: *op = EXPR_DIV; return 10;
+    case TOKEN_MOD: *op = EXPR_MOD; return 10;
+    case TOKEN_ADD: *op = EXPR_ADD; return 9;
+    case TOKEN_SUB: *op = EXPR_SUB; return 9;
+    case TOKEN_BSL: *op = EXPR_BSL; return 8;
+    case TOKEN_BSR: *op = EXPR_BSR; return 8;
+    case TOKEN_LT:  *op = EXPR_LT; return 7;
+    case TOKEN_LE:  *op = EXPR_LE; return 7;
+    case TOKEN_GT:  *op = EXPR_GT; return 7;
+    case TOKEN_GE:  *op = EXPR_GE; return 7;
+    case TOKEN_EQ:  *op = EXPR_EQ; return 6;
+    case TOKEN_NE:  *op = EXPR_NE; return 6;
+    case TOKEN_BAND: *op = EXPR_BAND; return 5;
+    case TOKEN_XOR: *op = EXPR_XOR; return 4;
+    case TOKEN_BOR: *op = EXPR_BOR; return 3;
+    case TOKEN_AND: *op = EXPR_AND; return 2;
+    case TOKEN_OR:  *op = EXPR_OR; return 1;
+    default: return 0;
+    }
+}
+
+//Parse binary operators of precedence prec or higher, left associative
+static char *parse_expr_binary(struct parse *p, int prec) {
+    assert(p);
+
+    struct token t;
+    char *err = parse_expr_2(p);
+    if(err) return err;
+
+    parse_mark(p);
+
+    for(;;) {
+        struct expr l = p->expr;
+
+        //An operator on the next line starts a new statement, as * - and &
+        //are also prefixes, rather than continuing this expression
+        bool nl = false;
+        while(t = token_stream_next(p->ts), t.type == TOKEN_NEWLINE) nl = true;
+        enum expr_type op;
+        int op_prec = nl ? 0 : binary_op(t.type, &op);
+        if(op_prec < prec) {
+            parse_rewind(p);
+            return NULL;
+        }
+
+        if((err = parse_expr_binary(p, op_prec + 1))) {
+            parse_rewind(p);
+            return err;
+        }
+
+        p->expr.r = expr_alloc(p->expr);
+        p->expr.l = expr_alloc(l);
+        p->expr.type = op;
+        p->expr.op = t;
+
+        token_stream_unmark(p->ts);
+        parse_mark(p);
+    }
+}
+
+//Assignment of token type tt, with the operator of a compound assignment
+//in *op or EXPR_NONE. Returns the expression type, or EXPR_NONE if tt is not
+//an assignment.
+static enum expr_type assign_op(enum token_type tt, enum expr_type *op) {
+    *op = EXPR_NONE;
+    switch(tt) {
+    case TOKEN_ASSIGN: return EXPR_ASSIGN;
+    case TOKEN_DEFASSIGN: return EXPR_DEFINE;
+    case TOKEN_MULASSIGN: *op = EXPR_MUL; return EXPR_ASSIGN;
+    case TOKEN_DIVASSIGN: *op = EXPR_DIV; return EXPR_ASSIGN;
+    case TOKEN_MODASSIGN: *op = EXPR_MOD; return EXPR_ASSIGN;
+    case TOKEN_ADDASSIGN: *op = EXPR_ADD; return EXPR_ASSIGN;
+    case TOKEN_SUBASSIGN: *op = EXPR_SUB; return EXPR_ASSIGN;
+    case TOKEN_BSLASSIGN: *op = EXPR_BSL; return EXPR_ASSIGN;
+    case TOKEN_BSRASSIGN: *op = EXPR_BSR; return EXPR_ASSIGN;
+    case TOKEN_BANDASSIGN: *op = EXPR_BAND; return EXPR_ASSIGN;
+    case TOKEN_XORASSIGN: *op = EXPR_XOR; return EXPR_ASSIGN;
+    case TOKEN_BORASSIGN: *op = EXPR_BOR; return EXPR_ASSIGN;
+    default: return EXPR_NONE;
+    }
+}
+
+//Parse an expression, with assignments binding loosest and right associative
 static char *parse_expr(struct parse *p) {
     assert(p);
-    return parse_expr_2(p);
+
+    char *err = parse_expr_binary(p, 1);
+    if(err) return err;
+
+    parse_mark(p);
+
+    struct token t = token_stream_next(p->ts);
+    enum expr_type op, type = assign_op(t.type, &op);
+    if(type == EXPR_NONE) {
+        parse_rewind(p);
+        return NULL;
+    }
+
+    //(a, b) := ... defines each
+    struct expr l = p->expr;
+    bool idents = l.type == EXPR_IDENT || l.type == EXPR_TUPLE;
+    for(int i = 0; l.type == EXPR_TUPLE && i < l.vals_n; i++) idents &= l.vals[i].type == EXPR_IDENT;
+    if(type == EXPR_DEFINE && !idents) {
+        parse_rewind(p);
+        return "Expected identifier before :=";
+    }
+
+    if((err = parse_expr(p))) {
+        parse_rewind(p);
+        return err;
+    }
+
+    //a op= b is a = a op b
+    struct expr r = p->expr;
+    if(op != EXPR_NONE) {
+        r = (struct expr){op, .op = t};
+        r.l = expr_alloc(expr_clone(&l));
+        r.r = expr_alloc(p->expr);
+    }
+
+    p->expr = (struct expr){type, .op = t};
+    p->expr.l = expr_alloc(l);
+    p->expr.r = expr_alloc(r);
+
+    token_stream_unmark(p->ts);
+    return NULL;
 }
 
 static char *parse_include(struct parse *p) {
     assert(p);
     struct token t;
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     bool ignore_nl = false;
     EXPECT(TOKEN_INCLUDE);
@@ -342,16 +903,18 @@ static char *parse_const(struct parse *p) {
 
     char *err = NULL;
     struct token t;
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     bool ignore_nl = false;
     EXPECT(TOKEN_CONST);
+    bool export = false;
+    MAYBE(TOKEN_EXPORT) export = true;
     EXPECT(TOKEN_IDENT);
 
     char *ident = token_str(t);
     assert(ident);
 
-    struct type type = {TYPE_NONE};
+    struct type *type = type_none();
     if(!parse_type_expr(p)) type = p->type;
 
     EXPECT(TOKEN_ASSIGN);
@@ -362,7 +925,7 @@ static char *parse_const(struct parse *p) {
     token_stream_unmark(p->ts);
 
     ns_set(&p->globals, ident,
-            (struct val){VAL_CONST, .expr=p->expr, .expr_type=type});
+            (struct val){VAL_CONST, .export=export, .expr=p->expr, .expr_type=type});
 
     return NULL;
 }
@@ -372,18 +935,22 @@ static char *parse_let(struct parse *p) {
 
     char *err = NULL;
     struct token t;
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     bool ignore_nl = false;
     EXPECT(TOKEN_LET);
+    bool export = false;
+    MAYBE(TOKEN_EXPORT) export = true;
     EXPECT(TOKEN_IDENT);
 
     char *ident = token_str(t);
     assert(ident);
 
-    struct type type;
+    p->expr = (struct expr){EXPR_NONE};
+
+    struct type *type;
     if(parse_type_expr(p)){
-        type = (struct type){TYPE_NONE};
+        type = type_none();
         EXPECT(TOKEN_ASSIGN);
     } else {
         type = p->type;
@@ -397,26 +964,51 @@ ret:
     token_stream_unmark(p->ts);
 
     ns_set(&p->globals, ident,
-            (struct val){VAL_VAR, .expr=p->expr, .expr_type=type});
+            (struct val){VAL_VAR, .export=export, .expr=p->expr, .expr_type=type});
 
     return NULL;
 }
 
-//Parse struct definition in curly braces '{...}'
+//Parse 'align <n>' if next, n a power of two. align is 0 otherwise
+static char *parse_align(struct parse *p, int *align) {
+    struct token t = token_stream_peek(p->ts);
+    *align = 0;
+    if(t.type != TOKEN_IDENT || t.len != 5 || strncmp(t.str, "align", 5) != 0) return NULL;
+
+    parse_mark(p);
+    token_stream_next(p->ts);
+    t = token_stream_next(p->ts);
+    long n = t.type == TOKEN_NUM ? strtol(t.str, NULL, 0) : 0;
+    if(n <= 0 || n > TYPE_ALIGN_MAX || (n & (n - 1)))
+        ERRF("Alignment must be a power of two up to %i", TYPE_ALIGN_MAX);
+
+    token_stream_unmark(p->ts);
+    *align = n;
+    return NULL;
+}
+
+//Parse struct definition in curly braces '{...}', after an optional
+//'align <n>'. Members may be followed by 'align <n>' too.
 //Fills p->type with parsed members and TYPE_STRUCT
 static char *parse_struct_members(struct parse *p) {
     char *err;
     struct token t;
 
-    token_stream_mark(p->ts);
-    p->type.type = TYPE_ERR;
+    parse_mark(p);
+    p->type = type_intern((struct type){TYPE_ERR});
 
     char *idents[BUF_MAX];
-    struct type types[BUF_MAX];
-    int mem_n = 0;
+    struct type *types[BUF_MAX];
+    int aligns[BUF_MAX], mem_n = 0, align_to, align;
+    bool aligned = false;
 
     bool ignore_nl = false;
+    if((err = parse_align(p, &align_to))) {
+        parse_rewind(p);
+        return err;
+    }
     EXPECT(TOKEN_LCURL);
+    struct token lcurl = t;
     ignore_nl = true;
 
     for(;;){
@@ -425,35 +1017,54 @@ static char *parse_struct_members(struct parse *p) {
 ident:  assert(mem_n < BUF_MAX);
         EXPECT(TOKEN_IDENT);
         idents[mem_n] = token_str(t);
-        types[mem_n++] = (struct type){TYPE_NONE};
+        types[mem_n++] = NULL;
 
         MAYBE(TOKEN_COMMA) goto ident;
 
         MUST(parse_type_expr);
+        struct type *type = p->type;
+        if((err = parse_align(p, &align))) {
+            parse_rewind(p);
+            return err;
+        }
+        aligned |= align != 0;
 
-        for(int i = mem_n-1; i>=0 && types[i].type == TYPE_NONE; i--)
-            types[i] = p->type;
+        for(int i = mem_n-1; i>=0 && types[i] == NULL; i--)
+            types[i] = type, aligns[i] = align;
 
         MAYBE(TOKEN_RCURL) break;
         EXPECT(TOKEN_SEMICOLON);
     }
 
     token_stream_unmark(p->ts);
-    p->type.type = TYPE_STRUCT;
-    p->type.idents = NULL;
-    p->type.types = NULL;
-    p->type.mem_n = mem_n;
+
+    struct type type = {TYPE_STRUCT};
+    type.idents = NULL;
+    type.types = NULL;
+    type.mem_n = mem_n;
+    type.offsets = NULL;
+    type.aligns = NULL;
+    type.align_to = align_to;
+    type.tok = lcurl;
 
     if(mem_n > 0) {
-        p->type.idents = malloc(sizeof(*idents) * mem_n);
-        assert(p->type.idents);
-        memcpy(p->type.idents, idents, sizeof(*idents) * mem_n);
+        type.idents = malloc(sizeof(*idents) * mem_n);
+        assert(type.idents);
+        memcpy(type.idents, idents, sizeof(*idents) * mem_n);
+
+        type.types = malloc(sizeof(*types) * mem_n);
+        assert(type.types);
+        memcpy(type.types, types, sizeof(*types) * mem_n);
+    }
 
-        p->type.types = malloc(sizeof(*types) * mem_n);
-        assert(p->type.types);
-        memcpy(p->type.types, types, sizeof(*types) * mem_n);
+    if(aligned) {
+        type.aligns = malloc(sizeof(*aligns) * mem_n);
+        assert(type.aligns);
+        memcpy(type.aligns, aligns, sizeof(*aligns) * mem_n);
     }
 
+    p->type = type_intern(type);
+
     return NULL;
 }
 
@@ -463,15 +1074,17 @@ static char *parse_enum_members(struct parse *p) {
     struct token t;
     char *err;
 
-    token_stream_mark(p->ts);
-    p->type.type = TYPE_ERR;
+    parse_mark(p);
+    p->type = type_intern((struct type){TYPE_ERR});
 
     char *opts[BUF_MAX];
+    struct type *enum_type = NULL;
     struct expr vals[BUF_MAX];
     int opts_n = 0;
 
     bool ignore_nl = false;
     EXPECT(TOKEN_LCURL);
+    struct token lcurl = t;
     ignore_nl = true;
 
     MAYBE(TOKEN_RCURL); else {
@@ -484,49 +1097,70 @@ static char *parse_enum_members(struct parse *p) {
                 MUST(parse_expr);
                 vals[opts_n++] = p->expr;
             } else {
-                vals[opts_n++].type = EXPR_NONE;
+                vals[opts_n++] = (struct expr){EXPR_NONE};
             }
 
             MAYBE(TOKEN_COMMA); else break;
         }
 
-        MAYBE(TOKEN_RCURL)
-            p->type.enum_type = NULL;
+        MAYBE(TOKEN_RCURL);
         else {
             MUST(parse_type_expr);
-            p->type.enum_type = type_alloc(p->type);
+            enum_type = p->type;
             EXPECT(TOKEN_RCURL);
         }
     }
 
     token_stream_unmark(p->ts);
 
-    p->type.type = TYPE_ENUM;
-    p->type.opts = NULL;
-    p->type.vals = NULL;
-    p->type.opts_n = opts_n;
+    struct type type = {TYPE_ENUM};
+    type.opts = NULL;
+    type.vals = NULL;
+    type.enum_type = enum_type;
+    type.opts_n = opts_n;
+    type.tok = lcurl;
 
     if(opts_n > 0) {
-        p->type.opts = malloc(sizeof(*opts) * opts_n);
-        assert(p->type.opts);
-        memcpy(p->type.opts, opts, sizeof(*opts) * opts_n);
+        type.opts = malloc(sizeof(*opts) * opts_n);
+        assert(type.opts);
+        memcpy(type.opts, opts, sizeof(*opts) * opts_n);
 
-        p->type.vals = malloc(sizeof(*vals) * opts_n);
-        assert(p->type.vals);
-        memcpy(p->type.vals, vals, sizeof(*vals) * opts_n);
+        type.vals = malloc(sizeof(*vals) * opts_n);
+        assert(type.vals);
+        memcpy(type.vals, vals, sizeof(*vals) * opts_n);
     }
 
+    p->type = type_intern(type);
+
     return NULL;
 }
 
+//Element type of vector type name v#type, setting n to #. TYPE_NUM if t
+//does not name a vector.
+static enum type_primative vec_type(struct token t, int *n) {
+    uint32_t i = 1;
+    if(t.len < 2 || t.str[0] != 'v' || t.str[1] < '1' || t.str[1] > '9') return TYPE_NUM;
+
+    for(*n = 0; i < t.len && t.str[i] >= '0' && t.str[i] <= '9'; i++)
+        if(*n <= TYPE_VEC_MAX) *n = *n * 10 + t.str[i] - '0';
+
+    for(enum type_primative pt = TYPE_INT; pt < TYPE_NUM; pt++)
+        if(t.len - i == strlen(type_primative_str[pt])
+                && strncmp(type_primative_str[pt], t.str + i, t.len - i) == 0)
+            return pt;
+    return TYPE_NUM;
+}
+
 static char *parse_type_expr(struct parse *p) {
     char *err = NULL;
 
-    token_stream_mark(p->ts);
+    parse_mark(p);
     struct token t = token_stream_next(p->ts);
 
     bool ignore_nl = false;
-    p->type.type = TYPE_ERR;
+    p->type = type_intern((struct type){TYPE_ERR});
+
+    struct type type = {TYPE_ERR};
 
     switch(t.type) {
 
@@ -539,42 +1173,66 @@ static char *parse_type_expr(struct parse *p) {
                     break;
 
             if(pt != TYPE_NUM) {
-                p->type.type = TYPE_PRIMATIVE;
-                p->type.primative = pt;
+                p->type = type_prim(pt);
                 break;
             }
 
-            p->type.type = TYPE_IDENT;
-            p->type.ident = token_str(t);
-            p->type.mod = NULL;
+            int n;
+            if((pt = vec_type(t, &n)) != TYPE_NUM) {
+                if(n < 2 || n > TYPE_VEC_MAX || (n & (n - 1)))
+                    ERRF("Vector length must be a power of two from 2 to %i", TYPE_VEC_MAX);
+                p->type = type_vec(pt, n);
+                break;
+            }
+
+            type.type = TYPE_IDENT;
+            type.ident = token_str(t);
+            type.mod = NULL;
+            type.def = NULL;
+            type.tok = t;
 
             MAYBE(TOKEN_RARR) {
                 EXPECT(TOKEN_IDENT);
-                p->type.mod = p->type.ident;
-                p->type.ident = token_str(t);
+                type.mod = type.ident;
+                type.ident = token_str(t);
             }
 
+            p->type = type_intern(type);
+            type_use(p, p->type, type.tok);
             break;
         }
 
         case TOKEN_MUL:
             parse_type_expr(p);
-            p->type.of = type_alloc(p->type);
-            p->type.type = TYPE_PTR;
+            type.type = TYPE_PTR;
+            type.of = p->type;
+            type.n = 0;
+            p->type = type_intern(type);
             break;
 
         case TOKEN_LBRA:
-            p->type.n = -1;
-            MAYBE(TOKEN_NUM) {
-                char *s = token_str(t);
-                p->type.n = atoi(s);
-                free(s);
+            type.n = -1;
+            type.len = NULL;
+            MAYBE(TOKEN_RBRA); else {
+                //Literal lengths are kept in n, so [4]int is the same type
+                //wherever it appears. Others are bound by fold().
+                struct expr e = p->expr;
+                MUST(parse_expr);
+                if(p->expr.type == EXPR_NUM) {
+                    char *s = token_str(p->expr.lit);
+                    type.n = atoi(s);
+                    free(s);
+                } else {
+                    type.len = expr_alloc(p->expr);
+                }
+                p->expr = e;
+                EXPECT(TOKEN_RBRA);
             }
-            EXPECT(TOKEN_RBRA);
 
             parse_type_expr(p);
-            p->type.of = type_alloc(p->type);
-            p->type.type = TYPE_ARRAY;
+            type.type = TYPE_ARRAY;
+            type.of = p->type;
+            p->type = type_intern(type);
 
             break;
 
@@ -582,7 +1240,7 @@ static char *parse_type_expr(struct parse *p) {
             EXPECT(TOKEN_LPAREN);
 
             //Parse args
-            struct type args[BUF_MAX];
+            struct type *args[BUF_MAX];
             int args_n = 0;
 
             for(;;){
@@ -595,7 +1253,7 @@ static char *parse_type_expr(struct parse *p) {
             }
 
             //Parse returns
-            struct type ret[BUF_MAX];
+            struct type *ret[BUF_MAX];
             int ret_n = 0;
 
             MAYBE(TOKEN_LPAREN) {
@@ -612,24 +1270,25 @@ static char *parse_type_expr(struct parse *p) {
                 ret[ret_n++] = p->type;
             }
 
-            p->type.type = TYPE_FUNC;
-            p->type.args = NULL;
-            p->type.args_n = args_n;
-            p->type.ret = NULL;
-            p->type.ret_n = ret_n;
+            type.type = TYPE_FUNC;
+            type.args = NULL;
+            type.args_n = args_n;
+            type.ret = NULL;
+            type.ret_n = ret_n;
 
             if(args_n > 0) {
-                p->type.args = malloc(sizeof(*args) * args_n);
-                assert(p->type.args);
-                memcpy(p->type.args, args, sizeof(*args) * args_n);
+                type.args = malloc(sizeof(*args) * args_n);
+                assert(type.args);
+                memcpy(type.args, args, sizeof(*args) * args_n);
             }
 
             if(ret_n > 0) {
-                p->type.ret = malloc(sizeof(*ret) * ret_n);
-                assert(p->type.ret);
-                memcpy(p->type.ret, ret, sizeof(*ret) * ret_n);
+                type.ret = malloc(sizeof(*ret) * ret_n);
+                assert(type.ret);
+                memcpy(type.ret, ret, sizeof(*ret) * ret_n);
             }
 
+            p->type = type_intern(type);
             break;
         }
 
@@ -652,7 +1311,7 @@ static char *parse_type_expr(struct parse *p) {
 
 static char *parse_typedef(struct parse *p) {
     struct token t;
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     bool ignore_nl = false;
     EXPECT(TOKEN_TYPEDEF);
@@ -668,14 +1327,14 @@ static char *parse_typedef(struct parse *p) {
     token_stream_unmark(p->ts);
 
     ts_set(&p->types, ident, p->type);
-    p->type.type = TYPE_NONE;
+    p->type = type_none();
 
     return NULL;
 }
 
 static char *parse_struct(struct parse *p) {
     struct token t;
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     bool ignore_nl = false;
     EXPECT(TOKEN_STRUCT);
@@ -691,14 +1350,14 @@ static char *parse_struct(struct parse *p) {
     token_stream_unmark(p->ts);
 
     ts_set(&p->types, ident, p->type);
-    p->type.type = TYPE_NONE;
+    p->type = type_none();
 
     return NULL;
 }
 
 static char *parse_enum(struct parse *p) {
     struct token t;
-    token_stream_mark(p->ts);
+    parse_mark(p);
 
     bool ignore_nl = false;
     EXPECT(TOKEN_ENUM);
@@ -714,7 +1373,7 @@ static char *parse_enum(struct parse *p) {
     token_stream_unmark(p->ts);
 
     ts_set(&p->types, ident, p->type);
-    p->type.type = TYPE_NONE;
+    p->type = type_none();
 
     return NULL;
 }
@@ -725,24 +1384,27 @@ static char *parse_func(struct parse *p) {
     char *err = NULL;
 
     char *args[BUF_MAX];
-    struct type args_type[BUF_MAX];
+    struct type *args_type[BUF_MAX];
     int args_n = 0;
 
-    struct type ret_type[BUF_MAX];
+    struct type *ret_type[BUF_MAX];
     int ret_n = 0;
 
     char *mod = NULL, *type_ident = NULL, *ident = NULL;
-    struct token t;
-    token_stream_mark(p->ts);
+    struct token t, type_tok;
+    parse_mark(p);
 
     bool ignore_nl = false;
     EXPECT(TOKEN_FUNC);
+    bool export = false;
+    MAYBE(TOKEN_EXPORT) export = true;
 
     //Parse ident, type->ident, or mod->type->ident
 
     EXPECT(TOKEN_IDENT);
     ident = token_str(t);
     assert(ident);
+    type_tok = t;
 
     MAYBE(TOKEN_RARR){
         type_ident = ident;
@@ -759,12 +1421,23 @@ static char *parse_func(struct parse *p) {
         assert(ident);
     }
 
+    //Methods take the receiver, named after its type, as first argument
+    struct type *recv = NULL;
+    if(type_ident) {
+        recv = type_intern((struct type){TYPE_IDENT,
+                .mod=mod ? strdup(mod) : NULL, .ident=strdup(type_ident),
+                .def=NULL, .tok=type_tok});
+        type_use(p, recv, type_tok);
+        args[args_n] = strdup(type_ident);
+        args_type[args_n++] = recv;
+    }
+
     //Parse arguments
     EXPECT(TOKEN_LPAREN);
     for(;;) {
         MAYBE(TOKEN_RPAREN) break;
 
-        if(args_n > 0) EXPECT(TOKEN_COMMA);
+        if(args_n > (recv != NULL)) EXPECT(TOKEN_COMMA);
 
         assert(args_n < BUF_MAX);
 
@@ -772,7 +1445,7 @@ static char *parse_func(struct parse *p) {
         args[args_n] = token_str(t);
 
         if(parse_type_expr(p))
-            args_type[args_n++] = (struct type){TYPE_NONE};
+            args_type[args_n++] = type_none();
         else
             args_type[args_n++] = p->type;
 
@@ -804,6 +1477,7 @@ static char *parse_func(struct parse *p) {
     struct val val = {};
 
     val.type = VAL_FUNC;
+    val.export = export;
     val.mod = mod;
     val.type_ident = type_ident;
     val.args_n = args_n;
@@ -825,7 +1499,45 @@ static char *parse_func(struct parse *p) {
         memcpy(val.ret_type, ret_type, sizeof(*ret_type) * ret_n);
     }
 
-    ns_set(&p->globals, ident, val);
+    if(recv) mt_set(&p->methods, recv, ident, val);
+    else ns_set(&p->globals, ident, val);
+
+    return NULL;
+}
+
+//Parse a line of compile time code, starting with #, and run it. It may
+//continue on following lines starting with #.
+static char *parse_hash(struct parse *p) {
+    assert(p);
+
+    char *err = NULL;
+    struct token t;
+    parse_mark(p);
+
+    bool ignore_nl = false;
+    EXPECT(TOKEN_HASH);
+
+    p->ts->ct = true;
+    err = parse_block_items(p, t, false);
+    p->ts->ct = false;
+    if(err) {
+        parse_rewind(p);
+        return err;
+    }
+
+    EXPECT(TOKEN_NEWLINE);
+    token_stream_unmark(p->ts);
+
+    //One expression runs as is, rather than as a block
+    struct expr e = p->expr;
+    if(e.vals_n == 1) {
+        e = e.vals[0];
+        free(p->expr.vals);
+    }
+
+    p->expr = (struct expr){EXPR_NONE};
+    ct_run(p, &e);
+    expr_free(&e);
 
     return NULL;
 }
@@ -842,7 +1554,8 @@ int parse(struct parse *p) {
         if(token_stream_peek(p->ts).type == TOKEN_EOF)
             break;
 
-        char *err = parse_include(p);
+        char *err = parse_hash(p);
+        if(err) err = parse_include(p);
         if(err) err = parse_typedef(p);
         if(err) err = parse_struct(p);
         if(err) err = parse_enum(p);
@@ -855,10 +1568,13 @@ int parse(struct parse *p) {
 
         if(err){
             p->error(p->ts, token_stream_next(p->ts), err);
-            while(token_stream_next(p->ts).type != TOKEN_NEWLINE);
+            for(enum token_type tt = TOKEN_ERR; tt != TOKEN_NEWLINE && tt != TOKEN_EOF;)
+                tt = token_stream_next(p->ts).type;
             errnum++;
         }
+
+        timing_count(TIMING_PARSE, 1);
     }
 
-    return errnum;
+    return errnum + p->ct.errnum;
 }
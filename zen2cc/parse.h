@@ -4,20 +4,40 @@
 #include "expr.h"
 #include "ts.h"
 #include "ns.h"
+#include "mt.h"
+#include "mono.h"
+#include "ct.h"
 
 typedef void (*error_func)(struct token_stream *ts, struct token, char*);
 
+#define PARSE_USES_INITIAL_CAP 16
+
+//Named type as written. Types are interned, so only these keep where each
+//use is, for resolve() to report every use of one that is not defined.
+struct type_use {
+    struct type *t;
+    struct token tok;
+};
+
 struct parse{
     struct token_stream *ts;
     struct ns globals;
     struct ts types;
-    error_func error;
+    struct mt methods;
+    struct mono instances;
+    struct ct ct;
+    struct ir_func *init;           //Stores the globals initialized at run time, made by ir() for native code
+    error_func error, warn;
+
+    struct type_use *uses;          //Named types used, in source order
+    int uses_n, uses_c;
+    int uses_at[TOKEN_MARK_MAX];    //uses_n at each mark of ts, restored on rewind
 
-    struct type type;
+    struct type *type;
     struct expr expr;
 };
 
-void parse_init(struct parse *p, struct token_stream *ts, error_func err);
+void parse_init(struct parse *p, struct token_stream *ts, error_func err, error_func warn);
 void parse_free(struct parse *p);
 
 int parse(struct parse *p);
@@ -0,0 +1,419 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "resolve.h"
+#include "timing.h"
+
+//Name resolution pass. Binds every EXPR_IDENT to its symbol (a global, an
+//argument of the enclosing function, or a local defined with :=) and every
+//TYPE_IDENT to its definition,
+//so later passes never look names up by string. Names that can not be
+//resolved are collected and reported together in source order.
+
+struct unresolved {
+    struct token t;
+    char *what;
+    int row, col, n;        //Where t is in the file, and order reported
+};
+
+struct resolve {
+    struct parse *p;
+    struct val *func;       //Function whose body is being resolved, or NULL
+
+    struct unresolved *u;
+    int u_c, u_n;
+
+    struct type **idents;   //TYPE_IDENT nodes reached
+    int idents_c, idents_n;
+
+    struct expr **scope;    //Locals in scope, innermost last
+    int scope_c, scope_n;
+
+    int errnum;
+};
+
+#define UNRESOLVED_INITIAL_CAP 16
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static void unresolved(struct resolve *r, struct token t, char *what) {
+    if(r->u_n >= r->u_c) {
+        int new_c = r->u_c * 2;
+        if(new_c < UNRESOLVED_INITIAL_CAP) new_c = UNRESOLVED_INITIAL_CAP;
+        r->u = realloc(r->u, new_c * sizeof *r->u);
+        assert(r->u);
+        r->u_c = new_c;
+    }
+
+    struct unresolved u = {t, what, .n = r->u_n};
+    token_pos(r->p->ts, t, &u.row, &u.col);
+    r->u[r->u_n++] = u;
+}
+
+//By line and column in the file, text spliced in by compile time code being
+//where it is spliced, then in the order found
+static int unresolved_cmp(const void *a, const void *b) {
+    const struct unresolved *ua = a, *ub = b;
+    if(ua->row != ub->row) return ua->row < ub->row ? -1 : 1;
+    if(ua->col != ub->col) return ua->col < ub->col ? -1 : 1;
+    return (ua->n > ub->n) - (ua->n < ub->n);
+}
+
+static bool tok_is(struct token t, char *s) {
+    return t.len == strlen(s) && strncmp(t.str, s, t.len) == 0;
+}
+
+static void resolve_expr(struct resolve *r, struct expr *e);
+static void resolve_type(struct resolve *r, struct type *t);
+
+//Bind e to a local or an argument of the enclosing function, if it names one
+static bool resolve_arg(struct resolve *r, struct expr *e) {
+    e->local = NULL;
+    for(int i = r->scope_n - 1; i >= 0; i--) {
+        if(r->scope[i]->lit.len == e->lit.len
+                && strncmp(r->scope[i]->lit.str, e->lit.str, e->lit.len) == 0) {
+            e->val = r->func;
+            e->local = r->scope[i];
+            return true;
+        }
+    }
+
+    if(!r->func) return false;
+
+    for(int i = 0; i < r->func->args_n; i++) {
+        if(tok_is(e->lit, r->func->args[i])) {
+            e->val = r->func;
+            e->arg = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void resolve_ident(struct resolve *r, struct expr *e) {
+    timing_count(TIMING_RESOLVE, 1);
+
+    e->val = NULL;
+    e->arg = -1;
+
+    if(resolve_arg(r, e)) return;
+
+    char *ident = token_str(e->lit);
+    e->val = ns_get(&r->p->globals, ident);
+    free(ident);
+
+    if(!e->val) unresolved(r, e->lit, "identifier");
+}
+
+//Bind type->method to the method, if the type has one by that name
+static void resolve_tacc(struct resolve *r, struct expr *e) {
+    resolve_type(r, e->tacc.t);
+
+    struct expr *m = e->tacc.m;
+    char *ident = token_str(m->lit);
+    m->val = mt_get(&r->p->methods, e->tacc.t, ident);
+    m->arg = -1;
+    free(ident);
+}
+
+//ident->ident is parsed as method access. Rebind it to a module's symbol
+//(mod->ident) or type access (type->ident) when the left hand side names a
+//module or type rather than a value. Methods of values are bound by sema(),
+//once the type of the value is known. Symbols of a module the driver loaded
+//must be exported, and functions other modules can call are bound to their
+//definition in it.
+static void resolve_macc(struct resolve *r, struct expr *e) {
+    struct expr *l = e->l;
+    if(l->type != EXPR_IDENT) {
+        resolve_expr(r, l);
+        return;
+    }
+
+    timing_count(TIMING_RESOLVE, 1);
+    l->val = NULL;
+    l->arg = -1;
+    if(resolve_arg(r, l)) return;
+
+    char *ident = token_str(l->lit);
+    struct val *v = ns_get(&r->p->globals, ident);
+
+    if(v && v->type == VAL_MODULE) {
+        struct expr *m = e->r;
+        e->type = EXPR_IDENT;
+        e->lit = m->lit;
+        e->val = v;
+        if(v->loaded) {
+            char *name = token_str(m->lit);
+            struct val *f = ns_get(&v->loaded->globals, name);
+            if(!f || !f->export) unresolved(r, m->lit, "identifier");
+            else if(val_is_portable(f)) e->val = f;
+            free(name);
+        }
+        e->arg = -1;
+        e->local = NULL;
+        free(m); free(l); free(ident);
+        return;
+    }
+
+    if(!v && ts_get(&r->p->types, ident)) {
+        struct expr *m = e->r;
+        e->type = EXPR_TACC;
+        e->tacc.t = type_intern((struct type){TYPE_IDENT,
+                .ident=ident, .mod=NULL, .def=NULL, .tok=l->lit});
+        e->tacc.m = m;
+        free(l);
+        resolve_tacc(r, e);
+        return;
+    }
+
+    free(ident);
+    resolve_ident(r, l);
+}
+
+//_ among a tuple defined or assigned to
+static bool is_discard(struct expr *e) {
+    return e->type == EXPR_IDENT && e->lit.len == 1 && e->lit.str[0] == '_';
+}
+
+//Make l a local of its own, defined where it is
+static void bind_self(struct resolve *r, struct expr *l) {
+    timing_count(TIMING_RESOLVE, 1);
+    l->val = r->func;
+    l->arg = -1;
+    l->local = l;
+}
+
+static void bind_local(struct resolve *r, struct expr *l) {
+    bind_self(r, l);
+
+    if(r->scope_n >= r->scope_c) {
+        r->scope_c = r->scope_c ? r->scope_c * 2 : UNRESOLVED_INITIAL_CAP;
+        r->scope = realloc(r->scope, r->scope_c * sizeof *r->scope);
+        assert(r->scope);
+    }
+    r->scope[r->scope_n++] = l;
+}
+
+//Bring the locals defined by e into scope, after resolving its value so that
+//x := x + 1 refers to an outer x
+static void resolve_define(struct resolve *r, struct expr *e) {
+    resolve_expr(r, e->r);
+
+    if(e->l->type != EXPR_TUPLE) bind_local(r, e->l);
+    else for(int i = 0; i < e->l->vals_n; i++) {
+        if(is_discard(&e->l->vals[i])) bind_self(r, &e->l->vals[i]);
+        else bind_local(r, &e->l->vals[i]);
+    }
+}
+
+//Each _ assigned to in a tuple is a local in no scope, so its value is
+//discarded
+static void resolve_assign(struct resolve *r, struct expr *e) {
+    resolve_expr(r, e->r);
+    if(e->l->type != EXPR_TUPLE) {
+        resolve_expr(r, e->l);
+        return;
+    }
+    for(int i = 0; i < e->l->vals_n; i++) {
+        if(is_discard(&e->l->vals[i])) bind_self(r, &e->l->vals[i]);
+        else resolve_expr(r, &e->l->vals[i]);
+    }
+}
+
+static void resolve_opt(struct resolve *r, struct expr *e) {
+    if(e) resolve_expr(r, e);
+}
+
+static void resolve_expr(struct resolve *r, struct expr *e) {
+    assert(e);
+
+    switch(e->type) {
+    case EXPR_NONE: case EXPR_NUM: case EXPR_STR: return;
+    case EXPR_IDENT: resolve_ident(r, e); return;
+
+    case EXPR_POSTINC: case EXPR_POSTDEC:
+    case EXPR_PREINC: case EXPR_PREDEC:
+    case EXPR_LNOT: case EXPR_BNOT: case EXPR_NEG:
+    case EXPR_DEFER: case EXPR_ADDR:
+        resolve_expr(r, e->l);
+        return;
+
+    case EXPR_FCALL:
+        resolve_expr(r, e->f);
+        for(int i = 0; i < e->args_n; i++) resolve_expr(r, &e->args[i]);
+        return;
+
+    case EXPR_ARRSUB: EXPR_CASE_BINARY: resolve_expr(r, e->l); resolve_expr(r, e->r); return;
+
+    //Member names are resolved against the type by sema()
+    case EXPR_SACC: resolve_expr(r, e->l); return;
+    case EXPR_TACC: resolve_tacc(r, e); return;
+    case EXPR_MACC: resolve_macc(r, e); return;
+
+    case EXPR_COMP_LIT:
+        resolve_type(r, e->t);
+        for(int i = 0; i < e->vals_n; i++) resolve_expr(r, &e->vals[i]);
+        return;
+    case EXPR_TUPLE:
+        for(int i = 0; i < e->vals_n; i++) resolve_expr(r, &e->vals[i]);
+        return;
+
+    case EXPR_CAST:
+        resolve_type(r, e->tacc.t);
+        resolve_expr(r, e->tacc.m);
+        return;
+
+    case EXPR_ASSIGN: resolve_assign(r, e); return;
+    case EXPR_DEFINE: resolve_define(r, e); return;
+
+    //Locals defined in a block, or in the init of a for, are scoped to it
+    case EXPR_BLOCK: {
+        int n = r->scope_n;
+        for(int i = 0; i < e->vals_n; i++) resolve_expr(r, &e->vals[i]);
+        r->scope_n = n;
+        return;
+    }
+
+    EXPR_CASE_CTL: {
+        int n = r->scope_n;
+        resolve_opt(r, e->ctl.init);
+        resolve_opt(r, e->ctl.cond);
+        resolve_opt(r, e->ctl.step);
+        resolve_opt(r, e->ctl.body);
+        resolve_opt(r, e->ctl.els);
+        r->scope_n = n;
+        return;
+    }
+    }
+
+    assert(0); //Should not be reached
+}
+
+//Bind TYPE_IDENT nodes reachable from t to their definitions
+static void resolve_type(struct resolve *r, struct type *t) {
+    if(!type_visit(t)) return;
+
+    switch(t->type) {
+    case TYPE_IDENT:
+        timing_count(TIMING_RESOLVE, 1);
+        if(t->mod) break;
+        t->def = ts_get(&r->p->types, t->ident);
+        if(!t->def) break;
+
+        if(r->idents_n >= r->idents_c) {
+            r->idents_c = r->idents_c ? r->idents_c * 2 : UNRESOLVED_INITIAL_CAP;
+            r->idents = realloc(r->idents, r->idents_c * sizeof *r->idents);
+            assert(r->idents);
+        }
+        r->idents[r->idents_n++] = t;
+        break;
+
+    case TYPE_ARRAY: if(t->len) resolve_expr(r, t->len);
+        //fallthrough
+    case TYPE_PTR: resolve_type(r, t->of); break;
+
+    case TYPE_FUNC:
+        for(int i = 0; i < t->args_n; i++) resolve_type(r, t->args[i]);
+        for(int i = 0; i < t->ret_n; i++) resolve_type(r, t->ret[i]);
+        break;
+
+    case TYPE_STRUCT:
+        for(int i = 0; i < t->mem_n; i++) resolve_type(r, t->types[i]);
+        break;
+
+    case TYPE_ENUM:
+        for(int i = 0; i < t->opts_n; i++) resolve_expr(r, &t->vals[i]);
+        if(t->enum_type) resolve_type(r, t->enum_type);
+        break;
+
+    default: break;
+    }
+}
+
+//Break typedef cycles (typedef a b, typedef b a), so following def always
+//terminates
+static void resolve_type_cycle(struct resolve *r, struct type *t) {
+    if(!t->def) return;
+
+    struct type *slow = t, *fast = t;
+    for(;;) {
+        if(fast->type != TYPE_IDENT || !fast->def) return;
+        fast = fast->def;
+        if(fast->type != TYPE_IDENT || !fast->def) return;
+        fast = fast->def;
+        slow = slow->def;
+        if(slow == fast) break;
+    }
+
+    snprintf(err_buf, ERRBUF_SIZE, "Cyclic type definition of '%s'", t->ident);
+    r->p->error(r->p->ts, t->tok, err_buf);
+    r->errnum++;
+    t->def = NULL;
+}
+
+static void resolve_val(struct resolve *r, struct val *v) {
+    switch(v->type) {
+    case VAL_CONST: case VAL_VAR:
+        resolve_type(r, v->expr_type);
+        resolve_expr(r, &v->expr);
+        break;
+    case VAL_FUNC:
+        for(int j = 0; j < v->args_n; j++) resolve_type(r, v->args_type[j]);
+        for(int j = 0; j < v->ret_n; j++) resolve_type(r, v->ret_type[j]);
+        r->func = v;
+        resolve_expr(r, &v->func_expr);
+        r->func = NULL;
+        break;
+    default: break;
+    }
+}
+
+//Resolve all names in the global namespace, types and function bodies.
+//Returns number of errors, which are reported through p->error
+int resolve(struct parse *p) {
+    assert(p);
+
+    timing_start(TIMING_RESOLVE);
+
+    struct resolve r = {p};
+    struct ns *ns = &p->globals;
+
+    type_visit_begin();
+
+    for(int i = 0; i < p->types.n; i++)
+        resolve_type(&r, p->types.val[i]);
+
+    for(int i = 0; i < ns->n; i++) resolve_val(&r, &ns->val[i]);
+    for(int i = 0; i < p->methods.n; i++) resolve_val(&r, &p->methods.val[i]);
+
+    //Types are interned, so each use of a named type not defined is found
+    //from where the parser saw it rather than from the node
+    for(int i = 0; i < p->uses_n; i++) {
+        struct type *t = p->uses[i].t;
+        resolve_type(&r, t);
+        struct val *v = t->mod ? ns_get(ns, t->mod) : NULL;
+        if(t->mod && (!v || v->type != VAL_MODULE)) unresolved(&r, p->uses[i].tok, "module");
+        else if(!t->mod && !t->def) unresolved(&r, p->uses[i].tok, "type");
+    }
+
+    for(int i = 0; i < r.idents_n; i++) resolve_type_cycle(&r, r.idents[i]);
+    free(r.idents);
+    free(r.scope);
+
+    if(r.u_n) qsort(r.u, r.u_n, sizeof *r.u, unresolved_cmp);
+    for(int i = 0; i < r.u_n; i++) {
+        struct token t = r.u[i].t;
+        snprintf(err_buf, ERRBUF_SIZE, "Unresolved %s '%.*s'", r.u[i].what, t.len, t.str);
+        p->error(p->ts, t, err_buf);
+    }
+    r.errnum += r.u_n;
+    free(r.u);
+
+    timing_stop(TIMING_RESOLVE);
+
+    return r.errnum;
+}
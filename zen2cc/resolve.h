@@ -0,0 +1,5 @@
+#pragma once
+
+#include "parse.h"
+
+int resolve(struct parse *p);
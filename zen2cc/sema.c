@@ -0,0 +1,657 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fold.h"
+#include "layout.h"
+#include "sema.h"
+#include "timing.h"
+
+//Type inference pass. Expression types are inferred bottom up and memoized
+//in expr->ty, so every node is visited exactly once no matter how often the
+//const or var containing it is referenced.
+
+struct sema {
+    struct parse *p;
+    int errnum;
+    int consts;         //Depth in const definitions, which fold() computes exactly
+};
+
+//Marks an expression whose type is currently being inferred
+static struct type visiting;
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static void sema_error(struct sema *s, struct token t, char *msg) {
+    s->p->error(s->p->ts, t, msg);
+    s->errnum++;
+}
+
+static struct type *infer(struct sema *s, struct expr *e);
+
+//Follow TYPE_IDENT definitions bound by resolve() to the underlying type.
+//Identifiers in other modules, or unresolved, are returned as is.
+struct type *sema_resolve(struct type *t) {
+    while(t->type == TYPE_IDENT && t->def) t = t->def;
+    return t;
+}
+
+//Whether t is a string, an array of or pointer to uint8
+bool sema_is_string(struct type *t) {
+    t = sema_resolve(t);
+    if(t->type != TYPE_ARRAY && t->type != TYPE_PTR) return false;
+    struct type *of = sema_resolve(t->of);
+    return of->type == TYPE_PRIMATIVE && of->primative == TYPE_UINT8;
+}
+
+static bool num_is_float(struct token t) {
+    bool hex = t.len > 1 && t.str[0] == '0' && (t.str[1] == 'x' || t.str[1] == 'X');
+    for(uint32_t i = 0; i < t.len; i++) {
+        char c = t.str[i];
+        if(c == '.') return true;
+        if(hex && (c == 'p' || c == 'P')) return true;
+        if(!hex && (c == 'e' || c == 'E')) return true;
+    }
+    return false;
+}
+
+//Type of integer c, the one C gives the literal written for it: int, or
+//int64 or uint64 if it does not fit in an int
+static struct type *int_type(struct cval *c) {
+    int64_t i;
+    if(c->type != CVAL_INT) return type_prim(TYPE_INT);
+    if(bn_to_int64(&c->num, &i)) return type_prim(i >= INT32_MIN && i <= INT32_MAX ? TYPE_INT : TYPE_INT64);
+    return type_prim(!c->num.neg && bn_bits(&c->num) <= 64 ? TYPE_UINT64 : TYPE_INT);
+}
+
+static struct type *num_type(struct token t) {
+    if(num_is_float(t)) return type_prim(TYPE_FLOAT);
+    struct cval c;
+    cval_init(&c);
+    struct type *r = cval_parse(&c, t) ? type_prim(TYPE_INT) : int_type(&c);
+    cval_free(&c);
+    return r;
+}
+
+//Whether e is made of integer constants, which C evaluates in the type
+//written rather than widening
+static bool is_const(struct expr *e) {
+    switch(e->type) {
+    case EXPR_NUM: return true;
+    case EXPR_IDENT: return !e->local && e->arg < 0 && e->val && e->val->type == VAL_CONST;
+    case EXPR_NEG: case EXPR_BNOT: return is_const(e->l);
+    EXPR_CASE_BINARY: return is_const(e->r) && is_const(e->l);
+    default: return false;
+    }
+}
+
+//Number of bytes in a string literal after escape processing
+static int str_len(struct token t) {
+    if(t.type != TOKEN_STR_ESC) return t.len;
+
+    int n = 0;
+    for(uint32_t i = 0; i < t.len; i++, n++) {
+        if(t.str[i] != '\\' || i+1 >= t.len) continue;
+        i++;
+        if(t.str[i] == 'x') {
+            for(int j = 0; j < 2 && i+1 < t.len && strchr("0123456789abcdefABCDEF", t.str[i+1]); j++) i++;
+        } else if(t.str[i] >= '0' && t.str[i] <= '7') {
+            for(int j = 0; j < 2 && i+1 < t.len && t.str[i+1] >= '0' && t.str[i+1] <= '7'; j++) i++;
+        }
+    }
+    return n;
+}
+
+static struct type *array_of(struct type *of, int n) {
+    return type_intern((struct type){TYPE_ARRAY, .of=of, .n=n});
+}
+
+//Type of a tuple of the n types ts, a struct of members _0, _1...
+struct type *sema_tuple(struct type **ts, int n) {
+    struct type t = {TYPE_STRUCT, .mem_n = n};
+    t.idents = malloc(n * sizeof *t.idents);
+    t.types = malloc(n * sizeof *t.types);
+    assert(t.idents); assert(t.types);
+    for(int i = 0; i < n; i++) {
+        t.idents[i] = malloc(16);
+        assert(t.idents[i]);
+        snprintf(t.idents[i], 16, "_%i", i);
+        t.types[i] = ts[i];
+    }
+    return type_intern(t);
+}
+
+//Whether t is the type of a tuple, made by sema_tuple()
+bool sema_is_tuple(struct type *t) {
+    t = sema_resolve(t);
+    return t->type == TYPE_STRUCT && t->mem_n > 1 && strcmp(t->idents[0], "_0") == 0;
+}
+
+static struct type *ptr_to(struct type *of) {
+    return type_intern((struct type){TYPE_PTR, .of=of});
+}
+
+//Type of function v, without its first skip arguments
+static struct type *func_type(struct val *v, int skip) {
+    struct type t = {TYPE_FUNC};
+    t.args_n = v->args_n - skip;
+    t.ret_n = v->ret_n;
+    t.args = NULL;
+    t.ret = NULL;
+
+    if(t.args_n > 0) {
+        t.args = malloc(sizeof(*t.args) * t.args_n);
+        assert(t.args);
+        memcpy(t.args, v->args_type + skip, sizeof(*t.args) * t.args_n);
+    }
+
+    if(v->ret_n > 0) {
+        t.ret = malloc(sizeof(*t.ret) * v->ret_n);
+        assert(t.ret);
+        memcpy(t.ret, v->ret_type, sizeof(*t.ret) * v->ret_n);
+    }
+
+    return type_intern(t);
+}
+
+//Whether function type t has untyped arguments, whose calls are checked as
+//they are bound to an instance by mono()
+static bool is_generic(struct type *t) {
+    for(int i = 0; i < t->args_n; i++)
+        if(t->args[i]->type == TYPE_NONE) return true;
+    return false;
+}
+
+static bool tok_is(struct token t, char *s) {
+    return t.len == strlen(s) && strncmp(t.str, s, t.len) == 0;
+}
+
+//Type of the definition of global v
+static struct type *infer_def(struct sema *s, struct val *v) {
+    s->consts += v->type == VAL_CONST;
+    struct type *t = infer(s, &v->expr);
+    s->consts -= v->type == VAL_CONST;
+    return t;
+}
+
+static struct type *infer_global(struct sema *s, struct expr *e, struct val *v) {
+    switch(v->type) {
+    case VAL_CONST:
+        //Errors in consts, including cycles, were reported by fold()
+        if(v->cval && v->cval->type == CVAL_NONE) return type_intern((struct type){TYPE_ERR});
+        //fallthrough
+    case VAL_VAR:
+        if(v->expr.ty == &visiting) {
+            snprintf(err_buf, ERRBUF_SIZE, "Cyclic definition of '%.*s'", e->lit.len, e->lit.str);
+            sema_error(s, e->lit, err_buf);
+            return type_intern((struct type){TYPE_ERR});
+        }
+
+        if(v->expr_type->type != TYPE_NONE) {
+            infer_def(s, v);
+            return v->expr_type;
+        }
+
+        //Untyped consts are written as their value, typed as C types it
+        if(v->type == VAL_CONST && v->cval && infer_def(s, v) == type_prim(TYPE_INT))
+            return int_type(v->cval);
+        return infer_def(s, v);
+
+    case VAL_FUNC: return func_type(v, 0);
+    default: return type_none();
+    }
+}
+
+static struct type *infer_ident(struct sema *s, struct expr *e) {
+    if(e->local) return e->local->ty && e->local != e ? e->local->ty : type_none();
+    if(!e->val) return type_none();
+    if(e->arg >= 0) return e->val->args_type[e->arg];
+    return infer_global(s, e, e->val);
+}
+
+static struct type *member_type(struct type *t, struct token m) {
+    if(t->type != TYPE_STRUCT) return NULL;
+    for(int i = 0; i < t->mem_n; i++)
+        if(tok_is(m, t->idents[i])) return t->types[i];
+    return NULL;
+}
+
+static struct type *infer_tacc(struct sema *s, struct expr *e) {
+    struct token m = e->tacc.m->lit;
+    e->tacc.m->ty = type_none();
+
+    if(tok_is(m, "size") || tok_is(m, "align") || tok_is(m, "num") || tok_is(m, "id"))
+        return type_prim(TYPE_UINT);
+    if(tok_is(m, "name")) return array_of(type_prim(TYPE_UINT8), -1);
+    if(layout_offset_of(sema_resolve(e->tacc.t), m) >= 0) return type_prim(TYPE_UINT);
+
+    if(e->tacc.m->val) return func_type(e->tacc.m->val, 0);
+
+    struct type *t = sema_resolve(e->tacc.t);
+    if(t->type == TYPE_ENUM) {
+        for(int i = 0; i < t->opts_n; i++)
+            if(tok_is(m, t->opts[i])) return e->tacc.t;
+    }
+
+    struct type *mt = member_type(t, m);
+    if(mt) return mt;
+
+    //Unresolved types were reported by resolve()
+    if(t->type == TYPE_IDENT || t->type == TYPE_NONE || t->type == TYPE_ERR) return type_none();
+    snprintf(err_buf, ERRBUF_SIZE, "Type has no accessor '%.*s'", m.len, m.str);
+    sema_error(s, m, err_buf);
+    return type_intern((struct type){TYPE_ERR});
+}
+
+//Bind value->method statically through the method table of the value's
+//type, returning the method's type without the receiver
+static struct type *infer_macc(struct sema *s, struct expr *e) {
+    struct type *t = infer(s, e->l);
+    struct expr *m = e->r;
+    m->ty = type_none();
+
+    if(t->type == TYPE_NONE || t->type == TYPE_ERR) return t;
+
+    char *ident = token_str(m->lit);
+    struct val *v = mt_get(&s->p->methods, t, ident);
+    if(!v && t->type == TYPE_PTR) v = mt_get(&s->p->methods, t->of, ident);
+    free(ident);
+
+    if(!v) {
+        snprintf(err_buf, ERRBUF_SIZE, "No method '%.*s' for type", m->lit.len, m->lit.str);
+        sema_error(s, m->lit, err_buf);
+        return type_intern((struct type){TYPE_ERR});
+    }
+
+    m->val = v;
+    m->arg = -1;
+    return func_type(v, 1);
+}
+
+static bool type_is_float(struct type *t) {
+    t = sema_resolve(t);
+    return t->type == TYPE_PRIMATIVE && t->primative >= TYPE_FLOAT;
+}
+
+//Type of arithmetic on operands of type a and b. Untyped operands take the
+//type of the other, and floats win over integers.
+static struct type *arith_type(struct type *a, struct type *b) {
+    if(a->type == TYPE_NONE || a->type == TYPE_ERR) return b;
+    if(b->type == TYPE_NONE || b->type == TYPE_ERR) return a;
+    if(!type_is_float(a) && type_is_float(b)) return b;
+    return a;
+}
+
+static bool type_is_vec(struct type *t) {
+    return sema_resolve(t)->type == TYPE_VEC;
+}
+
+//Type of comparing vectors of type t, a vector of signed integers as wide
+//as its elements, all bits set where true
+static struct type *vec_mask(struct type *t) {
+    static const enum type_primative mask[TYPE_NUM] = {
+        [TYPE_INT] = TYPE_INT32, [TYPE_INT8] = TYPE_INT8, [TYPE_INT16] = TYPE_INT16,
+        [TYPE_INT32] = TYPE_INT32, [TYPE_INT64] = TYPE_INT64,
+        [TYPE_UINT] = TYPE_INT32, [TYPE_UINT8] = TYPE_INT8, [TYPE_UINT16] = TYPE_INT16,
+        [TYPE_UINT32] = TYPE_INT32, [TYPE_UINT64] = TYPE_INT64,
+        [TYPE_FLOAT] = TYPE_INT64, [TYPE_FLOAT16] = TYPE_INT16,
+        [TYPE_FLOAT32] = TYPE_INT32, [TYPE_FLOAT64] = TYPE_INT64,
+    };
+    t = sema_resolve(t);
+    return type_vec(mask[t->of->primative], t->n);
+}
+
+//A switch takes the value of its first case if it has a default, as an if
+//does with an else. A fallthrough may only end the body of a case followed
+//by another, and is typed here so infer() reports any other.
+static struct type *infer_switch(struct sema *s, struct expr *e) {
+    struct expr *cases = e->ctl.body->vals;
+    int n = e->ctl.body->vals_n;
+
+    for(int i = 0; i < n; i++) {
+        struct expr *b = cases[i].ctl.body;
+        if(!b->vals_n || b->vals[b->vals_n-1].type != EXPR_FALLTHROUGH) continue;
+        if(i == n - 1 && !e->ctl.els) continue;
+        b->vals[b->vals_n-1].ty = type_prim(TYPE_VOID);
+    }
+
+    //A switch on a string takes its length, unless known from its type
+    bool str = false;
+    if(e->ctl.cond) {
+        struct type *at = infer(s, e->ctl.cond);
+        str = sema_is_string(at);
+        if(e->ctl.step) {
+            struct type *lt = sema_resolve(infer(s, e->ctl.step));
+            if(!str) sema_error(s, expr_tok(e->ctl.step), "Only a switch on a string takes a length");
+            else if(lt->type != TYPE_PRIMATIVE || lt->primative < TYPE_INT || lt->primative >= TYPE_FLOAT)
+                sema_error(s, expr_tok(e->ctl.step), "Length of a string must be an integer");
+        } else if(str && (sema_resolve(at)->type != TYPE_ARRAY || sema_resolve(at)->n < 0))
+            sema_error(s, expr_tok(e->ctl.cond), "Switch on a string of unknown length takes its length");
+    }
+
+    e->ctl.body->ty = type_prim(TYPE_VOID);
+    struct type *t = type_prim(TYPE_VOID);
+    for(int i = 0; i < n; i++) {
+        struct type *ct = infer(s, cases[i].ctl.cond);
+        if(str && !sema_is_string(ct)) sema_error(s, expr_tok(cases[i].ctl.cond), "Case label must be a string");
+        struct type *bt = infer(s, cases[i].ctl.body);
+        if(t == type_prim(TYPE_VOID)) t = bt;
+    }
+
+    //Valued as the first case with a value, as cases before it are empty or
+    //fall through. Without a default, a switch taking no case is valued 0.
+    if(!e->ctl.els) return t;
+    infer(s, e->ctl.els);
+    return n ? t : e->ctl.els->ty;
+}
+
+//(a, b) = t or (a, b) := t, taking each of tuple t. Defined locals take the
+//type of their value.
+static struct type *infer_unpack(struct sema *s, struct expr *e, struct type *t) {
+    struct expr *l = e->l;
+    struct type *rt = sema_resolve(t);
+
+    if(rt->type != TYPE_NONE && rt->type != TYPE_ERR && (!sema_is_tuple(rt) || rt->mem_n != l->vals_n)) {
+        snprintf(err_buf, ERRBUF_SIZE, "Expected %i values, got %i", l->vals_n,
+                sema_is_tuple(rt) ? rt->mem_n : 1);
+        sema_error(s, e->op, err_buf);
+        rt = type_intern((struct type){TYPE_ERR});
+    }
+
+    for(int i = 0; i < l->vals_n; i++) {
+        struct type *mt = rt->type == TYPE_STRUCT ? rt->types[i] : rt;
+        if(l->vals[i].local == &l->vals[i]) l->vals[i].ty = mt;
+        else infer(s, &l->vals[i]);
+    }
+    l->ty = rt;
+    return rt;
+}
+
+//Report msg at the operator of e, typing it as an error
+static struct type *vec_error(struct sema *s, struct expr *e, char *msg) {
+    sema_error(s, e->op, msg);
+    return type_intern((struct type){TYPE_ERR});
+}
+
+//Operators on vectors apply to each element. The operands are vectors of
+//the same type, or a vector and a scalar used for every element.
+static struct type *infer_vec_binary(struct sema *s, struct expr *e, struct type *l, struct type *r) {
+    struct type *v = type_is_vec(l) ? l : r, *o = v == l ? r : l;
+    struct type *rv = sema_resolve(v), *ro = sema_resolve(o);
+
+    if(ro->type == TYPE_VEC && ro != rv)
+        return vec_error(s, e, "Vector operands must have the same type");
+    if(ro->type != TYPE_VEC && ro->type != TYPE_NONE && ro->type != TYPE_ERR
+            && (ro->type != TYPE_PRIMATIVE || ro->primative == TYPE_VOID))
+        return vec_error(s, e, "Vectors can only be combined with vectors or numbers");
+
+    switch(e->type) {
+    case EXPR_AND: case EXPR_OR:
+        return vec_error(s, e, "Logical operators are not defined on vectors");
+    case EXPR_MOD: case EXPR_BSL: case EXPR_BSR:
+    case EXPR_BAND: case EXPR_XOR: case EXPR_BOR:
+        if(type_is_float(rv->of)) return vec_error(s, e, "Operator requires integer vector elements");
+        return v;
+    case EXPR_LT: case EXPR_LE: case EXPR_GT: case EXPR_GE: case EXPR_EQ: case EXPR_NE:
+        return vec_mask(rv);
+    default: return v;
+    }
+}
+
+//What an operand of type t is to an operator, which C would reject if not a
+//scalar. Unresolved and untyped operands are not checked.
+enum operand {OPERAND_NONE, OPERAND_INT, OPERAND_FLOAT, OPERAND_ADDR, OPERAND_ANY};
+
+static enum operand operand(struct type *t) {
+    t = sema_resolve(t);
+    switch(t->type) {
+    case TYPE_PRIMATIVE:
+        if(t->primative == TYPE_VOID) return OPERAND_NONE;
+        return t->primative >= TYPE_FLOAT ? OPERAND_FLOAT : OPERAND_INT;
+    case TYPE_ENUM: return OPERAND_INT;
+    case TYPE_PTR: case TYPE_ARRAY: case TYPE_FUNC: return OPERAND_ADDR;
+    case TYPE_IDENT: case TYPE_NONE: case TYPE_ERR: return OPERAND_ANY;
+    default: return OPERAND_NONE;
+    }
+}
+
+//Why binary operator e can not take operands of type l and r, or NULL
+static char *operands_error(struct expr *e, struct type *l, struct type *r) {
+    enum operand a = operand(l), b = operand(r);
+    if(a == OPERAND_ANY || b == OPERAND_ANY) return NULL;
+    if(a == OPERAND_NONE || b == OPERAND_NONE) return "Operands must be numbers or pointers";
+
+    switch(e->type) {
+    case EXPR_MUL: case EXPR_DIV:
+        if(a == OPERAND_ADDR || b == OPERAND_ADDR) return "Operator requires number operands";
+        return NULL;
+    case EXPR_MOD: case EXPR_BSL: case EXPR_BSR:
+    case EXPR_BAND: case EXPR_XOR: case EXPR_BOR:
+        if(a != OPERAND_INT || b != OPERAND_INT) return "Operator requires integer operands";
+        return NULL;
+    case EXPR_ADD:
+        if((a == OPERAND_ADDR || b == OPERAND_ADDR) && a + b != OPERAND_ADDR + OPERAND_INT)
+            return "Only an integer can be added to a pointer";
+        return NULL;
+    case EXPR_SUB:
+        if(b == OPERAND_ADDR && a != OPERAND_ADDR) return "A pointer can not be subtracted from a number";
+        if(a == OPERAND_ADDR && b == OPERAND_FLOAT) return "Only an integer can be subtracted from a pointer";
+        return NULL;
+    case EXPR_LT: case EXPR_LE: case EXPR_GT: case EXPR_GE: case EXPR_EQ: case EXPR_NE:
+        if(a + b == OPERAND_ADDR + OPERAND_FLOAT) return "A pointer can not be compared with a float";
+        return NULL;
+    default: return NULL;
+    }
+}
+
+static struct type *infer_binary(struct sema *s, struct expr *e) {
+    struct type *l = infer(s, e->l), *r = infer(s, e->r);
+
+    if(type_is_vec(l) || type_is_vec(r)) return infer_vec_binary(s, e, l, r);
+
+    //Operands of consts were checked by fold()
+    char *err = s->consts ? NULL : operands_error(e, l, r);
+    if(err) {
+        sema_error(s, e->op, err);
+        return type_intern((struct type){TYPE_ERR});
+    }
+
+    switch(e->type) {
+    case EXPR_LT: case EXPR_LE: case EXPR_GT: case EXPR_GE:
+    case EXPR_EQ: case EXPR_NE: case EXPR_AND: case EXPR_OR:
+        return type_prim(TYPE_INT);
+    case EXPR_BSL: case EXPR_BSR: break;
+    case EXPR_SUB:
+        //The distance between pointers, ptrdiff_t in C
+        if(operand(l) == OPERAND_ADDR && operand(r) == OPERAND_ADDR) return type_prim(TYPE_INT64);
+        //fallthrough
+    default: l = arith_type(l, r); break;
+    }
+
+    //C computes an expression of int constants in int, wrapping if too wide
+    if(!s->consts && l == type_prim(TYPE_INT) && is_const(e) && fold_overflows(s->p, l, e))
+        sema_error(s, e->op, "Constant expression does not fit in an int");
+    return l;
+}
+
+static struct type *infer_expr(struct sema *s, struct expr *e) {
+    struct type *t;
+
+    switch(e->type) {
+    case EXPR_NONE: return type_none();
+    case EXPR_NUM: return num_type(e->lit);
+    case EXPR_STR: return array_of(type_prim(TYPE_UINT8), str_len(e->lit));
+    case EXPR_IDENT: return infer_ident(s, e);
+
+    case EXPR_POSTINC: case EXPR_POSTDEC:
+    case EXPR_PREINC: case EXPR_PREDEC:
+    case EXPR_BNOT: case EXPR_NEG:
+        return infer(s, e->l);
+
+    EXPR_CASE_BINARY: return infer_binary(s, e);
+
+    case EXPR_LNOT:
+        if(type_is_vec(infer(s, e->l)))
+            return vec_error(s, e, "Logical operators are not defined on vectors");
+        return type_prim(TYPE_INT);
+
+    case EXPR_FCALL:
+        t = sema_resolve(infer(s, e->f));
+        for(int i = 0; i < e->args_n; i++) infer(s, &e->args[i]);
+        if(t->type != TYPE_FUNC) return type_none();
+        if(e->args_n != t->args_n && !is_generic(t)) {
+            snprintf(err_buf, ERRBUF_SIZE, "Expected %i arguments, got %i", t->args_n, e->args_n);
+            sema_error(s, e->f->type == EXPR_MACC ? e->f->r->lit : expr_tok(e->f), err_buf);
+            return type_intern((struct type){TYPE_ERR});
+        }
+        if(t->ret_n == 0) return type_prim(TYPE_VOID);
+        if(t->ret_n == 1) return t->ret[0];
+        return sema_tuple(t->ret, t->ret_n);
+
+    case EXPR_ARRSUB:
+        t = sema_resolve(infer(s, e->l));
+        infer(s, e->r);
+        if(t->type == TYPE_ARRAY || t->type == TYPE_PTR || t->type == TYPE_VEC) return t->of;
+        return type_none();
+
+    case EXPR_SACC:
+        t = sema_resolve(infer(s, e->l));
+        if(t->type == TYPE_PTR) t = sema_resolve(t->of);
+        t = member_type(t, e->r->lit);
+        e->r->ty = t ? t : type_none();
+        return e->r->ty;
+
+    case EXPR_TACC: return infer_tacc(s, e);
+    case EXPR_MACC: return infer_macc(s, e);
+
+    case EXPR_COMP_LIT:
+        for(int i = 0; i < e->vals_n; i++) infer(s, &e->vals[i]);
+        return e->t;
+
+    case EXPR_CAST:
+        infer(s, e->tacc.m);
+        return e->tacc.t;
+
+    case EXPR_DEFER:
+        t = sema_resolve(infer(s, e->l));
+        if(t->type == TYPE_PTR || t->type == TYPE_ARRAY) return t->of;
+        return type_none();
+
+    case EXPR_ADDR:
+        t = infer(s, e->l);
+        if(t->type == TYPE_NONE || t->type == TYPE_ERR) return t;
+        return ptr_to(t);
+
+    case EXPR_ASSIGN:
+        t = infer(s, e->r);
+        if(e->l->type == EXPR_TUPLE) return infer_unpack(s, e, t);
+        return infer(s, e->l);
+
+    //The local takes the type of its value
+    case EXPR_DEFINE:
+        t = infer(s, e->r);
+        if(e->l->type == EXPR_TUPLE) return infer_unpack(s, e, t);
+        e->l->ty = t;
+        return e->l->ty;
+
+    case EXPR_BLOCK:
+        t = type_prim(TYPE_VOID);
+        for(int i = 0; i < e->vals_n; i++) t = infer(s, &e->vals[i]);
+        return t;
+
+    case EXPR_IF:
+        infer(s, e->ctl.cond);
+        t = infer(s, e->ctl.body);
+        if(!e->ctl.els) return type_prim(TYPE_VOID);
+        infer(s, e->ctl.els);
+        return t;
+
+    case EXPR_TUPLE: {
+        struct type *ts[e->vals_n];
+        for(int i = 0; i < e->vals_n; i++) ts[i] = infer(s, &e->vals[i]);
+        return sema_tuple(ts, e->vals_n);
+    }
+
+    case EXPR_SWITCH: return infer_switch(s, e);
+    case EXPR_CASE: return infer(s, e->ctl.body);
+    case EXPR_FALLTHROUGH:
+        sema_error(s, e->ctl.kw, "fallthrough must end a case followed by another");
+        return type_prim(TYPE_VOID);
+
+    case EXPR_FOR:
+        if(e->ctl.init) infer(s, e->ctl.init);
+        if(e->ctl.cond) infer(s, e->ctl.cond);
+        if(e->ctl.step) infer(s, e->ctl.step);
+        infer(s, e->ctl.body);
+        return type_prim(TYPE_VOID);
+    }
+
+    assert(0); //Should not be reached
+    return NULL;
+}
+
+//Infers and memoizes the type of e
+static struct type *infer(struct sema *s, struct expr *e) {
+    assert(e);
+
+    if(e->ty == &visiting) return type_intern((struct type){TYPE_ERR});
+    if(e->ty) return e->ty;
+
+    timing_count(TIMING_SEMA, 1);
+
+    e->ty = &visiting;
+    e->ty = infer_expr(s, e);
+    return e->ty;
+}
+
+//Untyped arguments take the type of the following argument. Trailing
+//untyped arguments are left as TYPE_NONE.
+static void func_arg_types(struct val *v) {
+    for(int i = v->args_n - 2; i >= 0; i--)
+        if(v->args_type[i]->type == TYPE_NONE)
+            v->args_type[i] = v->args_type[i+1];
+}
+
+//Infer types in the body of function v, such as a generic instance.
+//Returns number of errors
+int sema_func(struct parse *p, struct val *v) {
+    assert(p); assert(v);
+
+    struct sema s = {p, 0};
+    infer(&s, &v->func_expr);
+    return s.errnum;
+}
+
+//Infer types of all global expressions, reporting errors through p->error.
+//Returns number of errors
+int sema(struct parse *p) {
+    assert(p);
+
+    timing_start(TIMING_SEMA);
+
+    struct sema s = {p, 0};
+    struct ns *ns = &p->globals;
+
+    for(int i = 0; i < ns->n; i++)
+        if(ns->val[i].type == VAL_FUNC) func_arg_types(&ns->val[i]);
+    for(int i = 0; i < p->methods.n; i++)
+        func_arg_types(&p->methods.val[i]);
+
+    for(int i = 0; i < ns->n; i++) {
+        struct val *v = &ns->val[i];
+        switch(v->type) {
+        case VAL_CONST: case VAL_VAR: infer_def(&s, v); break;
+        case VAL_FUNC: infer(&s, &v->func_expr); break;
+        default: break;
+        }
+    }
+
+    for(int i = 0; i < p->methods.n; i++)
+        infer(&s, &p->methods.val[i].func_expr);
+
+    timing_stop(TIMING_SEMA);
+
+    return s.errnum;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "parse.h"
+
+int sema(struct parse *p);
+int sema_func(struct parse *p, struct val *v);
+struct type *sema_resolve(struct type *t);
+bool sema_is_string(struct type *t);
+struct type *sema_tuple(struct type **ts, int n);
+bool sema_is_tuple(struct type *t);
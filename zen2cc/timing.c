@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "timing.h"
+
+char *timing_str[TIMING_MAX] = {
+    "parse",
+    "ct",
+    "ct hit",
+    "ct miss",
+    "resolve",
+    "fold",
+    "sema",
+    "mono",
+    "layout",
+    "lower",
+    "bounds",
+    "ir",
+    "emit",
+    "x64",
+    "cc",
+    "cc hit",
+};
+
+static struct timing timings[TIMING_MAX];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void timing_start(enum timing_id id) {
+    assert(id >= 0 && id < TIMING_MAX);
+    timings[id].start = now_ns();
+}
+
+void timing_stop(enum timing_id id) {
+    assert(id >= 0 && id < TIMING_MAX);
+    timings[id].ns += now_ns() - timings[id].start;
+}
+
+void timing_count(enum timing_id id, uint64_t n) {
+    assert(id >= 0 && id < TIMING_MAX);
+    timings[id].count += n;
+}
+
+void timing_print(FILE *f) {
+    fprintf(f, "%-12s %12s %12s\n", "phase", "ms", "count");
+    for(int i = 0; i < TIMING_MAX; i++)
+        fprintf(f, "%-12s %12.3f %12llu\n", timing_str[i],
+                timings[i].ns / 1e6, (unsigned long long)timings[i].count);
+}
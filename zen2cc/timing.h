@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+//Compiler phases and counters shown in the timing report (-T)
+enum timing_id {
+    TIMING_PARSE,           //Parsing (including lexing), counts top level definitions
+    TIMING_CT,              //Compile time execution, within parsing, counts instructions run
+    TIMING_CT_HIT,          //Cache lookups of compile time results, counts hits
+    TIMING_CT_MISS,         //Storing compile time results in the cache, counts misses
+    TIMING_RESOLVE,         //Name resolution, counts names bound
+    TIMING_FOLD,            //Constant folding, counts constants evaluated
+    TIMING_SEMA,            //Type inference pass, counts expression nodes visited
+    TIMING_MONO,            //Monomorphization, counts instances created
+    TIMING_LAYOUT,          //Data layout, counts structs laid out
+    TIMING_LOWER,           //Lowering choices, counts switches planned
+    TIMING_BOUNDS,          //Bounds check elision, counts checks elided
+    TIMING_IR,              //IR lowering and optimization, counts instructions removed
+    TIMING_EMIT,            //C code generation, counts functions emitted
+    TIMING_X64,             //x86-64 code generation, counts functions emitted
+    TIMING_CC,              //Starting and waiting for the C compiler, counts objects compiled
+    TIMING_CC_HIT,          //Cache lookups of objects, counts hits
+
+    TIMING_MAX
+};
+
+extern char *timing_str[TIMING_MAX];
+
+struct timing {
+    uint64_t ns;            //Total time spent between start/stop
+    uint64_t count;         //Phase specific counter
+    uint64_t start;
+};
+
+void timing_start(enum timing_id id);
+void timing_stop(enum timing_id id);
+void timing_count(enum timing_id id, uint64_t n);
+void timing_print(FILE *f);
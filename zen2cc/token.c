@@ -20,6 +20,7 @@ char *token_type_str[TOKEN_MAX] = {
     "TOKEN_NUM",
     "TOKEN_STR",
     "TOKEN_STR_ESC",
+    "TOKEN_SOURCE",
 
     "TOKEN_BREAK",
     "TOKEN_CASE",
@@ -29,6 +30,7 @@ char *token_type_str[TOKEN_MAX] = {
     "TOKEN_DO",
     "TOKEN_ELSE",
     "TOKEN_ENUM",
+    "TOKEN_EXPORT",
     "TOKEN_FALLTHROUGH",
     "TOKEN_FOR",
     "TOKEN_FUNC",
@@ -104,12 +106,12 @@ static char *punct[PUNCT_NUM] = {
 };
 
 
-#define KEYWORDS_NUM 20
+#define KEYWORDS_NUM 21
 
 //Must be in same order as enum definition above
 static char *keywords[KEYWORDS_NUM] = {
     "break", "case", "continue", "const", "default", "do", "else", "enum",
-    "fallthrough", "for", "func", "if", "include", "let", "return", "struct",
+    "export", "fallthrough", "for", "func", "if", "include", "let", "return", "struct",
     "switch", "typedef", "union", "volatile"
 };
 
@@ -150,7 +152,7 @@ static bool is_ident_initial(char c) {
 
 static bool is_numeric(char c) {
     switch(c){
-        case '-': case '.': case '_': case 'x': case 'X': case 'o': case 'O':
+        case '.': case '_': case 'x': case 'X': case 'o': case 'O':
         case 'b': case 'B': case 'p': case 'P':
         return true;
     }
@@ -161,6 +163,14 @@ static bool is_numeric_initial(char c) {
     return is_digit((int)c);
 }
 
+//Sign of an exponent, following e in decimal or p in hex numbers
+static bool is_numeric_sign(char c, char *num, uint32_t len) {
+    if(c != '-' && c != '+') return false;
+    char e = num[len-1];
+    bool hex = len > 1 && num[0] == '0' && (num[1] == 'x' || num[1] == 'X');
+    return e == 'p' || e == 'P' || (!hex && (e == 'e' || e == 'E'));
+}
+
 static bool is_str_initial(char c) {
     return c == '"' || c == '\'';
 }
@@ -324,7 +334,7 @@ start:
         t.str = (*s)++;
         t.len = 1;
 
-        while(is_numeric(**s)) (*s)++, t.len++;
+        while(is_numeric(**s) || is_numeric_sign(**s, t.str, t.len)) (*s)++, t.len++;
 
     } else if(is_str_initial(**s)) {
         char q = *((*s)++);
@@ -362,21 +372,100 @@ start:
     return t;
 }
 
+//Source whose text holds t, or NULL
+static struct token_src *token_src_find(struct token_stream *ts, struct token t) {
+    //Most tokens asked about are recent, so search from the newest source
+    for(int i = ts->srcs_n - 1; i >= 0; i--) {
+        struct token_src *src = ts->srcs[i];
+        if(t.str >= src->text && t.str <= src->text + src->len) return src;
+    }
+    return NULL;
+}
+
+//Table of the offsets lines of src start at
+static void token_lines(struct token_src *src) {
+    int n = 1;
+    for(int i = 0; i < src->len; i++) n += src->text[i] == '\n';
+    src->lines = malloc(n * sizeof *src->lines);
+    assert(src->lines);
+
+    src->lines[0] = 0;
+    src->lines_n = 1;
+    for(int i = 0; i < src->len; i++)
+        if(src->text[i] == '\n') src->lines[src->lines_n++] = i + 1;
+}
+
+//Position of t in the file. Tokens of spliced text are at the token they
+//were spliced for.
 void token_pos(struct token_stream *ts, struct token t, int *row, int *col) {
     assert(t.str);
     assert(ts);
-    assert(ts->text);
-    assert(t.str <= ts->text + ts->len);
-
-    int r=1,c=1;
-    char *s = ts->text;
-    while(s < t.str) {
-       if(*s == '\n') r++,c=1;
-       else c++;
-       s++;
+
+    struct token_src *src = token_src_find(ts, t);
+    while(src && src->parent) {
+        t = src->at;
+        src = src->parent;
+    }
+
+    if(!src) {
+        *row = *col = 0;    //Error message, not in any text
+        return;
+    }
+
+    //Last line starting at or before t
+    if(!src->lines) token_lines(src);
+    int off = t.str - src->text, lo = 0, hi = src->lines_n - 1;
+    while(lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if(src->lines[mid] <= off) lo = mid;
+        else hi = mid - 1;
+    }
+
+    *row = lo + 1, *col = off - src->lines[lo] + 1;
+}
+
+static int hex(char ch) {
+    if(ch >= '0' && ch <= '9') return ch - '0';
+    if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+//Bytes of a string literal, with escapes processed for "...". buf needs
+//room for t.len bytes. Returns the number of bytes.
+int token_unescape(struct token t, char *buf) {
+    int n = 0;
+
+    for(uint32_t i = 0; i < t.len; i++) {
+        char ch = t.str[i];
+        if(t.type != TOKEN_STR_ESC || ch != '\\' || i + 1 >= t.len) {
+            buf[n++] = ch;
+            continue;
+        }
+
+        ch = t.str[++i];
+        switch(ch) {
+        case 'n': buf[n++] = '\n'; break;
+        case 't': buf[n++] = '\t'; break;
+        case 'r': buf[n++] = '\r'; break;
+        case 'x': {
+            int v = 0;
+            for(int j = 0; j < 2 && i + 1 < t.len && hex(t.str[i+1]) >= 0; j++)
+                v = v * 16 + hex(t.str[++i]);
+            buf[n++] = v;
+            break;
+        }
+        default:
+            if(ch >= '0' && ch <= '7') {
+                int v = ch - '0';
+                for(int j = 0; j < 2 && i + 1 < t.len && t.str[i+1] >= '0' && t.str[i+1] <= '7'; j++)
+                    v = v * 8 + t.str[++i] - '0';
+                buf[n++] = v;
+            } else buf[n++] = ch;
+        }
     }
 
-    *row = r, *col = c;
+    return n;
 }
 
 //Allocates a malloc'd string with a copy of this token as a string.
@@ -388,22 +477,44 @@ char *token_str(struct token t) {
     return str;
 }
 
-void token_print(struct token_stream *ts, struct token t) {
-
-    char *s = token_type_str[t.type];
-
+void token_print(struct out *o, struct token_stream *ts, struct token t) {
     int line = 0, col = 0;
     token_pos(ts, t, &line, &col);
 
     if(t.type == TOKEN_STR || t.type == TOKEN_STR_ESC) col--;
 
-    if(t.len)
-        printf("%s [%i col %i] - \"%.*s\"", s, line, col, t.len, t.str);
-    else
-        printf("%s [%i col %i]", s, line, col);
+    out_str(o, token_type_str[t.type]);
+    out_str(o, " [");
+    out_int(o, line);
+    out_str(o, " col ");
+    out_int(o, col);
+    out_char(o, ']');
+
+    if(t.len) {
+        out_str(o, " - \"");
+        out_mem(o, t.str, t.len);
+        out_char(o, '"');
+    }
 
-    if(t.type >= TOKEN_NE)
-        printf(" %s", punct[t.type - TOKEN_NE]);
+    if(t.type >= TOKEN_NE) {
+        out_char(o, ' ');
+        out_str(o, punct[t.type - TOKEN_NE]);
+    }
+}
+
+static struct token_src *token_src_add(struct token_stream *ts, char *text, int len) {
+    if(ts->srcs_n >= ts->srcs_c) {
+        ts->srcs_c = ts->srcs_c ? ts->srcs_c * 2 : 8;
+        ts->srcs = realloc(ts->srcs, ts->srcs_c * sizeof *ts->srcs);
+        assert(ts->srcs);
+    }
+
+    struct token_src *src = calloc(1, sizeof *src);
+    assert(src);
+    src->text = text;
+    src->len = len;
+    ts->srcs[ts->srcs_n++] = src;
+    return src;
 }
 
 bool token_stream_init(struct token_stream *ts, char *path) {
@@ -416,15 +527,18 @@ bool token_stream_init(struct token_stream *ts, char *path) {
     struct stat sb;
     if (fstat(fd, &sb) == -1) goto err;
 
-    ts->text = mmap(NULL, sb.st_size+1, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (ts->text == MAP_FAILED) goto err;
+    char *text = mmap(NULL, sb.st_size+1, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (text == MAP_FAILED) goto err;
 
-    ts->len = sb.st_size;
+    *ts = (struct token_stream){0};
+    ts->src = token_src_add(ts, text, sb.st_size);
+    ts->src->mapped = true;
+    ts->src->bol = true;
     ts->path = strdup(path);
-    ts->offset = 0;
-    ts->buf_c = 0;
-    ts->buf_i = 0;
-    ts->mark_n = 0;
+
+    ts->buf_cap = TOKEN_BUF_SIZE;
+    ts->buf = malloc(ts->buf_cap * sizeof *ts->buf);
+    assert(ts->buf);
 
     close(fd);
     return true;
@@ -435,60 +549,124 @@ err:
 }
 
 void token_stream_close(struct token_stream *ts) {
-    if(ts->text) munmap(ts->text, ts->len);
+    for(int i = 0; i < ts->srcs_n; i++) {
+        struct token_src *src = ts->srcs[i];
+        if(src->mapped) munmap(src->text, src->len);
+        else free(src->text);
+        free(src->lines);
+        free(src);
+    }
+    free(ts->srcs);
+    free(ts->buf);
     if(ts->path) free(ts->path);
-    ts->text = 0;
-    ts->offset = 0;
-    ts->len = 0;
-    ts->path = 0;
-    ts->buf_c = 0;
-    ts->buf_i = 0;
-    ts->mark_n = 0;
+    *ts = (struct token_stream){0};
 }
 
-//Fill token stream buffer as much as possible. Will keep any tokens
-//in buffer that are required for a mark
-void token_stream_fill(struct token_stream *ts) {
+//Lex up to TOKEN_FILL more tokens in to the buffer. Tokens before the
+//oldest mark, which can not be returned to, are dropped first.
+static void token_stream_fill(struct token_stream *ts) {
     assert(ts);
 
-    //TODO: only clear out unmarked tokens
-    assert(ts->mark_n == 0);
+    int keep = ts->buf_i;
+    for(int i = 0; i < ts->mark_n; i++) if(ts->mark[i] < keep) keep = ts->mark[i];
+    if(keep > 0) {
+        memmove(ts->buf, ts->buf + keep, (ts->buf_c - keep) * sizeof *ts->buf);
+        ts->buf_c -= keep;
+        ts->buf_i -= keep;
+        for(int i = 0; i < ts->mark_n; i++) ts->mark[i] -= keep;
+    }
+
+    if(ts->buf_c + TOKEN_FILL > ts->buf_cap) {
+        ts->buf_cap *= 2;
+        ts->buf = realloc(ts->buf, ts->buf_cap * sizeof *ts->buf);
+        assert(ts->buf);
+    }
+
+    for(int n = 0; n < TOKEN_FILL; n++) {
+        if(ts->buf_c && ts->buf[ts->buf_c-1].t.type == TOKEN_EOF) break;
 
-    ts->buf_c -= ts->buf_i;
-    ts->buf_i = 0;
+        struct token_src *src = ts->src;
+        struct token_slot *slot = &ts->buf[ts->buf_c];
+        slot->src = src;
+        slot->offset = ts->offset;
+        slot->bol = ts->offset ? src->text[ts->offset-1] == '\n' : src->bol;
+
+        char *s = src->text + ts->offset;
+        slot->t = token_next(&s, src->text + src->len);
+
+        //Continue the source spliced text was inserted in to
+        if(slot->t.type == TOKEN_EOF && src->parent) {
+            ts->src = src->parent;
+            ts->offset = src->resume;
+            n--;
+            continue;
+        }
 
-    char *s = ts->text + ts->offset;
-    while(ts->buf_c < 2*TOKEN_BUF_SIZE)  {
-        struct token t = token_next(&s, ts->text + ts->len);
-        ts->buf[ts->buf_c++] = t;
-        if(t.type == TOKEN_EOF) break;
+        ts->offset = s - src->text;
+        assert(ts->offset <= src->len);
+        ts->buf_c++;
     }
+}
 
-    ts->offset = s - ts->text;
-    assert(ts->offset <= ts->len);
+//Compile time code spans lines starting with #. While reading it, those #
+//are skipped, and any other line reads as a single TOKEN_SOURCE, text to
+//be spliced in to the file when it runs.
+static struct token token_stream_ct(struct token_stream *ts, int *skip) {
+    for(;;) {
+        if(ts->buf_i >= ts->buf_c) token_stream_fill(ts);
+        struct token_slot *slot = &ts->buf[ts->buf_i];
+        struct token t = slot->t;
+        *skip = 1;
+
+        if(t.type == TOKEN_NEWLINE || t.type == TOKEN_EOF || !slot->bol)
+            return t;
+
+        if(t.type != TOKEN_HASH) {
+            //The whole line, up to the newline
+            int n = 0;
+            for(;;) {
+                if(ts->buf_i + n >= ts->buf_c) token_stream_fill(ts);
+                enum token_type tt = ts->buf[ts->buf_i + n].t.type;
+                if(tt == TOKEN_NEWLINE || tt == TOKEN_EOF) break;
+                n++;
+            }
+            slot = &ts->buf[ts->buf_i];
+            *skip = n;
+
+            char *s = slot->src->text + slot->offset, *end = slot->src->text + slot->src->len;
+            t.type = TOKEN_SOURCE;
+            t.str = s;
+            while(s < end && *s != '\n') s++;
+            t.len = s - t.str;
+            return t;
+        }
+
+        ts->buf_i++;
+    }
 }
 
-//Get next token from buffer. Will return EOF token continually once end
-//of stream is reached.
+//View next token in buffer without consuming. Will return EOF token
+//continually once end of stream is reached.
 struct token token_stream_peek(struct token_stream *ts) {
     assert(ts);
 
-    if(ts->buf_i > ts->buf_c || ts->buf_c == 0) token_stream_fill(ts);
-    assert(ts->buf_i <= ts->buf_c);
+    if(ts->buf_i >= ts->buf_c) token_stream_fill(ts);
+    assert(ts->buf_i < ts->buf_c);
 
-    return ts->buf[ts->buf_i];
+    int skip;
+    if(ts->ct) return token_stream_ct(ts, &skip);
+    return ts->buf[ts->buf_i].t;
 }
 
-//View next token in buffer without consuming
+//Get next token from buffer
 struct token token_stream_next(struct token_stream *ts) {
     assert(ts);
     if(ts->buf_i >= ts->buf_c) token_stream_fill(ts);
     assert(ts->buf_i < ts->buf_c);
 
-    struct token t;
-    if(ts->buf[ts->buf_i].type == TOKEN_EOF)
-         t = ts->buf[ts->buf_i];
-    else t = ts->buf[ts->buf_i++];
+    int skip = 1;
+    struct token t = ts->ct ? token_stream_ct(ts, &skip) : ts->buf[ts->buf_i].t;
+    if(t.type != TOKEN_EOF) ts->buf_i += skip;
 
     return t;
 }
@@ -502,9 +680,6 @@ void token_stream_mark(struct token_stream *ts) {
     assert(ts);
     assert(ts->mark_n < TOKEN_MARK_MAX);
 
-    if(ts->buf_c <= 0) token_stream_fill(ts);
-    assert(ts->buf_c > 0);
-
     ts->mark[ts->mark_n++] = ts->buf_i;
 }
 
@@ -522,3 +697,29 @@ void token_stream_unmark(struct token_stream *ts) {
     assert(ts->mark_n > 0);
     ts->mark_n--;
 }
+
+//Insert text at the current position, so it is read next. The stream takes
+//the malloc'd text, which like the file must be followed by a '\0'. Tokens already read ahead are dropped and lexed again
+//after it, so splicing costs no more than lexing the text.
+void token_stream_splice(struct token_stream *ts, char *text, int len, struct token at) {
+    assert(ts);
+    assert(text);
+
+    bool bol;
+    if(ts->buf_i < ts->buf_c) {
+        struct token_slot *slot = &ts->buf[ts->buf_i];
+        ts->src = slot->src;
+        ts->offset = slot->offset;
+        ts->buf_c = ts->buf_i;
+        bol = slot->bol;
+    } else bol = ts->offset ? ts->src->text[ts->offset-1] == '\n' : ts->src->bol;
+
+    struct token_src *src = token_src_add(ts, text, len);
+    src->bol = bol;
+    src->at = at;
+    src->parent = ts->src;
+    src->resume = ts->offset;
+
+    ts->src = src;
+    ts->offset = 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include "out.h"
 
 enum token_type {
     TOKEN_ERR = 0,
@@ -14,6 +15,7 @@ enum token_type {
     TOKEN_NUM,
     TOKEN_STR,
     TOKEN_STR_ESC,
+    TOKEN_SOURCE,       //Line of compile time code without #, see token_stream_ct()
 
     //Keywords
     TOKEN_BREAK,
@@ -24,6 +26,7 @@ enum token_type {
     TOKEN_DO,
     TOKEN_ELSE,
     TOKEN_ENUM,
+    TOKEN_EXPORT,
     TOKEN_FALLTHROUGH,
     TOKEN_FOR,
     TOKEN_FUNC,
@@ -104,20 +107,49 @@ extern char *token_type_str[TOKEN_MAX];
 struct token token_next(char **s, char *end);
 
 #define TOKEN_BUF_SIZE (1024)
-#define TOKEN_MARK_MAX 20
+#define TOKEN_FILL 64           //Tokens lexed ahead at a time
+#define TOKEN_MARK_MAX 256
+
+//Text tokens are read from: the file, or text spliced in to it by compile
+//time code. Sources are kept until the stream is closed, as tokens point in
+//to them.
+struct token_src {
+    char *text;
+    int len;
+    bool mapped;                //text is mmap'd, otherwise malloc'd
+    bool bol;                   //text starts a line
+    int *lines;                 //Offsets lines start at, made on first use by token_pos()
+    int lines_n;
+
+    struct token at;            //Token spliced text stands for, in parent
+    struct token_src *parent;   //Source to continue with at resume once done
+    int resume;
+};
+
+//Buffered token, with the lexer state it was read from
+struct token_slot {
+    struct token t;
+    struct token_src *src;
+    int offset;
+    bool bol;                   //t is the first token on its line
+};
 
 struct token_stream {
-    char *text;         //mmap'd text buffer
-    int offset;     //current offset in to text buffer
-    int len;            //length of text buffer
+    struct token_src *src;      //Source being lexed
+    int offset;                 //current offset in to its text
 
-    char *path;         //file path of text buffer
+    char *path;                 //file path of text buffer
 
-    struct token buf[TOKEN_BUF_SIZE];
-    int buf_i, buf_c;
+    struct token_src **srcs;    //All sources, the file first
+    int srcs_n, srcs_c;
+
+    struct token_slot *buf;
+    int buf_i, buf_c, buf_cap;
 
     int mark[TOKEN_MARK_MAX];
     int mark_n;
+
+    bool ct;            //Reading compile time code, see token_stream_peek()
 };
 
 bool token_stream_init(struct token_stream *ts, char *path);
@@ -126,7 +158,10 @@ struct token token_stream_next(struct token_stream *ts);
 void token_stream_mark(struct token_stream *ts);
 void token_stream_rewind(struct token_stream *ts);
 void token_stream_unmark(struct token_stream *ts);
+void token_stream_splice(struct token_stream *ts, char *text, int len, struct token at);
+void token_stream_close(struct token_stream *ts);
 
 void token_pos(struct token_stream *ts, struct token t, int *row, int *col);
 char *token_str(struct token t);
-void token_print(struct token_stream *ts, struct token t);
+int token_unescape(struct token t, char *buf);
+void token_print(struct out *o, struct token_stream *ts, struct token t);
@@ -17,10 +17,8 @@ void ts_init(struct ts *ts) {
 
 void ts_free(struct ts *ts) {
     if(ts == NULL) return;
-    for(int i = 0; i < ts->n; i++) {
+    for(int i = 0; i < ts->n; i++)
         free(ts->key[i]);
-        type_free(&ts->val[i]);
-    }
     free(ts->key);
     free(ts->val);
     ts->c = 0;
@@ -37,17 +35,17 @@ static int ts_find(struct ts *ts, char *key) {
     return -1;
 }
 
-void ts_set(struct ts *ts, char *key, struct type val) {
+void ts_set(struct ts *ts, char *key, struct type *val) {
     assert(ts); assert(key);
 
     int i = ts_find(ts, key);
     if(i < 0) {
-        if(ts->c >= ts->n) {
+        if(ts->n >= ts->c) {
             int new_c = ts->c * 2;
             if(new_c < TS_INITIAL_CAP) new_c = TS_INITIAL_CAP;
 
-            ts->key = reallocf(ts->key, new_c * sizeof *ts->key);
-            ts->val = reallocf(ts->val, new_c * sizeof *ts->val);
+            ts->key = realloc(ts->key, new_c * sizeof *ts->key);
+            ts->val = realloc(ts->val, new_c * sizeof *ts->val);
             assert(ts->key); assert(ts->val);
 
             ts->c = new_c;
@@ -65,7 +63,7 @@ struct type *ts_get(struct ts *ts, char *key) {
 
     int i = ts_find(ts, key);
     if(i < 0) return NULL;
-    return &ts->val[i];
+    return ts->val[i];
 }
 
 
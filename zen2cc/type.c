@@ -1,45 +1,133 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "type.h"
 #include "expr.h"
 
 char *type_primative_str[TYPE_NUM] = {
-    "void",
+    "void", "bool",
     "int", "int8", "int16", "int32", "int64",
     "uint", "uint8", "uint16", "uint32", "uint64",
     "float", "float16", "float32", "float64",
 };
 
-struct type *type_alloc(struct type t) {
-    struct type *ret = malloc(sizeof *ret);
-    assert(ret);
-    *ret = t;
-    return ret;
+//Interned types, open addressed hash table keyed by struct type hash
+static struct {
+    struct type **tab;
+    int c, n;
+} interned;
+
+static unsigned hash_str(unsigned h, char *s) {
+    if(!s) return h * 16777619u;
+    while(*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return (h ^ 0xFF) * 16777619u;
 }
 
-void type_free(struct type *t) {
-    if(t == NULL) return;
+static unsigned hash_ptr(unsigned h, void *p) {
+    unsigned long v = (unsigned long)p;
+    h = (h ^ (unsigned)v) * 16777619u;
+    return (h ^ (unsigned)(v >> 32)) * 16777619u;
+}
 
-    switch(t->type) {
-    case TYPE_PRIMATIVE: break;
-    case TYPE_IDENT: free(t->ident); free(t->mod); break;
-    case TYPE_PTR: case TYPE_ARRAY: type_free(t->of); free(t->of); break;
+static unsigned hash_int(unsigned h, int v) {
+    return (h ^ (unsigned)v) * 16777619u;
+}
 
+//Children of t are canonical, so hashing their pointers is enough
+static unsigned type_hash(struct type *t) {
+    unsigned h = hash_int(2166136261u, t->type);
+
+    switch(t->type) {
+    case TYPE_PRIMATIVE: h = hash_int(h, t->primative); break;
+    case TYPE_IDENT: h = hash_str(hash_str(h, t->mod), t->ident); break;
+    case TYPE_PTR: case TYPE_ARRAY: case TYPE_VEC:
+        h = hash_ptr(h, t->of);
+        h = t->n < 0 && t->len ? hash_int(h, expr_hash(t->len)) : hash_int(h, t->n);
+        break;
     case TYPE_FUNC:
-        for(int i = 0; i < t->args_n; i++) type_free(&t->args[i]);
-        for(int i = 0; i < t->ret_n; i++) type_free(&t->ret[i]);
-        free(t->args);
-        free(t->ret);
+        for(int i = 0; i < t->args_n; i++) h = hash_ptr(h, t->args[i]);
+        h = hash_int(h, t->args_n);
+        for(int i = 0; i < t->ret_n; i++) h = hash_ptr(h, t->ret[i]);
+        h = hash_int(h, t->ret_n);
         break;
-
     case TYPE_STRUCT:
         for(int i = 0; i < t->mem_n; i++) {
-             free(t->idents[i]);
-             type_free(&t->types[i]);
+            h = hash_ptr(hash_str(h, t->idents[i]), t->types[i]);
+            if(t->aligns) h = hash_int(h, t->aligns[i]);
         }
-        free(t->types); free(t->idents);
+        h = hash_int(hash_int(h, t->mem_n), t->align_to);
+        break;
+    case TYPE_ENUM:
+        for(int i = 0; i < t->opts_n; i++)
+            h = hash_int(hash_str(h, t->opts[i]), expr_hash(&t->vals[i]));
+        h = hash_ptr(hash_int(h, t->opts_n), t->enum_type);
+        break;
+    case TYPE_NONE: case TYPE_ERR: break;
+    default: assert(0);
+    }
+
+    return h;
+}
+
+static bool str_eq(char *a, char *b) {
+    if(!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+//Shallow structural equality, children are compared by pointer
+static bool type_node_eq(struct type *a, struct type *b) {
+    if(a->type != b->type || a->hash != b->hash) return false;
+
+    switch(a->type) {
+    case TYPE_PRIMATIVE: return a->primative == b->primative;
+    case TYPE_IDENT: return str_eq(a->mod, b->mod) && str_eq(a->ident, b->ident);
+    case TYPE_PTR: case TYPE_ARRAY: case TYPE_VEC:
+        if(a->of != b->of || a->n != b->n) return false;
+        if(a->n >= 0 || !a->len || !b->len) return a->n >= 0 || a->len == b->len;
+        return expr_eq(a->len, b->len);
+    case TYPE_FUNC:
+        if(a->args_n != b->args_n || a->ret_n != b->ret_n) return false;
+        for(int i = 0; i < a->args_n; i++) if(a->args[i] != b->args[i]) return false;
+        for(int i = 0; i < a->ret_n; i++) if(a->ret[i] != b->ret[i]) return false;
+        return true;
+    case TYPE_STRUCT:
+        if(a->mem_n != b->mem_n || a->align_to != b->align_to || !a->aligns != !b->aligns)
+            return false;
+        for(int i = 0; i < a->mem_n; i++)
+            if(a->types[i] != b->types[i] || !str_eq(a->idents[i], b->idents[i])
+                    || (a->aligns && a->aligns[i] != b->aligns[i]))
+                return false;
+        return true;
+    case TYPE_ENUM:
+        if(a->opts_n != b->opts_n || a->enum_type != b->enum_type) return false;
+        for(int i = 0; i < a->opts_n; i++)
+            if(!str_eq(a->opts[i], b->opts[i]) || !expr_eq(&a->vals[i], &b->vals[i]))
+                return false;
+        return true;
+    case TYPE_NONE: case TYPE_ERR: return true;
+    default: assert(0);
+    }
+
+    return false;
+}
+
+//Frees the memory owned by a single type node, but not its (canonical) children
+static void type_free(struct type *t) {
+    switch(t->type) {
+    case TYPE_IDENT: free(t->ident); free(t->mod); break;
+
+    case TYPE_ARRAY:
+        if(t->len) expr_free(t->len);
+        free(t->len);
+        break;
+
+    case TYPE_FUNC: free(t->args); free(t->ret); break;
+
+    case TYPE_STRUCT:
+        for(int i = 0; i < t->mem_n; i++) free(t->idents[i]);
+        free(t->types); free(t->idents); free(t->offsets); free(t->aligns);
         break;
 
     case TYPE_ENUM:
@@ -49,73 +137,184 @@ void type_free(struct type *t) {
         }
         free(t->vals);
         free(t->opts);
-        type_free(t->enum_type);
-        free(t->enum_type);
+        free(t->ivals);
         break;
 
-    case TYPE_NONE: case TYPE_ERR: break;
-    default: assert(0);
+    default: break;
     }
 }
 
-void type_print(struct type *t) {
+static void intern_grow(void) {
+    int new_c = interned.c * 2;
+    if(new_c < TYPE_INTERN_INITIAL_CAP) new_c = TYPE_INTERN_INITIAL_CAP;
+
+    struct type **tab = calloc(new_c, sizeof *tab);
+    assert(tab);
+
+    for(int i = 0; i < interned.c; i++) {
+        struct type *t = interned.tab[i];
+        if(!t) continue;
+        int j = t->hash & (new_c - 1);
+        while(tab[j]) j = (j + 1) & (new_c - 1);
+        tab[j] = t;
+    }
+
+    free(interned.tab);
+    interned.tab = tab;
+    interned.c = new_c;
+}
+
+//Returns the canonical node equal to t. Takes ownership of any memory
+//referenced by t (strings, member arrays, enum values), which is released if
+//an equal node already exists. All child types of t must be canonical.
+struct type *type_intern(struct type t) {
+    t.hash = type_hash(&t);
+
+    if(2 * (interned.n + 1) > interned.c) intern_grow();
+
+    int i = t.hash & (interned.c - 1);
+    for(; interned.tab[i]; i = (i + 1) & (interned.c - 1)) {
+        if(type_node_eq(interned.tab[i], &t)) {
+            type_free(&t);
+            return interned.tab[i];
+        }
+    }
+
+    struct type *ret = malloc(sizeof *ret);
+    assert(ret);
+    *ret = t;
+
+    interned.tab[i] = ret;
+    interned.n++;
+
+    return ret;
+}
+
+struct type *type_none(void) {
+    return type_intern((struct type){TYPE_NONE});
+}
+
+struct type *type_prim(enum type_primative pt) {
+    return type_intern((struct type){TYPE_PRIMATIVE, .primative=pt});
+}
+
+struct type *type_vec(enum type_primative pt, int n) {
+    return type_intern((struct type){TYPE_VEC, .of=type_prim(pt), .n=n});
+}
+
+static unsigned visit_gen;
+
+//Start a new walk over the type graph
+void type_visit_begin(void) {
+    visit_gen++;
+}
+
+//Returns true the first time t is seen since type_visit_begin(), so passes
+//walking the shared type graph visit every node once
+bool type_visit(struct type *t) {
+    if(t->visit == visit_gen) return false;
+    t->visit = visit_gen;
+    return true;
+}
+
+//Whether t is or contains a named type, a TYPE_IDENT, rather than being
+//built only of primitives
+bool type_is_named(struct type *t) {
+    switch(t->type) {
+    case TYPE_IDENT: return true;
+    case TYPE_PTR: case TYPE_ARRAY: case TYPE_VEC: return type_is_named(t->of);
+    case TYPE_FUNC:
+        for(int i = 0; i < t->args_n; i++) if(type_is_named(t->args[i])) return true;
+        for(int i = 0; i < t->ret_n; i++) if(type_is_named(t->ret[i])) return true;
+        return false;
+    case TYPE_STRUCT:
+        for(int i = 0; i < t->mem_n; i++) if(type_is_named(t->types[i])) return true;
+        return false;
+    default: return false;
+    }
+}
+
+//Release every canonical type node
+void type_intern_free(void) {
+    for(int i = 0; i < interned.c; i++) {
+        if(!interned.tab[i]) continue;
+        type_free(interned.tab[i]);
+        free(interned.tab[i]);
+    }
+
+    free(interned.tab);
+    interned.tab = NULL;
+    interned.c = 0;
+    interned.n = 0;
+}
+
+void type_print(struct out *o, struct type *t) {
 
 loop:
     switch(t->type){
         case TYPE_PRIMATIVE:
             assert(t->primative >= 0 && t->primative < TYPE_NUM);
-            printf("PRIMITIVE %s", type_primative_str[t->primative]);
+            out_str(o, "PRIMITIVE "); out_str(o, type_primative_str[t->primative]);
             break;
         case TYPE_IDENT:
-            if(t->mod)
-                printf("IDENT '%s'->'%s'", t->mod, t->ident);
-            else printf("IDENT '%s'", t->ident);
+            out_str(o, "IDENT '");
+            if(t->mod) out_str(o, t->mod), out_str(o, "'->'");
+            out_str(o, t->ident);
+            out_char(o, '\'');
             break;
         case TYPE_PTR:
-            printf("PTR to "); t = t->of; goto loop;
+            out_str(o, "PTR to "); t = t->of; goto loop;
         case TYPE_ARRAY:
-            if(t->n >= 0) printf("ARRAY [%i] of ", t->n);
-            else printf("ARRAY of ");
+            if(t->n >= 0) out_str(o, "ARRAY ["), out_int(o, t->n), out_str(o, "] of ");
+            else if(t->len) out_str(o, "ARRAY ["), expr_print(o, t->len), out_str(o, "] of ");
+            else out_str(o, "ARRAY of ");
+            t = t->of; goto loop;
+        case TYPE_VEC:
+            out_str(o, "VEC ["), out_int(o, t->n), out_str(o, "] of ");
             t = t->of; goto loop;
         case TYPE_FUNC:
-            printf("FUNC (");
+            out_str(o, "FUNC (");
             for(int i = 0; i<t->args_n; i++){
-                if(i>0) printf(", ");
-                type_print(&t->args[i]);
+                if(i>0) out_str(o, ", ");
+                type_print(o, t->args[i]);
             }
 
-            if(t->ret_n > 1) printf(") (");
-            else printf(") ");
+            if(t->ret_n > 1) out_str(o, ") (");
+            else out_str(o, ") ");
 
             for(int i = 0; i<t->ret_n; i++){
-                if(i>0) printf(", ");
-                type_print(&t->ret[i]);
+                if(i>0) out_str(o, ", ");
+                type_print(o, t->ret[i]);
             }
 
-            if(t->ret_n > 1) printf(")");
+            if(t->ret_n > 1) out_str(o, ")");
 
             break;
         case TYPE_STRUCT:
-            printf("STRUCT {\n");
+            out_str(o, "STRUCT ");
+            if(t->align_to) out_str(o, "ALIGN "), out_int(o, t->align_to), out_char(o, ' ');
+            out_str(o, "{\n");
             for(int i = 0; i < t->mem_n; i++) {
-                printf("\t%s ", t->idents[i]);
-                type_print(&t->types[i]);
-                printf("\n");
+                out_char(o, '\t'); out_str(o, t->idents[i]); out_char(o, ' ');
+                type_print(o, t->types[i]);
+                if(t->aligns && t->aligns[i]) out_str(o, " ALIGN "), out_int(o, t->aligns[i]);
+                out_str(o, "\n");
             }
-            printf("}");
+            out_str(o, "}");
             break;
         case TYPE_ENUM:
-            printf("ENUM {\n");
+            out_str(o, "ENUM {\n");
             for(int i = 0; i < t->opts_n; i++) {
-                if(t->vals[i].type == EXPR_NONE) printf("\t%s\n", t->opts[i]);
-                else printf("\t%s = ", t->opts[i]), expr_print(&t->vals[i]), printf("\n");
+                out_char(o, '\t'); out_str(o, t->opts[i]);
+                if(t->vals[i].type != EXPR_NONE) out_str(o, " = "), expr_print(o, &t->vals[i]);
+                out_char(o, '\n');
             }
             if(t->enum_type && t->enum_type->type != TYPE_NONE) {
-                printf("\tTYPE: ");
-                type_print(t->enum_type);
-                printf("\n");
+                out_str(o, "\tTYPE: ");
+                type_print(o, t->enum_type);
+                out_str(o, "\n");
             }
-            printf("}");
+            out_str(o, "}");
             break;
         case TYPE_ERR: case TYPE_NONE: break;
         default: assert(0);
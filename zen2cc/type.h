@@ -1,5 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "token.h"
+#include "out.h"
+
 struct expr;
 
 enum type_type {
@@ -13,10 +19,12 @@ enum type_type {
     TYPE_FUNC,              //Function with args ... returning ....
     TYPE_STRUCT,            //Struct of ...
     TYPE_ENUM,              //Struct of ...
+    TYPE_VEC,               //SIMD vector of n primitives, v#type
 };
 
 enum type_primative {
     TYPE_VOID = 0,
+    TYPE_BOOL,              //An int, packed to a bit as a struct member
 
     TYPE_INT,
     TYPE_INT8,
@@ -40,30 +48,64 @@ enum type_primative {
 
 extern char *type_primative_str[];
 
+//Types are hash-consed: every struct type reachable from the AST is a
+//canonical node returned by type_intern(), and all child types are canonical
+//too. Two types are equal iff their pointers are equal. Canonical nodes are
+//owned by the interner and must never be modified or freed by the caller.
 struct type {
     enum type_type type;
+    unsigned hash;                          //Structural hash, set by type_intern()
+    unsigned visit;                         //Walk generation, see type_visit()
+    struct token tok;                       //First occurrence, not part of identity
+    int size, align;                        //Memoized by layout_type(), see layout.h
+    struct type *folded;                    //Equal node with array lengths bound,
+                                            //memoized by fold()
     union {
         enum type_primative primative;      //TYPE_PRIMATIVE
-        struct {char *mod, *ident;};        //TYPE_IDENT
-        struct {struct type *of; int n;};   //TYPE_PTR, TYPE_ARRAY
+        struct {                            //TYPE_IDENT
+            char *mod, *ident;
+            struct type *def;               //Definition, bound by resolve()
+        };
+        struct {                            //TYPE_PTR, TYPE_ARRAY, TYPE_VEC
+            struct type *of;
+            int n;                          //Array or vector length, -1 if unsized
+            struct expr *len;               //Constant length expression, or NULL.
+                                            //n is bound from it by fold(), after
+                                            //which only n is part of identity
+        };
         struct {                            //TYPE_FUNC
-            struct type *args, *ret;
+            struct type **args, **ret;
             int args_n, ret_n;
         };
         struct {                            //TYPE_STRUCT
             char **idents;
-            struct type *types;
+            struct type **types;
             int mem_n;
+            int *offsets;                   //Member offsets in bits, set by layout_type()
+            int *aligns;                    //Alignment asked for members, 0 if none, or NULL
+            int align_to;                   //Alignment asked for the struct, 0 if none
         };
         struct {                            //TYPE_ENUM
             char **opts;
             struct expr *vals;
-            struct type *enum_type;
+            struct type *enum_type;         //Type asked for, or NULL
             int opts_n;
+            int64_t *ivals;                 //Option values, bound by fold()
+            struct type *repr;              //Storage type, chosen by fold()
         };
     };
 };
 
-void type_print(struct type *t);
-void type_free(struct type *t);
-struct type *type_alloc(struct type t);
+#define TYPE_INTERN_INITIAL_CAP 256
+#define TYPE_VEC_MAX 64         //Most elements in a vector type
+#define TYPE_ALIGN_MAX 4096     //Largest alignment asked for with align
+
+void type_print(struct out *o, struct type *t);
+struct type *type_intern(struct type t);
+struct type *type_none(void);
+struct type *type_prim(enum type_primative pt);
+struct type *type_vec(enum type_primative pt, int n);
+void type_visit_begin(void);
+bool type_visit(struct type *t);
+bool type_is_named(struct type *t);
+void type_intern_free(void);
@@ -0,0 +1,408 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm.h"
+#include "type.h"
+
+//Dispatch through a table of label addresses where the compiler supports
+//it, so every instruction ends in its own indirect jump, otherwise through
+//a switch
+#ifdef __GNUC__
+#define VM_COMPUTED_GOTO
+#endif
+
+void vm_init(struct vm *vm) {
+    assert(vm);
+    *vm = (struct vm){.steps_max = VM_STEPS_MAX, .mem_max = VM_MEM_MAX};
+}
+
+void vm_free(struct vm *vm) {
+    if(!vm) return;
+    for(int i = 0; i < vm->strs_n; i++) free(vm->strs[i]);
+    free(vm->strs);
+    free(vm->g);
+    free(vm->builtin);
+}
+
+//Add a global, initially void. Returns its index.
+int vm_global(struct vm *vm) {
+    if(vm->g_n == vm->g_c) {
+        vm->g_c = vm->g_c ? vm->g_c * 2 : 16;
+        vm->g = realloc(vm->g, sizeof(*vm->g) * vm->g_c);
+        assert(vm->g);
+    }
+    vm->g[vm->g_n] = (struct vm_val){VM_VOID};
+    return vm->g_n++;
+}
+
+//Register builtin f. Returns its index, for VM_CALL.
+int vm_builtin_add(struct vm *vm, vm_builtin f) {
+    if(vm->builtin_n == vm->builtin_c) {
+        vm->builtin_c = vm->builtin_c ? vm->builtin_c * 2 : 8;
+        vm->builtin = realloc(vm->builtin, sizeof(*vm->builtin) * vm->builtin_c);
+        assert(vm->builtin);
+    }
+    vm->builtin[vm->builtin_n] = f;
+    return vm->builtin_n++;
+}
+
+//Allocate a string of len bytes, copied from s unless NULL. Returns NULL
+//once the memory budget is exhausted.
+struct vm_str *vm_str(struct vm *vm, char *s, size_t len) {
+    if(len > UINT32_MAX || vm->mem + len > vm->mem_max) return NULL;
+
+    if(vm->strs_n == vm->strs_c) {
+        vm->strs_c = vm->strs_c ? vm->strs_c * 2 : 16;
+        vm->strs = realloc(vm->strs, sizeof(*vm->strs) * vm->strs_c);
+        assert(vm->strs);
+    }
+
+    struct vm_str *r = malloc(sizeof *r + len);
+    assert(r);
+    r->len = len;
+    if(s) memcpy(r->s, s, len);
+
+    vm->mem += len;
+    vm->strs[vm->strs_n++] = r;
+    return r;
+}
+
+bool vm_is_true(struct vm_val *v) {
+    switch(v->type) {
+    case VM_INT: return v->i != 0;
+    case VM_FLOAT: return v->f != 0;
+    case VM_STR: return v->s->len != 0;
+    default: return false;
+    }
+}
+
+//Text of v, as printed by warn() and err(). The result is malloc'd.
+char *vm_val_str(struct vm_val *v) {
+    char buf[64], *s = buf;
+    int len = 0;
+
+    switch(v->type) {
+    case VM_VOID: break;
+    case VM_INT: len = snprintf(buf, sizeof buf, "%" PRId64, v->i); break;
+    case VM_FLOAT:
+        //Shortest of these that reads back the same
+        len = snprintf(buf, sizeof buf, "%.15g", v->f);
+        if(strtod(buf, NULL) != v->f) len = snprintf(buf, sizeof buf, "%.17g", v->f);
+        break;
+    case VM_STR: s = v->s->s; len = v->s->len; break;
+    }
+
+    char *r = malloc(len + 1);
+    assert(r);
+    memcpy(r, s, len);
+    r[len] = '\0';
+    return r;
+}
+
+static int str_cmp(struct vm_str *a, struct vm_str *b) {
+    int c = memcmp(a->s, b->s, a->len < b->len ? a->len : b->len);
+    if(c) return c;
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+#define INT(x) ((struct vm_val){VM_INT, .i = (x)})
+#define FLOAT(x) ((struct vm_val){VM_FLOAT, .f = (x)})
+
+//Integer arithmetic wraps as two's complement
+#define WRAP(a, op, b) ((int64_t)((uint64_t)(a) op (uint64_t)(b)))
+
+static char *arith_str(struct vm *vm, int op, struct vm_val *r, struct vm_str *a, struct vm_str *b) {
+    switch(op) {
+    case VM_ADD: {
+        struct vm_str *s = vm_str(vm, NULL, (size_t)a->len + b->len);
+        if(!s) return "Compile time memory budget exceeded";
+        memcpy(s->s, a->s, a->len);
+        memcpy(s->s + a->len, b->s, b->len);
+        *r = (struct vm_val){VM_STR, .s = s};
+        return NULL;
+    }
+    case VM_LT: *r = INT(str_cmp(a, b) < 0); return NULL;
+    case VM_LE: *r = INT(str_cmp(a, b) <= 0); return NULL;
+    case VM_EQ: *r = INT(str_cmp(a, b) == 0); return NULL;
+    case VM_NE: *r = INT(str_cmp(a, b) != 0); return NULL;
+    default: return "Operator requires numeric operands";
+    }
+}
+
+static char *arith_float(int op, struct vm_val *r, double a, double b) {
+    switch(op) {
+    case VM_ADD: *r = FLOAT(a + b); return NULL;
+    case VM_SUB: *r = FLOAT(a - b); return NULL;
+    case VM_MUL: *r = FLOAT(a * b); return NULL;
+    case VM_DIV: *r = FLOAT(a / b); return NULL;
+    case VM_MOD: *r = FLOAT(fmod(a, b)); return NULL;
+    case VM_LT: *r = INT(a < b); return NULL;
+    case VM_LE: *r = INT(a <= b); return NULL;
+    case VM_EQ: *r = INT(a == b); return NULL;
+    case VM_NE: *r = INT(a != b); return NULL;
+    default: return "Operator requires integer operands";
+    }
+}
+
+static char *arith_int(int op, struct vm_val *r, int64_t a, int64_t b) {
+    switch(op) {
+    case VM_ADD: *r = INT(WRAP(a, +, b)); return NULL;
+    case VM_SUB: *r = INT(WRAP(a, -, b)); return NULL;
+    case VM_MUL: *r = INT(WRAP(a, *, b)); return NULL;
+    case VM_DIV: case VM_MOD:
+        if(b == 0) return "Division by zero";
+        if(b == -1) *r = INT(op == VM_DIV ? WRAP(0, -, a) : 0);
+        else *r = INT(op == VM_DIV ? a / b : a % b);
+        return NULL;
+    case VM_SHL: case VM_SHR:
+        if(b < 0 || b > 63) return "Shift amount out of range";
+        *r = INT(op == VM_SHL ? WRAP(a, <<, b) : a >> b);
+        return NULL;
+    case VM_BAND: *r = INT(a & b); return NULL;
+    case VM_BOR: *r = INT(a | b); return NULL;
+    case VM_XOR: *r = INT(a ^ b); return NULL;
+    case VM_LT: *r = INT(a < b); return NULL;
+    case VM_LE: *r = INT(a <= b); return NULL;
+    case VM_EQ: *r = INT(a == b); return NULL;
+    case VM_NE: *r = INT(a != b); return NULL;
+    default: assert(0); return NULL;
+    }
+}
+
+//Binary operators on operands other than two integers
+static char *arith(struct vm *vm, int op, struct vm_val *r, struct vm_val *a, struct vm_val *b) {
+    if(a->type == VM_VOID || b->type == VM_VOID) return "Operand has no value";
+
+    if(a->type == VM_STR && b->type == VM_STR) return arith_str(vm, op, r, a->s, b->s);
+    if(a->type == VM_STR || b->type == VM_STR) return "Operator requires operands of the same type";
+
+    if(a->type == VM_FLOAT || b->type == VM_FLOAT) {
+        double x = a->type == VM_FLOAT ? a->f : a->i;
+        double y = b->type == VM_FLOAT ? b->f : b->i;
+        return arith_float(op, r, x, y);
+    }
+
+    return arith_int(op, r, a->i, b->i);
+}
+
+//Convert a to primitive type t, wrapping integers to its width
+static char *cast(struct vm_val *r, struct vm_val *a, enum type_primative t) {
+    if(a->type == VM_VOID) return "Operand has no value";
+    if(a->type == VM_STR) return "Can not cast a string";
+
+    if(t == TYPE_BOOL) {
+        *r = INT(a->type == VM_FLOAT ? a->f != 0 : a->i != 0);
+        return NULL;
+    }
+
+    if(t >= TYPE_FLOAT) {
+        double f = a->type == VM_FLOAT ? a->f : a->i;
+        *r = FLOAT(t == TYPE_FLOAT32 || t == TYPE_FLOAT16 ? (float)f : f);
+        return NULL;
+    }
+
+    int64_t i = a->i;
+    if(a->type == VM_FLOAT) {
+        if(!(a->f >= -0x1p63 && a->f < 0x1p64)) return "Value out of range for cast";
+        i = a->f < 0x1p63 ? (int64_t)a->f : (int64_t)(uint64_t)a->f;
+    }
+
+    switch(t) {
+    case TYPE_INT8: i = (int8_t)i; break;
+    case TYPE_INT16: i = (int16_t)i; break;
+    case TYPE_INT32: i = (int32_t)i; break;
+    case TYPE_UINT8: i = (uint8_t)i; break;
+    case TYPE_UINT16: i = (uint16_t)i; break;
+    case TYPE_UINT32: i = (uint32_t)i; break;
+    default: break;
+    }
+
+    *r = INT(i);
+    return NULL;
+}
+
+//Run code, storing its result in ret. Returns an error message, or NULL.
+//On error vm->tok is the instruction at fault.
+char *vm_run(struct vm *vm, struct vm_code *code, struct vm_val *ret) {
+    assert(vm); assert(code); assert(ret);
+    assert(code->regs <= VM_REG_MAX);
+
+    struct vm_val reg[VM_REG_MAX];
+    for(int j = 0; j < code->regs; j++) reg[j].type = VM_VOID;
+
+    struct vm_val *k = code->k, *g = vm->g;
+    vm_ins *pc = code->ins, i;
+    uint64_t steps = vm->steps_max - vm->steps;
+    char *err = NULL;
+
+#define A VM_A(i)
+#define B VM_B(i)
+#define C VM_C(i)
+#define R(x) reg[x]
+#define FETCH() do{ if(steps == 0) goto budget; steps--; i = *pc++; }while(0)
+
+#ifdef VM_COMPUTED_GOTO
+    static void *labels[VM_OP_MAX] = {
+        [VM_HALT] = &&L_VM_HALT, [VM_MOV] = &&L_VM_MOV, [VM_LOADK] = &&L_VM_LOADK,
+        [VM_LOADG] = &&L_VM_LOADG, [VM_STOREG] = &&L_VM_STOREG,
+        [VM_NEG] = &&L_VM_NEG, [VM_NOT] = &&L_VM_NOT, [VM_BNOT] = &&L_VM_BNOT,
+        [VM_CAST] = &&L_VM_CAST,
+        [VM_ADD] = &&L_VM_ADD, [VM_SUB] = &&L_VM_SUB, [VM_MUL] = &&L_VM_MUL,
+        [VM_DIV] = &&L_VM_DIV, [VM_MOD] = &&L_VM_MOD, [VM_SHL] = &&L_VM_SHL,
+        [VM_SHR] = &&L_VM_SHR, [VM_BAND] = &&L_VM_BAND, [VM_BOR] = &&L_VM_BOR,
+        [VM_XOR] = &&L_VM_XOR, [VM_LT] = &&L_VM_LT, [VM_LE] = &&L_VM_LE,
+        [VM_EQ] = &&L_VM_EQ, [VM_NE] = &&L_VM_NE,
+        [VM_JMP] = &&L_VM_JMP, [VM_JMPF] = &&L_VM_JMPF, [VM_JMPT] = &&L_VM_JMPT,
+        [VM_CALL] = &&L_VM_CALL,
+    };
+#define CASE(op) L_##op
+#define NEXT() do{ FETCH(); goto *labels[VM_OP(i)]; }while(0)
+    NEXT();
+#else
+#define CASE(op) case op
+#define NEXT() goto dispatch
+dispatch:
+    FETCH();
+    switch(VM_OP(i)) {
+#endif
+
+    CASE(VM_HALT):
+        *ret = R(A);
+        vm->steps = vm->steps_max - steps;
+        return NULL;
+
+    CASE(VM_MOV): R(A) = R(B); NEXT();
+    CASE(VM_LOADK): R(A) = k[VM_BX(i)]; NEXT();
+    CASE(VM_LOADG): R(A) = g[VM_BX(i)]; NEXT();
+    CASE(VM_STOREG): g[VM_BX(i)] = R(A); NEXT();
+
+    CASE(VM_NEG):
+        if(R(B).type == VM_INT) R(A) = INT(WRAP(0, -, R(B).i));
+        else if(R(B).type == VM_FLOAT) R(A) = FLOAT(-R(B).f);
+        else { err = "Operator requires numeric operands"; goto fail; }
+        NEXT();
+
+    CASE(VM_NOT):
+        if(R(B).type == VM_VOID) { err = "Operand has no value"; goto fail; }
+        R(A) = INT(!vm_is_true(&R(B)));
+        NEXT();
+
+    CASE(VM_BNOT):
+        if(R(B).type != VM_INT) { err = "Operator requires integer operands"; goto fail; }
+        R(A) = INT(~R(B).i);
+        NEXT();
+
+    CASE(VM_CAST):
+        if((err = cast(&R(A), &R(B), C))) goto fail;
+        NEXT();
+
+    //Integer operands take the fast path
+#define BINARY(op, expr) \
+    CASE(op): \
+        if(R(B).type == VM_INT && R(C).type == VM_INT) { \
+            int64_t x = R(B).i, y = R(C).i; \
+            R(A) = INT(expr); \
+            NEXT(); \
+        } \
+        if((err = arith(vm, op, &R(A), &R(B), &R(C)))) goto fail; \
+        NEXT();
+#define BINARY_SLOW(op) \
+    CASE(op): \
+        if((err = R(B).type == VM_INT && R(C).type == VM_INT \
+                ? arith_int(op, &R(A), R(B).i, R(C).i) \
+                : arith(vm, op, &R(A), &R(B), &R(C)))) goto fail; \
+        NEXT();
+
+    BINARY(VM_ADD, WRAP(x, +, y))
+    BINARY(VM_SUB, WRAP(x, -, y))
+    BINARY(VM_MUL, WRAP(x, *, y))
+    BINARY_SLOW(VM_DIV)
+    BINARY_SLOW(VM_MOD)
+    BINARY_SLOW(VM_SHL)
+    BINARY_SLOW(VM_SHR)
+    BINARY(VM_BAND, x & y)
+    BINARY(VM_BOR, x | y)
+    BINARY(VM_XOR, x ^ y)
+    BINARY(VM_LT, x < y)
+    BINARY(VM_LE, x <= y)
+    BINARY(VM_EQ, x == y)
+    BINARY(VM_NE, x != y)
+
+    CASE(VM_JMP): pc += VM_SBX(i); NEXT();
+    CASE(VM_JMPF): if(!vm_is_true(&R(A))) pc += VM_SBX(i); NEXT();
+    CASE(VM_JMPT): if(vm_is_true(&R(A))) pc += VM_SBX(i); NEXT();
+
+    CASE(VM_CALL): {
+        struct vm_val r = {VM_VOID};
+        vm->pc = pc - code->ins - 1;
+        vm->tok = code->tok[vm->pc];
+        if((err = vm->builtin[B](vm, &R(A), C, &r))) goto fail;
+        R(A) = r;
+        NEXT();
+    }
+
+#ifndef VM_COMPUTED_GOTO
+    default: assert(0);
+    }
+#endif
+
+    //Out of steps before the instruction at pc, which may be the first
+budget:
+    vm->tok = code->tok[pc - code->ins];
+    vm->steps = vm->steps_max;
+    return "Compile time instruction budget exceeded";
+fail:
+    vm->tok = code->tok[pc - code->ins - 1];
+    vm->steps = vm->steps_max - steps;
+    return err;
+
+#undef A
+#undef B
+#undef C
+#undef R
+#undef FETCH
+#undef CASE
+#undef NEXT
+#undef BINARY
+#undef BINARY_SLOW
+}
+
+void vm_code_init(struct vm_code *code) {
+    assert(code);
+    *code = (struct vm_code){NULL};
+}
+
+void vm_code_free(struct vm_code *code) {
+    if(!code) return;
+    free(code->ins);
+    free(code->tok);
+    free(code->k);
+}
+
+//Append instruction i, from token t. Returns its index.
+int vm_emit(struct vm_code *code, vm_ins i, struct token t) {
+    if(code->n == code->c) {
+        code->c = code->c ? code->c * 2 : 64;
+        code->ins = realloc(code->ins, sizeof(*code->ins) * code->c);
+        code->tok = realloc(code->tok, sizeof(*code->tok) * code->c);
+        assert(code->ins && code->tok);
+    }
+    code->ins[code->n] = i;
+    code->tok[code->n] = t;
+    return code->n++;
+}
+
+//Add constant k. Returns its index.
+int vm_const(struct vm_code *code, struct vm_val k) {
+    if(code->k_n == code->k_c) {
+        code->k_c = code->k_c ? code->k_c * 2 : 16;
+        code->k = realloc(code->k, sizeof(*code->k) * code->k_c);
+        assert(code->k);
+    }
+    code->k[code->k_n] = k;
+    return code->k_n++;
+}
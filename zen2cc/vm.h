@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "token.h"
+
+//Register based bytecode virtual machine, which runs compile time code.
+//Instructions are 32 bits: an 8 bit opcode, an 8 bit register a, and either
+//two 8 bit operands b and c or a 16 bit operand bx. Registers are local to a
+//run, globals persist between runs.
+
+enum vm_op {
+    VM_HALT,                    //Stop, result in a
+    VM_MOV,                     //a = b
+    VM_LOADK,                   //a = constant bx
+    VM_LOADG,                   //a = global bx
+    VM_STOREG,                  //global bx = a
+    VM_NEG,                     //a = -b
+    VM_NOT,                     //a = !b
+    VM_BNOT,                    //a = ~b
+    VM_CAST,                    //a = b converted to enum type_primative c
+    VM_ADD, VM_SUB, VM_MUL, VM_DIV, VM_MOD, //a = b op c
+    VM_SHL, VM_SHR, VM_BAND, VM_BOR, VM_XOR,
+    VM_LT, VM_LE, VM_EQ, VM_NE,
+    VM_JMP,                     //Jump by signed bx
+    VM_JMPF,                    //Jump by signed bx if a is false
+    VM_JMPT,                    //Jump by signed bx if a is true
+    VM_CALL,                    //a = builtin b of the c arguments from a on
+
+    VM_OP_MAX
+};
+
+typedef uint32_t vm_ins;
+
+#define VM_INS(op, a, b, c) ((vm_ins)(op) | (vm_ins)(a) << 8 | (vm_ins)(b) << 16 | (vm_ins)(c) << 24)
+#define VM_INSX(op, a, bx) ((vm_ins)(op) | (vm_ins)(a) << 8 | (vm_ins)(bx) << 16)
+#define VM_OP(i) ((i) & 0xff)
+#define VM_A(i) ((i) >> 8 & 0xff)
+#define VM_B(i) ((i) >> 16 & 0xff)
+#define VM_C(i) ((i) >> 24)
+#define VM_BX(i) ((i) >> 16)
+#define VM_SBX(i) ((int)VM_BX(i) - 0x8000)
+#define VM_SBX_MAX 0x7fff
+
+#define VM_REG_MAX 256
+#define VM_STEPS_MAX 100000000  //Instructions executed, over all runs
+#define VM_MEM_MAX (64 << 20)   //Bytes of strings allocated, over all runs
+
+enum vm_type {VM_VOID, VM_INT, VM_FLOAT, VM_STR};
+
+struct vm_str {
+    uint32_t len;
+    char s[];                   //Not terminated
+};
+
+struct vm_val {
+    enum vm_type type;
+    union {
+        int64_t i;
+        double f;
+        struct vm_str *s;
+    };
+};
+
+//Compiled code. tok locates each instruction in the source.
+struct vm_code {
+    vm_ins *ins;
+    struct token *tok;
+    int n, c;
+
+    struct vm_val *k;           //Constants
+    int k_n, k_c;
+
+    int regs;                   //Registers used
+};
+
+struct vm;
+
+//Builtins take n arguments from args and store their result in ret. They
+//return an error message, or NULL.
+typedef char *(*vm_builtin)(struct vm *vm, struct vm_val *args, int n, struct vm_val *ret);
+
+struct vm {
+    struct vm_val *g;           //Globals
+    int g_n, g_c;
+
+    vm_builtin *builtin;
+    int builtin_n, builtin_c;
+
+    struct vm_str **strs;       //All strings allocated, freed with the vm
+    int strs_n, strs_c;
+
+    uint64_t steps, steps_max;
+    size_t mem, mem_max;
+
+    struct token tok;           //Instruction being run, for errors and builtins
+    int pc;                     //Its index, set for builtins
+    void *ctx;                  //For builtins
+};
+
+void vm_init(struct vm *vm);
+void vm_free(struct vm *vm);
+int vm_global(struct vm *vm);
+int vm_builtin_add(struct vm *vm, vm_builtin f);
+struct vm_str *vm_str(struct vm *vm, char *s, size_t len);
+char *vm_run(struct vm *vm, struct vm_code *code, struct vm_val *ret);
+bool vm_is_true(struct vm_val *v);
+char *vm_val_str(struct vm_val *v);
+
+void vm_code_init(struct vm_code *code);
+void vm_code_free(struct vm_code *code);
+int vm_emit(struct vm_code *code, vm_ins i, struct token t);
+int vm_const(struct vm_code *code, struct vm_val k);
@@ -0,0 +1,1211 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fold.h"
+#include "ir.h"
+#include "layout.h"
+#include "mono.h"
+#include "sema.h"
+#include "timing.h"
+#include "x64.h"
+
+//Code is made as tcc does, one IR instruction at a time: operands are
+//brought into rax and rcx, and the result stored back to where its var
+//lives. The vars used most live in the callee saved registers, the rest in
+//the stack frame. Integers are held in 64 bits, sign or zero extended from
+//their type as C converts them, so operating on them in a wider type is
+//exact and only results need extending again.
+//
+//Floating point values are held as their bits, float32 zero extended, and
+//operated on in xmm0 and xmm1. Stack slots are reached by their address,
+//which is constant, and copied or zeroed with rep movsb and rep stosb.
+//
+//Phis are copies on the edges into their block, made in parallel through
+//the stack. Calls pass arguments in registers, then on the stack, as the
+//SysV ABI does.
+
+enum {RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15, XMM};
+
+//Condition codes, of setcc and jcc
+enum {CC_B = 2, CC_AE, CC_E, CC_NE, CC_BE, CC_A, CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G};
+
+//Sections of the object, by their index in it
+enum x64_sect {X64_UNDEF, X64_TEXT, X64_DATA, X64_BSS, X64_RODATA, X64_INIT, X64_SECTS};
+
+enum {R_X86_64_64 = 1, R_X86_64_PC32 = 2, R_X86_64_PLT32 = 4};
+
+static const int saved[X64_REGS] = {RBX, R12, R13, R14, R15};
+static const int arg_regs[] = {RDI, RSI, RDX, RCX, R8, R9};
+#define ARG_REGS 6
+#define ARG_XMMS 8
+
+struct x64_buf {
+    uint8_t *b;
+    int n, c;
+};
+
+struct x64_sym {
+    void *key;                  //Val it is, or NULL
+    char *name;                 //Or NULL for string literals
+    enum x64_sect sect;         //Or X64_UNDEF if not defined
+    int off, size;
+    bool global, func;
+};
+
+struct x64_rel {
+    int off;                    //In the section
+    int sym, type;
+    int64_t addend;
+};
+
+//Jump to a block, its offset filled in once the block is placed
+struct x64_fix {
+    int off, block;
+};
+
+struct x64 {
+    struct parse *p;
+    char *mod;
+    int errnum;
+
+    struct x64_buf sect[X64_SECTS];     //Contents, but for X64_BSS only its size n
+    int align[X64_SECTS];               //Most alignment of what each holds
+    struct x64_rel *rels[X64_SECTS];
+    int rels_n[X64_SECTS], rels_c[X64_SECTS];
+    struct x64_sym *syms;
+    int syms_n, syms_c;
+
+    //Function being emitted
+    struct ir_func *f;
+    int *home;                  //Register each var lives in, or negative offset from rbp
+    int *slot;                  //Offset from rbp of the stack slot a var is the address of
+    int ret;                    //Bytes of the floating point value returned, or 0
+    int saved_n;                //Callee saved registers used, saved on entry
+    int *at;                    //Offset of each block
+    struct x64_fix *fixes;
+    int fixes_n, fixes_c;
+};
+
+#define ERRBUF_SIZE 1024
+static char err_buf[ERRBUF_SIZE];
+
+static void *grow(void *a, int n, int *c, size_t size) {
+    if(n < *c) return a;
+    *c = *c ? *c * 2 : X64_INITIAL_CAP;
+    a = realloc(a, *c * size);
+    assert(a);
+    return a;
+}
+
+static void error(struct x64 *x, struct token t, char *msg) {
+    x->p->error(x->p->ts, t, msg);
+    x->errnum++;
+}
+
+static void mem(struct x64_buf *b, const void *s, int n) {
+    if(!n) return;
+    while(b->n + n > b->c) b->b = grow(b->b, b->c, &b->c, 1);
+    memcpy(b->b + b->n, s, n);
+    b->n += n;
+}
+
+static void u8(struct x64_buf *b, uint8_t v) {
+    mem(b, &v, 1);
+}
+
+static void u16(struct x64_buf *b, uint16_t v) {
+    mem(b, &v, 2);
+}
+
+static void u32(struct x64_buf *b, uint32_t v) {
+    mem(b, &v, 4);
+}
+
+static void u64(struct x64_buf *b, uint64_t v) {
+    mem(b, &v, 8);
+}
+
+static void align(struct x64_buf *b, int a, uint8_t fill) {
+    while(b->n % a) u8(b, fill);
+}
+
+
+//Symbols
+
+static int sym(struct x64 *x, void *key) {
+    for(int i = 0; i < x->syms_n; i++) if(key && x->syms[i].key == key) return i;
+    x->syms = grow(x->syms, x->syms_n, &x->syms_c, sizeof *x->syms);
+    x->syms[x->syms_n] = (struct x64_sym){key};
+    return x->syms_n++;
+}
+
+static char *name(struct x64 *x, struct val *v, char *key) {
+    int n = strlen(x->mod) + strlen(key) + 3;
+    if(v->type == VAL_FUNC && v->type_ident) n += strlen(v->type_ident) + 2;
+    if(v->type == VAL_FUNC && v->mod) n += strlen(v->mod) + 2;
+
+    char *s = malloc(n + 1);
+    assert(s);
+    if(v->type == VAL_FUNC && v->mod) snprintf(s, n + 1, "%s__%s__%s__%s", x->mod, v->mod, v->type_ident, key);
+    else if(v->type == VAL_FUNC && v->type_ident) snprintf(s, n + 1, "%s__%s__%s", x->mod, v->type_ident, key);
+    else snprintf(s, n + 1, "%s__%s", x->mod, key);
+    return s;
+}
+
+static void name_val(struct x64 *x, struct val *v, char *key) {
+    int i = sym(x, v);
+    struct x64_sym *s = &x->syms[i];
+    s->name = name(x, v, key);
+    s->global = v->export;
+    s->func = v->type == VAL_FUNC;
+}
+
+//Functions of module v, loaded by the driver, that other modules can call,
+//as symbols left to the object of their module to define
+static void import(struct x64 *x, struct val *v) {
+    struct ns *ns = &v->loaded->globals;
+    for(int i = 0; i < ns->n; i++) {
+        if(!val_is_portable(&ns->val[i])) continue;
+        struct x64_sym *s = &x->syms[sym(x, &ns->val[i])];
+        int n = strlen(v->mod_name) + strlen(ns->key[i]) + 3;
+        s->name = malloc(n);
+        assert(s->name);
+        snprintf(s->name, n, "%s__%s", v->mod_name, ns->key[i]);
+        s->global = s->func = true;
+    }
+}
+
+//Relocation of type at off in sect, against symbol s
+static void rel(struct x64 *x, enum x64_sect sect, int off, int s, int type, int64_t addend) {
+    x->rels[sect] = grow(x->rels[sect], x->rels_n[sect], &x->rels_c[sect], sizeof *x->rels[sect]);
+    x->rels[sect][x->rels_n[sect]++] = (struct x64_rel){off, s, type, addend};
+}
+
+//Symbol of the bytes of string literal s, with a terminating 0
+static int str(struct x64 *x, struct token t) {
+    struct x64_buf *b = &x->sect[X64_RODATA];
+    char *s = malloc(t.len + 1);
+    assert(s);
+    int n = token_unescape(t, s);
+
+    int i = sym(x, NULL);
+    x->syms[i] = (struct x64_sym){NULL, NULL, X64_RODATA, b->n, n + 1};
+    mem(b, s, n);
+    u8(b, 0);
+    free(s);
+    return i;
+}
+
+
+//Types
+
+//Width and signedness of values of t as held in a register, false for
+//floats, whose width is that in memory
+static bool width(struct type *t, int *bits, bool *sign) {
+    t = sema_resolve(t);
+    if(t->type == TYPE_ENUM) t = sema_resolve(t->repr ? t->repr : type_prim(TYPE_INT));
+    *bits = 64, *sign = false;
+    if(t->type != TYPE_PRIMATIVE || t->primative == TYPE_VOID) return true;
+    if(t->primative >= TYPE_FLOAT) {
+        layout_type(t);
+        *bits = t->size * 8;
+        return false;
+    }
+    if(t->primative == TYPE_BOOL) {
+        *bits = 32, *sign = true;
+        return true;
+    }
+    layout_type(t);
+    *bits = t->size * 8;
+    *sign = t->primative < TYPE_UINT;
+    return true;
+}
+
+//Bytes of floating point type t, 0 if t is not one
+static int fp(struct type *t) {
+    int bits;
+    bool sign;
+    return t && !width(t, &bits, &sign) ? bits / 8 : 0;
+}
+
+static bool is_signed(struct type *t) {
+    int bits;
+    bool sign;
+    return width(t, &bits, &sign) && sign;
+}
+
+static bool is_ptr(struct type *t) {
+    t = sema_resolve(t);
+    return t->type == TYPE_PTR || t->type == TYPE_FUNC || t->type == TYPE_ARRAY;
+}
+
+//Size of what pointer t points at, as GNU C scales by
+static int scale(struct type *t) {
+    t = sema_resolve(t);
+    if(t->type != TYPE_PTR && t->type != TYPE_ARRAY) return 1;
+    struct type *of = sema_resolve(t->of);
+    layout_type(of);
+    return of->size > 0 ? of->size : 1;
+}
+
+
+//Instructions
+
+static struct x64_buf *text(struct x64 *x) {
+    return &x->sect[X64_TEXT];
+}
+
+static void rex(struct x64 *x, bool w, int r, int b, bool force) {
+    uint8_t v = 0x40 | w << 3 | (r >> 3) << 2 | (b >> 3);
+    if(v != 0x40 || force) u8(text(x), v);
+}
+
+//Opcode of one byte, or two after 0x0f
+static void opcode(struct x64 *x, int op) {
+    if(op > 0xff) u8(text(x), op >> 8);
+    u8(text(x), op);
+}
+
+//op with register operand r, or opcode extension, and register rm
+static void rr(struct x64 *x, bool w, int op, int r, int rm) {
+    rex(x, w, r, rm, true);
+    opcode(x, op);
+    u8(text(x), 0xc0 | (r & 7) << 3 | (rm & 7));
+}
+
+//op with register operand r and memory at base + disp
+static void rm(struct x64 *x, bool w, int op, int r, int base, int disp) {
+    rex(x, w, r, base, true);
+    opcode(x, op);
+    u8(text(x), 0x80 | (r & 7) << 3 | (base & 7));
+    if((base & 7) == RSP) u8(text(x), 0x24);
+    u32(text(x), disp);
+}
+
+static void mov(struct x64 *x, int d, int s) {
+    if(d != s) rr(x, true, 0x89, s, d);
+}
+
+static void mov_imm(struct x64 *x, int r, int64_t i) {
+    if(i >= INT32_MIN && i <= INT32_MAX) {
+        rr(x, true, 0xc7, 0, r);
+        u32(text(x), i);
+    } else {
+        rex(x, true, 0, r, true);
+        u8(text(x), 0xb8 | (r & 7));
+        u64(text(x), i);
+    }
+}
+
+//op of rsp and an immediate, by opcode extension
+static void rsp_imm(struct x64 *x, int ext, int32_t i) {
+    if(!i) return;
+    rr(x, true, 0x81, ext, RSP);
+    u32(text(x), i);
+}
+
+static void push(struct x64 *x, int r) {
+    if(r > 7) u8(text(x), 0x41);
+    u8(text(x), 0x50 | (r & 7));
+}
+
+static void pop(struct x64 *x, int r) {
+    if(r > 7) u8(text(x), 0x41);
+    u8(text(x), 0x58 | (r & 7));
+}
+
+//Address of symbol s into r
+static void lea(struct x64 *x, int r, int s) {
+    rex(x, true, r, 0, true);
+    u8(text(x), 0x8d);
+    u8(text(x), 0x05 | (r & 7) << 3);
+    rel(x, X64_TEXT, text(x)->n, s, R_X86_64_PC32, -4);
+    u32(text(x), 0);
+}
+
+//Sign or zero extend r from bits to 64
+static void extend(struct x64 *x, int r, int bits, bool sign) {
+    switch(bits) {
+    case 8: rr(x, true, sign ? 0x0fbe : 0x0fb6, r, r); break;
+    case 16: rr(x, true, sign ? 0x0fbf : 0x0fb7, r, r); break;
+    case 32:
+        if(sign) rr(x, true, 0x63, r, r);
+        else rr(x, false, 0x89, r, r);
+        break;
+    }
+}
+
+//r converted to type t
+static void convert(struct x64 *x, int r, struct type *t) {
+    int bits;
+    bool sign;
+    if(width(t, &bits, &sign)) extend(x, r, bits, sign);
+}
+
+//r loaded from [base] as type t
+static void load(struct x64 *x, int r, int base, struct type *t) {
+    int bits;
+    bool sign;
+    width(t, &bits, &sign);
+    switch(bits) {
+    case 8: rm(x, true, sign ? 0x0fbe : 0x0fb6, r, base, 0); break;
+    case 16: rm(x, true, sign ? 0x0fbf : 0x0fb7, r, base, 0); break;
+    case 32: rm(x, sign, sign ? 0x63 : 0x8b, r, base, 0); break;
+    default: rm(x, true, 0x8b, r, base, 0); break;
+    }
+}
+
+//r stored to [base] as type t
+static void store(struct x64 *x, int r, int base, struct type *t) {
+    int bits;
+    bool sign;
+    width(t, &bits, &sign);
+    if(bits == 16) u8(text(x), 0x66);
+    rm(x, bits == 64, bits == 8 ? 0x88 : 0x89, r, base, 0);
+}
+
+static void jump(struct x64 *x, int cc, int block) {
+    if(cc < 0) u8(text(x), 0xe9);
+    else u8(text(x), 0x0f), u8(text(x), 0x80 | cc);
+    x->fixes = grow(x->fixes, x->fixes_n, &x->fixes_c, sizeof *x->fixes);
+    x->fixes[x->fixes_n++] = (struct x64_fix){text(x)->n, block};
+    u32(text(x), 0);
+}
+
+
+//Short jump on cc, or always if cc < 0, to where land() is called with
+//what it returns
+static int skip(struct x64 *x, int cc) {
+    u8(text(x), cc < 0 ? 0xeb : 0x70 | cc);
+    u8(text(x), 0);
+    return text(x)->n;
+}
+
+static void land(struct x64 *x, int from) {
+    text(x)->b[from - 1] = text(x)->n - from;
+}
+
+//SSE op after its mandatory prefix, if any, with register operands r and rm
+static void sse(struct x64 *x, int prefix, bool w, int op, int r, int rm) {
+    if(prefix) u8(text(x), prefix);
+    rr(x, w, op, r, rm);
+}
+
+//Bits of a float of n bytes between xmm register v and register r
+static void movq(struct x64 *x, bool to_xmm, int v, int r, int n) {
+    sse(x, 0x66, n == 8, to_xmm ? 0x0f6e : 0x0f7e, v, r);
+}
+
+//rax converted from type from to type to as C converts, through rdx, xmm0
+//and xmm1 for floats
+static void cast(struct x64 *x, struct type *from, struct type *to) {
+    int f = fp(from), t = fp(to), pre = t == 4 ? 0xf3 : 0xf2;
+    int bits;
+    bool sign;
+
+    if(!f && !t) {
+        convert(x, RAX, to);
+        return;
+    }
+    if(f && t) {
+        if(f == t) return;
+        movq(x, true, 0, RAX, f);
+        sse(x, f == 4 ? 0xf3 : 0xf2, false, 0x0f5a, 0, 0);
+        movq(x, false, 0, RAX, t);
+        return;
+    }
+
+    //Integers are exact in 64 bits, but for uint64 of the top bit set, which
+    //is halved keeping the bit rounded by, converted and doubled
+    if(t) {
+        width(from, &bits, &sign);
+        int big = -1, done = -1;
+        if(bits == 64 && !sign) {
+            rr(x, true, 0x85, RAX, RAX);
+            big = skip(x, CC_S);
+        }
+        sse(x, pre, true, 0x0f2a, 0, RAX);
+        if(big >= 0) {
+            done = skip(x, -1);
+            land(x, big);
+            mov(x, RDX, RAX);
+            rr(x, true, 0xd1, 5, RDX);
+            rr(x, false, 0x83, 4, RAX);
+            u8(text(x), 1);
+            rr(x, true, 0x09, RAX, RDX);
+            sse(x, pre, true, 0x0f2a, 0, RDX);
+            sse(x, pre, false, 0x0f58, 0, 0);
+            land(x, done);
+        }
+        movq(x, false, 0, RAX, t);
+        return;
+    }
+
+    //Floats are truncated as doubles, those of uint64 from 2^63 less 2^63
+    //and the top bit set after
+    movq(x, true, 0, RAX, f);
+    if(f == 4) sse(x, 0xf3, false, 0x0f5a, 0, 0);
+    width(to, &bits, &sign);
+    if(bits == 64 && !sign) {
+        mov_imm(x, RAX, 0x43e0000000000000);
+        movq(x, true, 1, RAX, 8);
+        sse(x, 0x66, false, 0x0f2e, 0, 1);
+        int big = skip(x, CC_AE);
+        sse(x, 0xf2, true, 0x0f2c, RAX, 0);
+        int done = skip(x, -1);
+        land(x, big);
+        sse(x, 0xf2, false, 0x0f5c, 0, 1);
+        sse(x, 0xf2, true, 0x0f2c, RAX, 0);
+        rr(x, true, 0x0fba, 7, RAX);
+        u8(text(x), 63);
+        land(x, done);
+        return;
+    }
+    sse(x, 0xf2, true, 0x0f2c, RAX, 0);
+    convert(x, RAX, to);
+}
+
+
+//Values
+
+//Value leaf e into r: the address of a function, global or string, or an
+//integer constant, or the bits of a real one as a double
+static void leaf(struct x64 *x, int r, struct expr *e) {
+    struct val *v = e->val;
+    struct token s;
+    int64_t i;
+    double d;
+
+    if(e->type == EXPR_IDENT && !e->local && e->arg < 0 && v && (v->type == VAL_FUNC || v->type == VAL_VAR))
+        lea(x, r, sym(x, v));
+    else if(fold_str(x->p, e, &s)) lea(x, r, str(x, s));
+    else if(fold_int(x->p, e, &i)) mov_imm(x, r, i);
+    else if(fold_real(x->p, e, &d)) {
+        memcpy(&i, &d, 8);
+        mov_imm(x, r, i);
+    } else error(x, expr_tok(e), "Value not supported by the x86-64 backend");
+}
+
+static void get(struct x64 *x, int r, struct ir_val v) {
+    switch(v.kind) {
+    case IR_VAR:
+        if(x->home[v.var] >= 0) mov(x, r, x->home[v.var]);
+        else rm(x, true, 0x8b, r, RBP, x->home[v.var]);
+        return;
+    case IR_INT: mov_imm(x, r, v.i); return;
+    case IR_LEAF: leaf(x, r, v.leaf); return;
+    case IR_GLOBAL: lea(x, r, sym(x, v.global)); return;
+    case IR_NONE: return;
+    }
+}
+
+static void put(struct x64 *x, int d, int r) {
+    if(x->home[d] >= 0) mov(x, x->home[d], r);
+    else rm(x, true, 0x89, r, RBP, x->home[d]);
+}
+
+//Address of the memory in loads or stores into rax, through rcx
+static void address(struct x64 *x, struct ir_ins *in) {
+    get(x, RAX, in->a);
+    if(in->b.kind == IR_NONE) return;
+    get(x, RCX, in->b);
+
+    //cmp rcx, n; jb ok; ud2
+    if(in->n >= 0) {
+        rr(x, true, 0x81, 7, RCX);
+        u32(text(x), in->n);
+        u8(text(x), 0x72), u8(text(x), 2);
+        u8(text(x), 0x0f), u8(text(x), 0x0b);
+    }
+
+    struct type *t = sema_resolve(in->ty);
+    layout_type(t);
+    if(t->size != 1) {
+        rr(x, true, 0x69, RCX, RCX);
+        u32(text(x), t->size);
+    }
+    rr(x, true, 0x01, RCX, RAX);
+}
+
+//Register each argument of types ts is passed in, as the SysV ABI classes
+//them: integers and pointers in arg_regs, floats in xmm registers, from
+//XMM on, and the rest on the stack, -1. Returns how many are on the stack.
+static int classify(struct type **ts, int n, int *regs) {
+    int ints = 0, xmms = 0, stack = 0;
+    for(int i = 0; i < n; i++) {
+        if(fp(ts[i]) && xmms < ARG_XMMS) regs[i] = XMM + xmms++;
+        else if(!fp(ts[i]) && ints < ARG_REGS) regs[i] = arg_regs[ints++];
+        else regs[i] = -1, stack++;
+    }
+    return stack;
+}
+
+static void call(struct x64 *x, struct ir_ins *in) {
+    struct val *v = in->f;
+    int n = in->args_n, regs[n + 1];
+    struct type *ts[n + 1];
+    for(int i = 0; i < n; i++) ts[i] = i < v->args_n ? v->args_type[i] : type_prim(TYPE_INT64);
+    int stack = classify(ts, n, regs), pad = stack % 2;
+
+    //Those on the stack are pushed last first, then those in registers,
+    //which pop in order
+    rsp_imm(x, 5, pad * 8);
+    for(int r = 0; r < 2; r++)
+        for(int i = n - 1; i >= 0; i--) {
+            if((regs[i] < 0) != !r) continue;
+            get(x, RAX, in->args[i]);
+            convert(x, RAX, ts[i]);
+            push(x, RAX);
+        }
+    for(int i = 0; i < n; i++) {
+        if(regs[i] < 0) continue;
+        if(regs[i] < XMM) pop(x, regs[i]);
+        else {
+            pop(x, RAX);
+            movq(x, true, regs[i] - XMM, RAX, 8);
+        }
+    }
+
+    u8(text(x), 0xe8);
+    rel(x, X64_TEXT, text(x)->n, sym(x, v), R_X86_64_PLT32, -4);
+    u32(text(x), 0);
+    rsp_imm(x, 0, (stack + pad) * 8);
+    if(in->d < 0) return;
+    if(fp(x->f->vars[in->d].ty)) movq(x, false, 0, RAX, fp(x->f->vars[in->d].ty));
+    put(x, in->d, RAX);
+}
+
+//Binary op of rax and rcx in type t, into rax
+static void binary(struct x64 *x, struct ir_ins *in) {
+    static const int ops[] = {[IR_ADD] = 0x01, [IR_SUB] = 0x29, [IR_BAND] = 0x21, [IR_XOR] = 0x31, [IR_BOR] = 0x09};
+    static const int scc[] = {[IR_LT] = CC_L, [IR_LE] = CC_LE, [IR_GT] = CC_G, [IR_GE] = CC_GE, [IR_EQ] = CC_E, [IR_NE] = CC_NE};
+    static const int ucc[] = {[IR_LT] = CC_B, [IR_LE] = CC_BE, [IR_GT] = CC_A, [IR_GE] = CC_AE, [IR_EQ] = CC_E, [IR_NE] = CC_NE};
+    struct ir_func *f = x->f;
+    struct type *t = in->ty, *ta = ir_type(f, in->a), *tb = ir_type(f, in->b);
+    bool sign = is_signed(t);
+
+    get(x, RAX, in->a);
+    get(x, RCX, in->b);
+
+    //Pointer arithmetic scales the integer, and the difference of pointers
+    //is divided
+    if(is_ptr(t) && (in->op == IR_ADD || in->op == IR_SUB)) {
+        bool both = is_ptr(ta) && is_ptr(tb);
+        int r = !is_ptr(ta) ? RAX : RCX, s = scale(t);
+        if(!both && s != 1) {
+            rr(x, true, 0x69, r, r);
+            u32(text(x), s);
+        }
+        rr(x, true, ops[in->op], RCX, RAX);
+        if(both && s != 1) {
+            mov_imm(x, RCX, s);
+            u8(text(x), 0x48), u8(text(x), 0x99);
+            rr(x, true, 0xf7, 7, RCX);
+        }
+        return;
+    }
+
+    convert(x, RAX, t);
+    if(in->op != IR_BSL && in->op != IR_BSR) convert(x, RCX, t);
+
+    switch(in->op) {
+    case IR_MUL: rr(x, true, 0x0faf, RAX, RCX); break;
+    case IR_DIV: case IR_MOD:
+        if(sign) u8(text(x), 0x48), u8(text(x), 0x99);
+        else rr(x, false, 0x31, RDX, RDX);
+        rr(x, true, 0xf7, sign ? 7 : 6, RCX);
+        if(in->op == IR_MOD) mov(x, RAX, RDX);
+        break;
+    case IR_BSL: rr(x, true, 0xd3, 4, RAX); break;
+    case IR_BSR: rr(x, true, 0xd3, sign ? 7 : 5, RAX); break;
+    case IR_LT: case IR_LE: case IR_GT: case IR_GE: case IR_EQ: case IR_NE:
+        rr(x, true, 0x39, RCX, RAX);
+        u8(text(x), 0x0f), u8(text(x), 0x90 | (sign ? scc : ucc)[in->op]), u8(text(x), 0xc0);
+        rr(x, false, 0x0fb6, RAX, RAX);
+        break;
+    default: rr(x, true, ops[in->op], RCX, RAX); break;
+    }
+}
+
+//Binary op of a and b in floating point type ty, into rax. Compares are
+//false if either is NaN, but for !=.
+static void fbinary(struct x64 *x, struct ir_ins *in) {
+    static const int ops[] = {[IR_MUL] = 0x0f59, [IR_DIV] = 0x0f5e, [IR_ADD] = 0x0f58, [IR_SUB] = 0x0f5c};
+    struct ir_func *f = x->f;
+    int n = fp(in->ty);
+
+    get(x, RAX, in->b);
+    cast(x, ir_type(f, in->b), in->ty);
+    mov(x, RCX, RAX);
+    get(x, RAX, in->a);
+    cast(x, ir_type(f, in->a), in->ty);
+    movq(x, true, 0, RAX, n);
+    movq(x, true, 1, RCX, n);
+
+    switch(in->op) {
+    case IR_MUL: case IR_DIV: case IR_ADD: case IR_SUB:
+        sse(x, n == 4 ? 0xf3 : 0xf2, false, ops[in->op], 0, 1);
+        movq(x, false, 0, RAX, n);
+        return;
+
+    //a < b is b > a, and unordered sets the carry
+    case IR_LT: case IR_LE: case IR_GT: case IR_GE: {
+        bool swap = in->op == IR_LT || in->op == IR_LE;
+        sse(x, n == 4 ? 0 : 0x66, false, 0x0f2e, swap, !swap);
+        int cc = in->op == IR_LT || in->op == IR_GT ? CC_A : CC_AE;
+        u8(text(x), 0x0f), u8(text(x), 0x90 | cc), u8(text(x), 0xc0);
+        break;
+    }
+    default: {
+        bool eq = in->op == IR_EQ;
+        sse(x, n == 4 ? 0 : 0x66, false, 0x0f2e, 0, 1);
+        u8(text(x), 0x0f), u8(text(x), 0x90 | (eq ? CC_E : CC_NE)), u8(text(x), 0xc0);
+        u8(text(x), 0x0f), u8(text(x), 0x90 | (eq ? CC_NP : CC_P)), u8(text(x), 0xc1);
+        rr(x, false, eq ? 0x20 : 0x08, RCX, RAX);
+        break;
+    }
+    }
+    rr(x, false, 0x0fb6, RAX, RAX);
+}
+
+//Whether rax, of type t, is not 0. The sign of a float is shifted out, as
+//-0.0 is false.
+static void test(struct x64 *x, struct type *t) {
+    if(fp(t)) rr(x, fp(t) == 8, 0xd1, 4, RAX);
+    rr(x, true, 0x85, RAX, RAX);
+}
+
+//Copies the phis of block s make on the edge from block k
+static void phis(struct x64 *x, int k, int s) {
+    struct ir_block *bs = &x->f->blocks[s];
+    int e = 0, n = 0;
+    while(bs->preds[e] != k) e++;
+    while(n < bs->ins_n && bs->ins[n].op == IR_PHI) n++;
+
+    for(int i = 0; i < n; i++) {
+        get(x, RAX, bs->ins[i].args[e]);
+        push(x, RAX);
+    }
+    for(int i = n - 1; i >= 0; i--) {
+        pop(x, RAX);
+        put(x, bs->ins[i].d, RAX);
+    }
+}
+
+static void ins(struct x64 *x, int k, int next, struct ir_ins *in) {
+    struct ir_func *f = x->f;
+    struct ir_block *bk = &f->blocks[k];
+
+    switch(in->op) {
+    case IR_NOP: case IR_PHI: case IR_UNDEF: return;
+
+    case IR_COPY:
+        get(x, RAX, in->a);
+        cast(x, ir_type(f, in->a), f->vars[in->d].ty);
+        break;
+    case IR_NEG: case IR_BNOT:
+        get(x, RAX, in->a);
+        convert(x, RAX, in->ty);
+        if(fp(in->ty)) {
+            rr(x, true, 0x0fba, 7, RAX);
+            u8(text(x), fp(in->ty) * 8 - 1);
+        } else rr(x, true, 0xf7, in->op == IR_NEG ? 3 : 2, RAX);
+        break;
+    case IR_LNOT:
+        get(x, RAX, in->a);
+        test(x, ir_type(f, in->a));
+        u8(text(x), 0x0f), u8(text(x), 0x90 | CC_E), u8(text(x), 0xc0);
+        rr(x, false, 0x0fb6, RAX, RAX);
+        break;
+
+    case IR_LOAD:
+        address(x, in);
+        load(x, RAX, RAX, in->ty);
+        break;
+    case IR_STORE:
+        address(x, in);
+        get(x, RCX, in->c);
+        store(x, RCX, RAX, in->ty);
+        return;
+    case IR_SLOT: rm(x, true, 0x8d, RAX, RBP, -x->slot[in->d]); break;
+    case IR_INDEX: address(x, in); break;
+    case IR_ZERO: case IR_MOVE: {
+        struct type *t = sema_resolve(in->ty);
+        layout_type(t);
+        if(in->op == IR_MOVE) {
+            get(x, RAX, in->b);
+            mov(x, RSI, RAX);
+        }
+        get(x, RAX, in->a);
+        mov(x, RDI, RAX);
+        mov_imm(x, RCX, t->size);
+        if(in->op == IR_ZERO) rr(x, false, 0x31, RAX, RAX);
+        u8(text(x), 0xf3), u8(text(x), in->op == IR_ZERO ? 0xaa : 0xa4);
+        return;
+    }
+    case IR_CALL: call(x, in); return;
+
+    case IR_JUMP:
+        phis(x, k, bk->succ[0]);
+        if(bk->succ[0] != next) jump(x, -1, bk->succ[0]);
+        return;
+    case IR_BRANCH:
+        get(x, RAX, in->a);
+        test(x, ir_type(f, in->a));
+        if(bk->succ[0] == next) jump(x, CC_E, bk->succ[1]);
+        else {
+            jump(x, CC_NE, bk->succ[0]);
+            if(bk->succ[1] != next) jump(x, -1, bk->succ[1]);
+        }
+        return;
+    case IR_RET:
+        get(x, RAX, in->a);
+        if(x->ret) movq(x, true, 0, RAX, x->ret);
+        for(int i = 0; i < x->saved_n; i++) rm(x, true, 0x8b, saved[i], RBP, -8 * (i + 1));
+        u8(text(x), 0xc9);
+        u8(text(x), 0xc3);
+        return;
+
+    default:
+        if(fp(in->ty)) fbinary(x, in);
+        else binary(x, in);
+        break;
+    }
+
+    convert(x, RAX, f->vars[in->d].ty);
+    put(x, in->d, RAX);
+}
+
+
+//Functions
+
+static bool supported(struct x64 *x, struct ir_val v) {
+    return fp(ir_type(x->f, v)) != 2;
+}
+
+//Whether f holds no 16 bit floats, which SSE has no arithmetic on
+static bool integral(struct x64 *x) {
+    struct ir_func *f = x->f;
+    for(int i = 0; i < f->vars_n; i++) if(fp(f->vars[i].ty) == 2) return false;
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            if(fp(in->ty) == 2) return false;
+            if(!supported(x, in->a) || !supported(x, in->b) || !supported(x, in->c)) return false;
+            for(int k = 0; k < in->args_n; k++) if(!supported(x, in->args[k])) return false;
+        }
+    return true;
+}
+
+//Where each var of f lives: those used most in the callee saved registers,
+//after them in the frame those that are not, then the stack slots. Returns
+//the size of the frame.
+static int homes(struct x64 *x) {
+    struct ir_func *f = x->f;
+    int *uses = calloc(f->vars_n + 1, sizeof *uses);
+    assert(uses);
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            struct ir_val ops[] = {in->a, in->b, in->c};
+            if(in->d >= 0) uses[in->d]++;
+            for(int k = 0; k < 3; k++) if(ops[k].kind == IR_VAR) uses[ops[k].var]++;
+            for(int k = 0; k < in->args_n; k++) if(in->args[k].kind == IR_VAR) uses[in->args[k].var]++;
+        }
+    for(int i = 0; i < f->vars_n; i++) if(f->vars[i].arg >= 0) uses[i]++;
+
+    for(int i = 0; i < f->vars_n; i++) x->home[i] = -1;
+    for(x->saved_n = 0; x->saved_n < X64_REGS; x->saved_n++) {
+        int best = -1;
+        for(int i = 0; i < f->vars_n; i++)
+            if(x->home[i] == -1 && uses[i] && (best < 0 || uses[i] > uses[best])) best = i;
+        if(best < 0) break;
+        x->home[best] = saved[x->saved_n];
+    }
+    int slots = x->saved_n;
+    for(int i = 0; i < f->vars_n; i++) if(x->home[i] == -1) x->home[i] = -8 * ++slots;
+
+    //rbp is 16 aligned, so slots are aligned to at most that
+    int frame = slots * 8;
+    for(int i = 0; i < f->blocks_n; i++)
+        for(int j = 0; j < f->blocks[i].ins_n; j++) {
+            struct ir_ins *in = &f->blocks[i].ins[j];
+            if(in->op != IR_SLOT) continue;
+            struct type *t = sema_resolve(in->ty);
+            layout_type(t);
+            int a = t->align < 1 ? 1 : t->align > 16 ? 16 : t->align;
+            frame = (frame + (t->size > 0 ? t->size : 1) + a - 1) / a * a;
+            x->slot[in->d] = frame;
+        }
+
+    free(uses);
+    return (frame + 15) / 16 * 16;
+}
+
+//Code of f as symbol i, returning a float of ret bytes, or 0
+static void body(struct x64 *x, struct ir_func *f, int i, int ret) {
+    x->f = f;
+    x->ret = ret;
+    x->home = malloc((f->vars_n + 1) * sizeof *x->home);
+    x->slot = malloc((f->vars_n + 1) * sizeof *x->slot);
+    x->at = malloc((f->blocks_n + 1) * sizeof *x->at);
+    assert(x->home); assert(x->slot); assert(x->at);
+    x->fixes_n = 0;
+
+    align(text(x), 16, 0x90);
+    x->syms[i].sect = X64_TEXT;
+    x->syms[i].off = text(x)->n;
+
+    //push rbp; mov rbp, rsp; sub rsp, frame
+    push(x, RBP);
+    mov(x, RBP, RSP);
+    rsp_imm(x, 5, homes(x));
+    for(int i = 0; i < x->saved_n; i++) rm(x, true, 0x89, saved[i], RBP, -8 * (i + 1));
+
+    //Arguments are where classify() has the caller pass them
+    int n = 0;
+    for(int i = 0; i < f->vars_n; i++) if(f->vars[i].arg >= n) n = f->vars[i].arg + 1;
+    struct type *ts[n + 1];
+    int regs[n + 1], stack[n + 1];
+    for(int i = 0; i < n; i++) ts[i] = type_prim(TYPE_INT64);
+    for(int i = 0; i < f->vars_n; i++) if(f->vars[i].arg >= 0) ts[f->vars[i].arg] = f->vars[i].ty;
+    classify(ts, n, regs);
+    for(int a = 0, s = 0; a < n; a++) stack[a] = regs[a] < 0 ? s++ : -1;
+
+    for(int i = 0; i < f->vars_n; i++) {
+        int a = f->vars[i].arg;
+        if(a < 0) continue;
+        if(regs[a] >= XMM) {
+            movq(x, false, regs[a] - XMM, RAX, fp(ts[a]));
+            put(x, i, RAX);
+        } else if(regs[a] >= 0) put(x, i, regs[a]);
+        else {
+            rm(x, true, 0x8b, RAX, RBP, 16 + 8 * stack[a]);
+            put(x, i, RAX);
+        }
+    }
+
+    for(int k = 0; k < f->blocks_n; k++) {
+        if(f->blocks[k].dead) continue;
+        int next = k + 1;
+        while(next < f->blocks_n && f->blocks[next].dead) next++;
+        x->at[k] = text(x)->n;
+        for(int j = 0; j < f->blocks[k].ins_n; j++) ins(x, k, next, &f->blocks[k].ins[j]);
+    }
+    for(int i = 0; i < x->fixes_n; i++) {
+        struct x64_fix *fx = &x->fixes[i];
+        uint32_t d = x->at[fx->block] - (fx->off + 4);
+        memcpy(text(x)->b + fx->off, &d, 4);
+    }
+
+    x->syms[i].size = text(x)->n - x->syms[i].off;
+    free(x->home);
+    free(x->slot);
+    free(x->at);
+    timing_count(TIMING_X64, 1);
+}
+
+static void func(struct x64 *x, struct val *v, char *key) {
+    struct token at = expr_tok(&v->func_expr);
+    x->f = v->ir;
+    if(!x->f || !integral(x)) {
+        snprintf(err_buf, ERRBUF_SIZE, "Function '%s' is not supported by the x86-64 backend%s", key,
+                x->f ? ", which has no 16 bit floating point" : "");
+        error(x, at, err_buf);
+        return;
+    }
+    body(x, v->ir, sym(x, v), v->ret_n == 1 ? fp(v->ret_type[0]) : 0);
+}
+
+//Function storing the globals initialized at run time, called before main
+//through .init_array
+static void init_func(struct x64 *x) {
+    int s = sym(x, NULL), n = strlen(x->mod) + 7;
+    char *name = malloc(n);
+    assert(name);
+    snprintf(name, n, "%s__init", x->mod);
+    x->syms[s] = (struct x64_sym){NULL, name, X64_TEXT, 0, 0, false, true};
+    body(x, x->p->init, s, 0);
+
+    struct x64_buf *b = &x->sect[X64_INIT];
+    rel(x, X64_INIT, b->n, s, R_X86_64_64, 0);
+    u64(b, 0);
+}
+
+//main of the program, calling that of the module and returning its result,
+//or 0 if it has none
+static void main_func(struct x64 *x, struct val *main) {
+    int s = sym(x, NULL);
+    align(text(x), 16, 0x90);
+    x->syms[s] = (struct x64_sym){NULL, strdup("main"), X64_TEXT, text(x)->n, 0, true, true};
+
+    push(x, RBP);
+    u8(text(x), 0xe8);
+    rel(x, X64_TEXT, text(x)->n, sym(x, main), R_X86_64_PLT32, -4);
+    u32(text(x), 0);
+    if(main->ret_n == 0 || sema_resolve(main->ret_type[0]) == type_prim(TYPE_VOID))
+        rr(x, false, 0x31, RAX, RAX);
+    pop(x, RBP);
+    u8(text(x), 0xc3);
+    x->syms[s].size = text(x)->n - x->syms[s].off;
+}
+
+
+//Globals
+
+static struct type *var_type(struct val *v) {
+    if(v->expr_type->type != TYPE_NONE) return v->expr_type;
+    return v->expr.ty ? v->expr.ty : type_none();
+}
+
+//Write initializer e of type t at off in .data, as ir_data() allows. The
+//bytes are zero already. False if a value cannot be written.
+static bool constant(struct x64 *x, int off, struct type *t, struct expr *e) {
+    struct x64_buf *b = &x->sect[X64_DATA];
+    struct type *s = sema_resolve(t);
+    struct expr *l = e->type == EXPR_ADDR ? e->l : e;
+    struct token lit;
+    int64_t i;
+    double d;
+
+    if(s->type == TYPE_ENUM) s = sema_resolve(s->repr ? s->repr : type_prim(TYPE_INT));
+    layout_type(s);
+    if(e->type == EXPR_NONE) return true;
+    if(e->type == EXPR_COMP_LIT && s->type == TYPE_STRUCT) {
+        for(int k = 0; k < e->vals_n; k++) {
+            int bit = s->offsets[k];
+            if(!layout_is_bit(s, k)) {
+                if(!constant(x, off + bit / 8, s->types[k], &e->vals[k])) return false;
+            } else if(!fold_int(x->p, &e->vals[k], &i)) return false;
+            else if(i) b->b[off + bit / 8] |= 1 << bit % 8;
+        }
+        return true;
+    }
+    if(e->type == EXPR_COMP_LIT) {
+        struct type *of = sema_resolve(s->of);
+        layout_type(of);
+        for(int k = 0; k < e->vals_n; k++)
+            if(!constant(x, off + k * of->size, of, &e->vals[k])) return false;
+        return true;
+    }
+    if(s->type == TYPE_ARRAY && fold_str(x->p, e, &lit)) {
+        char *bytes = calloc(lit.len + 1, 1);
+        assert(bytes);
+        int n = token_unescape(lit, bytes) + 1;
+        memcpy(b->b + off, bytes, n < s->size ? n : s->size);
+        free(bytes);
+        return true;
+    }
+    if(fp(s) && fold_real(x->p, e, &d)) {
+        float f = d;
+        if(fp(s) == 4) memcpy(b->b + off, &f, 4);
+        else if(fp(s) == 8) memcpy(b->b + off, &d, 8);
+        return fp(s) != 2;
+    }
+    //Reals given an integer are truncated, as C converts them
+    bool num = fold_int(x->p, e, &i);
+    if(!num && fold_real(x->p, e, &d)) i = d, num = true;
+    if(num) {
+        memcpy(b->b + off, &i, s->size);
+        return true;
+    }
+    if(fold_str(x->p, e, &lit)) {
+        rel(x, X64_DATA, off, str(x, lit), R_X86_64_64, 0);
+        return true;
+    }
+    if(l->type != EXPR_IDENT || !l->val) return false;
+    rel(x, X64_DATA, off, sym(x, l->val), R_X86_64_64, 0);
+    return true;
+}
+
+//Global v, in .data if its initializer is data and else in .bss, stored by
+//the init function
+static void var(struct x64 *x, struct val *v, char *key) {
+    struct expr *e = &v->expr;
+    struct type *t = sema_resolve(var_type(v));
+    layout_type(t);
+    int size = t->size > 0 ? t->size : 8, a = t->align > 0 ? t->align : 8;
+    bool data = e->type != EXPR_NONE && ir_data(x->p, var_type(v), e);
+    enum x64_sect sect = data ? X64_DATA : X64_BSS;
+    struct x64_buf *b = &x->sect[sect];
+
+    if(e->type != EXPR_NONE && !data && !x->p->init) {
+        snprintf(err_buf, ERRBUF_SIZE, "Initializer of '%s' is not supported by the x86-64 backend", key);
+        error(x, expr_tok(e), err_buf);
+        return;
+    }
+
+    if(a > x->align[sect]) x->align[sect] = a;
+    if(sect == X64_BSS) b->n = (b->n + a - 1) / a * a;
+    else align(b, a, 0);
+    int off = b->n;
+
+    if(sect == X64_BSS) b->n += size;
+    else {
+        for(int i = 0; i < size; i++) u8(b, 0);
+        if(!constant(x, off, t, e)) {
+            snprintf(err_buf, ERRBUF_SIZE, "Initializer of '%s' is not supported by the x86-64 backend", key);
+            error(x, expr_tok(e), err_buf);
+            return;
+        }
+    }
+
+    int k = sym(x, v);
+    x->syms[k].sect = sect;
+    x->syms[k].off = off;
+    x->syms[k].size = size;
+}
+
+
+//ELF
+
+static void shdr(struct x64_buf *o, int name, int type, int flags, int off, int size,
+        int link, int info, int align, int entsize) {
+    u32(o, name); u32(o, type); u64(o, flags); u64(o, 0);
+    u64(o, off); u64(o, size); u32(o, link); u32(o, info);
+    u64(o, align); u64(o, entsize);
+}
+
+//Write the object: the sections, their relocations, the symbols, local
+//before global, and the section headers last
+static void elf(struct x64 *x, struct out *out) {
+    enum {SH_TEXT = X64_TEXT, SH_DATA, SH_BSS, SH_RODATA, SH_INIT, SH_RELA_TEXT, SH_RELA_DATA,
+        SH_RELA_INIT, SH_SYMTAB, SH_STRTAB, SH_SHSTRTAB, SH_STACK, SH_N};
+    struct x64_buf o = {0}, strtab = {0}, symtab = {0}, rela[X64_SECTS] = {{0}}, shstr = {0};
+    int *index = malloc((x->syms_n + 1) * sizeof *index), n = 1;
+    assert(index);
+
+    //Symbol 0 is null, and locals come first
+    u8(&strtab, 0);
+    mem(&symtab, (uint8_t[24]){0}, 24);
+    for(int g = 0; g < 2; g++)
+        for(int i = 0; i < x->syms_n; i++) {
+            struct x64_sym *s = &x->syms[i];
+            bool global = s->global || s->sect == X64_UNDEF;
+            if(global != g) continue;
+            index[i] = n++;
+            u32(&symtab, s->name ? strtab.n : 0);
+            if(s->name) mem(&strtab, s->name, strlen(s->name) + 1);
+            u8(&symtab, global << 4 | (s->sect == X64_UNDEF ? 0 : s->func ? 2 : 1));
+            u8(&symtab, 0);
+            u16(&symtab, s->sect);
+            u64(&symtab, s->off);
+            u64(&symtab, s->size);
+        }
+    int locals = 1;
+    for(int i = 0; i < x->syms_n; i++) locals += !(x->syms[i].global || x->syms[i].sect == X64_UNDEF);
+
+    for(int s = X64_TEXT; s < X64_SECTS; s++)
+        for(int i = 0; i < x->rels_n[s]; i++) {
+            struct x64_rel *r = &x->rels[s][i];
+            u64(&rela[s], r->off);
+            u64(&rela[s], (uint64_t)index[r->sym] << 32 | r->type);
+            u64(&rela[s], r->addend);
+        }
+
+    static const char *names[SH_N] = {"", ".text", ".data", ".bss", ".rodata", ".init_array",
+        ".rela.text", ".rela.data", ".rela.init_array", ".symtab", ".strtab", ".shstrtab",
+        ".note.GNU-stack"};
+    int name[SH_N], off[SH_N];
+    for(int i = 0; i < SH_N; i++) {
+        name[i] = shstr.n;
+        mem(&shstr, names[i], strlen(names[i]) + 1);
+    }
+
+    //Header, filled in once the section headers are placed
+    mem(&o, (uint8_t[64]){0}, 64);
+    struct x64_buf *data[SH_N] = {[SH_TEXT] = &x->sect[X64_TEXT], [SH_DATA] = &x->sect[X64_DATA],
+        [SH_RODATA] = &x->sect[X64_RODATA], [SH_INIT] = &x->sect[X64_INIT],
+        [SH_RELA_TEXT] = &rela[X64_TEXT], [SH_RELA_DATA] = &rela[X64_DATA],
+        [SH_RELA_INIT] = &rela[X64_INIT], [SH_SYMTAB] = &symtab, [SH_STRTAB] = &strtab,
+        [SH_SHSTRTAB] = &shstr};
+    int data_align = x->align[X64_DATA] > 16 ? x->align[X64_DATA] : 16;
+    int bss_align = x->align[X64_BSS] > 16 ? x->align[X64_BSS] : 16;
+    for(int i = 1; i < SH_N; i++) {
+        align(&o, i == SH_DATA ? data_align : 16, 0);
+        off[i] = o.n;
+        if(data[i]) mem(&o, data[i]->b, data[i]->n);
+    }
+    align(&o, 8, 0);
+    int shoff = o.n;
+
+    mem(&o, (uint8_t[64]){0}, 64);
+    shdr(&o, name[SH_TEXT], 1, 6, off[SH_TEXT], x->sect[X64_TEXT].n, 0, 0, 16, 0);
+    shdr(&o, name[SH_DATA], 1, 3, off[SH_DATA], x->sect[X64_DATA].n, 0, 0, data_align, 0);
+    shdr(&o, name[SH_BSS], 8, 3, off[SH_BSS], x->sect[X64_BSS].n, 0, 0, bss_align, 0);
+    shdr(&o, name[SH_RODATA], 1, 2, off[SH_RODATA], x->sect[X64_RODATA].n, 0, 0, 16, 0);
+    shdr(&o, name[SH_INIT], 14, 3, off[SH_INIT], x->sect[X64_INIT].n, 0, 0, 8, 8);
+    shdr(&o, name[SH_RELA_TEXT], 4, 0x40, off[SH_RELA_TEXT], rela[X64_TEXT].n, SH_SYMTAB, SH_TEXT, 8, 24);
+    shdr(&o, name[SH_RELA_DATA], 4, 0x40, off[SH_RELA_DATA], rela[X64_DATA].n, SH_SYMTAB, SH_DATA, 8, 24);
+    shdr(&o, name[SH_RELA_INIT], 4, 0x40, off[SH_RELA_INIT], rela[X64_INIT].n, SH_SYMTAB, SH_INIT, 8, 24);
+    shdr(&o, name[SH_SYMTAB], 2, 0, off[SH_SYMTAB], symtab.n, SH_STRTAB, locals, 8, 24);
+    shdr(&o, name[SH_STRTAB], 3, 0, off[SH_STRTAB], strtab.n, 0, 0, 1, 0);
+    shdr(&o, name[SH_SHSTRTAB], 3, 0, off[SH_SHSTRTAB], shstr.n, 0, 0, 1, 0);
+    shdr(&o, name[SH_STACK], 1, 0, off[SH_STACK], 0, 0, 0, 1, 0);
+
+    //ELF64, little endian, relocatable, x86-64
+    struct x64_buf h = {o.b, 0, o.c};
+    mem(&h, "\177ELF\2\1\1", 7);
+    h.n = 16;
+    u16(&h, 1); u16(&h, 62); u32(&h, 1);
+    u64(&h, 0); u64(&h, 0); u64(&h, shoff);
+    u32(&h, 0); u16(&h, 64); u16(&h, 0); u16(&h, 0);
+    u16(&h, 64); u16(&h, SH_N); u16(&h, SH_SHSTRTAB);
+
+    out_mem(out, (char *)o.b, o.n);
+
+    free(o.b); free(strtab.b); free(symtab.b); free(shstr.b);
+    for(int s = 0; s < X64_SECTS; s++) free(rela[s].b);
+    free(index);
+}
+
+//Emit the module in p, after ir(), as an x86-64 ELF object to o. mod names
+//the module. Returns number of errors, which are reported through p->error
+int emit_x64(struct parse *p, struct out *o, char *mod) {
+    assert(p); assert(o); assert(mod);
+
+    timing_start(TIMING_X64);
+
+    struct x64 x = {p, mod};
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type == VAL_VAR || (v->type == VAL_FUNC && !func_is_generic(v))) name_val(&x, v, p->globals.key[i]);
+    }
+    for(int i = 0; i < p->methods.n; i++)
+        if(!func_is_generic(&p->methods.val[i])) name_val(&x, &p->methods.val[i], p->methods.key[i]);
+    for(int i = 0; i < p->instances.n; i++) name_val(&x, p->instances.inst[i], p->instances.name[i]);
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type == VAL_MODULE && v->loaded) import(&x, v);
+    }
+
+    for(int i = 0; i < p->globals.n; i++) {
+        struct val *v = &p->globals.val[i];
+        if(v->type == VAL_VAR) var(&x, v, p->globals.key[i]);
+        else if(v->type == VAL_FUNC && !func_is_generic(v)) func(&x, v, p->globals.key[i]);
+    }
+    for(int i = 0; i < p->methods.n; i++)
+        if(!func_is_generic(&p->methods.val[i])) func(&x, &p->methods.val[i], p->methods.key[i]);
+    for(int i = 0; i < p->instances.n; i++) func(&x, p->instances.inst[i], p->instances.name[i]);
+
+    if(p->init) init_func(&x);
+
+    struct val *main = ns_get(&p->globals, "main");
+    if(main && main->type == VAL_FUNC && !func_is_generic(main)) main_func(&x, main);
+
+    if(!x.errnum) elf(&x, o);
+
+    for(int i = 0; i < x.syms_n; i++) free(x.syms[i].name);
+    free(x.syms);
+    for(int s = 0; s < X64_SECTS; s++) {
+        free(x.sect[s].b);
+        free(x.rels[s]);
+    }
+    free(x.fixes);
+
+    timing_stop(TIMING_X64);
+
+    return x.errnum;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "parse.h"
+#include "out.h"
+
+//Native x86-64 backend, emitting a module straight to a relocatable ELF
+//object for the system linker, without going through a C compiler. Meant for
+//fast debug builds: code is made from the IR of each function one
+//instruction at a time, with no optimization beyond what ir() did.
+//
+//The object defines the symbols the C backend would, so it links the same,
+//along with main calling the module's main. Only functions ir() lowered are
+//supported, with no 16 bit floating point. Globals initialized with constant
+//data are written as it, others stored by a function run from .init_array.
+
+#define X64_INITIAL_CAP 256
+#define X64_REGS 5              //Callee saved registers vars are allocated to
+
+int emit_x64(struct parse *p, struct out *o, char *mod);